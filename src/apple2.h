@@ -15,9 +15,15 @@
 
 #define ZP_START        0x00
 #define ZP_DATAFLG      0x13
+#define ZP_WNDLFT       0x20
+#define ZP_WNDWDTH      0x21
+#define ZP_WNDTOP       0x22
+#define ZP_WNDBTM       0x23
 #define ZP_CH           0x24
 #define ZP_CV           0x25
+#define ZP_BASL         0x28
 #define ZP_PROMPT       0x33
+#define ZP_YSAV1        0x35
 #define ZP_LINNUM       0x50
 #define ZP_TXTTAB       0x67
 #define ZP_VARTAB       0x69 // LOMEM
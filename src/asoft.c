@@ -0,0 +1,618 @@
+//  asoft.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// AppleSoft programs, without the emulated machine: a tokenizer and a
+// lister that do what the ROM does when a program is typed in at the
+// "]" prompt, or LISTed. --tokenize and --detokenize use them (unless
+// --rom-tokenizer is given), as does --run-basic, to load its program.
+//
+// Each step below follows the ROM routine it's named for (the line
+// entry at RESTART ($D43C), GETLN ($FD6A), LINGET ($DA0C), PARSE
+// ($D559), FNDLIN ($D61A) and LIST ($D6A5)), quirks and all, so that
+// the results are byte-for-byte the same as the emulated machine's.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+#define TOK_FIRST       0x80
+#define TOK_DATA        0x83
+#define TOK_REM         0xB2
+#define TOK_PRINT       0xBA
+#define TOK_AT          0xC5
+
+#define INLIN_MAX       0xEF    // INLIN truncates lines to this
+#define LINGET_MAX      6400    // no more digits from here (63999 max)
+#define DATAFLG_DATA    0x49
+
+// The names in the ROM's token table ($D0D0), $80 on.
+static const char *const token_names[] = {
+    "END", "FOR", "NEXT", "DATA", "INPUT", "DEL", "DIM", "READ", "GR",
+    "TEXT", "PR#", "IN#", "CALL", "PLOT", "HLIN", "VLIN", "HGR2", "HGR",
+    "HCOLOR=", "HPLOT", "DRAW", "XDRAW", "HTAB", "HOME", "ROT=", "SCALE=",
+    "SHLOAD", "TRACE", "NOTRACE", "NORMAL", "INVERSE", "FLASH", "COLOR=",
+    "POP", "VTAB", "HIMEM:", "LOMEM:", "ONERR", "RESUME", "RECALL", "STORE",
+    "SPEED=", "LET", "GOTO", "RUN", "IF", "RESTORE", "&", "GOSUB", "RETURN",
+    "REM", "STOP", "ON", "WAIT", "LOAD", "SAVE", "DEF", "POKE", "PRINT",
+    "CONT", "LIST", "CLEAR", "GET", "NEW", "TAB(", "TO", "FN", "SPC(",
+    "THEN", "AT", "NOT", "STEP", "+", "-", "*", "/", "^", "AND", "OR", ">",
+    "=", "<", "SGN", "INT", "ABS", "USR", "FRE", "SCRN(", "PDL", "POS",
+    "SQR", "RND", "LOG", "EXP", "COS", "SIN", "TAN", "ATN", "PEEK", "LEN",
+    "STR$", "VAL", "ASC", "CHR$", "LEFT$", "RIGHT$", "MID$",
+};
+#define NUM_TOKENS  (sizeof token_names / sizeof token_names[0])
+
+// There are no tokens past MID$ ($EA), but LIST will still print
+// something for one, reading on past the token table into the error
+// messages (and stopping short at a zero byte, as it does).
+static const char *const list_extras[] = {
+    "", "SYNTAX", "RETURN WITHOUT GOSUB", "OUT OF DATA",
+    "ILLEGAL QUANTITY", "OVERFLOW", "OUT OF MEMORY", "UNDEF'D STATEMENT",
+    "BAD SUBSCRIPT", "REDIM'D ARRAY", "DIVISION BY ZERO", "ILLEGAL DIRECT",
+    "TYPE MISMATCH", "STRING TOO LONG", "FORMULA TOO COMPLEX",
+    "CAN'T CONTINUE", "UNDEF'D FUNCTION", " ERROR\a", "h", "h", "h",
+};
+
+/********** Tokenizing **********/
+
+struct tokenizer {
+    bool                upshift;    // the enhanced //e's PARSE upshifts
+    word                start;
+    word                memsize;
+    unsigned long long  text_line;
+    byte                *prog;      // start .. VARTAB
+    size_t              sz;
+};
+
+static void asoft_error(const struct tokenizer *t, word linnum,
+                        const char *msg)
+{
+    DIE(0, "AppleSoft gave an error while tokenizing text line #%llu,\n",
+        t->text_line);
+    DIE(0, "  basic line #%u (may be wrong):\n", (unsigned int)linnum);
+    // What the ROM would have printed.
+    fprintf(stderr, "?%s ERROR\n", msg);
+    DIE_CONT(1, "");
+}
+
+static byte upshift(const struct tokenizer *t, byte c)
+{
+    return (t->upshift && c >= 0x61)? c & 0x5F : c;
+}
+
+// Searches the token table for the text at *XP, skipping spaces in
+// the text. Returns the token (leaving *XP at the last character of
+// its name), or else the (upshifted) character.
+static byte search_tokens(const struct tokenizer *t, const byte *in,
+                          size_t *xp, byte endchr)
+{
+    // (The ROM reads the text here as PARSE's GET() would; but ENDCHR
+    // is a character that it upshifts, unless it's the end of the line.)
+    bool up = endchr != '\0';
+    size_t startx = *xp;
+    for (size_t tok = 0; tok != NUM_TOKENS; ++tok) {
+        const char *name = token_names[tok];
+        size_t x = startx;
+        for (;;) {
+            byte c = up? upshift(t, in[x]) : in[x];
+            while (c == ' ') {
+                ++x;
+                c = up? upshift(t, in[x]) : in[x];
+            }
+            if (c != (byte)*name) break;
+            if (*++name == '\0') break;
+            ++x;
+        }
+        if (*name != '\0') continue;
+        // "AT" followed by "N" is ATN; by "O", it's "A TO".
+        if (TOK_FIRST + tok == TOK_AT
+            && (upshift(t, in[x + 1]) == 'N'
+                || upshift(t, in[x + 1]) == 'O')) {
+            continue;
+        }
+        *xp = x;
+        return TOK_FIRST + tok;
+    }
+    return upshift(t, in[startx]);
+}
+
+// PARSE: crunches the text of a line, starting at X, into OUT (which
+// ends up with a zero at the end). Returns the number of bytes.
+static size_t parse(const struct tokenizer *t, const byte *in, size_t x,
+                    byte *out)
+{
+    byte dataflg = 4;
+    byte endchr = 0;
+    size_t n = 0;
+    byte c;
+#define GET(i) ((endchr == 0 || endchr == '"' || dataflg == DATAFLG_DATA)? \
+                in[i] : upshift(t, in[i]))
+
+    for (;;) {
+        c = GET(x);
+        if (!(dataflg & 0x40) && c == ' ') {
+            ++x;
+            continue;
+        }
+        endchr = c;
+        if (c == '"') {
+            out[n++] = c;
+            ++x;
+        } else {
+            if (dataflg & 0x40) {
+                // DATA: stored as is
+            } else if (c == '?') {
+                c = TOK_PRINT;
+            } else if (c >= '0' && c < '<') {
+                // stored as is
+            } else {
+                c = search_tokens(t, in, &x, endchr);
+            }
+            ++x;
+            out[n++] = c;
+            if (c == '\0') return n;
+            if (c == ':') dataflg = 0;
+            if (c == TOK_DATA) dataflg = DATAFLG_DATA;
+            if (c != TOK_REM) continue;
+            endchr = 0;
+        }
+        // Copy everything up to (and including) ENDCHR, or the end.
+        for (c = GET(x); c != '\0' && c != endchr; c = GET(x)) {
+            out[n++] = c;
+            ++x;
+        }
+        ++x;
+        out[n++] = c;
+        if (c == '\0') return n;
+    }
+#undef GET
+}
+
+// Relinks every line, as the ROM does after each line is entered.
+static void relink(struct tokenizer *t)
+{
+    size_t o = 0;
+    while (o < t->sz - 2) {
+        size_t e = o + 4;
+        while (t->prog[e] != 0) ++e;
+        word next = t->start + e + 1;
+        t->prog[o] = LO(next);
+        t->prog[o + 1] = HI(next);
+        o = e + 1;
+    }
+}
+
+// A line has been typed, up to (not including) the RETURN. Enter it.
+static void enter_line(struct tokenizer *t, byte *buf, size_t len)
+{
+    if (len > INLIN_MAX) len = INLIN_MAX;
+    buf[len] = '\0';
+    for (size_t i = 0; i != len; ++i) {
+        buf[i] &= 0x7F;
+    }
+
+    size_t x = 0;
+    while (buf[x] == ' ') ++x;
+    if (buf[x] == '\0') return;
+    if (buf[x] < '0' || buf[x] > '9') {
+        DIE(1, "Unnumbered line at text line #%llu.\n", t->text_line);
+    }
+
+    // LINGET
+    word linnum = 0;
+    while (buf[x] >= '0' && buf[x] <= '9') {
+        if (linnum >= LINGET_MAX) asoft_error(t, linnum, "SYNTAX");
+        linnum = linnum * 10 + (buf[x] - '0');
+        do ++x; while (buf[x] == ' ');
+    }
+
+    byte out[256];
+    size_t n = parse(t, buf, x, out);
+
+    // FNDLIN. A line is only ever found to be out of order when its
+    // number has the same high byte as the one it'd go in front of.
+    size_t o = 0;
+    while (t->prog[o + 1] != 0) {
+        word ln = WORD(t->prog[o + 2], t->prog[o + 3]);
+        if (HI(linnum) < HI(ln)) break;
+        if (HI(linnum) == HI(ln)) {
+            if (LO(linnum) == LO(ln)) {
+                DIE(1,"Text line #%llu: BASIC line #%u already exists.\n",
+                    t->text_line, linnum);
+            } else if (LO(linnum) < LO(ln)) {
+                DIE(1,"Text line #%llu: BASIC line #%u is lower"
+                    " than previous number\n", t->text_line, linnum);
+            }
+        }
+        o = WORD(t->prog[o], t->prog[o + 1]) - t->start;
+    }
+    if (out[0] == '\0') return; // (nothing to store)
+
+    size_t len_line = 4 + n;
+    if ((unsigned long)t->start + t->sz + len_line >= t->memsize) {
+        asoft_error(t, linnum, "OUT OF MEMORY");
+    }
+    memmove(&t->prog[o + len_line], &t->prog[o], t->sz - o);
+    t->prog[o] = t->prog[o + 1] = 0xFF; // (relinked below)
+    t->prog[o + 2] = LO(linnum);
+    t->prog[o + 3] = HI(linnum);
+    memcpy(&t->prog[o + 4], out, n);
+    t->sz += len_line;
+    relink(t);
+}
+
+byte *asoft_tokenize(FILE *in, word start, word memsize, int flags,
+                     size_t *szp)
+{
+    struct tokenizer t = {
+        .upshift = machine_is_enhanced_iie(),
+        .start = start,
+        .memsize = memsize,
+        .text_line = 0,
+        .prog = xalloc(0x10000),
+        .sz = 2, // (just the end-of-program link)
+    };
+    t.prog[0] = t.prog[1] = 0;
+
+    // GETLN, on the characters as the keyboard delivers them.
+    byte buf[256];
+    size_t x = 0;
+    bool comments = flags & ASOFT_COMMENTS;
+    int c;
+    while ((c = getc(in)) != EOF) {
+        if (comments && x == 0 && c == '#') {
+            while (c != EOF && c != '\n') c = getc(in);
+            ++t.text_line;
+            continue;
+        }
+        comments = false;
+
+        int k = util_fromascii(c);
+        if (k == 0x9B) {
+            // The simple interface's left-arrow is a backspace; but
+            // the right-arrow, and ESC, work from the screen.
+            int c2 = getc(in);
+            int c3 = (c2 == '[' || c2 == 'O')? getc(in) : EOF;
+            k = (c3 == 'D')? 0x88 : 0x95;
+        }
+        if (k == 0x95) {
+            DIE(1, "Text line #%llu has an ESC or Ctrl-U, which only"
+                " --rom-tokenizer can type.\n", t.text_line + 1);
+        }
+        buf[x] = k;
+        if (k == 0x8D) {
+            ++t.text_line;
+            enter_line(&t, buf, x);
+            x = 0;
+        } else if (k == 0x88) {
+            if (x != 0) --x;
+        } else if (k == 0x98) {
+            x = 0;
+        } else if (++x == sizeof buf) {
+            x = 0; // GETLN cancels a line this long
+        }
+    }
+    if (ferror(in)) {
+        int err = errno;
+        DIE(1, "Couldn't read AppleSoft text: %s\n", strerror(err));
+    }
+    // A line left without a RETURN is never entered, when typed.
+    if ((flags & ASOFT_LAST_LINE) && x != 0) {
+        ++t.text_line;
+        enter_line(&t, buf, x);
+    }
+
+    *szp = t.sz;
+    return t.prog;
+}
+
+/********** Listing **********/
+
+static void list_char(FILE *f, byte c)
+{
+    // As the simple interface prints what LIST prints.
+    c &= 0x7F;
+    if (c == '\r') {
+        putc('\n', f);
+    } else if (util_isprint(c) || c == '\t' || c == '\b') {
+        putc(c, f);
+    }
+}
+
+void asoft_list(const byte *mem, word start, FILE *f)
+{
+    word p = start;
+    unsigned long lines = 0;
+    while (mem[(word)(p + 1)] != 0) {
+        if (lines++ != 0) putc('\n', f); // (the first CR is suppressed)
+        if (lines > 0x10000) {
+            DIE(1, "--detokenize: the program's lines link around in"
+                " a loop.\n");
+        }
+        fprintf(f, " %u ", (unsigned int)WORD(mem[(word)(p + 2)],
+                                              mem[(word)(p + 3)]));
+        for (byte y = 4; mem[(word)(p + y)] != 0; ++y) {
+            byte b = mem[(word)(p + y)];
+            if (b < TOK_FIRST) {
+                list_char(f, b);
+                // A backspace (from the left edge) leaves the cursor at
+                // the right of the line above; LIST, seeing it past
+                // column 32, starts a new line.
+                if (b == '\b') putc('\n', f);
+                continue;
+            }
+            size_t tok = b - TOK_FIRST;
+            const char *name = tok < NUM_TOKENS? token_names[tok]
+                : list_extras[tok - NUM_TOKENS];
+            putc(' ', f);
+            for (; *name; ++name) list_char(f, *name);
+            putc(' ', f);
+            if (y == 0xFF) {
+                DIE(1, "--detokenize: a program line runs on past"
+                    " 255 bytes.\n");
+            }
+        }
+        p = WORD(mem[p], mem[(word)(p + 1)]);
+    }
+    if (lines != 0) putc('\n', f);
+}
+
+/********** --tokenize, --detokenize **********/
+
+static void tokenize_tool(void)
+{
+    if (isatty(STDOUT_FILENO)) {
+        DIE(2,"Can't --tokenize output to a tty!\n");
+    }
+    if (cfg.remain_after_pipe || cfg.remain_tty) {
+        DIE(2,"--tokenize conflicts with --remain.\n");
+    }
+
+    size_t sz;
+    byte *prog = asoft_tokenize(stdin, LOC_ASOFT_PROG, 0xC000, 0, &sz);
+    errno = 0;
+    size_t wb = fwrite(prog, sizeof (byte), sz, stdout);
+    if (wb != sz || fflush(stdout) != 0) {
+        int err = errno;
+        DIE(0,"An error occurred wile writing tokenized BASIC out:\n");
+        DIE(1,"fwrite: %s\n", strerror(err));
+    }
+    free(prog);
+    WARN("Tokenized data written to %s.\n",
+         cfg.outputfile? cfg.outputfile : "standard output");
+}
+
+static void detokenize_tool(void)
+{
+    const char *fname = cfg.inputfile && !STREQ(cfg.inputfile, "-")?
+        cfg.inputfile : "/dev/stdin";
+    errno = 0;
+    FILE *f = fopen(fname, "rb");
+    if (f == NULL) {
+        int err = errno;
+        DIE(1, "--detokenize: Couldn't open \"%s\": %s\n",
+            fname, strerror(err));
+    }
+    // (Anything that wouldn't fit below $10000 would never be LISTed.)
+    size_t bufsz = 0x10000 + 2 - LOC_ASOFT_PROG;
+    byte *buf = xalloc(bufsz);
+    size_t sz = fread(buf, 1, bufsz, f);
+    if (ferror(f)) {
+        int err = errno;
+        DIE(1, "--detokenize: Couldn't read \"%s\": %s\n",
+            fname, strerror(err));
+    }
+    fclose(f);
+
+    const byte *prog = buf;
+    asoft_adjust_start(fname, &prog, &sz, LOC_ASOFT_PROG);
+    if (sz > 0x10000 - LOC_ASOFT_PROG) sz = 0x10000 - LOC_ASOFT_PROG;
+
+    byte *mem = xalloc(0x10000);
+    memset(mem, 0, 0x10000);
+    memcpy(&mem[LOC_ASOFT_PROG], prog, sz);
+    asoft_list(mem, LOC_ASOFT_PROG, stdout);
+    if (fflush(stdout) != 0) {
+        int err = errno;
+        DIE(1, "--detokenize: Couldn't write the listing: %s\n",
+            strerror(err));
+    }
+    free(mem);
+    free(buf);
+}
+
+void asoft_tool(void)
+{
+    if (cfg.tokenize) {
+        tokenize_tool();
+    } else {
+        detokenize_tool();
+    }
+    bobbin_exit(0);
+}
+
+/********** Tokenized program files **********/
+
+static bool check_asoft_link(const byte *buf, size_t start, size_t sz,
+                             word w, long *chlenp)
+{
+    long chlen;
+    bool val = true;
+    for (chlen = 0; chlen < 65536; ++chlen) {
+        if (w == 0x0000) {
+            val = true;
+            break;
+        } else if (w < start || w > start + sz - sizeof(word)) {
+            val = false;
+            break;
+        } else {
+            // next link
+            w = WORD(buf[w - start], buf[w - start + 1]);
+        }
+    }
+    if (chlen == 65536)
+        chlen = -1;
+    if (val)
+        *chlenp = chlen;
+    return val;
+}
+
+void asoft_adjust_start(const char *fname, const byte **bufp,
+                        size_t *szp, word load_loc) {
+    /*
+       If we're loading an AppleSoft BASIC file, there is some
+       possibility that the first two bytes are not actually part of
+       the AppleSoft program to load, but are a word representing
+       the size of the file, minus one (= size of program, plus one?)
+       Apparently this is how Apple DOS stores the file, and there
+       are tokenizer programs that output this way.
+
+       In every case where we determine tha word 0 is a file length and
+       not the first BASIC link, we complain with a warning to avoid
+       tokenizers that prefix a file length header word.
+
+       If word zero is not the file length, word zero is the first BASIC
+       link. But check it anyway, and error if it's invalid.
+
+       Otheriwse, if word zero is not a valid BASIC link, then we assume
+       it's a file length and skip it.
+
+       Otherwise, if word zero is a valid BASIC link, and word one is not,
+       we assume word zero is the first BASIC link (and word one is
+       the first line number).
+
+       If both word zero and word one are valid BASIC links, we
+       use word zero, UNLESS it appears to have a loop in the chain
+       while word one doesn't, in which case we use word one.
+
+       The notion of a "valid BASIC link" is determined as:
+         (a) it refers to a memory location that resides within the
+             loaded file's range, or else has the value zero.
+         (b) if it refers to a memory location, the value at that
+             location must itself a valid BASIC link (this definition
+             is recursive)
+       Chain linkage is only followed up to 65,535 links. If linkage
+       exceeds this number (may be a looping chain), it is still
+       considered a "valid BASIC link", but the chain length is reported
+       as -1, for the purposes of comparing chain lengths (see above, in
+       the case where both words zero and one are "valid BASIC links").
+
+       Note that things like backwards-links, or links that jump forward
+       by more than 256 bytes, or line numbers whose values jump around,
+       are not checked (even though it is not normally possible to
+       create such programs), because people do pull shenanigans with
+       the BASIC program representation, and we want to be as permissive
+       as possible.
+
+       It is possible, though unlikely, for a value to be both a valid
+       file length, *and* a valid BASIC link, if the file length is
+       greater than the --load-at location (or default $801), and the
+       value of that file length as a memory pointer just so happens to
+       fall at a valid link.
+
+       It is similarly possible, though unlikely, for a value to be both
+       a valid line number, and a valid BASIC link.
+    */
+    if (*szp < sizeof (word)) {
+        DIE(0, "--load-basic-bin: file \"%s\" has insufficient length (%zu)\n",
+            fname, *szp);
+        DIE(2, "  to be a valid AppleSoft BASIC program binary.\n");
+    }
+
+    INFO("Determining whether AppleSoft program in file \"%s\" begins\n",
+         fname);
+    INFO("  at the first word, or the second.\n");
+
+    bool adjusted = false;
+    const word lenval = (*szp)-1;
+    word w0 = WORD((*bufp)[0], (*bufp)[1]);
+    long w0chain;
+    bool w0valid = check_asoft_link(*bufp, load_loc, *szp,
+                                    w0, &w0chain);
+#define VPFX "    ..."
+    if (w0valid) {
+        VERBOSE(VPFX "word 0 is a valid BASIC chain of length %ld.\n",
+                w0chain);
+    } else {
+        VERBOSE(VPFX "word 0 is not a valid BASIC chain.\n");
+    }
+
+    bool is_lenval = (w0 == lenval);
+    VERBOSE(VPFX "word 0 is%s a valid file length.\n", is_lenval? "" : " not");
+    if (is_lenval) {
+        // Nothing to do yet, futher checking is required.
+    } else if (!w0valid) {
+        // Not the length value, but also not a valid BASIC link. Error.
+        DIE(0, "First word of --load-basic-bin file \"%s\" is neither a\n",
+            fname);
+        DIE(0, "  valid filesize value, nor a valid AppleSoft link!\n");
+        DIE(2, "  Not a valud AppleSoft BASIC program binary.\n");
+    } else {
+        // is not the length value, but is a BASIC link. We have enough info.
+        goto no_adjust;
+    }
+
+    // From here on out, we know word zero was a valid file length!
+
+    long w1chain = -1;
+    bool w1valid =
+        (*szp > 2 * sizeof (word)) // don't read word 1 if it doesn't exist
+        && check_asoft_link(*bufp + sizeof (word), load_loc,
+                            *szp - sizeof (word),
+                            WORD((*bufp)[2], (*bufp)[3]), // w1
+                            &w1chain);
+    if (w1valid) {
+        VERBOSE(VPFX "word 1 is a valid BASIC chain of length %ld.\n",
+                w1chain);
+    } else {
+        VERBOSE(VPFX "word 1 is not a valid BASIC chain.\n");
+    }
+
+    if (w0valid) {
+        // handled further below
+    } else if (!w1valid) {
+        DIE(0, "Neither word 0 nor word 1 are valid AppleSoft BASIC links.\n");
+        DIE(0, "--load-basic-bin file \"%s\" is not an AppleSoft BASIC\n",
+            fname);
+        DIE(2, "  program binary.\n");
+    } else {
+        goto adjust; // word 0 is the length value, is not a valid link.
+    }
+
+    // Okay, both word 0 and word 1 are vaild BASIC links...
+    WARN("AMBIGUOUS BASIC FILE! Word 0 and word 1 of --load-basic-bin\n");
+    WARN("  file \"%s\" are BOTH valid program starts, but word 0\n",
+         fname);
+    WARN("  could ALSO be a valid file length header.\n");
+    WARN("If the program listing appears to be wrong, please use a\n");
+    WARN("  different AppleSoft tokenizer program\n");
+    WARN("  (such as `bobbin --tokenize`), and start with a line\n");
+    WARN("  number below 2000.\n");
+    if (w0chain == -1 && w1chain != -1) {
+        WARN("Using word 1, as word 0 appears to be an infinite chain.\n");
+        goto adjust;
+    }
+    goto no_adjust;
+
+#undef VPFX
+adjust:
+    WARN("file-length prefix detected for AppleSoft binary\n");
+    WARN("  file \"%s\". Please use a tokenizer\n",
+         fname);
+    WARN("  that doesn't write this prefix (such as bobbin --tokenize.\n");
+    adjusted = true;
+    *bufp += 2;
+    *szp -= 2;
+    // fall through
+no_adjust:
+    INFO("Determination: AppleSoft program begins at word %s.\n",
+         adjusted? "one" : "zero");
+}
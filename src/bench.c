@@ -0,0 +1,59 @@
+//  bench.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// --bench: run flat-out for a fixed number of frames (or until some
+// other exit, such as --trap-success), then report throughput.
+
+#include "bobbin-internal.h"
+
+#include <time.h>
+
+static struct timespec  start_ts;
+static uintmax_t        start_instrs;
+static uintmax_t        start_events;
+static uintmax_t        frames;
+static uintmax_t        cycles;
+
+static void bench_report(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    struct timespec el = timing_subtract(now, start_ts);
+    double secs = el.tv_sec + el.tv_nsec / (double)ONE_SEC_IN_NS;
+    if (secs <= 0) secs = 1e-9;
+
+    uintmax_t cyc = cycles + cycle_count;
+    uintmax_t instrs = instr_count - start_instrs;
+    uintmax_t events = event_count - start_events;
+
+    // All on one line, as key=value pairs, for the benefit of scripts.
+    fprintf(stderr, "bench: frames=%ju cycles=%ju instrs=%ju events=%ju"
+            " secs=%.3f mhz=%.3f ips=%.0f fps=%.1f eps=%.0f\n",
+            frames, cyc, instrs, events,
+            secs, cyc / secs / 1e6, instrs / secs, frames / secs,
+            events / secs);
+}
+
+void bench_start(void)
+{
+    if (cfg.bench_frames == 0) return;
+
+    start_instrs = instr_count;
+    start_events = event_count;
+    clock_gettime(CLOCK_MONOTONIC, &start_ts);
+    atexit(bench_report);
+}
+
+void bench_frame(void)
+{
+    if (cfg.bench_frames == 0) return;
+
+    cycles += cycle_count;
+    cycles_rebase();
+    if (++frames >= cfg.bench_frames) {
+        bobbin_exit(0);
+    }
+}
@@ -0,0 +1,167 @@
+//  block.c
+//
+//  Copyright (c) 2023-2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// Basic-block cache, for --block-cache.
+//
+// Normally every instruction gets a PRESTEP event, a visit from the
+// debugger, and a STEP event. Nearly all of the listeners for those
+// are only interested in a handful of PC locations, so with the
+// cache enabled, straight-line runs of code are decoded once into
+// "blocks". The first instruction of a block is executed with the
+// full set of events; the rest are executed back-to-back, without
+// them. A block never extends past a branch, jump, or return, never
+// leaves the page it starts in, and never includes (beyond its first
+// instruction) a PC that someone has asked to see via event_step_pc().
+//
+// Blocks are keyed on where the code actually lives (main, aux,
+// language-card bank, or ROM), not on the 6502 address, so a soft
+// switch that remaps a page simply causes different blocks to be
+// looked up. Writes to a page that holds decoded blocks discard all
+// of that page's blocks.
+
+#include "bobbin-internal.h"
+
+#include <string.h>
+
+#define NBLOCKS         8192
+#define MAX_INSTRS      64
+#define NO_KEY          ((uint32_t)-1)
+
+struct block {
+    uint32_t        key;
+    unsigned int    gen;    // page generation this block was decoded in
+    word            len;    // bytes covered by the block
+    byte            ninstrs;
+};
+
+static MACHINE_LOCAL struct block blocks[NBLOCKS];
+
+MACHINE_LOCAL byte block_code_pages[BLOCK_HOST_PAGES];
+static MACHINE_LOCAL unsigned int page_gen[BLOCK_HOST_PAGES];
+
+MACHINE_LOCAL bool block_invalidated;
+
+void block_invalidate_page(unsigned int hpg)
+{
+    block_code_pages[hpg] = false;
+    ++page_gen[hpg];
+    block_invalidated = true;
+}
+
+void block_stop(void)
+{
+    block_invalidated = true;
+}
+
+void block_invalidate_all(void)
+{
+    for (unsigned int hpg = 0; hpg != BLOCK_HOST_PAGES; ++hpg) {
+        block_invalidate_page(hpg);
+    }
+}
+
+static bool ends_block(byte op)
+{
+    switch (op) {
+        case 0x00: // BRK
+        case 0x20: // JSR
+        case 0x40: // RTI
+        case 0x4C: // JMP abs
+        case 0x60: // RTS
+        case 0x6C: // JMP (ind)
+            return true;
+        case 0x7C: // JMP (abs,X)
+        case 0x80: // BRA
+            return machine_is_enhanced_iie();
+        default:
+            // Conditional branches are all xxx10000
+            return (op & 0x1F) == 0x10;
+    }
+}
+
+static void decode(struct block *b, word start)
+{
+    unsigned int pc = start;
+    unsigned int page_end = (start & 0xFF00) + 0x100;
+    int n = 0;
+
+    for (;;) {
+        byte op = peek_sneaky(pc);
+        int oplen = disasm_op_len(op);
+        if (oplen == 0 || pc + oplen > page_end) {
+            // Unknown opcode, or one that straddles the page end:
+            // the block stops short of it.
+            break;
+        }
+        pc += oplen;
+        ++n;
+        if (ends_block(op) || n == MAX_INSTRS || pc == page_end
+            || event_step_pc_wanted(pc)) {
+            break;
+        }
+    }
+    b->len = pc - start;
+    b->ninstrs = n;
+}
+
+static const struct block *lookup(word pc)
+{
+    long key = mem_code_key(pc);
+    if (key < 0) return NULL; // not cacheable (e.g. $C000-$CFFF)
+
+    unsigned int hpg = key >> 8;
+    struct block *b = &blocks[key % NBLOCKS];
+    if (b->key != (uint32_t)key || b->gen != page_gen[hpg]) {
+        b->key = key;
+        b->gen = page_gen[hpg];
+        decode(b, pc);
+        block_code_pages[hpg] = true;
+        STAT_INC(block_decodes);
+    }
+    return b;
+}
+
+bool block_usable(void)
+{
+    return cfg.block_cache && !event_step_everywhere()
+        && !debugger_needs_steps();
+}
+
+void block_init(void)
+{
+    for (struct block *b = blocks; b != blocks + NBLOCKS; ++b) {
+        b->key = NO_KEY;
+    }
+}
+
+void block_run(void (*step)(void), uintmax_t stop)
+{
+    word start = PC;
+    const struct block *b = lookup(start);
+
+    // First instruction: with all the usual events (any of which
+    // may ask us to stop after it).
+    block_invalidated = false;
+    cpu_full_step(step);
+    STAT_INC(block_runs);
+    STAT_INC(block_instrs);
+    if (b == NULL || current_pc_val != start)
+        return; // Someone moved the PC out from under us.
+
+    // The rest: only as many as were decoded, and only while the PC
+    // keeps moving forward through them. A jump or branch back into
+    // the block (its last instruction) ends it, so that a loop gets
+    // its events, and the frame its end, on every pass.
+    unsigned int end = start + b->len;
+    word last = start;
+    for (unsigned int n = 1; n < b->ninstrs && PC > last && PC < end
+             && cycle_count < stop && !block_invalidated; ++n) {
+        last = PC;
+        current_pc_val = PC;
+        step();
+        STAT_INC(block_instrs);
+    }
+}
@@ -20,6 +20,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include <strings.h>
 
@@ -28,6 +29,8 @@
 typedef uint16_t    word;
 typedef uint8_t     byte;
 
+typedef struct Snapshot Snapshot;  // see SNAPSHOT, below
+
 #define STREQ(a, b) (!strcmp(a, b))
 #define STREQCASE(a, b) (!strcasecmp(a, b))
 
@@ -36,8 +39,21 @@ typedef uint8_t     byte;
 #define HI(w)           ((0xFF00 & (w)) >> 8)
 #define LO(w)           (0x00FF & (w))
 
+// The emulated machine's state. Built for embedding (./configure
+// --enable-embed), each thread of the host program gets its own copy,
+// and so its own machine (see embed.c); otherwise, this is nothing.
+#ifdef BOBBIN_EMBED
+#define MACHINE_LOCAL   __thread
+#else
+#define MACHINE_LOCAL
+#endif
+
 extern void bobbin_run(void);
+extern void bobbin_frame(void); // emulate one frame, then fire EV_FRAME
+extern void bobbin_exit(int st) __attribute__((noreturn));
+    // exit(), or, for an embedded machine, just stop it
 extern word current_pc(void);
+extern MACHINE_LOCAL word current_pc_val;
 
 /********** LOGGING **********/
 
@@ -79,7 +95,8 @@ extern word current_pc(void);
 
 #define DIE_FINAL(st) do { \
         SQUAWK(DIE_LEVEL, "Exiting (%d).\n", (int)st); \
-        exit(st); \
+        flight_dump("fatal error"); \
+        bobbin_exit(st); \
     } while (0)
 #define DIE_CONT(st, ...) do { \
         SQUAWK_CONT(DIE_LEVEL, __VA_ARGS__); \
@@ -92,7 +109,7 @@ extern word current_pc(void);
 
 /********** CONFIG **********/
 
-extern const char *program_name; // main.c
+extern MACHINE_LOCAL const char *program_name; // argv[0]
 
 typedef struct Config Config;
 struct Config {
@@ -108,6 +125,7 @@ struct Config {
     const char *    disk2;
     bool            hdd_set;
     bool            uthernet2_set;
+    bool            uthernet2_thread;
     bool            mouse_set;
     bool            machine_set;
     size_t          amt_ram;
@@ -115,18 +133,41 @@ struct Config {
     const char *    rom_load_file;
     bool            turbo;
     bool            turbo_was_set;
+    double          speed;
+    bool            disk_accel;
+    bool            fast_rwts;
     bool            lang_card;
     bool            lang_card_set;
     bool            bell;
+    bool            block_cache;
+    unsigned long   bench_frames;
+    bool            stats;
+    const char *    profile_file;
+    const char *    coverage_file;
+    const char *    coverage_listing;
+    bool            coverage_branches;
+    const char *    snapshot_dir;
+    const char *    screen_shm;
+    unsigned long   screen_shm_every;
+    const char *    control_socket;
+    const char *    fork_server;
+    const char *    fork_job;
+    bool            disk_overlay;
+    bool            disk_overlay_commit;
 
     // "simple" interface config:
     bool            remain_after_pipe;
     bool            remain_tty;
+    bool            fast_cout;
 
     // trace stuff
     bool            die_on_brk;
     bool            debug_on_brk;
     const char *    trace_file;
+    bool            trace_binary;
+    unsigned long   flight_recorder;
+    const char *    flight_file;
+    const char *    decode_trace;
     uintmax_t       trace_start;
     uintmax_t       trace_end;
     bool            trap_success_on;
@@ -140,10 +181,12 @@ struct Config {
 
     // special options
     bool            watch;
+    bool            watch_warm;
     bool            tokenize;
     bool            detokenize;
+    bool            rom_tokenizer;
 };
-extern Config cfg;
+extern MACHINE_LOCAL Config cfg;
 
 /********** CPU **********/
 
@@ -162,7 +205,7 @@ struct Cpu {
     Registers regs;
 };
 
-extern Cpu theCpu;
+extern MACHINE_LOCAL Cpu theCpu;
 
 #define PC      (theCpu.regs.pc)
 #define SP      (theCpu.regs.sp)
@@ -196,6 +239,12 @@ extern Cpu theCpu;
 
 extern void cpu_reset(void);
 extern void cpu_step(void);
+extern void cpu_select_machine(void); // choose 6502 or 65C02 opcodes
+extern void cpu_run(uintmax_t cycle_end);
+extern void cpu_full_step(void (*step)(void));
+    // One instruction, with PRESTEP, debugger and STEP.
+    // Run instructions (with PRESTEP/STEP events and the debugger)
+    // until cycle_count reaches cycle_end.
 
 static inline void go_to(word w) {
     PC = w;
@@ -203,18 +252,20 @@ static inline void go_to(word w) {
 
 /********** MACHINE **********/
 
+extern void machine_init(void);  // from cfg.machine
 size_t expected_rom_size(void);
-extern const char *default_romfname;
+extern MACHINE_LOCAL const char *default_romfname;
 extern bool validate_rom(unsigned char *buf, size_t sz);
 extern bool machine_is_iie(void);
 extern bool machine_is_enhanced_iie(void);
 extern bool machine_has_mousetext(void);
+extern bool machine_has_applesoft(void);
 
 /********** MEMORY **********/
 
 typedef byte SoftSwitches[3];
 
-extern SoftSwitches ss;
+extern MACHINE_LOCAL SoftSwitches ss;
 
 // Flag positions for various soft switches
 typedef enum {
@@ -259,6 +310,7 @@ extern const char *mem_get_acctype_name(MemAccessType m);
 extern void mem_init(void);
 extern void mem_reset(void);
 extern void mem_reboot(void);
+extern void mem_remap(void); // rebuild page tables after changing ss
 extern const byte *getram(void);
 extern void mem_put(const byte *buf, unsigned long start, size_t sz);
 extern byte peek(word loc);
@@ -267,6 +319,10 @@ extern void poke(word loc, byte val);
 //  and don't affect or use floating bus values.
 extern byte peek_sneaky(word loc);
 extern void poke_sneaky(word loc, byte val);
+// Many bytes at once, with the same effects as peek()/poke() on each
+// (but much faster, where no one's watching).
+extern void mem_peek_buf(byte *buf, word start, size_t sz);
+extern void mem_poke_buf(const byte *buf, word start, size_t sz);
 extern bool mem_match(word loc, unsigned int nargs, ...);
 extern byte *load_rom(const char *fname, size_t expected, bool exact);
 extern void load_ram_finish(void);
@@ -274,6 +330,8 @@ extern void load_ram_finish(void);
 // NOTE: Does not account for bank-switched ROM in slots area,
 //       nor <64k configured RAM
 extern void mem_get_true_access(word loc, bool wr, size_t *bufloc, bool *in_aux, MemAccessType *access);
+// Where the code at LOC currently lives (see BLOCK CACHE), or -1.
+extern long mem_code_key(word loc);
 
 static inline byte stack_get(void)
 {
@@ -367,11 +425,20 @@ static inline void rts(void) {
 extern void dlypc_init(void);
 extern void dlypc_load(const char *fname);
 extern void dlypc_load_basic(const char *fname);
+extern void dlypc_run_basic(const char *fname); // (tokenizes it, first)
 extern void dlypc_delay_until(word loc);
 extern void dlypc_load_at(word loc);
 extern void dlypc_jump_to(word loc);
 extern void dlypc_reboot(void);
 
+// For --snapshot-cache, which snapshots at the first --delay-until point
+extern bool dlypc_has_snap_point(void);
+extern void dlypc_snap_key(void);       // what's loaded before that point
+extern void dlypc_snap_restored(void);  // we're now at that point
+// For --watch-warm
+extern bool dlypc_loaded_before_snap_point(const char *fname);
+extern void dlypc_warm_reload(void);    // load (and jump) again
+
 // iterator abstraction for traversing the files to be loaded
 struct dlypc_file_iter;
 
@@ -379,6 +446,26 @@ extern struct dlypc_file_iter *dlypc_file_iter_new(void);
 extern const char *dlypc_file_iter_getnext(struct dlypc_file_iter *);
 extern void dlypc_file_iter_destroy(struct dlypc_file_iter *);
 
+/********** ASOFT **********/
+
+// Flags for asoft_tokenize()
+#define ASOFT_COMMENTS  0x01    // skip leading "#" lines
+#define ASOFT_LAST_LINE 0x02    // enter a last line that has no newline
+
+// Tokenizes the AppleSoft text from IN, as the ROM would if it were
+// typed in, into a program at START (DIE()s as --tokenize would, on a
+// line AppleSoft would refuse). Returns the program's bytes, through
+// the end-of-program link, and their number in *SZP.
+extern byte *asoft_tokenize(FILE *in, word start, word memsize, int flags,
+                            size_t *szp);
+// Prints the program at START in MEM (all 64K of it), as LIST would.
+extern void asoft_list(const byte *mem, word start, FILE *f);
+// Runs --tokenize or --detokenize, without booting a machine. Exits.
+extern void asoft_tool(void);
+// Skips a file-length prefix in a tokenized program file, if it has one.
+extern void asoft_adjust_start(const char *fname, const byte **bufp,
+                               size_t *szp, word load_loc);
+
 /********** EVENT **********/
 
 enum EventType {
@@ -429,7 +516,9 @@ enum EventType {
     /* The following event types are ONLY sent if requested
        via the handler flags. */
     EV_CYCLE,
-        /* Start of every cycle. */
+        /* End of every cycle. While nobody is registered for this,
+           the CPU switches to a faster path that only updates
+           cycle_count once per instruction. */
     EV_FRAME,
         /* Called when ~ a 60th of a second (emulated time) has passed.
            Interfaces are automatically registered for this. */
@@ -451,9 +540,21 @@ enum EventType {
            to indicate via a "disk light" or some such. `val` holds
            the activity type: 0 for drives off, 1 for drive 1 motor
            running, and 2 for drive 2 motor running. */
+
+    EV_NUM_TYPES
 };
 typedef enum EventType EventType;
 
+// Masks for event_reghandler_for()
+#define EV_MASK(t)          (1UL << (t))
+#define EV_MASK_BUS         (EV_MASK(EV_PEEK) | EV_MASK(EV_POKE))
+#define EV_MASK_DEFAULT     (EV_MASK(EV_INIT) | EV_MASK(EV_START) \
+                             | EV_MASK(EV_REBOOT) | EV_MASK(EV_RESET) \
+                             | EV_MASK(EV_PRESTEP) | EV_MASK(EV_STEP) \
+                             | EV_MASK_BUS | EV_MASK(EV_SWITCH))
+// Not an event type: see event_step_pc()
+#define EV_FLAG_SOME_PCS    (1UL << 31)
+
 typedef struct Event Event;
 struct Event {
     enum EventType type;
@@ -480,18 +581,94 @@ typedef void (*event_handler)(Event *e);
 
 extern void events_init(void);
 extern void event_reghandler(event_handler h);
+    // Registers for all of EV_MASK_DEFAULT. Prefer event_reghandler_for(),
+    // so the handler isn't called for (e.g.) every PEEK and POKE.
+extern void event_reghandler_for(event_handler h, unsigned long mask);
+extern void event_reghandler_range(event_handler h, unsigned long mask,
+                                   word start, word end);
+    // As event_reghandler_for(), but PEEK and POKE events are only
+    // sent for accesses within the pages spanned by START..END.
+    // May be called again for the same handler, to add more ranges.
 extern void event_unreghandler(event_handler h);
+extern bool event_has_handlers(EventType type);
 extern void event_fire_disk_active(int val);
 extern int event_fire_peek(word loc);
 extern bool event_fire_poke(word loc, byte val);
 extern void event_fire_switch(SoftSwitchFlagPos f);
+extern void event_fire_cycle(void);
 extern void event_fire(EventType type); // For all other events
 
-// frame_timer: resets the timer if exists, creates if not
-extern void frame_timer(unsigned int time, void (*fn)(void));
-// frame_timer_reset: resets the timer if it exists, ignores if not
-extern void frame_timer_reset(unsigned int time, void (*fn)(void));
-extern void frame_timer_cancel(void (*fn)(void));
+// Number of events dispatched to handlers so far (for --bench).
+extern MACHINE_LOCAL uintmax_t event_count;
+
+// Which pages anyone wants PEEK/POKE events for.
+extern MACHINE_LOCAL byte event_bus_pages[256];
+static inline bool event_bus_wanted(word loc)
+{
+    return event_bus_pages[loc >> 8] != 0;
+}
+
+// PCs at which someone needs PRESTEP/STEP events, even when
+// --block-cache would otherwise skip them. Handlers that register
+// with EV_FLAG_SOME_PCS promise to declare every PC they care about;
+// any other PRESTEP or STEP handler is assumed to need every
+// instruction (which keeps the block cache switched off).
+// event_unstep_pc() takes back one event_step_pc() for that PC.
+extern void event_step_pc(word pc);
+extern void event_unstep_pc(word pc);
+extern bool event_step_pc_wanted(word pc);
+extern bool event_step_everywhere(void);
+
+// Interfaces call event_iface_bus_range() at EV_INIT, to declare the
+// address ranges they want PEEK and POKE events for. An interface
+// that declares none receives all of them. Likewise,
+// event_iface_step_pcs() declares the only PCs at which the interface
+// acts on PRESTEP and STEP.
+extern void event_iface_reset(void);
+extern void event_iface_bus_range(word start, word end);
+extern void event_iface_step_pcs(const word *pcs, size_t n);
+extern void event_iface_defaults(void);
+
+/********** SCHEDULER **********/
+
+// Work due at an absolute emulated cycle (see cycles_now(), below).
+// A SchedTimer belongs to its user (typically it's a static), so that
+// scheduling never allocates. cpu_run() runs uninterrupted until the
+// earliest deadline, then fires whatever's due.
+typedef struct SchedTimer SchedTimer;
+struct SchedTimer {
+    void        (*fn)(void);
+    uintmax_t   when;
+    int         slot;   // (private) heap position; -1 if not scheduled
+};
+#define SCHED_TIMER(f)  { .fn = (f), .slot = -1 }
+
+extern void sched_at(SchedTimer *t, uintmax_t when); // or reschedules
+extern void sched_in(SchedTimer *t, uintmax_t cycles);
+extern void sched_cancel(SchedTimer *t);
+static inline bool sched_pending(const SchedTimer *t) { return t->slot >= 0; }
+extern uintmax_t sched_next(void);  // UINTMAX_MAX if nothing's scheduled
+extern void sched_run_due(void);
+extern void cycles_rebase(void);
+    // Folds cycle_count into cycle_base, and zeroes it.
+
+/********** BLOCK CACHE **********/
+
+// Host pages that code can live in: main and aux RAM, then ROM.
+#define BLOCK_ROM_KEY       0x20000
+#define BLOCK_HOST_PAGES    ((BLOCK_ROM_KEY + 0x4000) / 256)
+
+extern void block_init(void);
+extern bool block_usable(void);
+extern void block_run(void (*step)(void), uintmax_t stop);
+    // Runs the basic block at PC (at least one instruction), stopping
+    // early once cycle_count reaches STOP.
+
+// Set for each host page that has blocks decoded from it.
+extern MACHINE_LOCAL byte block_code_pages[BLOCK_HOST_PAGES];
+extern void block_invalidate_page(unsigned int hpg);
+extern void block_invalidate_all(void);
+extern void block_stop(void);   // after the current instruction
 
 /********** HOOKS **********/
 
@@ -504,13 +681,63 @@ struct IfaceDesc {
     event_handler event;
     bool (*squawk)(int level, bool cont, const char *fmt, va_list args);
         // returns true to suppress default squawk handling
+    bool bus_detail;
+        // set if PEEK/POKE events must have aux, aloc and acctype
+        // filled in (otherwise, they're only guaranteed for
+        // non-interface handlers)
+    void (*snap_save)(Snapshot *s);
+    void (*snap_restore)(const Snapshot *s);
+        // interface state that a snapshot must carry (e.g., whether
+        // the echo of input being fed in is currently suppressed)
+    bool (*idle_wait)(long ns);
+        // the guest is only polling an empty keyboard: block for up
+        // to ns nanoseconds, or until input arrives. Returns false if
+        // it couldn't wait (input is already pending, say).
 };
 
 extern void interfaces_init(void);
 extern void interfaces_start(void);
 extern void iface_fire(Event *e); // For all other events
+extern bool iface_wants_access_detail(void);
+extern void iface_snap_save(Snapshot *s);
+extern void iface_snap_restore(const Snapshot *s);
+// Interfaces report each read of the keyboard ($C000), and whether
+// a key was waiting. Once a frame, the main loop calls
+// iface_idle_wait(), which blocks (via the interface's idle_wait)
+// if the guest has done nothing but poll an empty keyboard lately.
+extern void iface_kbd_polled(bool got_key);
+extern bool iface_idle_wait(long ns);
+// poll()s fd for input for up to ns nanoseconds; false if input (or
+// an error) ended the wait early.
+extern bool iface_wait_fd(int fd, long ns);
 extern void squawk(int level, bool cont, const char *format, ...);
 
+/********** SNAPSHOT **********/
+
+// Whole-machine state, for --snapshot-cache and the debugger's
+// save-state and load-state commands. Each component saves its state
+// as a tagged chunk; on restore, a component whose chunk is missing
+// (or the wrong size) leaves its current state alone.
+extern void snap_put(Snapshot *s, const char *tag, const void *data,
+                     size_t sz);
+extern const void *snap_get(const Snapshot *s, const char *tag, size_t sz);
+
+extern void snapshot_init(void);    // after mem_init(); finds the cache
+extern void snapshot_boot(void);    // after a reset: restore from cache
+extern void snapshot_reached(void); // at the --delay-until point
+extern bool snapshot_have_warm(void);   // --watch-warm's, at that point
+extern void snapshot_warm_restore(void);
+extern int snapshot_save_file(const char *fname); // 0, or an errno
+extern int snapshot_load_file(const char *fname);
+
+// Adds to the cache key: anything that affects the snapshotted state.
+extern void snapshot_key_add(const void *data, size_t sz);
+extern void snapshot_key_add_file(const char *fname);
+
+extern void mem_snap_save(Snapshot *s);
+extern void mem_snap_restore(const Snapshot *s);
+extern void mem_snap_key(void);
+
 /********** PERIPHERALS **********/
 
 // Doesn't nearly represent everything a card can see,
@@ -525,6 +752,9 @@ typedef struct PeriphDesc PeriphDesc;
 struct PeriphDesc {
     void (*init)(void);
     periph_handler  handler;
+    bool (*snap_save)(Snapshot *); // false if state can't be saved now
+    void (*snap_restore)(const Snapshot *);
+    void (*snap_key)(void);        // e.g. for the card's image files
 };
 
 extern void periph_init(void);
@@ -533,6 +763,9 @@ extern byte periph_sw_peek(word loc);
 extern void periph_sw_poke(word loc, byte val);
 extern byte periph_rom_peek(word loc);
 extern void periph_rom_poke(word loc, byte val);
+extern bool periph_snap_save(Snapshot *s);
+extern void periph_snap_restore(const Snapshot *s);
+extern void periph_snap_key(void);
 
 // Disk ][ controller
 extern bool drive_spinning(void);
@@ -542,6 +775,15 @@ extern int insert_disk(int drive, const char *path);
 
 // Smartport controller
 extern void smartport_add_image(const char *fname);
+extern bool smartport_busy(void); // block I/O within the last half-second
+
+// Disk images (--disk-overlay)
+extern int overlay_map(const char *fname, byte **buf, size_t *sz);
+    // Maps a disk image for reading and writing: the file itself, or
+    // with --disk-overlay, a private copy-on-write view of it. Returns
+    // 0, or an errno (with *buf NULL).
+extern void overlay_release(byte *buf);
+    // Before unmapping an image: --disk-overlay-commit writes it back.
 
 // Mouse card
 extern void mouse_set_slot(unsigned int slot);
@@ -564,6 +806,13 @@ struct DiskFormatDesc {
     byte (*read_byte)(DiskFormatDesc *);
     void (*write_byte)(DiskFormatDesc *, byte);
     void (*eject)(DiskFormatDesc *);
+    long (*tell)(DiskFormatDesc *);         // position within track
+    void (*seek)(DiskFormatDesc *, long);   //  (NULL if no disk)
+    // Whole 256-byte sectors, by track and physical sector, for
+    // --fast-rwts. NULL for formats that must go through the
+    // nibbles (.nib, no disk); false if there's no such sector.
+    bool (*read_sector)(DiskFormatDesc *, int, int, byte *);
+    bool (*write_sector)(DiskFormatDesc *, int, int, const byte *);
 };
 
 extern DiskFormatDesc disk_format_load(const char *path);
@@ -571,24 +820,161 @@ extern DiskFormatDesc disk_format_load(const char *path);
 /********** TRACE **********/
 
 extern const char *trfile_name;
-extern FILE *trfile;
+extern MACHINE_LOCAL FILE *trfile;
 
 extern void trace_reg(void);
 extern void trace_step(Event *e);
 extern void trace_on(char *format, ...);
 extern void trace_off(void);
 extern int  tracing(void);
+extern void trace_fork_job(void);
+    // In a --fork-server job: trace to the job's own file, FILE.PID.
 
 extern void trace_read(word loc, byte val);
 extern void trace_write(word loc, byte val);
 
+// --flight-recorder: flight_dump() writes out the recent records,
+// if there are any. (Also called from DIE_FINAL.)
+extern void flight_init(void);
+extern void flight_dump(const char *why);
+
+// Renders a --trace-binary file as the text trace. Returns an exit
+// status.
+extern int  trace_decode(const char *fname, FILE *out);
+
 /********** DEBUG **********/
 
 typedef int (*printer)(const char * fmt, ...);
 bool command_do(const char *line, printer pr);
 
+/********** UNTIL **********/
+
+// The debugger's "until COND [within N]" command. until_start() prints
+// its own error and returns false if COND doesn't parse; on success,
+// the caller should resume execution.
+extern bool until_start(const char *args);
+extern void until_cancel(void);
+// Called by the simple interface when the program polls the keyboard
+// and there's nothing in the inject queue.
+extern void until_input_idle(void);
+
+/********** STATS **********/
+
+// Host-side performance counters, for the debugger's "stats" command
+// and --stats. Only built with ./configure --enable-stats; otherwise
+// the STAT_*() macros compile to nothing.
+#ifdef BOBBIN_STATS
+struct stats {
+    uintmax_t peek_events;
+    uintmax_t poke_events;
+    uintmax_t handlers_visited;
+    uintmax_t true_access_calls;
+    uintmax_t switch_flips[8 * sizeof (SoftSwitches)];
+    uintmax_t disk_nibbles;
+    uintmax_t sched_calls;
+    uintmax_t frames_slept;
+    uintmax_t frames_late;      // took longer than a frame; no sleep
+    uintmax_t oversleep_ns;
+    uintmax_t undersleep_ns;
+    uintmax_t frames_idle;      // guest waited on the keyboard
+    uintmax_t block_runs;       // --block-cache runs...
+    uintmax_t block_instrs;     // ...the instructions they ran...
+    uintmax_t block_decodes;    // ...and the blocks decoded for them
+};
+extern MACHINE_LOCAL struct stats stats;
+#define STAT_INC(f)     ((void)++stats.f)
+#define STAT_ADD(f, n)  ((void)(stats.f += (n)))
+#else
+#define STAT_INC(f)     ((void)0)
+#define STAT_ADD(f, n)  ((void)0)
+#endif
+
+extern void stats_start(void);  // registers the --stats dump at exit
+extern void stats_print(printer pr);
+extern void stats_reset(void);
+
+/********** PROFILE **********/
+
+// Guest-code profiler (--profile): cycles and executions per PC and
+// bank, plus a JSR call tree.
+extern void profile_init(void);
+extern bool profiling(void);
+extern void profile_reset(void);
+extern int profile_write(const char *fname);
+    // Writes a hot-spot listing to FNAME, and collapsed stacks
+    // (for flamegraph tools) to FNAME.folded.
+
+/********** COVERAGE **********/
+
+// Guest code coverage (--coverage): a bit per PC and bank, set as each
+// instruction is fetched; and with --coverage-branches, whether each
+// conditional branch was taken, and not taken.
+enum {
+    COV_EXEC = 0,
+    COV_TAKEN,
+    COV_NOT_TAKEN,
+    COV_NMAPS,
+};
+// For each page, its 32 bytes of bitmap, for wherever the page is
+// mapped from now (kept up to date by mem_remap()). A scratch page,
+// if nobody's covering it.
+extern MACHINE_LOCAL byte *cov_map[COV_NMAPS][256];
+static inline void cov_mark(int m, word pc)
+{
+    cov_map[m][pc >> 8][(pc & 0xFF) >> 3] |= 1 << (pc & 7);
+}
+extern void coverage_init(void);
+extern void coverage_remap(unsigned int pg, MemAccessType acc, bool aux);
+extern int coverage_write(const char *fname);
+    // An lcov tracefile for the --coverage-listing, or a list of the
+    // addresses executed.
+
 /********** GRAPHICS EXPORT **********/
 
+typedef enum {
+    GFX_HGR,
+    GFX_HGR_COLOR,  // HGR with color artifacts
+    GFX_DHGR,
+    GFX_GR,
+    GFX_DGR,
+} GfxMode;
+
+extern const byte *gfx_render(GfxMode mode, word base, bool native,
+                              int *w, int *h);
+    // Renders a graphics page into a shared RGB buffer (3 bytes per
+    // pixel; valid until the next render), and returns it. GR and DGR
+    // are scaled up to 280/560x192 unless NATIVE. Returns NULL for the
+    // double modes, without aux memory.
+extern int png_write(const char *filename, const byte *rgb, int w, int h);
+
+// --screen-shm
+extern void screen_shm_init(void);
+extern uint32_t screen_current(uint32_t *flags, char text[24][80],
+                               const byte **rgb, int *w, int *h);
+    // Captures what's on the screen right now, regardless of
+    // --screen-shm: returns a SCREEN_* mode (see screen-shm.h), and
+    // fills in flags and the text page. For graphics modes, *RGB is
+    // the page as gfx_render() draws it (*w by *h); otherwise NULL.
+
+// --control-socket
+extern void control_init(void);
+
+// --fork-server, --fork-job
+extern void forksrv_init(void);
+extern void forksrv_reached(void);  // at the --delay-until point
+    // In the server: never returns, except in a newly forked child,
+    // which must then carry on and run its job.
+extern int forksrv_job(char **argv);
+    // The --fork-job client: has the server run a job with these
+    // options (and our stdin, stdout and stderr), and returns its
+    // exit status.
+extern void do_job_config(char **v);    // parse a job's options
+
+// --enable-embed
+extern void embed_exit(int st);
+    // For bobbin_exit(): stops this thread's machine, if it's embedded
+    // (and doesn't return); otherwise, does nothing.
+
 // HGR (Hi-Res) - 280x192
 extern int hgr_export_ascii(word base, const char *filename, int scale);
 extern int hgr_export_ppm(word base, const char *filename, bool color_mode);
@@ -600,26 +986,32 @@ extern bool hgr_command_do_color(const char *line, printer pr);
 extern int gr_export_ascii(word base, const char *filename);
 extern int gr_export_ppm(word base, const char *filename);
 extern int gr_export_ppm_native(word base, const char *filename);
+extern int gr_export_png(word base, const char *filename);
 extern bool gr_command_do(const char *line, printer pr);
 
 // DHGR (Double Hi-Res) - 560x192, //e only
 extern int dhgr_export_ascii(word base, const char *filename, int scale);
 extern int dhgr_export_ppm(word base, const char *filename);
+extern int dhgr_export_png(word base, const char *filename);
 extern bool dhgr_command_do(const char *line, printer pr);
 
 // DGR (Double Lo-Res) - 80x48, //e only
 extern int dgr_export_ascii(word base, const char *filename);
 extern int dgr_export_ppm(word base, const char *filename);
 extern int dgr_export_ppm_native(word base, const char *filename);
+extern int dgr_export_png(word base, const char *filename);
 extern bool dgr_command_do(const char *line, printer pr);
 
 // AI Agent keyboard injection (simple interface only)
 extern void simple_inject_keys(const char *keys, size_t len);
+extern void simple_new_input(void);     // for a --fork-server job
 
 extern void dbg_on(void);
 extern void debugger(void);
 extern bool debugging(void);
+extern bool debugger_needs_steps(void); // breakpoints, "c ADDR", etc.
 extern void breakpoint_set(word loc);
+extern bool breakpoints_set(void); // any, enabled or not
 
 /********** TIMING **********/
 
@@ -627,6 +1019,12 @@ struct timing_t;
 
 extern struct timing_t  *timing_init(void);
 extern void             timing_adjust(struct timing_t *);
+extern struct timespec  timing_subtract(struct timespec a, struct timespec b);
+
+/********** BENCH **********/
+
+extern void bench_start(void);
+extern void bench_frame(void); // Call at the end of each frame
 
 /********** UTIL **********/
 
@@ -650,6 +1048,22 @@ extern bool check_watches(void);
 
 /* TBD */
 extern word print_disasm(FILE *f, word pos, const Registers *regs);
+extern int disasm_op_len(byte op); // 0 if not a valid opcode
+
+// Where the disassembler (and util_print_state) read memory from;
+// normally peek_sneaky(), but --decode-trace swaps in the bytes that
+// were recorded with each instruction.
+extern MACHINE_LOCAL byte (*disasm_peek)(word loc);
+
+// A span of memory that print_disasm() shows, beyond the instruction
+// itself. An in_page span wraps around within its page.
+typedef struct DisasmRef DisasmRef;
+struct DisasmRef {
+    word    addr;
+    byte    len;
+    bool    in_page;
+};
+extern int disasm_refs(word pc, const Registers *regs, DisasmRef refs[3]);
 
 // Although the Apple II processor is run at 1,022,727.143 Hz most of
 // the time, every 65th cycle is elongated, run at an effective
@@ -664,11 +1078,13 @@ extern word print_disasm(FILE *f, word pos, const Registers *regs);
 #define LINES_PER_FRAME     262
 #define CYCLES_PER_FRAME    (CYCLES_PER_LINE * LINES_PER_FRAME)
 
-extern uintmax_t cycle_count;
-extern uintmax_t instr_count;
-extern uintmax_t frame_count;
-extern bool text_flash;
+extern MACHINE_LOCAL uintmax_t cycle_count;   // this frame (see cycles_rebase())
+extern MACHINE_LOCAL uintmax_t cycle_base;    // all the cycles before this frame
+extern MACHINE_LOCAL uintmax_t instr_count;
+extern MACHINE_LOCAL uintmax_t frame_count;
+extern MACHINE_LOCAL bool text_flash;
 static inline void cycle(void) { ++cycle_count; }
+static inline uintmax_t cycles_now(void) { return cycle_base + cycle_count; }
 extern volatile sig_atomic_t sigint_received;
 extern volatile sig_atomic_t sigwinch_received;
 extern volatile sig_atomic_t sigalrm_received;
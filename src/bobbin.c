@@ -14,13 +14,13 @@
 #include <fcntl.h>
 #include <unistd.h>
 
-extern void machine_init(void);
 extern void signals_init(void);
 
-uintmax_t frame_count = 0;
-bool text_flash;
+MACHINE_LOCAL const char *program_name;
+MACHINE_LOCAL uintmax_t frame_count = 0;
+MACHINE_LOCAL bool text_flash;
 
-word current_pc_val;
+MACHINE_LOCAL word current_pc_val;
 word current_pc(void) {
     return current_pc_val;
 }
@@ -34,46 +34,64 @@ void bobbin_run(void)
     signals_init();
     machine_init();
     handle_io_opts();
+    if ((cfg.tokenize || cfg.detokenize) && !cfg.rom_tokenizer) {
+        asoft_tool(); // (no need to boot a machine for those)
+    }
     hooks_init();
+    profile_init();
+    coverage_init();
+    screen_shm_init();
+    control_init();
+    forksrv_init();
     interfaces_init();
     periph_init();
     mem_init(); // Loads ROM files. Nothing past this point
                 // should be validating options or arguments.
+    snapshot_init();
     dlypc_reboot();
     setup_watches();
     interfaces_start();
     struct timing_t *timing = timing_init();
 
+    bench_start();
+    stats_start();
+    flight_init();
     event_fire(EV_RESET);
+    snapshot_boot();
 
     for (;;) /* ever */ {
+        // If the guest is just waiting for a key, wait for one on the
+        // host too, rather than emulating its polling flat-out. (Then
+        // timing_adjust() only sleeps whatever's left of the frame.)
+        (void) iface_idle_wait(NS_PER_FRAME);
         if (!cfg.turbo) {
             timing_adjust(timing);
         }
         if (check_watches()) frame_count = 0;
-        cycle_count = 0;
-        do {
-            // Provide hooks the opportunity to alter the PC, here
-            do {
-                current_pc_val = PC;
-                event_fire(EV_PRESTEP);
-                debugger();
-            } while (current_pc_val != PC); // dbgr is allowed to change pc, too
-                                            // and since it was  user-requested,
-                                            // doesn't get count-limited.
+        bobbin_frame();
+        bench_frame();
+    }
+}
 
-            event_fire(EV_STEP);
-            cpu_step();
-        } while (cycle_count < CYCLES_PER_FRAME);
-        frame_count += cycle_count / CYCLES_PER_FRAME;
-        if (cfg.max_frames != 0 && frame_count >= cfg.max_frames) {
-            fputc('\n', stderr);
-            DIE(3, "max emulated runtime (%lu secs) exceeded.\n", cfg.max_frames / 60);
-        }
-        text_flash = frame_count % 30 >= 15;
-        event_fire(EV_FRAME);
-        cycle_count %= CYCLES_PER_FRAME;
+void bobbin_frame(void)
+{
+    cycles_rebase();
+    cpu_run(CYCLES_PER_FRAME);
+    frame_count += cycle_count / CYCLES_PER_FRAME;
+    if (cfg.max_frames != 0 && frame_count >= cfg.max_frames) {
+        fputc('\n', stderr);
+        DIE(3, "max emulated runtime (%lu secs) exceeded.\n", cfg.max_frames / 60);
     }
+    text_flash = frame_count % 30 >= 15;
+    event_fire(EV_FRAME);
+}
+
+void bobbin_exit(int st)
+{
+#ifdef BOBBIN_EMBED
+    embed_exit(st); // (doesn't return, for an embedded machine)
+#endif
+    exit(st);
 }
 
 static void handle_io_opts(void)
@@ -23,6 +23,8 @@ m\n\
     invoke the Apple ][ monitor.\n\
 disk NUM { eject | load PATH }.\n\
     Eject or load a disk image.\n\
+save-state FILE, load-state FILE\n\
+    Save or restore the whole machine's state.\n\
 save-hgr-ascii FILE (sha FILE)\n\
     Save HGR page 1 as ASCII art.\n\
 save-hgr-ppm FILE (shp FILE)\n\
@@ -67,6 +69,16 @@ save-dgr2-ppm FILE (sdgp2 FILE)\n\
     Save DGR page 2 as PPM image (scaled 560x192).\n\
 save-dgr2-ppm-native FILE\n\
     Save DGR page 2 as PPM image (native 80x48).\n\
+save-{hgr,gr,dhgr,dgr}[2]-png FILE\n\
+    Save the page as PNG image (sized as for -ppm).\n\
+save-hgr-png-color FILE, save-hgr2-png-color FILE\n\
+    Save HGR page 1 or 2 as PNG image (color artifacts).\n\
+profile [reset | FILE]\n\
+    Write (or zero) the --profile results so far.\n\
+stats [reset]\n\
+    Show (or zero) host-side performance counters.\n\
+flight\n\
+    Write out the --flight-recorder's recent instructions.\n\
 keys TEXT\n\
     Inject TEXT as keyboard input (for AI agents).\n\
     Escape sequences: \\r=RETURN, \\n=RETURN, \\e=ESC.\n\
@@ -76,6 +88,9 @@ static const char SAVE_RAM_STR[] = "save-ram ";
 static const char DISK_STR[] = "disk ";
 static const char LOAD_STR[] = "load ";
 static const char KEYS_STR[] = "keys ";
+static const char PROFILE_STR[] = "profile ";
+static const char SAVE_STATE_STR[] = "save-state ";
+static const char LOAD_STATE_STR[] = "load-state ";
 
 bool command_do(const char *line, printer pr)
 {
@@ -118,9 +133,41 @@ bool command_do(const char *line, printer pr)
     } else if (HAVE("q") || HAVE("quit")) {
         event_fire(EV_UNHOOK);
         printf("Exiting.\n"); // Don't use pr
-        exit(0);
+        bobbin_exit(0);
     } else if (HAVE("h") || HAVE("help")) {
         pr("%s", cmd_help);
+    } else if (HAVE("profile") || HAVE("profile reset")
+               || !memcmp(line, PROFILE_STR, sizeof(PROFILE_STR)-1)) {
+        if (!profiling()) {
+            pr("ERR: profile: not profiling (use --profile FILE).\n");
+        } else if (HAVE("profile reset")) {
+            profile_reset();
+            pr("Profile reset.\n");
+        } else {
+            const char *fname = cfg.profile_file;
+            if (!HAVE("profile")) {
+                line += sizeof(PROFILE_STR)-1;
+                while (*line == ' ') ++line;
+                if (*line != '\0') fname = line;
+            }
+            if (profile_write(fname) == 0) {
+                pr("Wrote profile to \"%s\" and \"%s.folded\".\n",
+                   fname, fname);
+            } else {
+                pr("ERR: profile: couldn't write \"%s\".\n", fname);
+            }
+        }
+    } else if (HAVE("stats")) {
+        stats_print(pr);
+    } else if (HAVE("stats reset")) {
+        stats_reset();
+        pr("Counters reset.\n");
+    } else if (HAVE("flight")) {
+        if (cfg.flight_recorder == 0) {
+            pr("ERR: flight: --flight-recorder is not on.\n");
+        } else {
+            flight_dump("debugger");
+        }
     } else if (!memcmp(line, SAVE_RAM_STR, sizeof(SAVE_RAM_STR)-1)) {
         // XXX disable if I ever add a "safe mode"
         line += sizeof(SAVE_RAM_STR)-1; // skip to the argument
@@ -143,6 +190,20 @@ bool command_do(const char *line, printer pr)
         pr("Success: saved RAM to file \"%s\".\n", line);
 ramsave_bail:
         if (ramfile != NULL) fclose(ramfile);
+    } else if (!memcmp(line, SAVE_STATE_STR, sizeof(SAVE_STATE_STR)-1)
+               || !memcmp(line, LOAD_STATE_STR, sizeof(LOAD_STATE_STR)-1)) {
+        bool save = line[0] == 's';
+        line += sizeof(SAVE_STATE_STR)-1; // (same length)
+        while (*line == ' ') ++line;
+        int err = save? snapshot_save_file(line) : snapshot_load_file(line);
+        if (err) {
+            pr("ERR: Could not %s state %s \"%s\": %s\n",
+               save? "save" : "load", save? "to" : "from", line,
+               strerror(err));
+        } else {
+            pr("Success: %s state %s file \"%s\".\n",
+               save? "saved" : "loaded", save? "to" : "from", line);
+        }
     } else if (!memcmp(line, DISK_STR, sizeof(DISK_STR)-1)) {
         line += sizeof(DISK_STR)-1; // skip past command
         while (*line == ' ') ++line; // skip WS
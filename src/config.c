@@ -10,12 +10,13 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-Config cfg = {
+MACHINE_LOCAL Config cfg = {
     .squawk_level = DEFAULT_LEVEL,
     .machine = "//e",
     .amt_ram = 128 * 1024,
@@ -23,7 +24,9 @@ Config cfg = {
     .lang_card = true,
     .bell = true,
     .turbo = true,
+    .speed = 1.0,
     .trace_file = "trace.log",
+    .flight_file = "flight.log",
 };
 
 typedef enum {
@@ -39,13 +42,18 @@ typedef enum {
     T_ALIAS,
 } OptType;
 
+// Config fields are given by their offsets in cfg (with CFG() and
+// SET()): its address isn't a constant when cfg is MACHINE_LOCAL.
 typedef struct OptInfo OptInfo;
 struct OptInfo {
     const char * const *    names;
     OptType                 type;
-    void *                  arg;
-    bool *                  was_set;
+    void *                  arg;        // T_FUNCTION, T_FN_ARG, T_ALIAS
+    size_t                  field;      // in cfg, for the other types
+    size_t                  was_set;    // in cfg (a bool); 0 for none
 };
+#define CFG(f)  .field = offsetof(Config, f)
+#define SET(f)  .was_set = offsetof(Config, f)
 
 typedef const char * const AryOfStr;
 
@@ -83,6 +91,8 @@ struct fn help = {do_help};
 
 void do_ram(const char *s);
 struct fnarg ramfn = {do_ram};
+void do_speed(const char *s);
+struct fnarg speedfn = {do_speed};
 void do_trace_to(const char *s);
 struct fnarg trace_to_fn = {do_trace_to};
 struct fnarg load_basic = {dlypc_load_basic};
@@ -101,50 +111,76 @@ struct fnarg jump_to_fn = {dlypc_jump_to_s};
 const OptInfo options[] = {
     { VERSION_OPT_NAMES, T_FUNCTION, &version },
     { HELP_OPT_NAMES, T_FUNCTION, &help },
-    { QUIET_OPT_NAMES, T_INT_RESET, &cfg.squawk_level },
-    { VERBOSE_OPT_NAMES, T_INCREMENT, &cfg.squawk_level },
+    { QUIET_OPT_NAMES, T_INT_RESET, CFG(squawk_level) },
+    { VERBOSE_OPT_NAMES, T_INCREMENT, CFG(squawk_level) },
     { VV_OPT_NAMES, T_FUNCTION, &vv },
     { VVV_OPT_NAMES, T_FUNCTION, &vvv },
-    { INPUT_OPT_NAMES, T_STRING_ARG, &cfg.inputfile },
-    { OUTPUT_OPT_NAMES, T_STRING_ARG, &cfg.outputfile },
-    { RUN_BASIC_OPT_NAMES, T_STRING_ARG, &cfg.runbasicfile },
-    { MACHINE_OPT_NAMES, T_STRING_ARG, &cfg.machine, &cfg.machine_set },
-    { DISK_OPT_NAMES, T_STRING_ARG, &cfg.disk },
-    { DISK2_OPT_NAMES, T_STRING_ARG, &cfg.disk2 },
-    { HDD_OPT_NAMES, T_FN_ARG, &hdd, &cfg.hdd_set },
-    { UTHERNET2_OPT_NAMES, T_BOOL, &cfg.uthernet2_set },
-    { MOUSE_OPT_NAMES, T_BOOL, &cfg.mouse_set },
-    { LANG_CARD_OPT_NAMES, T_BOOL, &cfg.lang_card, &cfg.lang_card_set },
-    { BELL_OPT_NAMES, T_BOOL, &cfg.bell },
-    { TURBO_OPT_NAMES, T_BOOL, &cfg.turbo, &cfg.turbo_was_set },
+    { INPUT_OPT_NAMES, T_STRING_ARG, CFG(inputfile) },
+    { OUTPUT_OPT_NAMES, T_STRING_ARG, CFG(outputfile) },
+    { RUN_BASIC_OPT_NAMES, T_STRING_ARG, CFG(runbasicfile) },
+    { MACHINE_OPT_NAMES, T_STRING_ARG, CFG(machine), SET(machine_set) },
+    { DISK_OPT_NAMES, T_STRING_ARG, CFG(disk) },
+    { DISK2_OPT_NAMES, T_STRING_ARG, CFG(disk2) },
+    { HDD_OPT_NAMES, T_FN_ARG, &hdd, SET(hdd_set) },
+    { UTHERNET2_OPT_NAMES, T_BOOL, CFG(uthernet2_set) },
+    { UTHERNET2_THREAD_OPT_NAMES, T_BOOL, CFG(uthernet2_thread) },
+    { MOUSE_OPT_NAMES, T_BOOL, CFG(mouse_set) },
+    { LANG_CARD_OPT_NAMES, T_BOOL, CFG(lang_card), SET(lang_card_set) },
+    { BELL_OPT_NAMES, T_BOOL, CFG(bell) },
+    { TURBO_OPT_NAMES, T_BOOL, CFG(turbo), SET(turbo_was_set) },
+    { SPEED_OPT_NAMES, T_FN_ARG, &speedfn },
+    { DISK_ACCEL_OPT_NAMES, T_BOOL, CFG(disk_accel) },
+    { FAST_RWTS_OPT_NAMES, T_BOOL, CFG(fast_rwts) },
+    { BLOCK_CACHE_OPT_NAMES, T_BOOL, CFG(block_cache) },
+    { BENCH_OPT_NAMES, T_ULONG_DEC_ARG, CFG(bench_frames) },
+    { STATS_OPT_NAMES, T_BOOL, CFG(stats) },
+    { PROFILE_OPT_NAMES, T_STRING_ARG, CFG(profile_file) },
+    { COVERAGE_OPT_NAMES, T_STRING_ARG, CFG(coverage_file) },
+    { COVERAGE_LISTING_OPT_NAMES, T_STRING_ARG, CFG(coverage_listing) },
+    { COVERAGE_BRANCHES_OPT_NAMES, T_BOOL, CFG(coverage_branches) },
+    { SNAPSHOT_CACHE_OPT_NAMES, T_STRING_ARG, CFG(snapshot_dir) },
+    { SCREEN_SHM_OPT_NAMES, T_STRING_ARG, CFG(screen_shm) },
+    { SCREEN_SHM_EVERY_OPT_NAMES, T_ULONG_DEC_ARG, CFG(screen_shm_every) },
+    { CONTROL_SOCKET_OPT_NAMES, T_STRING_ARG, CFG(control_socket) },
+    { FORK_SERVER_OPT_NAMES, T_STRING_ARG, CFG(fork_server) },
+    { FORK_JOB_OPT_NAMES, T_STRING_ARG, CFG(fork_job) },
+    { DISK_OVERLAY_OPT_NAMES, T_BOOL, CFG(disk_overlay) },
+    { DISK_OVERLAY_COMMIT_OPT_NAMES, T_BOOL, CFG(disk_overlay_commit) },
     { RAM_OPT_NAMES, T_FN_ARG, &ramfn },
-    { ROM_FILE_OPT_NAMES, T_STRING_ARG, &cfg.rom_load_file },
-    { ROM_OPT_NAMES, T_BOOL, &cfg.load_rom },
+    { ROM_FILE_OPT_NAMES, T_STRING_ARG, CFG(rom_load_file) },
+    { ROM_OPT_NAMES, T_BOOL, CFG(load_rom) },
     { LOAD_OPT_NAMES, T_FN_ARG, &load_fn },
     { LOAD_AT_OPT_NAMES, T_FN_ARG, &load_at_fn },
     { LOAD_BASIC_BIN_OPT_NAMES, T_FN_ARG, &load_basic },
-    { IF_OPT_NAMES, T_STRING_ARG, &cfg.interface },
+    { IF_OPT_NAMES, T_STRING_ARG, CFG(interface) },
     { SIMPLE_OPT_NAMES, T_ALIAS, (char *)ALIAS_SIMPLE },
-    { REMAIN_OPT_NAMES, T_BOOL, &cfg.remain_after_pipe },
-    { REMAIN_TTY_OPT_NAMES, T_BOOL, &cfg.remain_tty },
-    { DIE_ON_BRK_OPT_NAMES, T_BOOL, &cfg.die_on_brk },
-    { DEBUG_ON_BRK_OPT_NAMES, T_BOOL, &cfg.debug_on_brk },
+    { REMAIN_OPT_NAMES, T_BOOL, CFG(remain_after_pipe) },
+    { REMAIN_TTY_OPT_NAMES, T_BOOL, CFG(remain_tty) },
+    { FAST_COUT_OPT_NAMES, T_BOOL, CFG(fast_cout) },
+    { DIE_ON_BRK_OPT_NAMES, T_BOOL, CFG(die_on_brk) },
+    { DEBUG_ON_BRK_OPT_NAMES, T_BOOL, CFG(debug_on_brk) },
     { BREAKPOINT_OPT_NAMES, T_FN_ARG, &breakpoint },
-    { TRACE_FILE_OPT_NAMES, T_STRING_ARG, &cfg.trace_file },
+    { TRACE_FILE_OPT_NAMES, T_STRING_ARG, CFG(trace_file) },
     { TRACE_TO_OPT_NAMES, T_FN_ARG, &trace_to_fn },
-    { TRAP_FAILURE_OPT_NAMES, T_WORD_ARG, &cfg.trap_failure,
-        &cfg.trap_failure_on },
-    { TRAP_SUCCESS_OPT_NAMES, T_WORD_ARG, &cfg.trap_success,
-        &cfg.trap_success_on },
-    { TRAP_PRINT_OPT_NAMES, T_WORD_ARG, &cfg.trap_print,
-        &cfg.trap_print_on },
+    { TRACE_BINARY_OPT_NAMES, T_BOOL, CFG(trace_binary) },
+    { FLIGHT_RECORDER_OPT_NAMES, T_ULONG_DEC_ARG, CFG(flight_recorder) },
+    { FLIGHT_FILE_OPT_NAMES, T_STRING_ARG, CFG(flight_file) },
+    { DECODE_TRACE_OPT_NAMES, T_STRING_ARG, CFG(decode_trace) },
+    { TRAP_FAILURE_OPT_NAMES, T_WORD_ARG, CFG(trap_failure),
+        SET(trap_failure_on) },
+    { TRAP_SUCCESS_OPT_NAMES, T_WORD_ARG, CFG(trap_success),
+        SET(trap_success_on) },
+    { TRAP_PRINT_OPT_NAMES, T_WORD_ARG, CFG(trap_print),
+        SET(trap_print_on) },
     { JUMP_TO_OPT_NAMES, T_FN_ARG, &jump_to_fn },
     { DELAY_UNTIL_PC_OPT_NAMES, T_FN_ARG, &delay_until },
-    { WATCH_OPT_NAMES, T_BOOL, &cfg.watch },
-    { TOKENIZE_OPT_NAMES, T_BOOL, &cfg.tokenize },
-    { DETOKENIZE_OPT_NAMES, T_BOOL, &cfg.detokenize },
-    { MAX_RUNTIME_OPT_NAMES, T_ULONG_DEC_ARG, &cfg.max_frames },
-    { BOT_MODE_OPT_NAMES, T_BOOL, &cfg.bot_mode },
+    { WATCH_OPT_NAMES, T_BOOL, CFG(watch) },
+    { WATCH_WARM_OPT_NAMES, T_BOOL, CFG(watch_warm) },
+    { TOKENIZE_OPT_NAMES, T_BOOL, CFG(tokenize) },
+    { DETOKENIZE_OPT_NAMES, T_BOOL, CFG(detokenize) },
+    { ROM_TOKENIZER_OPT_NAMES, T_BOOL, CFG(rom_tokenizer) },
+    { MAX_RUNTIME_OPT_NAMES, T_ULONG_DEC_ARG, CFG(max_frames) },
+    { BOT_MODE_OPT_NAMES, T_BOOL, CFG(bot_mode) },
 };
 
 static const OptInfo *find_option(const char *opt)
@@ -191,11 +227,20 @@ void handle_numeric_arg(OptType type, const char *opt, void *argvar, const char
     }
 }
 
-void do_config(int c, char **v)
+// The options a --fork-server job may give: those that load memory,
+// or jump, at or after the server's ready point; and verbosity.
+static bool job_option(const OptInfo *info)
+{
+    if (info->type == T_INCREMENT || info->type == T_INT_RESET)
+        return info->field == offsetof(Config, squawk_level);
+    return info->arg == &load_fn || info->arg == &load_at_fn
+        || info->arg == &load_basic || info->arg == &jump_to_fn
+        || info->arg == &delay_until
+        || info->arg == &vv || info->arg == &vvv;
+}
+
+static void do_opts(char **v, bool job)
 {
-    // Set up config
-    
-    ++v; // skip program name
     for (; *v != NULL; ++v) {
         // Does it start with "-" or "--"?
         if (**v != '-')
@@ -226,10 +271,14 @@ recheck:// Past this point, can't assume opt points at a real argv[] item
                 info = NULL;
         }
         if (!info) DIE(2, "Unknown option \"--%s\".\n", opt);
+        if (job && info->type != T_ALIAS && !job_option(info))
+            DIE(2, "Option \"--%s\" can't be given to a --fork-server job.\n",
+                opt);
 
         // Mark the option as set.
-        if (info->was_set != NULL)
-            (*info->was_set) = true;
+        if (info->was_set != 0)
+            *(bool *)((char *)&cfg + info->was_set) = true;
+        void *field = (char *)&cfg + info->field;
 
         switch (info->type) {
             case T_STRING_ARG:
@@ -263,16 +312,16 @@ recheck:// Past this point, can't assume opt points at a real argv[] item
             }
                 break;
             case T_INCREMENT:
-                ++(*(int *)info->arg);
+                ++(*(int *)field);
                 break;
             case T_INT_RESET:
-                (*(int *)info->arg) = 0;
+                (*(int *)field) = 0;
                 break;
             case T_BOOL:
             {
                 bool b = !(opt[0] == 'n' && opt[1] == 'o');
 
-                (*(bool *)info->arg) = b;
+                (*(bool *)field) = b;
             }
                 break;
             case T_ALIAS:
@@ -287,12 +336,12 @@ recheck:// Past this point, can't assume opt points at a real argv[] item
             case T_ULONG_ARG:
             case T_WORD_ARG:
             {
-                handle_numeric_arg(info->type, opt, info->arg, arg);
+                handle_numeric_arg(info->type, opt, field, arg);
             }
                 break;
             case T_STRING_ARG:
             {
-                (*(const char **)info->arg) = arg;
+                (*(const char **)field) = arg;
             }
                 break;
             default:
@@ -302,6 +351,18 @@ recheck:// Past this point, can't assume opt points at a real argv[] item
         if (eq) *eq = '='; // put it back, in case it was an alias
                            //  and just  housekeeping
     }
+}
+
+void do_job_config(char **v)
+{
+    do_opts(v, true);
+}
+
+void do_config(int c, char **v)
+{
+    // Set up config
+
+    do_opts(v + 1, false); // (skipping program name)
 
     if (cfg.runbasicfile &&
         (cfg.remain_after_pipe ||
@@ -317,6 +378,14 @@ recheck:// Past this point, can't assume opt points at a real argv[] item
     if (cfg.detokenize) {
         dlypc_load_basic(cfg.inputfile? cfg.inputfile : "/dev/stdin");
     }
+    // A benchmark wants to run flat-out, whatever the interface
+    if (cfg.bench_frames != 0) {
+        cfg.turbo = true;
+        cfg.turbo_was_set = true;
+    }
+    if (cfg.watch_warm) {
+        cfg.watch = true;
+    }
     // User specifies runtime in secs, we want it in frames
     if (cfg.max_frames != 0) {
         cfg.max_frames *= 60;
@@ -340,13 +409,31 @@ PACKAGE_URL "\n"
 "tty"
 "\n"
         , stdout);
-    exit(0);
+    bobbin_exit(0);
 }
 
 void do_help(void)
 {
-    fputs(help_text, stdout);
-    exit(0);
+    for (const char *const *line = help_text; *line != NULL; ++line) {
+        fputs(*line, stdout);
+    }
+    bobbin_exit(0);
+}
+
+void do_speed(const char *v)
+{
+    char *end;
+    errno = 0;
+    double speed = strtod(v, &end);
+    if (end == v || *end != '\0' || errno == ERANGE) {
+        DIE(2, "Could not parse numeric arg to --speed.\n");
+    } else if (speed < 0.05 || speed > 1000) {
+        DIE(2, "--speed must be between 0.05 and 1000.\n");
+    }
+    cfg.speed = speed;
+    // A fixed speed is a throttled one.
+    cfg.turbo = false;
+    cfg.turbo_was_set = true;
 }
 
 void do_ram(const char *v)
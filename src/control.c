@@ -0,0 +1,404 @@
+//  control.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// --control-socket: a Unix-domain socket through which other programs
+// can inspect and drive the emulator, without the debugger, and
+// without going through the terminal. The protocol is in control.h.
+//
+// The socket is serviced once per frame, from EV_FRAME: new clients
+// are accepted, whatever requests have arrived are carried out in
+// order, and the responses to all of them go back together. A client
+// can pipeline as many requests as it likes into one round trip.
+
+#include "bobbin-internal.h"
+#include "control.h"
+#include "screen-shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define MAX_CLIENTS     4
+#define HDR_SIZE        8
+#define IN_SIZE         (HDR_SIZE + CTL_MAX_PAYLOAD)
+#define OUT_SIZE        (1 << 20)
+// How long a client may leave its responses unread (with bobbin's
+// output buffer, and the socket's, full) before it's dropped.
+#define SEND_TIMEOUT_MS 1000
+
+typedef struct {
+    int     fd;     // -1 if unused
+    byte    *in;
+    size_t  inlen;
+    byte    *out;
+    size_t  outlen;
+} Client;
+
+static int listen_fd = -1;
+static Client clients[MAX_CLIENTS];
+static int nclients;
+static bool paused;
+
+static void put16(byte *p, unsigned v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+}
+
+static void put32(byte *p, unsigned long v)
+{
+    put16(p, v & 0xFFFF);
+    put16(p + 2, (v >> 16) & 0xFFFF);
+}
+
+static unsigned get16(const byte *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static unsigned long get32(const byte *p)
+{
+    return get16(p) | ((unsigned long)get16(p + 2) << 16);
+}
+
+static void drop_client(Client *c)
+{
+    close(c->fd);
+    c->fd = -1;
+    c->inlen = c->outlen = 0;
+    --nclients;
+    if (nclients == 0 && paused) {
+        INFO("--control-socket: last client gone; resuming.\n");
+        paused = false;
+    }
+}
+
+// Returns false (having dropped the client) if it couldn't be sent.
+static bool flush_client(Client *c)
+{
+    size_t done = 0;
+    while (done < c->outlen) {
+        ssize_t n = send(c->fd, c->out + done, c->outlen - done,
+                         MSG_NOSIGNAL);
+        if (n > 0) {
+            done += n;
+        } else if (n < 0 && errno == EINTR) {
+            ;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = { .fd = c->fd, .events = POLLOUT };
+            if (poll(&pfd, 1, SEND_TIMEOUT_MS) == 0) {
+                WARN("--control-socket: client not reading; dropped.\n");
+                drop_client(c);
+                return false;
+            }
+        } else {
+            drop_client(c);
+            return false;
+        }
+    }
+    c->outlen = 0;
+    return true;
+}
+
+// Starts a response with room for LEN bytes of payload, and returns
+// where the payload goes (or NULL, if the client had to be dropped).
+static byte *respond(Client *c, const byte *req, int status, size_t len)
+{
+    if (c->outlen + HDR_SIZE + len > OUT_SIZE && !flush_client(c))
+        return NULL;
+    byte *p = c->out + c->outlen;
+    put32(p, len);
+    put16(p + 4, get16(req + 4));
+    p[6] = req[6];
+    p[7] = status;
+    c->outlen += HDR_SIZE + len;
+    return p + HDR_SIZE;
+}
+
+static void respond_err(Client *c, const byte *req, int status,
+                        const char *msg)
+{
+    size_t len = strlen(msg);
+    byte *p = respond(c, req, status, len);
+    if (p) memcpy(p, msg, len);
+}
+
+// A NUL-terminated copy of a file-name payload.
+static char *payload_str(const byte *pl, size_t len)
+{
+    char *s = xalloc(len + 1);
+    memcpy(s, pl, len);
+    s[len] = '\0';
+    return s;
+}
+
+static void do_screen(Client *c, const byte *req, bool want_pixels)
+{
+    uint32_t flags;
+    char text[24][80];
+    const byte *rgb;
+    int w, h;
+    uint32_t mode = screen_current(&flags, text, &rgb, &w, &h);
+    if (!want_pixels || rgb == NULL) w = h = 0;
+
+    size_t npix = (size_t)w * h * 3;
+    byte *p = respond(c, req, CTL_OK, 16 + sizeof text + npix);
+    if (!p) return;
+    put32(p, mode);
+    put32(p + 4, flags);
+    put32(p + 8, w);
+    put32(p + 12, h);
+    memcpy(p + 16, text, sizeof text);
+    if (npix) memcpy(p + 16 + sizeof text, rgb, npix);
+}
+
+static void handle(Client *c, const byte *req)
+{
+    size_t len = get32(req);
+    const byte *pl = req + HDR_SIZE;
+    byte *p;
+
+    switch (req[6]) {
+        case CTL_PING:
+            p = respond(c, req, CTL_OK, len);
+            if (p) memcpy(p, pl, len);
+            break;
+        case CTL_PEEK: {
+            if (len != 4) goto bad;
+            word addr = get16(pl);
+            unsigned n = get16(pl + 2);
+            p = respond(c, req, CTL_OK, n);
+            for (unsigned i = 0; p && i != n; ++i) {
+                p[i] = peek_sneaky(addr + i);
+            }
+            break;
+        }
+        case CTL_POKE:
+            if (len < 2 || len - 2 > 0x10000 - get16(pl)) goto bad;
+            mem_poke_buf(pl + 2, get16(pl), len - 2);
+            respond(c, req, CTL_OK, 0);
+            break;
+        case CTL_GET_REGS:
+            if (len != 0) goto bad;
+            p = respond(c, req, CTL_OK, 8);
+            if (!p) break;
+            put16(p, PC);
+            p[2] = ACC;
+            p[3] = XREG;
+            p[4] = YREG;
+            p[5] = SP;
+            p[6] = PFLAGS;
+            p[7] = 0;
+            break;
+        case CTL_SET_REGS:
+            if (len != 8) goto bad;
+            go_to(get16(pl));
+            ACC = pl[2];
+            XREG = pl[3];
+            YREG = pl[4];
+            SP = pl[5];
+            PFLAGS = pl[6];
+            respond(c, req, CTL_OK, 0);
+            break;
+        case CTL_KEYS:
+            if (!STREQ(cfg.interface, "simple")) {
+                respond_err(c, req, CTL_FAILED,
+                            "keys need the \"simple\" interface");
+                break;
+            }
+            simple_inject_keys((const char *)pl, len);
+            respond(c, req, CTL_OK, 0);
+            break;
+        case CTL_RUN: {
+            if (len != 4) goto bad;
+            cpu_run(cycle_count + get32(pl));
+            uintmax_t now = cycles_now();
+            p = respond(c, req, CTL_OK, 8);
+            if (!p) break;
+            put32(p, now & 0xFFFFFFFFUL);
+            put32(p + 4, (now >> 16) >> 16);
+            break;
+        }
+        case CTL_PAUSE:
+        case CTL_RESUME:
+            if (len != 0) goto bad;
+            paused = req[6] == CTL_PAUSE;
+            respond(c, req, CTL_OK, 0);
+            break;
+        case CTL_SAVE_STATE:
+        case CTL_LOAD_STATE: {
+            if (len == 0) goto bad;
+            char *fname = payload_str(pl, len);
+            int err = req[6] == CTL_SAVE_STATE? snapshot_save_file(fname)
+                : snapshot_load_file(fname);
+            free(fname);
+            if (err) {
+                respond_err(c, req, CTL_FAILED, strerror(err));
+            } else {
+                respond(c, req, CTL_OK, 0);
+            }
+            break;
+        }
+        case CTL_SCREEN:
+            if (len != 1) goto bad;
+            do_screen(c, req, pl[0] != 0);
+            break;
+        default:
+        bad:
+            respond_err(c, req, CTL_BAD_REQUEST, "bad request");
+    }
+}
+
+static void accept_clients(void)
+{
+    for (;;) {
+        int fd = accept(listen_fd, NULL, NULL);
+        if (fd < 0) return; // (EAGAIN: no one else waiting)
+
+        Client *c = NULL;
+        for (int i = 0; i != MAX_CLIENTS; ++i) {
+            if (clients[i].fd < 0) {
+                c = &clients[i];
+                break;
+            }
+        }
+        if (c == NULL) {
+            WARN("--control-socket: too many clients; refused one.\n");
+            close(fd);
+            continue;
+        }
+        (void) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        if (c->in == NULL) {
+            c->in = xalloc(IN_SIZE);
+            c->out = xalloc(OUT_SIZE);
+        }
+        c->fd = fd;
+        ++nclients;
+    }
+}
+
+static void read_client(Client *c)
+{
+    for (;;) {
+        ssize_t n = recv(c->fd, c->in + c->inlen, IN_SIZE - c->inlen, 0);
+        if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN
+                       && errno != EWOULDBLOCK)) {
+            drop_client(c);
+            return;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        c->inlen += n;
+
+        // Carry out every complete request.
+        size_t pos = 0;
+        while (c->inlen - pos >= HDR_SIZE) {
+            unsigned long len = get32(c->in + pos);
+            if (len > CTL_MAX_PAYLOAD) {
+                respond_err(c, c->in + pos, CTL_BAD_REQUEST,
+                            "request too large");
+                if (c->fd >= 0 && flush_client(c)) drop_client(c);
+                return;
+            }
+            if (c->inlen - pos < HDR_SIZE + len) break;
+            handle(c, c->in + pos);
+            if (c->fd < 0) return;
+            pos += HDR_SIZE + len;
+        }
+        memmove(c->in, c->in + pos, c->inlen - pos);
+        c->inlen -= pos;
+    }
+}
+
+static void service(void)
+{
+    accept_clients();
+    for (int i = 0; i != MAX_CLIENTS; ++i) {
+        if (clients[i].fd >= 0) read_client(&clients[i]);
+    }
+    for (int i = 0; i != MAX_CLIENTS; ++i) {
+        if (clients[i].fd >= 0 && clients[i].outlen)
+            (void) flush_client(&clients[i]);
+    }
+}
+
+// While paused, wait here, between frames, for requests.
+static void wait_paused(void)
+{
+    while (paused) {
+        struct pollfd pfd[1 + MAX_CLIENTS];
+        int n = 0;
+        pfd[n++] = (struct pollfd){ .fd = listen_fd, .events = POLLIN };
+        for (int i = 0; i != MAX_CLIENTS; ++i) {
+            if (clients[i].fd >= 0) {
+                pfd[n++] = (struct pollfd){ .fd = clients[i].fd,
+                                            .events = POLLIN };
+            }
+        }
+        if (poll(pfd, n, -1) < 0 && errno == EINTR && sigint_received) {
+            // Let the user get to the debugger.
+            paused = false;
+            break;
+        }
+        service();
+    }
+}
+
+static void control_event(Event *e)
+{
+    if (e->type != EV_FRAME) return;
+    service();
+    wait_paused();
+}
+
+static void control_at_exit(void)
+{
+    (void) unlink(cfg.control_socket);
+}
+
+void control_init(void)
+{
+    if (cfg.control_socket == NULL) return;
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(cfg.control_socket) >= sizeof addr.sun_path) {
+        DIE(2, "--control-socket: path too long: \"%s\"\n",
+            cfg.control_socket);
+    }
+    strcpy(addr.sun_path, cfg.control_socket);
+
+    errno = 0;
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        DIE(1, "--control-socket: couldn't create socket: %s\n",
+            strerror(errno));
+    }
+    // A socket left behind by an earlier run would make bind() fail.
+    (void) unlink(cfg.control_socket);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof addr) < 0
+        || listen(listen_fd, MAX_CLIENTS) < 0) {
+        DIE(1, "--control-socket: couldn't listen on \"%s\": %s\n",
+            cfg.control_socket, strerror(errno));
+    }
+    (void) fcntl(listen_fd, F_SETFL,
+                 fcntl(listen_fd, F_GETFL, 0) | O_NONBLOCK);
+    atexit(control_at_exit);
+
+    for (int i = 0; i != MAX_CLIENTS; ++i) clients[i].fd = -1;
+    event_reghandler_for(control_event, EV_MASK(EV_FRAME));
+}
@@ -0,0 +1,96 @@
+//  control.h
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// Wire protocol for the --control-socket channel. This header has no
+// dependencies on the rest of bobbin, so that client programs can use
+// it as is.
+//
+// Every message, in either direction, is a CtlHeader followed by `len`
+// bytes of payload. All integers are little-endian. A client may send
+// any number of requests without waiting. bobbin handles everything
+// that has arrived, in order, between emulated frames, and answers each
+// request with exactly one response. The response carries the same id
+// and op, and a status. On a failure (CTL_FAILED), its payload is an
+// error message, without a terminating NUL.
+//
+// Requests, and the payloads of their successful responses:
+//
+//  CTL_PING        any bytes           -> the same bytes
+//  CTL_PEEK        u16 addr, u16 n     -> n bytes from memory, as the
+//                                         debugger sees it (no soft
+//                                         switch side effects)
+//  CTL_POKE        u16 addr, bytes     -> (empty) Written as the CPU
+//                                         would, so soft switches and
+//                                         screen updates do happen.
+//  CTL_GET_REGS    (empty)             -> CtlRegs
+//  CTL_SET_REGS    CtlRegs             -> (empty)
+//  CTL_KEYS        bytes               -> (empty) Typed into the
+//                                         "simple" interface; CR ends
+//                                         a line.
+//  CTL_RUN         u32 cycles          -> u64 total cycles run so far
+//  CTL_PAUSE       (empty)             -> (empty) Stop emulating (only
+//                                         CTL_RUN advances the machine)
+//                                         until CTL_RESUME, or until
+//                                         every client has gone.
+//  CTL_RESUME      (empty)             -> (empty)
+//  CTL_SAVE_STATE  file name           -> (empty)
+//  CTL_LOAD_STATE  file name           -> (empty)
+//  CTL_SCREEN      u8 want_pixels      -> CtlScreen, then (if
+//                                         want_pixels, in a graphics
+//                                         mode) width * height RGB
+//                                         triples.
+
+#ifndef BOBBIN_CONTROL_H
+#define BOBBIN_CONTROL_H
+
+#include <stdint.h>
+
+#define CTL_MAX_PAYLOAD 0x10010
+
+enum {
+    CTL_PING,
+    CTL_PEEK,
+    CTL_POKE,
+    CTL_GET_REGS,
+    CTL_SET_REGS,
+    CTL_KEYS,
+    CTL_RUN,
+    CTL_PAUSE,
+    CTL_RESUME,
+    CTL_SAVE_STATE,
+    CTL_LOAD_STATE,
+    CTL_SCREEN,
+};
+
+// Response statuses
+enum {
+    CTL_OK,
+    CTL_BAD_REQUEST,    // unknown op, or a malformed payload
+    CTL_FAILED,
+};
+
+typedef struct {
+    uint32_t    len;        // of the payload that follows
+    uint16_t    id;         // chosen by the client; echoed back
+    uint8_t     op;
+    uint8_t     status;     // responses only
+} CtlHeader;
+
+typedef struct {
+    uint16_t    pc;
+    uint8_t     a, x, y, sp, p;
+    uint8_t     pad;
+} CtlRegs;
+
+typedef struct {
+    uint32_t    mode;       // as in screen-shm.h: SCREEN_TEXT40, etc.
+    uint32_t    flags;      // SCREEN_MIXED, etc.
+    uint32_t    width;      // of the pixels that follow, if any
+    uint32_t    height;
+    char        text[24][80];
+} CtlScreen;
+
+#endif // BOBBIN_CONTROL_H
@@ -0,0 +1,358 @@
+//  coverage.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// Guest code coverage, for --coverage.
+//
+// One bit per PC, for each bank that code can be fetched from (as for
+// --profile, MemAccessType plus aux), is set as each instruction is
+// fetched. So that that's all it costs, mem_remap() keeps cov_map
+// pointing, page by page, at the bitmap for wherever that page is
+// currently mapped from; with coverage off, everything points at a
+// scratch page. With --coverage-branches, two more sets of bitmaps
+// record whether each conditional branch was ever taken, and ever not
+// taken.
+//
+// At exit, the bits are written out as an lcov tracefile for the
+// --coverage-listing (a ca65 listing, made with "ca65 -l"), or without
+// one, as a plain list of the addresses executed.
+
+#include "bobbin-internal.h"
+
+#include <ctype.h>
+#include <errno.h>
+
+#define NBANKS      (2 * MA_LANG_CARD)  // (MemAccessType, aux) pairs
+#define BANK_BYTES  (0x10000 / 8)
+#define MAX_SEGS    32
+
+MACHINE_LOCAL byte *cov_map[COV_NMAPS][256];
+
+static MACHINE_LOCAL byte *bits[COV_NMAPS][NBANKS];
+static MACHINE_LOCAL byte scratch[256 / 8];
+
+static int bank_of(MemAccessType acc, bool aux)
+{
+    return (acc - 1) * 2 + (aux? 1 : 0);
+}
+
+static const char *bank_name(int bank)
+{
+    static char buf[16];
+    snprintf(buf, sizeof buf, "%s%s", (bank & 1)? "AUX:" : "",
+             mem_get_acctype_name(bank / 2 + 1));
+    return buf;
+}
+
+static bool bit_at(int m, int bank, unsigned int pc)
+{
+    return bits[m][bank] != NULL
+        && (bits[m][bank][pc >> 3] & (1 << (pc & 7))) != 0;
+}
+
+// Whether the bit for PC is set in any bank (a listing doesn't say
+// which bank its code was meant to run from).
+static bool any_bit_at(int m, unsigned int pc)
+{
+    for (int b = 0; b != NBANKS; ++b) {
+        if (bit_at(m, b, pc)) return true;
+    }
+    return false;
+}
+
+void coverage_remap(unsigned int pg, MemAccessType acc, bool aux)
+{
+    int bank = bank_of(acc, aux);
+    for (int m = 0; m != COV_NMAPS; ++m) {
+        cov_map[m][pg] = bits[m][bank]?
+            &bits[m][bank][pg * (256 / 8)] : scratch;
+    }
+}
+
+static bool is_branch(byte op)
+{
+    // Conditional branches are all xxx10000 (and BRA, $80, isn't one).
+    return (op & 0x1F) == 0x10;
+}
+
+/* --- Without a listing: the raw addresses. --- */
+
+static void write_addresses(FILE *f)
+{
+    fprintf(f, "# Instructions executed (bank, address%s):\n",
+            cfg.coverage_branches? ", branches taken/not taken" : "");
+    for (int b = 0; b != NBANKS; ++b) {
+        if (bits[COV_EXEC][b] == NULL) continue;
+        for (unsigned int pc = 0; pc != 0x10000; ++pc) {
+            if (!bit_at(COV_EXEC, b, pc)) continue;
+            fprintf(f, "%s %04X", bank_name(b), pc);
+            if (cfg.coverage_branches && (bit_at(COV_TAKEN, b, pc)
+                                          || bit_at(COV_NOT_TAKEN, b, pc))) {
+                fprintf(f, " %s%s", bit_at(COV_TAKEN, b, pc)? "T" : "",
+                        bit_at(COV_NOT_TAKEN, b, pc)? "N" : "");
+            }
+            putc('\n', f);
+        }
+    }
+}
+
+/* --- With a ca65 listing: an lcov tracefile. --- */
+
+struct seg {
+    char            name[32];
+    unsigned long   start;
+};
+
+// Reads the segment start addresses from the "Segment list" of the
+// ld65 map file (made with "ld65 -m"). Returns how many it found.
+static size_t read_map(const char *fname, struct seg *segs)
+{
+    FILE *f = fopen(fname, "r");
+    if (f == NULL) return 0;
+
+    char line[256];
+    size_t nsegs = 0;
+    bool in_list = false;
+    while (fgets(line, sizeof line, f) != NULL) {
+        if (!in_list) {
+            in_list = STREQ(line, "Segment list:\n");
+            continue;
+        }
+        struct seg s;
+        unsigned long end;
+        if (sscanf(line, "%31s %lx %lx", s.name, &s.start, &end) == 3) {
+            if (nsegs == MAX_SEGS) break;
+            segs[nsegs++] = s;
+        } else if (line[0] == '\n') {
+            if (nsegs != 0) break; // end of the list
+        }
+    }
+    fclose(f);
+    return nsegs;
+}
+
+static bool word_is(const char *s, size_t len, const char *w)
+{
+    if (strlen(w) != len) return false;
+    for (size_t i = 0; i != len; ++i) {
+        if (tolower((unsigned char)s[i]) != w[i]) return false;
+    }
+    return true;
+}
+
+// Finds the first word of a source line's statement, past any labels.
+static const char *statement(const char *src, size_t *lenp)
+{
+    for (;;) {
+        while (isspace((unsigned char)*src)) ++src;
+        size_t len = 0;
+        while (src[len] != '\0' && !isspace((unsigned char)src[len])
+               && src[len] != ';') {
+            ++len;
+        }
+        if (len != 0 && src[len-1] == ':') {
+            src += len;
+            continue;
+        }
+        *lenp = len;
+        return src;
+    }
+}
+
+// Notes a segment change, from a source line that has no code bytes.
+static void track_segment(const char *src, char *seg, size_t segsz)
+{
+    size_t len;
+    const char *w = statement(src, &len);
+    static const char * const shorthands[][2] = {
+        { ".code", "CODE" }, { ".data", "DATA" }, { ".bss", "BSS" },
+        { ".rodata", "RODATA" }, { ".zeropage", "ZEROPAGE" },
+    };
+    for (size_t i = 0; i != sizeof shorthands / sizeof shorthands[0]; ++i) {
+        if (word_is(w, len, shorthands[i][0])) {
+            snprintf(seg, segsz, "%s", shorthands[i][1]);
+            return;
+        }
+    }
+    if (word_is(w, len, ".segment")) {
+        const char *q = strchr(w + len, '"');
+        const char *e = q? strchr(q + 1, '"') : NULL;
+        if (e != NULL) {
+            snprintf(seg, segsz, "%.*s", (int)(e - q - 1), q + 1);
+        }
+    }
+}
+
+struct lcov_counts {
+    unsigned long   lf, lh, brf, brh;
+};
+
+// One line of a ca65 listing. The line header is laid out as:
+//
+//   000402r 1  BD rr rr     loop:   lda msg,x
+//
+// the PC (relative to the segment start, if followed by 'r'), the
+// include depth, up to four code bytes ("rr" for ones the linker fills
+// in), and from column 24, the source line.
+static void listing_line(FILE *out, const char *line, unsigned long lineno,
+                         char *seg, size_t segsz,
+                         const struct seg *segs, size_t nsegs,
+                         struct lcov_counts *n)
+{
+    size_t len = strlen(line);
+    if (len < 9) return;
+    for (int i = 0; i != 6; ++i) {
+        if (!isxdigit((unsigned char)line[i])) return;
+    }
+    if ((line[6] != 'r' && line[6] != ' ') || line[7] != ' ') return;
+
+    const char *src = len > 24? line + 24 : "";
+    int nbytes = 0;
+    int op = -1;
+    for (size_t col = 11; col + 2 <= len && col < 23; col += 3) {
+        if (isxdigit((unsigned char)line[col])
+            && isxdigit((unsigned char)line[col+1])) {
+            unsigned int val;
+            if (nbytes == 0 && sscanf(line + col, "%2x", &val) == 1)
+                op = val;
+        } else if (line[col] != 'r' || line[col+1] != 'r') {
+            break;
+        }
+        ++nbytes;
+    }
+    if (nbytes == 0) {
+        track_segment(src, seg, segsz);
+        return;
+    }
+
+    // Only statements that can be executed count: not data
+    // directives, nor the extra lines of bytes for a long one.
+    size_t wlen;
+    const char *w = statement(src, &wlen);
+    if (wlen == 0 || w[0] == '.') return;
+
+    unsigned long pc;
+    (void) sscanf(line, "%6lx", &pc);
+    if (line[6] == 'r') {
+        for (size_t i = 0; i != nsegs; ++i) {
+            if (STREQ(segs[i].name, seg)) {
+                pc += segs[i].start;
+                break;
+            }
+        }
+    }
+    pc &= 0xFFFF;
+
+    bool hit = any_bit_at(COV_EXEC, pc);
+    fprintf(out, "DA:%lu,%d\n", lineno, hit? 1 : 0);
+    ++n->lf;
+    if (hit) ++n->lh;
+
+    if (cfg.coverage_branches && op >= 0 && is_branch(op)) {
+        if (hit) {
+            bool taken = any_bit_at(COV_TAKEN, pc);
+            bool not_taken = any_bit_at(COV_NOT_TAKEN, pc);
+            fprintf(out, "BRDA:%lu,0,0,%d\nBRDA:%lu,0,1,%d\n",
+                    lineno, taken? 1 : 0, lineno, not_taken? 1 : 0);
+            n->brh += taken + not_taken;
+        } else {
+            fprintf(out, "BRDA:%lu,0,0,-\nBRDA:%lu,0,1,-\n",
+                    lineno, lineno);
+        }
+        n->brf += 2;
+    }
+}
+
+static int write_lcov(FILE *out, const char *lstname)
+{
+    errno = 0;
+    FILE *f = fopen(lstname, "r");
+    if (f == NULL) {
+        WARN("Couldn't open coverage listing \"%s\": %s\n", lstname,
+             strerror(errno));
+        return -1;
+    }
+
+    // The segment starts come from the map file beside it
+    // (FOO.map, for FOO.lst).
+    const char *dot = strrchr(lstname, '.');
+    size_t stem = (dot && !strchr(dot, '/'))? (size_t)(dot - lstname)
+                                            : strlen(lstname);
+    char *mapname = xalloc(stem + sizeof ".map");
+    sprintf(mapname, "%.*s.map", (int)stem, lstname);
+    struct seg segs[MAX_SEGS];
+    size_t nsegs = read_map(mapname, segs);
+    if (nsegs == 0) {
+        INFO("No segment list in \"%s\"; taking listing addresses"
+             " as absolute.\n", mapname);
+    }
+    free(mapname);
+
+    fprintf(out, "TN:\nSF:%s\n", lstname);
+    struct lcov_counts n = { 0 };
+    char seg[32] = "CODE";
+    char line[512];
+    unsigned long lineno = 0;
+    bool partial = false;
+    while (fgets(line, sizeof line, f) != NULL) {
+        // (The tail of an over-long line isn't a line of its own.)
+        bool was_partial = partial;
+        partial = strchr(line, '\n') == NULL;
+        if (was_partial) continue;
+        ++lineno;
+        listing_line(out, line, lineno, seg, sizeof seg, segs, nsegs, &n);
+    }
+    fclose(f);
+
+    if (cfg.coverage_branches) {
+        fprintf(out, "BRF:%lu\nBRH:%lu\n", n.brf, n.brh);
+    }
+    fprintf(out, "LF:%lu\nLH:%lu\nend_of_record\n", n.lf, n.lh);
+    return 0;
+}
+
+int coverage_write(const char *fname)
+{
+    errno = 0;
+    FILE *f = fopen(fname, "w");
+    if (f == NULL) {
+        WARN("Couldn't open coverage file \"%s\": %s\n", fname,
+             strerror(errno));
+        return -1;
+    }
+    int ret = 0;
+    if (cfg.coverage_listing) {
+        ret = write_lcov(f, cfg.coverage_listing);
+    } else {
+        write_addresses(f);
+    }
+    fclose(f);
+    return ret;
+}
+
+static void coverage_at_exit(void)
+{
+    (void) coverage_write(cfg.coverage_file);
+}
+
+void coverage_init(void)
+{
+    if (cfg.coverage_file == NULL) {
+        if (cfg.coverage_listing || cfg.coverage_branches) {
+            DIE(2, "--coverage-listing and --coverage-branches"
+                " need --coverage.\n");
+        }
+        return;
+    }
+
+    int nmaps = cfg.coverage_branches? COV_NMAPS : 1;
+    for (int m = 0; m != nmaps; ++m) {
+        for (int b = 0; b != NBANKS; ++b) {
+            bits[m][b] = xalloc(BANK_BYTES);
+            memset(bits[m][b], 0, BANK_BYTES);
+        }
+    }
+    atexit(coverage_at_exit);
+}
@@ -0,0 +1,845 @@
+//  cpu-ops.h
+//
+//  Copyright (c) 2023-2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// The opcode implementations, and step functions built on them.
+// This file is included (twice) only by cpu.c, which defines
+// beforehand:
+//   OPS_NAME(n)    - to give each copy's functions distinct names
+//   CYCLE()        - what to do at the end of each cycle
+// Opcodes count their cycles into a local `cyc', which is added to
+// cycle_count when the opcode completes.
+
+static bool OPS_NAME(cpu_step_65C02)(byte op, byte immed)
+{
+    /* This function returns true if it found (and handled) an
+       extended 65C02 opcode. Returns false if caller should handle
+       opcode that also exists in 6502. */
+    unsigned int cyc = 0;
+
+    switch (op) {
+        case 0x04: // TSB zp - Test and Set Bits, Zero Page (MOS 65C02 only)
+            OP_RMW_ZP(
+                PPUT(PZERO, (val & ACC) == 0);
+                val |= ACC;
+            );
+            break;
+        case 0x0C: // TSB abs - Test and Set Bits, Absolute (MOS 65C02 only)
+            OP_RMW_ABS(
+                PPUT(PZERO, (val & ACC) == 0);
+                val |= ACC;
+            );
+            break;
+        case 0x12: // ORA (zp) - OR with Accumulator, Zero Page Indirect (MOS 65C02 only)
+            {
+                byte zp_addr = immed;
+                PC_ADV;
+                CYCLE();
+                byte lo = peek(zp_addr);
+                CYCLE();
+                byte hi = peek((zp_addr + 1) & 0xFF);
+                CYCLE();
+                byte val = peek(WORD(lo, hi));
+                ff(ACC |= val);
+                CYCLE();
+            }
+            break;
+        case 0x14: // TRB zp - Test and Reset Bits, Zero Page (MOS 65C02 only)
+            OP_RMW_ZP(
+                PPUT(PZERO, (val & ACC) == 0);
+                val &= ~ACC;
+            );
+            break;
+        case 0x1A: // INC A (MOS 65C02) / NOP (6502) - ProDOS 2.4.2 uses this to distinguish CPU types
+            OP_RMW_IMPL(ff(++ACC));
+            break;
+        case 0x1C: // TRB abs - Test and Reset Bits, Absolute (MOS 65C02 only)
+            OP_RMW_ABS(
+                PPUT(PZERO, (val & ACC) == 0);
+                val &= ~ACC;
+            );
+            break;
+        case 0x32: // AND (zp) - AND with Accumulator, Zero Page Indirect (MOS 65C02 only)
+            {
+                byte zp_addr = immed;
+                PC_ADV;
+                CYCLE();
+                byte lo = peek(zp_addr);
+                CYCLE();
+                byte hi = peek((zp_addr + 1) & 0xFF);
+                CYCLE();
+                byte val = peek(WORD(lo, hi));
+                ff(ACC &= val);
+                CYCLE();
+            }
+            break;
+        case 0x34: // BIT zp,X - BIT Zero Page,X (MOS 65C02 only)
+            OP_READ_ZP_IDX(XREG, do_bit(val));
+            break;
+        case 0x3A: // DEC A (MOS 65C02) / NOP (6502)
+            OP_RMW_IMPL(ff(--ACC));
+            break;
+        case 0x3C: // BIT abs,X - BIT Absolute,X (MOS 65C02 only)
+            OP_READ_ABS_IDX(XREG, do_bit(val));
+            break;
+        case 0x52: // EOR (zp) - Exclusive OR, Zero Page Indirect (MOS 65C02 only)
+            {
+                byte zp_addr = immed;
+                PC_ADV;
+                CYCLE();
+                byte lo = peek(zp_addr);
+                CYCLE();
+                byte hi = peek((zp_addr + 1) & 0xFF);
+                CYCLE();
+                byte val = peek(WORD(lo, hi));
+                ff(ACC ^= val);
+                CYCLE();
+            }
+            break;
+        case 0x5A: // PHY (Push Y) - MOS 65C02 only
+            CYCLE();
+            stack_push(YREG);
+            CYCLE();
+            break;
+        case 0x64: // STZ zp - Store Zero, Zero Page (MOS 65C02 only)
+            OP_WRITE_ZP(0);
+            break;
+        case 0x72: // ADC (zp) - Add with Carry, Zero Page Indirect (MOS 65C02 only)
+            {
+                byte zp_addr = immed;
+                PC_ADV;
+                CYCLE();
+                byte lo = peek(zp_addr);
+                CYCLE();
+                byte hi = peek((zp_addr + 1) & 0xFF);
+                CYCLE();
+                byte val = peek(WORD(lo, hi));
+                do_adc(val);
+                CYCLE();
+            }
+            break;
+        case 0x74: // STZ zp,X - Store Zero, Zero Page,X (MOS 65C02 only)
+            OP_WRITE_ZP_IDX(XREG, 0);
+            break;
+        case 0x7A: // PLY (Pull Y) - MOS 65C02 only
+            {
+                CYCLE();
+                stack_inc();
+                CYCLE();
+                YREG = peek(STACK);
+                ff(YREG);
+                CYCLE();
+            }
+            break;
+        case 0x7C: // JMP (abs,X) - Jump Absolute Indirect Indexed (MOS 65C02 only)
+            {
+                byte lo = immed;
+                PC_ADV;
+                CYCLE();
+                byte hi = pc_get_adv();
+                CYCLE();
+                word base_addr = WORD(lo, hi);
+                word addr = base_addr + XREG;
+                CYCLE();
+                lo = peek(addr);
+                CYCLE();
+                hi = peek(addr + 1);
+                word dest = WORD(lo, hi);
+                go_to(dest);
+                CYCLE();
+            }
+            break;
+        case 0x80: // BRA (Branch Always) - MOS 65C02 only
+            OP_BRANCH(true);
+            break;
+        case 0x89: // BIT #imm - BIT Immediate (MOS 65C02 only)
+            OP_READ_IMM(PPUT(PZERO, (ACC & val) == 0));
+            break;
+        case 0x92: // STA (zp) - Store Accumulator, Zero Page Indirect (MOS 65C02 only)
+            {
+                byte zp_addr = immed;
+                PC_ADV;
+                CYCLE();
+                byte lo = peek(zp_addr);
+                CYCLE();
+                byte hi = peek((zp_addr + 1) & 0xFF);
+                CYCLE();
+                poke(WORD(lo, hi), ACC);
+                CYCLE();
+            }
+            break;
+        case 0x9C: // STZ abs - Store Zero, Absolute (MOS 65C02 only)
+            OP_WRITE_ABS(0);
+            break;
+        case 0x9E: // STZ abs,X - Store Zero, Absolute,X (MOS 65C02 only)
+            OP_WRITE_ABS_IDX(XREG, 0);
+            break;
+        case 0xB2: // LDA (zp) - Load Accumulator, Zero Page Indirect (MOS 65C02 only)
+            {
+                byte zp_addr = immed;
+                PC_ADV;
+                CYCLE();
+                byte lo = peek(zp_addr);
+                CYCLE();
+                byte hi = peek((zp_addr + 1) & 0xFF);
+                CYCLE();
+                byte val = peek(WORD(lo, hi));
+                ff(ACC = val);
+                CYCLE();
+            }
+            break;
+        case 0xD2: // CMP, (ZP)
+            {
+                byte zp_addr = immed;
+                PC_ADV;
+                CYCLE();
+                byte lo = peek(zp_addr);
+                CYCLE();
+                byte hi = peek((zp_addr + 1) & 0xFF);
+                CYCLE();
+                byte val = peek(WORD(lo, hi));
+                do_cmp(ACC, val);
+                CYCLE();
+            }
+            break;
+        case 0xDA: // PHX (Push X) - MOS 65C02 only
+            CYCLE();
+            stack_push(XREG);
+            CYCLE();
+            break;
+        case 0xF2: // SBC (zp) - Subtract with Borrow, Zero Page Indirect (MOS 65C02 only)
+            {
+                byte zp_addr = immed;
+                PC_ADV;
+                CYCLE();
+                byte lo = peek(zp_addr);
+                CYCLE();
+                byte hi = peek((zp_addr + 1) & 0xFF);
+                CYCLE();
+                byte val = peek(WORD(lo, hi));
+                do_sbc(val);
+                CYCLE();
+            }
+            break;
+        case 0xFA: // PLX (Pull X) - MOS 65C02 only
+            {
+                CYCLE();
+                stack_inc();
+                CYCLE();
+                XREG = peek(STACK);
+                ff(XREG);
+                CYCLE();
+            }
+            break;
+        default:   // UNRECOGNIZED OPCODE (treat as BRK)
+            return false; // We DID NOT handle
+    }
+
+    cycle_count += cyc;
+    return true; // handled.
+}
+
+static bool OPS_NAME(cpu_step_6502)(byte op, byte immed)
+{
+    unsigned int cyc = 0;
+    switch (op) {
+        case 0x01: // ORA, (MEM,x).
+            OP_READ_INDX(ff(ACC |= val));
+            break;
+        case 0x05: // ORA, ZP
+            OP_READ_ZP(ff(ACC |= val));
+            break;
+        case 0x06: // ASL, ZP
+            OP_RMW_ZP(val = do_asl(val));
+            break;
+        case 0x08: // PHP (impl.)
+            CYCLE();
+            stack_push_flags_or(1 << PBRK);
+            CYCLE();
+            break;
+        case 0x09: // ORA, immed.
+            OP_READ_IMM(ff(ACC |= immed));
+            break;
+        case 0x0A: // ASL, impl.
+            OP_RMW_IMPL(ACC = do_asl(ACC));
+            break;
+        case 0x0D: // ORA, abs
+            OP_READ_ABS(ff(ACC |= val));
+            break;
+        case 0x0E: // ASL, abs
+            OP_RMW_ABS(val = do_asl(val));
+            break;
+        case 0x10: // BPL
+            OP_BRANCH(!PTEST(PNEG));
+            break;
+        case 0x11: // ORA, (MEM),y
+            OP_READ_INDY(ff(ACC |= val));
+            break;
+        case 0x15: // ORA, ZP,x
+            OP_READ_ZP_IDX(XREG, ff(ACC |= val));
+            break;
+        case 0x16: // ASL, ZP,x
+            OP_RMW_ZP_IDX(XREG, val = do_asl(val));
+            break;
+        case 0x18: // CLC (impl.)
+            OP_RMW_IMPL(PPUT(PCARRY, 0));
+            break;
+        case 0x19: // ORA, MEM,y
+            OP_READ_ABS_IDX(YREG, ff(ACC |= val));
+            break;
+        case 0x1A: // UNDOCUMENTED nop (when 6502). ProDOS 2.4.2 uses it
+                   //  to distinguish CPU types...
+                   //  # cycles/order of ops may be wrong...
+            OP_RMW_IMPL(); // NOP behavior - empty statement
+            break;
+        case 0x1D: // ORA, MEM,x
+            OP_READ_ABS_IDX(XREG, ff(ACC |= val));
+            break;
+        case 0x1E: // ASL, MEM,x
+            OP_RMW_ABS_IDX(XREG, val = do_asl(val));
+            break;
+        case 0x20: // JSR
+            {
+                byte lo = immed;
+                PC_ADV;
+                CYCLE();
+                (void) stack_get();
+                CYCLE();
+                stack_push(HI(PC));
+                CYCLE();
+                stack_push(LO(PC));
+                CYCLE();
+                word dest = WORD(lo, peek(PC));
+                go_to(dest);
+                CYCLE();
+            }
+            break;
+        case 0x21: // AND, (MEM,x)
+            OP_READ_INDX(ff(ACC &= val));
+            break;
+        case 0x24: // BIT, ZP
+            OP_READ_ZP(do_bit(val));
+            break;
+        case 0x25: // AND, ZP
+            OP_READ_ZP(ff(ACC &= val));
+            break;
+        case 0x26: // ROL, ZP
+            OP_RMW_ZP(val = do_rol(val));
+            break;
+        case 0x28: // PLP (impl.)
+            {
+                CYCLE();
+                stack_inc();
+                CYCLE();
+                byte p = peek(STACK);
+                // BRK and UNUSED must always be set; they're not real
+                //  flags (no associated flip flops)
+                PFLAGS = p | PMASK(PUNUSED) | PMASK(PBRK);
+                CYCLE();
+            }
+            break;
+        case 0x29: // AND, imm
+            OP_READ_IMM(ff(ACC &= val));
+            break;
+        case 0x2A: // ROL, impl.
+            OP_RMW_IMPL(ACC = do_rol(ACC));
+            break;
+        case 0x2C: // BIT, abs
+            OP_READ_ABS(do_bit(val));
+            break;
+        case 0x2D: // AND, abs
+            OP_READ_ABS(ff(ACC &= val));
+            break;
+        case 0x2E: // ROL, abs
+            OP_RMW_ABS(val = do_rol(val));
+            break;
+        case 0x30: // BMI
+            OP_BRANCH(PTEST(PNEG));
+            break;
+        case 0x31: // AND, (MEM),y
+            OP_READ_INDY(ff(ACC &= val));
+            break;
+        case 0x35: // AND, ZP,x
+            OP_READ_ZP_IDX(XREG, ff(ACC &= val));
+            break;
+        case 0x36: // ROL, ZP,x
+            OP_RMW_ZP_IDX(XREG, val = do_rol(val));
+            break;
+        case 0x38: // SEC (impl.)
+            OP_RMW_IMPL(PPUT(PCARRY, 1));
+            break;
+        case 0x39: // AND, MEM,y
+            OP_READ_ABS_IDX(YREG, ff(ACC &= val));
+            break;
+        case 0x3A: // On 6502, this is an undocumented NOP instruction
+            OP_RMW_IMPL(); // NOP behavior - empty statement
+            break;
+        case 0x3D: // AND, MEM,x
+            OP_READ_ABS_IDX(XREG, ff(ACC &= val));
+            break;
+        case 0x3E: // ROL, MEM,x
+            OP_RMW_ABS_IDX(XREG, val = do_rol(val));
+            break;
+        case 0x40: // RTI
+            {
+                CYCLE(); // end 2
+                byte p = stack_pop();
+                CYCLE(); // 3
+                PFLAGS = (p & 0xCF) | PMASK(PUNUSED);
+                byte lo = stack_pop();
+                CYCLE(); // 4
+                go_to(WORD(lo, HI(PC)));
+                byte hi = stack_pop();
+                CYCLE(); // 5
+                go_to(WORD(lo, hi));
+                (void) peek(STACK);
+                CYCLE(); // 6
+            }
+            break;
+        case 0x41: // EOR, (MEM,x)
+            OP_READ_INDX(ff(ACC ^= val));
+            break;
+        case 0x45: // EOR, ZP
+            OP_READ_ZP(ff(ACC ^= val));
+            break;
+        case 0x46: // LSR, ZP
+            OP_RMW_ZP(val = do_lsr(val));
+            break;
+        case 0x48: // PHA
+            CYCLE();
+            stack_push(ACC);
+            CYCLE();
+            break;
+        case 0x49: // EOR, imm
+            OP_READ_IMM(ff(ACC ^= val));
+            break;
+        case 0x4A: // LSR, impl.
+            OP_RMW_IMPL(ACC = do_lsr(ACC));
+            break;
+        case 0x4C: // JMP
+            {
+                byte lo = immed;
+                PC_ADV;
+                CYCLE();
+                byte hi = pc_get_adv();
+                word dest = WORD(lo, hi);
+                go_to(dest);
+                CYCLE();
+            }
+            break;
+        case 0x4D: // EOR, abs
+            OP_READ_ABS(ff(ACC ^= val));
+            break;
+        case 0x4E: // LSR, abs
+            OP_RMW_ABS(val = do_lsr(val));
+            break;
+        case 0x50: // BVC
+            OP_BRANCH(!PTEST(POVERFL));
+            break;
+        case 0x51: // EOR, (MEM),y
+            OP_READ_INDY(ff(ACC ^= val));
+            break;
+        case 0x55: // EOR, ZP,x
+            OP_READ_ZP_IDX(XREG, ff(ACC ^= val));
+            break;
+        case 0x56: // LSR, ZP,x
+            OP_RMW_ZP_IDX(XREG, val = do_lsr(val));
+            break;
+        case 0x58: // CLI
+            OP_RMW_IMPL(PPUT(PINT, 0));
+            break;
+        case 0x59: // EOR, MEM,y
+            OP_READ_ABS_IDX(YREG, ff(ACC ^= val));
+            break;
+        case 0x5D: // EOR, MEM,x
+            OP_READ_ABS_IDX(XREG, ff(ACC ^= val));
+            break;
+        case 0x5E: // LSR, MEM,x
+            OP_RMW_ABS_IDX(XREG, val = do_lsr(val));
+            break;
+        case 0x60: // RTS
+            {
+                word orig = PC;
+                CYCLE(); // end 2
+                byte lo = stack_pop();
+                CYCLE(); // 3
+                go_to(WORD(lo, HI(PC)));
+                (void) stack_pop();
+                CYCLE(); // 4
+                byte hi = peek(STACK);
+                word dest = WORD(lo, hi);
+                go_to(dest);
+                CYCLE(); // 5
+                PC_ADV;
+                CYCLE(); // 6
+            }
+            break;
+        case 0x61: // ADC, (MEM,x)
+            OP_READ_INDX(do_adc(val));
+            break;
+        case 0x65: // ADC, ZP
+            OP_READ_ZP(do_adc(val));
+            break;
+        case 0x66: // ROR, ZP
+            OP_RMW_ZP(val = do_ror(val));
+            break;
+        case 0x68: // PLA
+            CYCLE();
+            (void) stack_pop();
+            CYCLE();
+            ff(ACC = peek(STACK));
+            CYCLE();
+            break;
+        case 0x69: // ADC, imm
+            OP_READ_IMM(do_adc(val));
+            break;
+        case 0x6A: // ROR, impl.
+            OP_RMW_IMPL(ACC = do_ror(ACC));
+            break;
+        case 0x6C: // JMP ()
+            {
+                byte lo = immed;
+                PC_ADV;
+                CYCLE(); // 2
+                byte hi = pc_get_adv();
+                word addr = WORD(lo,hi);
+                CYCLE(); // 3
+                lo = peek(addr);
+                CYCLE(); // 4
+                if (machine_is_enhanced_iie()) {
+                    hi = peek(addr+1);
+                } else {
+                    // 6502 page-crossing BUG!!
+                    hi = peek(WORD(LO(addr+1),HI(addr)));
+                }
+                word dest = WORD(lo, hi);
+                go_to(dest);
+                CYCLE(); // 5
+            }
+            break;
+        case 0x6D: // ADC, abs
+            OP_READ_ABS(do_adc(val));
+            break;
+        case 0x6E: // ROR, abs
+            OP_RMW_ABS(val = do_ror(val));
+            break;
+        case 0x70: // BVS
+            OP_BRANCH(PTEST(POVERFL));
+            break;
+        case 0x71: // ADC, (MEM),y
+            OP_READ_INDY(do_adc(val));
+            break;
+        case 0x75: // ADC, ZP,x
+            OP_READ_ZP_IDX(XREG, do_adc(val));
+            break;
+        case 0x76: // ROR, ZP,x
+            OP_RMW_ZP_IDX(XREG, val = do_ror(val));
+            break;
+        case 0x78: // SEI
+            OP_RMW_IMPL(PPUT(PINT, 1));
+            break;
+        case 0x79: // ADC MEM,y
+            OP_READ_ABS_IDX(YREG, do_adc(val));
+            break;
+        case 0x7D: // ADC, MEM,x
+            OP_READ_ABS_IDX(XREG, do_adc(val));
+            break;
+        case 0x7E: // ROR, MEM,x
+            OP_RMW_ABS_IDX(XREG, val = do_ror(val));
+            break;
+        case 0x81: // STA, (MEM,x)
+            OP_WRITE_INDX(ACC);
+            break;
+        case 0x84: // STY, ZP
+            OP_WRITE_ZP(YREG);
+            break;
+        case 0x85: // STA, ZP
+            OP_WRITE_ZP(ACC);
+            break;
+        case 0x86: // STX, ZP
+            OP_WRITE_ZP(XREG);
+            break;
+        case 0x88: // DEY
+            OP_RMW_IMPL(ff(--YREG));
+            break;
+        case 0x8A: // TXA
+            OP_RMW_IMPL(ff(ACC = XREG));
+            break;
+        case 0x8C: // STY, abs
+            OP_WRITE_ABS(YREG);
+            break;
+        case 0x8D: // STA, abs
+            OP_WRITE_ABS(ACC);
+            break;
+        case 0x8E: // STX, abs
+            OP_WRITE_ABS(XREG);
+            break;
+        case 0x90: // BCC
+            OP_BRANCH(!PTEST(PCARRY));
+            break;
+        case 0x91: // STA, (MEM),y
+            OP_WRITE_INDY(ACC);
+            break;
+        case 0x94: // STY, ZP,x
+            OP_WRITE_ZP_IDX(XREG, YREG);
+            break;
+        case 0x95: // STA, ZP,x
+            OP_WRITE_ZP_IDX(XREG, ACC);
+            break;
+        case 0x96: // STX, ZP,y
+            OP_WRITE_ZP_IDX(YREG, XREG);
+            break;
+        case 0x98: // TYA
+            OP_RMW_IMPL(ff(ACC = YREG));
+            break;
+        case 0x99: // STA, MEM,y
+            OP_WRITE_ABS_IDX(YREG, ACC);
+            break;
+        case 0x9A: // TXS
+            OP_RMW_IMPL(SP = XREG); // No flag changes!
+            break;
+        case 0x9D: // STA, MEM,x
+            OP_WRITE_ABS_IDX(XREG, ACC);
+            break;
+        case 0xA0: // LDY, immed.
+            OP_READ_IMM(ff(YREG = val));
+            break;
+        case 0xA1: // LDA, (MEM,x)
+            OP_READ_INDX(ff(ACC = val));
+            break;
+        case 0xA2: // LDX, immed.
+            OP_READ_IMM(ff(XREG = val));
+            break;
+        case 0xA4: // LDY, ZP
+            OP_READ_ZP(ff(YREG = val));
+            break;
+        case 0xA5: // LDA, ZP
+            OP_READ_ZP(ff(ACC = val));
+            break;
+        case 0xA6: // LDX, ZP
+            OP_READ_ZP(ff(XREG = val));
+            break;
+        case 0xA8: // TAY
+            OP_RMW_IMPL(ff(YREG = ACC));
+            break;
+        case 0xA9: // LDA, immed.
+            OP_READ_IMM(ff(ACC = val));
+            break;
+        case 0xAA: // TAX
+            OP_RMW_IMPL(ff(XREG = ACC));
+            break;
+        case 0xAC: // LDY, abs
+            OP_READ_ABS(ff(YREG = val));
+            break;
+        case 0xAD: // LDA, abs
+            OP_READ_ABS(ff(ACC = val));
+            break;
+        case 0xAE: // LDX, abs
+            OP_READ_ABS(ff(XREG = val));
+            break;
+        case 0xB0: // BCS
+            OP_BRANCH(PTEST(PCARRY));
+            break;
+        case 0xB1: // LDA, (MEM),y
+            OP_READ_INDY(ff(ACC = val));
+            break;
+        case 0xB4: // LDY, ZP,x
+            OP_READ_ZP_IDX(XREG, ff(YREG = val));
+            break;
+        case 0xB5: // LDA, ZP,x
+            OP_READ_ZP_IDX(XREG, ff(ACC = val));
+            break;
+        case 0xB6: // LDX, ZP,y
+            OP_READ_ZP_IDX(YREG, ff(XREG = val));
+            break;
+        case 0xB8: // CLV
+            OP_RMW_IMPL(PPUT(POVERFL, 0));
+            break;
+        case 0xB9: // LDA, MEM,y
+            OP_READ_ABS_IDX(YREG, ff(ACC = val));
+            break;
+        case 0xBA: // TSX
+            OP_RMW_IMPL(ff(XREG = SP));
+            break;
+        case 0xBC: // LDY MEM,x
+            OP_READ_ABS_IDX(XREG, ff(YREG = val));
+            break;
+        case 0xBD: // LDA MEM,x
+            OP_READ_ABS_IDX(XREG, ff(ACC = val));
+            break;
+        case 0xBE: // LDX MEM,y
+            OP_READ_ABS_IDX(YREG, ff(XREG = val));
+            break;
+        case 0xC0: // CPY, immed.
+            OP_READ_IMM(do_cmp(YREG, val));
+            break;
+        case 0xC1: // CMP, (MEM,x)
+            OP_READ_INDX(do_cmp(ACC, val));
+            break;
+        case 0xC2: // UNDOCUMENTED: NOP, immed.
+            // Used in BITSY.BOOT. Perhaps to distiguish
+            //  a 65816?
+            OP_READ_IMM();
+            break;
+        case 0xC4: // CPY, ZP
+            OP_READ_ZP(do_cmp(YREG, val));
+            break;
+        case 0xC5: // CMP, ZP
+            OP_READ_ZP(do_cmp(ACC, val));
+            break;
+        case 0xC6: // DEC, ZP
+            OP_RMW_ZP(ff(--val));
+            break;
+        case 0xC8: // INY, impl.
+            OP_RMW_IMPL(ff(++YREG));
+            break;
+        case 0xC9: // CMP, immed.
+            OP_READ_IMM(do_cmp(ACC, val));
+            break;
+        case 0xCA: // DEX, immed.
+            OP_RMW_IMPL(ff(--XREG));
+            break;
+        case 0xCC: // CPY, abs.
+            OP_READ_ABS(do_cmp(YREG, val));
+            break;
+        case 0xCD: // CMP, abs.
+            OP_READ_ABS(do_cmp(ACC, val));
+            break;
+        case 0xCE: // DEC, abs.
+            OP_RMW_ABS(ff(--val));
+            break;
+        case 0xD0: // BNE
+            OP_BRANCH(!PTEST(PZERO));
+            break;
+        case 0xD1: // CMP, (MEM),y
+            OP_READ_INDY(do_cmp(ACC, val));
+            break;
+        case 0xD5: // CMP, ZP,x
+            OP_READ_ZP_IDX(XREG, do_cmp(ACC, val));
+            break;
+        case 0xD6: // DEC, ZP,x
+            OP_RMW_ZP_IDX(XREG, ff(--val));
+            break;
+        case 0xD8: // CLD
+            OP_RMW_IMPL(PPUT(PDEC, 0));
+            break;
+        case 0xD9: // CMP, MEM,y
+            OP_READ_ABS_IDX(YREG, do_cmp(ACC, val));
+            break;
+        case 0xDD: // CMP, MEM,x
+            OP_READ_ABS_IDX(XREG, do_cmp(ACC, val));
+            break;
+        case 0xDE: // DEC, MEM,x
+            OP_RMW_ABS_IDX(XREG, ff(--val));
+            break;
+        case 0xE0: // CPX, immed.
+            OP_READ_IMM(do_cmp(XREG, val));
+            break;
+        case 0xE1: // SBC, (MEM,x)
+            OP_READ_INDX(do_sbc(val));
+            break;
+        case 0xE4: // CPX, ZP
+            OP_READ_ZP(do_cmp(XREG, val));
+            break;
+        case 0xE5: // SBC, ZP
+            OP_READ_ZP(do_sbc(val));
+            break;
+        case 0xE6: // INC, ZP
+            OP_RMW_ZP(ff(++val));
+            break;
+        case 0xE8: // INX (impl.)
+            OP_RMW_IMPL(ff(++XREG));
+            break;
+        case 0xE9: // SBC, immed.
+            OP_READ_IMM(do_sbc(val));
+            break;
+        case 0xEA: // NOP
+            OP_RMW_IMPL(); // empty statement
+            break;
+        case 0xEC: // CPX, abs.
+            OP_READ_ABS(do_cmp(XREG, val));
+            break;
+        case 0xED: // SBC, abs.
+            OP_READ_ABS(do_sbc(val));
+            break;
+        case 0xEE: // INC, abs.
+            OP_RMW_ABS(ff(++val));
+            break;
+        case 0xF0: // BEQ
+            OP_BRANCH(PTEST(PZERO));
+            break;
+        case 0xF1: // SBC, (MEM),y
+            OP_READ_INDY(do_sbc(val));
+            break;
+        case 0xF5: // SBC, ZP,x
+            OP_READ_ZP_IDX(XREG, do_sbc(val));
+            break;
+        case 0xF6: // INC, ZP,x
+            OP_RMW_ZP_IDX(XREG, ff(++val));
+            break;
+        case 0xF8: // SED
+            OP_RMW_IMPL(PPUT(PDEC, 1));
+            break;
+        case 0xF9: // SBC, MEM,y
+            OP_READ_ABS_IDX(YREG, do_sbc(val));
+            break;
+        case 0xFD: // SBC, MEM,x
+            OP_READ_ABS_IDX(XREG, do_sbc(val));
+            break;
+        case 0xFE: // INC, MEM,x
+            OP_RMW_ABS_IDX(XREG, ff(++val));
+            break;
+        case 0x00: // BRK
+            handle_brk_or_illegal(op);
+            break;
+        default:
+            return false; // NOT handled.
+    }
+    cycle_count += cyc;
+    return true; // handled.
+}
+
+
+// Per-opcode dispatch for the 65C02. Each entry starts out pointing
+// at resolve_65C02(), which works out whether the opcode belongs to
+// the 65C02 extensions or the common 6502 set, and then replaces
+// itself with the right one, so that every later execution of that
+// opcode goes through just the one switch.
+static MACHINE_LOCAL opcode_handler OPS_NAME(optable_65C02)[256];
+
+static bool OPS_NAME(resolve_65C02)(byte op, byte immed)
+{
+    if (OPS_NAME(cpu_step_65C02)(op, immed)) {
+        OPS_NAME(optable_65C02)[op] = OPS_NAME(cpu_step_65C02);
+        return true;
+    }
+    OPS_NAME(optable_65C02)[op] = OPS_NAME(cpu_step_6502);
+    return OPS_NAME(cpu_step_6502)(op, immed);
+}
+
+static void OPS_NAME(step_6502)(void)
+{
+    /* Cycle references taken from https://www.nesdev.org/6502_cpu.txt. */
+    unsigned int cyc = 0;
+    cov_mark(COV_EXEC, PC);
+    byte op = pc_get_adv();
+    CYCLE(); // end 1
+    cycle_count += cyc;
+
+    byte immed = peek(PC);
+    step_finish(op, OPS_NAME(cpu_step_6502)(op, immed));
+}
+
+static void OPS_NAME(step_65C02)(void)
+{
+    unsigned int cyc = 0;
+    cov_mark(COV_EXEC, PC);
+    byte op = pc_get_adv();
+    CYCLE(); // end 1
+    cycle_count += cyc;
+
+    byte immed = peek(PC);
+    step_finish(op, OPS_NAME(optable_65C02)[op](op, immed));
+}
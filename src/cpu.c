@@ -10,9 +10,31 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-Cpu theCpu;
+MACHINE_LOCAL Cpu theCpu;
 
-uintmax_t instr_count = 0;
+MACHINE_LOCAL uintmax_t instr_count = 0;
+
+// Set by cpu_run() if anyone is listening for EV_CYCLE. If nobody is,
+// each opcode tallies its cycles in a local and adds them to
+// cycle_count once, at the end; otherwise cycle_count is advanced
+// (and EV_CYCLE fired) at every cycle.
+static MACHINE_LOCAL bool cycle_events;
+
+static void cycle_exact(void)
+{
+    cycle();
+    event_fire_cycle();
+}
+
+// For the (rare) cycles spent outside of the opcode switches.
+static inline void cpu_cycle(void)
+{
+    if (cycle_events) {
+        cycle_exact();
+    } else {
+        cycle();
+    }
+}
 
 void cpu_reset(void)
 {
@@ -21,27 +43,27 @@ void cpu_reset(void)
     /* Cycles here are counted from 0 to match the source (for
        comparison purposes), but elsewhere counted from 1. */
     (void) peek(PC);
-    cycle(); /* end of cycle 0 */
+    cpu_cycle(); /* end of cycle 0 */
     (void) peek(PC);
-    cycle();
+    cpu_cycle();
     (void) peek(PC);
-    cycle();
+    cpu_cycle();
 
     (void) stack_get();
     (void) stack_dec();
-    cycle(); /* end of cycle 3; fake push of PCH */
+    cpu_cycle(); /* end of cycle 3; fake push of PCH */
     (void) stack_get();
     (void) stack_dec();
-    cycle(); /* end of cycle 4; fake push of PCL */
+    cpu_cycle(); /* end of cycle 4; fake push of PCL */
     (void) stack_get();
     (void) stack_dec();
-    cycle(); /* end of cycle 5; fake push of status */
+    cpu_cycle(); /* end of cycle 5; fake push of status */
 
     byte pcL = peek(VEC_RESET);
-    cycle(); /* end of cycle 6; read vector low byte */
+    cpu_cycle(); /* end of cycle 6; read vector low byte */
     byte pcH = peek(VEC_RESET+1);
     go_to(WORD(pcL, pcH));
-    cycle(); /* end of cycle 7 (8th); read vector high byte */
+    cpu_cycle(); /* end of cycle 7 (8th); read vector high byte */
 }
 
 // Sign extend
@@ -52,38 +74,38 @@ void cpu_reset(void)
 #define OP_READ_INDX(exec) \
     do { \
         PC_ADV; \
-        cycle(); \
+        CYCLE(); \
         (void) peek(XREG); \
-        cycle(); \
+        CYCLE(); \
         byte lo = peek(LO(immed + XREG)); \
-        cycle(); \
+        CYCLE(); \
         byte hi = peek(LO(immed + XREG + 1)); \
-        cycle(); \
+        CYCLE(); \
         byte val = peek(WORD(lo, hi)); \
         exec; \
-        cycle(); \
+        CYCLE(); \
     } while (0)
 
 #define OP_READ_ZP(exec) \
     do { \
         PC_ADV; \
-        cycle(); \
+        CYCLE(); \
         byte val = peek(immed); \
         exec; \
-        cycle(); \
+        CYCLE(); \
     } while (0)
 
 #define OP_RMW_ZP(exec) \
     do { \
         PC_ADV; \
-        cycle(); \
+        CYCLE(); \
         byte val = peek(immed); \
-        cycle(); \
+        CYCLE(); \
         poke(LO(immed), val); \
-        cycle(); \
+        CYCLE(); \
         exec; \
         poke(LO(immed), val); \
-        cycle(); \
+        CYCLE(); \
     } while (0)
 
 #define OP_READ_IMM(exec) \
@@ -91,94 +113,95 @@ void cpu_reset(void)
         byte val = immed; /* just in case */ \
         PC_ADV; \
         exec; \
-        cycle(); \
+        CYCLE(); \
     } while (0)
 
 #define OP_RMW_IMPL(exec) \
     do { \
         exec; \
-        cycle(); \
+        CYCLE(); \
     } while (0)
 
 #define OP_READ_ABS(exec) \
     do { \
         byte lo = immed; \
         PC_ADV; \
-        cycle(); \
+        CYCLE(); \
         byte hi = pc_get_adv(); \
-        cycle(); \
+        CYCLE(); \
         byte val = peek(WORD(lo, hi)); \
         exec; \
-        cycle(); \
+        CYCLE(); \
     } while (0)
 
 #define OP_RMW_ABS(exec) \
     do { \
         byte lo = immed; \
         PC_ADV; \
-        cycle(); \
+        CYCLE(); \
         byte hi = pc_get_adv(); \
-        cycle(); \
+        CYCLE(); \
         word addr = WORD(lo, hi); \
         byte val = peek(addr); \
-        cycle(); \
+        CYCLE(); \
         poke(addr, val); \
-        cycle(); \
+        CYCLE(); \
         exec; \
         poke(addr,val); \
-        cycle(); \
+        CYCLE(); \
     } while (0)
 
 #define OP_BRANCH(test) \
     do { \
+        cov_mark((test)? COV_TAKEN : COV_NOT_TAKEN, PC - 1); \
         PC_ADV; \
-        cycle(); /* 2 */ \
+        CYCLE(); /* 2 */ \
         word orig = PC; \
         (void) peek(PC); \
         if (test) { \
             word offset = SE(immed); \
             word addr = PC + offset; \
             go_to(WORD(LO(addr), HI(PC))); \
-            cycle(); /* 3 */\
+            CYCLE(); /* 3 */\
             (void) peek(PC); \
             if (PC != addr) { \
-                cycle(); /* 4 */ \
+                CYCLE(); /* 4 */ \
                 go_to(addr); \
                 (void) peek(PC); \
             } \
-            cycle(); /* 4 or 5 */ \
+            CYCLE(); /* 4 or 5 */ \
         } else { \
-            cycle(); /* 3 */ \
+            CYCLE(); /* 3 */ \
         } \
     } while (0)
 
 #define OP_READ_INDY(exec) \
     do { \
         PC_ADV; \
-        cycle(); /* 2 */ \
+        CYCLE(); /* 2 */ \
         byte lo = peek(immed); \
-        cycle(); /* 3 */ \
+        CYCLE(); /* 3 */ \
         byte hi = peek(immed + 1); \
         word addr = WORD(lo, hi) + YREG; \
         word wrAddr = WORD(LO(lo + YREG), hi); \
-        cycle(); /* 4 */ \
+        CYCLE(); /* 4 */ \
         byte val = peek(wrAddr); \
         if (addr == wrAddr) { \
             exec; \
         } else { \
-            cycle(); /* 5 */ \
+            CYCLE(); /* 5 */ \
             val = peek(addr); \
             exec; \
         } \
-        cycle(); /* 5 or 6 */ \
+        CYCLE(); /* 5 or 6 */ \
     } while (0)
 
 #define OP_READ_ZP_IDX(reg, exec) \
     do { \
         PC_ADV; \
-        cycle(); \
+        CYCLE(); \
         (void) peek(immed); \
-        cycle(); \
+        CYCLE(); \
         byte val = peek(LO(immed + reg)); \
         exec; \
     } while (0)
@@ -186,33 +209,33 @@ void cpu_reset(void)
 #define OP_RMW_ZP_IDX(reg, exec) \
     do { \
         PC_ADV; \
-        cycle(); \
+        CYCLE(); \
         (void) peek(immed); \
-        cycle(); \
+        CYCLE(); \
         byte addr = LO(immed + reg); \
         byte val = peek(addr); \
-        cycle(); \
+        CYCLE(); \
         poke(addr, val); \
-        cycle(); \
+        CYCLE(); \
         exec; \
         poke(addr, val); \
-        cycle(); /* 6 */ \
+        CYCLE(); /* 6 */ \
     } while (0)
 
 #define OP_READ_ABS_IDX(reg, exec) \
     do { \
         PC_ADV; \
-        cycle(); \
+        CYCLE(); \
         byte lo = immed; \
         byte hi = pc_get_adv(); \
         word addr = WORD(lo, hi) + reg; \
         word wrAddr = WORD(LO(lo + reg), hi); \
-        cycle(); /* 3 */ \
+        CYCLE(); /* 3 */ \
         byte val = peek(wrAddr); \
         if (addr == wrAddr) { \
             exec; \
         } else { \
-            cycle(); \
+            CYCLE(); \
             val = peek(addr); \
             exec; \
         } \
@@ -221,93 +244,93 @@ void cpu_reset(void)
 #define OP_RMW_ABS_IDX(reg, exec) \
     do { \
         PC_ADV; \
-        cycle(); \
+        CYCLE(); \
         byte lo = immed; \
         byte hi = pc_get_adv(); \
         word addr = WORD(lo, hi) + reg; \
         word wrAddr = WORD(LO(lo + reg), hi); \
-        cycle(); /* 3 */ \
+        CYCLE(); /* 3 */ \
         byte val = peek(wrAddr); \
-        cycle(); /* 4 */ \
+        CYCLE(); /* 4 */ \
         val = peek(addr); \
-        cycle(); /* 5 */ \
+        CYCLE(); /* 5 */ \
         poke(addr, val); \
-        cycle(); /* 6 */ \
+        CYCLE(); /* 6 */ \
         exec; \
         poke(addr, val); \
-        cycle(); /* 7 */ \
+        CYCLE(); /* 7 */ \
     } while (0)
 
 #define OP_WRITE_INDX(valReg) \
     do { \
         PC_ADV; \
-        cycle(); /* 2 */ \
+        CYCLE(); /* 2 */ \
         (void) peek(immed); \
-        cycle(); /* 3 */ \
+        CYCLE(); /* 3 */ \
         immed += XREG; \
         byte lo = peek(immed); \
-        cycle(); /* 4 */ \
+        CYCLE(); /* 4 */ \
         immed += 1; \
         byte hi = peek(immed); \
-        cycle(); /* 5 */ \
+        CYCLE(); /* 5 */ \
         poke(WORD(lo, hi), valReg); \
-        cycle(); /* 6 */ \
+        CYCLE(); /* 6 */ \
     } while (0)
 
 #define OP_WRITE_ZP(reg) \
     do { \
         PC_ADV; \
-        cycle(); /* 2 */ \
+        CYCLE(); /* 2 */ \
         poke(immed, reg); \
-        cycle(); /* 3 */ \
+        CYCLE(); /* 3 */ \
     } while (0)
 
 #define OP_WRITE_ZP_IDX(idxReg, valReg) \
     do { \
         PC_ADV; \
-        cycle(); /* 2 */ \
+        CYCLE(); /* 2 */ \
         (void) peek(immed); \
-        cycle(); /* 3 */ \
+        CYCLE(); /* 3 */ \
         poke(LO(immed + idxReg), valReg); \
-        cycle();  /* 4 */ \
+        CYCLE();  /* 4 */ \
     } while (0)
 
 #define OP_WRITE_ABS_IDX(idxReg, valReg) \
     do { \
         byte lo = immed; \
         PC_ADV; \
-        cycle(); /* 2 */ \
+        CYCLE(); /* 2 */ \
         byte hi = pc_get_adv(); \
-        cycle(); /* 3 */ \
+        CYCLE(); /* 3 */ \
         (void) peek(WORD(LO(lo + idxReg), hi)); \
-        cycle(); /* 4 */ \
+        CYCLE(); /* 4 */ \
         poke(WORD(lo, hi) + idxReg, valReg); \
-        cycle(); /* 5 */ \
+        CYCLE(); /* 5 */ \
     } while (0)
 
 #define OP_WRITE_INDY(valReg) \
     do { \
         PC_ADV; \
-        cycle(); /* 2 */ \
+        CYCLE(); /* 2 */ \
         byte lo = peek(immed); \
-        cycle(); /* 3 */ \
+        CYCLE(); /* 3 */ \
         byte hi = peek(LO(immed + 1)); \
-        cycle(); /* 4 */ \
+        CYCLE(); /* 4 */ \
         (void) peek(WORD(LO(lo+YREG), hi)); \
-        cycle(); /* 5 */ \
+        CYCLE(); /* 5 */ \
         poke(WORD(lo, hi)+YREG, valReg); \
-        cycle(); /* 6 */ \
+        CYCLE(); /* 6 */ \
     } while (0)
 
 #define OP_WRITE_ABS(valReg) \
     do { \
         byte lo = immed; \
         PC_ADV; \
-        cycle(); /* 2 */ \
+        CYCLE(); /* 2 */ \
         byte hi = pc_get_adv(); \
-        cycle(); /* 3 */ \
+        CYCLE(); /* 3 */ \
         poke(WORD(lo, hi), valReg); \
-        cycle(); /* 4 */ \
+        CYCLE(); /* 4 */ \
     } while (0)
 
 // Fix up flags
@@ -471,28 +494,30 @@ void handle_brk_or_illegal(byte op) {
 
         fprintf(stderr, "Instr #: %ju\n", instr_count);
         util_print_state(stderr, current_pc(), &theCpu.regs);
-        exit(3);
+        flight_dump("--die-on-brk");
+        bobbin_exit(3);
     }
     else if (cfg.debug_on_brk) {
         WARN("%s (--debug-on-brk)\n",
              op == 0? "BRK" : "ILLEGAL OP");
+        flight_dump("--debug-on-brk");
         dbg_on();
     }
     else {
         // XXX cycles and behavior not realistic
         //  for non-break unsupported op-codes
         PC_ADV;
-        cycle(); // end 2
+        cpu_cycle(); // end 2
 
         stack_push(HI(PC));
-        cycle(); // 3
+        cpu_cycle(); // 3
         stack_push(LO(PC));
-        cycle(); // 4
+        cpu_cycle(); // 4
         stack_push_flags_or(PMASK(PBRK));
-        cycle(); // 5
+        cpu_cycle(); // 5
 
         byte pcL = peek(VEC_BRK);
-        cycle(); // 6
+        cpu_cycle(); // 6
         byte pcH = peek(VEC_BRK + 1);
         go_to(WORD(pcL, pcH));
         PPUT(PINT,1);
@@ -502,813 +527,94 @@ void handle_brk_or_illegal(byte op) {
             // http://www.6502.org/tutorials/65c02opcodes.html#:~:text=also%20clear%20the%20D%20flag
             PPUT(PDEC,0);
         }
-        cycle(); // 7
+        cpu_cycle(); // 7
     }
 }
 
-bool cpu_step_65C02(byte op, byte immed)
+typedef bool (*opcode_handler)(byte op, byte immed);
+
+static inline void step_finish(byte op, bool handled)
 {
-    /* This function returns true if it found (and handled) an
-       extended 65C02 opcode. Returns false if caller should handle
-       opcode that also exists in 6502. */
-
-    switch (op) {
-        case 0x04: // TSB zp - Test and Set Bits, Zero Page (MOS 65C02 only)
-            OP_RMW_ZP(
-                PPUT(PZERO, (val & ACC) == 0);
-                val |= ACC;
-            );
-            break;
-        case 0x0C: // TSB abs - Test and Set Bits, Absolute (MOS 65C02 only)
-            OP_RMW_ABS(
-                PPUT(PZERO, (val & ACC) == 0);
-                val |= ACC;
-            );
-            break;
-        case 0x12: // ORA (zp) - OR with Accumulator, Zero Page Indirect (MOS 65C02 only)
-            {
-                byte zp_addr = immed;
-                PC_ADV;
-                cycle();
-                byte lo = peek(zp_addr);
-                cycle();
-                byte hi = peek((zp_addr + 1) & 0xFF);
-                cycle();
-                byte val = peek(WORD(lo, hi));
-                ff(ACC |= val);
-                cycle();
-            }
-            break;
-        case 0x14: // TRB zp - Test and Reset Bits, Zero Page (MOS 65C02 only)
-            OP_RMW_ZP(
-                PPUT(PZERO, (val & ACC) == 0);
-                val &= ~ACC;
-            );
-            break;
-        case 0x1A: // INC A (MOS 65C02) / NOP (6502) - ProDOS 2.4.2 uses this to distinguish CPU types
-            OP_RMW_IMPL(ff(++ACC));
-            break;
-        case 0x1C: // TRB abs - Test and Reset Bits, Absolute (MOS 65C02 only)
-            OP_RMW_ABS(
-                PPUT(PZERO, (val & ACC) == 0);
-                val &= ~ACC;
-            );
-            break;
-        case 0x32: // AND (zp) - AND with Accumulator, Zero Page Indirect (MOS 65C02 only)
-            {
-                byte zp_addr = immed;
-                PC_ADV;
-                cycle();
-                byte lo = peek(zp_addr);
-                cycle();
-                byte hi = peek((zp_addr + 1) & 0xFF);
-                cycle();
-                byte val = peek(WORD(lo, hi));
-                ff(ACC &= val);
-                cycle();
-            }
-            break;
-        case 0x34: // BIT zp,X - BIT Zero Page,X (MOS 65C02 only)
-            OP_READ_ZP_IDX(XREG, do_bit(val));
-            break;
-        case 0x3A: // DEC A (MOS 65C02) / NOP (6502)
-            OP_RMW_IMPL(ff(--ACC));
-            break;
-        case 0x3C: // BIT abs,X - BIT Absolute,X (MOS 65C02 only)
-            OP_READ_ABS_IDX(XREG, do_bit(val));
-            break;
-        case 0x52: // EOR (zp) - Exclusive OR, Zero Page Indirect (MOS 65C02 only)
-            {
-                byte zp_addr = immed;
-                PC_ADV;
-                cycle();
-                byte lo = peek(zp_addr);
-                cycle();
-                byte hi = peek((zp_addr + 1) & 0xFF);
-                cycle();
-                byte val = peek(WORD(lo, hi));
-                ff(ACC ^= val);
-                cycle();
-            }
-            break;
-        case 0x5A: // PHY (Push Y) - MOS 65C02 only
-            cycle();
-            stack_push(YREG);
-            cycle();
-            break;
-        case 0x64: // STZ zp - Store Zero, Zero Page (MOS 65C02 only)
-            OP_WRITE_ZP(0);
-            break;
-        case 0x72: // ADC (zp) - Add with Carry, Zero Page Indirect (MOS 65C02 only)
-            {
-                byte zp_addr = immed;
-                PC_ADV;
-                cycle();
-                byte lo = peek(zp_addr);
-                cycle();
-                byte hi = peek((zp_addr + 1) & 0xFF);
-                cycle();
-                byte val = peek(WORD(lo, hi));
-                do_adc(val);
-                cycle();
-            }
-            break;
-        case 0x74: // STZ zp,X - Store Zero, Zero Page,X (MOS 65C02 only)
-            OP_WRITE_ZP_IDX(XREG, 0);
-            break;
-        case 0x7A: // PLY (Pull Y) - MOS 65C02 only
-            {
-                cycle();
-                stack_inc();
-                cycle();
-                YREG = peek(STACK);
-                ff(YREG);
-                cycle();
-            }
-            break;
-        case 0x7C: // JMP (abs,X) - Jump Absolute Indirect Indexed (MOS 65C02 only)
-            {
-                byte lo = immed;
-                PC_ADV;
-                cycle();
-                byte hi = pc_get_adv();
-                cycle();
-                word base_addr = WORD(lo, hi);
-                word addr = base_addr + XREG;
-                cycle();
-                lo = peek(addr);
-                cycle();
-                hi = peek(addr + 1);
-                word dest = WORD(lo, hi);
-                go_to(dest);
-                cycle();
-            }
-            break;
-        case 0x80: // BRA (Branch Always) - MOS 65C02 only
-            OP_BRANCH(true);
-            break;
-        case 0x89: // BIT #imm - BIT Immediate (MOS 65C02 only)
-            OP_READ_IMM(PPUT(PZERO, (ACC & val) == 0));
-            break;
-        case 0x92: // STA (zp) - Store Accumulator, Zero Page Indirect (MOS 65C02 only)
-            {
-                byte zp_addr = immed;
-                PC_ADV;
-                cycle();
-                byte lo = peek(zp_addr);
-                cycle();
-                byte hi = peek((zp_addr + 1) & 0xFF);
-                cycle();
-                poke(WORD(lo, hi), ACC);
-                cycle();
-            }
-            break;
-        case 0x9C: // STZ abs - Store Zero, Absolute (MOS 65C02 only)
-            OP_WRITE_ABS(0);
-            break;
-        case 0x9E: // STZ abs,X - Store Zero, Absolute,X (MOS 65C02 only)
-            OP_WRITE_ABS_IDX(XREG, 0);
-            break;
-        case 0xB2: // LDA (zp) - Load Accumulator, Zero Page Indirect (MOS 65C02 only)
-            {
-                byte zp_addr = immed;
-                PC_ADV;
-                cycle();
-                byte lo = peek(zp_addr);
-                cycle();
-                byte hi = peek((zp_addr + 1) & 0xFF);
-                cycle();
-                byte val = peek(WORD(lo, hi));
-                ff(ACC = val);
-                cycle();
-            }
-            break;
-        case 0xD2: // CMP, (ZP)
-            {
-                byte zp_addr = immed;
-                PC_ADV;
-                cycle();
-                byte lo = peek(zp_addr);
-                cycle();
-                byte hi = peek((zp_addr + 1) & 0xFF);
-                cycle();
-                byte val = peek(WORD(lo, hi));
-                do_cmp(ACC, val);
-                cycle();
-            }
-            break;
-        case 0xDA: // PHX (Push X) - MOS 65C02 only
-            cycle();
-            stack_push(XREG);
-            cycle();
-            break;
-        case 0xF2: // SBC (zp) - Subtract with Borrow, Zero Page Indirect (MOS 65C02 only)
-            {
-                byte zp_addr = immed;
-                PC_ADV;
-                cycle();
-                byte lo = peek(zp_addr);
-                cycle();
-                byte hi = peek((zp_addr + 1) & 0xFF);
-                cycle();
-                byte val = peek(WORD(lo, hi));
-                do_sbc(val);
-                cycle();
-            }
-            break;
-        case 0xFA: // PLX (Pull X) - MOS 65C02 only
-            {
-                cycle();
-                stack_inc();
-                cycle();
-                XREG = peek(STACK);
-                ff(XREG);
-                cycle();
-            }
-            break;
-        default:   // UNRECOGNIZED OPCODE (treat as BRK)
-            return false; // We DID NOT handle
+    if (!handled) {
+        handle_brk_or_illegal(op);
     }
 
-    return true; // handled.
+    ++instr_count;
+}
+
+#define OPS_NAME(n)     n ## _fast
+#define CYCLE()         (++cyc)
+#include "cpu-ops.h"
+#undef OPS_NAME
+#undef CYCLE
+
+#define OPS_NAME(n)     n ## _exact
+#define CYCLE()         cycle_exact()
+#include "cpu-ops.h"
+#undef OPS_NAME
+#undef CYCLE
+
+static MACHINE_LOCAL bool is_65C02;
+
+void cpu_select_machine(void)
+{
+    block_init(); // decoding depends on the opcode set
+    is_65C02 = machine_is_enhanced_iie();
+    if (is_65C02) {
+        for (int i = 0; i != 256; ++i) {
+            optable_65C02_fast[i] = resolve_65C02_fast;
+            optable_65C02_exact[i] = resolve_65C02_exact;
+        }
+    }
 }
 
-bool cpu_step_6502(byte op, byte immed)
+static void (*select_step(void))(void)
 {
-    switch (op) {
-        case 0x01: // ORA, (MEM,x).
-            OP_READ_INDX(ff(ACC |= val));
-            break;
-        case 0x05: // ORA, ZP
-            OP_READ_ZP(ff(ACC |= val));
-            break;
-        case 0x06: // ASL, ZP
-            OP_RMW_ZP(val = do_asl(val));
-            break;
-        case 0x08: // PHP (impl.)
-            cycle();
-            stack_push_flags_or(1 << PBRK);
-            cycle();
-            break;
-        case 0x09: // ORA, immed.
-            OP_READ_IMM(ff(ACC |= immed));
-            break;
-        case 0x0A: // ASL, impl.
-            OP_RMW_IMPL(ACC = do_asl(ACC));
-            break;
-        case 0x0D: // ORA, abs
-            OP_READ_ABS(ff(ACC |= val));
-            break;
-        case 0x0E: // ASL, abs
-            OP_RMW_ABS(val = do_asl(val));
-            break;
-        case 0x10: // BPL
-            OP_BRANCH(!PTEST(PNEG));
-            break;
-        case 0x11: // ORA, (MEM),y
-            OP_READ_INDY(ff(ACC |= val));
-            break;
-        case 0x15: // ORA, ZP,x
-            OP_READ_ZP_IDX(XREG, ff(ACC |= val));
-            break;
-        case 0x16: // ASL, ZP,x
-            OP_RMW_ZP_IDX(XREG, val = do_asl(val));
-            break;
-        case 0x18: // CLC (impl.)
-            OP_RMW_IMPL(PPUT(PCARRY, 0));
-            break;
-        case 0x19: // ORA, MEM,y
-            OP_READ_ABS_IDX(YREG, ff(ACC |= val));
-            break;
-        case 0x1A: // UNDOCUMENTED nop (when 6502). ProDOS 2.4.2 uses it
-                   //  to distinguish CPU types...
-                   //  # cycles/order of ops may be wrong...
-            OP_RMW_IMPL(); // NOP behavior - empty statement
-            break;
-        case 0x1D: // ORA, MEM,x
-            OP_READ_ABS_IDX(XREG, ff(ACC |= val));
-            break;
-        case 0x1E: // ASL, MEM,x
-            OP_RMW_ABS_IDX(XREG, val = do_asl(val));
-            break;
-        case 0x20: // JSR
-            {
-                byte lo = immed;
-                PC_ADV;
-                cycle();
-                (void) stack_get();
-                cycle();
-                stack_push(HI(PC));
-                cycle();
-                stack_push(LO(PC));
-                cycle();
-                word dest = WORD(lo, peek(PC));
-                go_to(dest);
-                cycle();
-            }
-            break;
-        case 0x21: // AND, (MEM,x)
-            OP_READ_INDX(ff(ACC &= val));
-            break;
-        case 0x24: // BIT, ZP
-            OP_READ_ZP(do_bit(val));
-            break;
-        case 0x25: // AND, ZP
-            OP_READ_ZP(ff(ACC &= val));
-            break;
-        case 0x26: // ROL, ZP
-            OP_RMW_ZP(val = do_rol(val));
-            break;
-        case 0x28: // PLP (impl.)
-            {
-                cycle();
-                stack_inc();
-                cycle();
-                byte p = peek(STACK);
-                // BRK and UNUSED must always be set; they're not real
-                //  flags (no associated flip flops)
-                PFLAGS = p | PMASK(PUNUSED) | PMASK(PBRK);
-                cycle();
-            }
-            break;
-        case 0x29: // AND, imm
-            OP_READ_IMM(ff(ACC &= val));
-            break;
-        case 0x2A: // ROL, impl.
-            OP_RMW_IMPL(ACC = do_rol(ACC));
-            break;
-        case 0x2C: // BIT, abs
-            OP_READ_ABS(do_bit(val));
-            break;
-        case 0x2D: // AND, abs
-            OP_READ_ABS(ff(ACC &= val));
-            break;
-        case 0x2E: // ROL, abs
-            OP_RMW_ABS(val = do_rol(val));
-            break;
-        case 0x30: // BMI
-            OP_BRANCH(PTEST(PNEG));
-            break;
-        case 0x31: // AND, (MEM),y
-            OP_READ_INDY(ff(ACC &= val));
-            break;
-        case 0x35: // AND, ZP,x
-            OP_READ_ZP_IDX(XREG, ff(ACC &= val));
-            break;
-        case 0x36: // ROL, ZP,x
-            OP_RMW_ZP_IDX(XREG, val = do_rol(val));
-            break;
-        case 0x38: // SEC (impl.)
-            OP_RMW_IMPL(PPUT(PCARRY, 1));
-            break;
-        case 0x39: // AND, MEM,y
-            OP_READ_ABS_IDX(YREG, ff(ACC &= val));
-            break;
-        case 0x3A: // On 6502, this is an undocumented NOP instruction
-            OP_RMW_IMPL(); // NOP behavior - empty statement
-            break;
-        case 0x3D: // AND, MEM,x
-            OP_READ_ABS_IDX(XREG, ff(ACC &= val));
-            break;
-        case 0x3E: // ROL, MEM,x
-            OP_RMW_ABS_IDX(XREG, val = do_rol(val));
-            break;
-        case 0x40: // RTI
-            {
-                cycle(); // end 2
-                byte p = stack_pop();
-                cycle(); // 3
-                PFLAGS = (p & 0xCF) | PMASK(PUNUSED);
-                byte lo = stack_pop();
-                cycle(); // 4
-                go_to(WORD(lo, HI(PC)));
-                byte hi = stack_pop();
-                cycle(); // 5
-                go_to(WORD(lo, hi));
-                (void) peek(STACK);
-                cycle(); // 6
-            }
-            break;
-        case 0x41: // EOR, (MEM,x)
-            OP_READ_INDX(ff(ACC ^= val));
-            break;
-        case 0x45: // EOR, ZP
-            OP_READ_ZP(ff(ACC ^= val));
-            break;
-        case 0x46: // LSR, ZP
-            OP_RMW_ZP(val = do_lsr(val));
-            break;
-        case 0x48: // PHA
-            cycle();
-            stack_push(ACC);
-            cycle();
-            break;
-        case 0x49: // EOR, imm
-            OP_READ_IMM(ff(ACC ^= val));
-            break;
-        case 0x4A: // LSR, impl.
-            OP_RMW_IMPL(ACC = do_lsr(ACC));
-            break;
-        case 0x4C: // JMP
-            {
-                byte lo = immed;
-                PC_ADV;
-                cycle();
-                byte hi = pc_get_adv();
-                word dest = WORD(lo, hi);
-                go_to(dest);
-                cycle();
-            }
-            break;
-        case 0x4D: // EOR, abs
-            OP_READ_ABS(ff(ACC ^= val));
-            break;
-        case 0x4E: // LSR, abs
-            OP_RMW_ABS(val = do_lsr(val));
-            break;
-        case 0x50: // BVC
-            OP_BRANCH(!PTEST(POVERFL));
-            break;
-        case 0x51: // EOR, (MEM),y
-            OP_READ_INDY(ff(ACC ^= val));
-            break;
-        case 0x55: // EOR, ZP,x
-            OP_READ_ZP_IDX(XREG, ff(ACC ^= val));
-            break;
-        case 0x56: // LSR, ZP,x
-            OP_RMW_ZP_IDX(XREG, val = do_lsr(val));
-            break;
-        case 0x58: // CLI
-            OP_RMW_IMPL(PPUT(PINT, 0));
-            break;
-        case 0x59: // EOR, MEM,y
-            OP_READ_ABS_IDX(YREG, ff(ACC ^= val));
-            break;
-        case 0x5D: // EOR, MEM,x
-            OP_READ_ABS_IDX(XREG, ff(ACC ^= val));
-            break;
-        case 0x5E: // LSR, MEM,x
-            OP_RMW_ABS_IDX(XREG, val = do_lsr(val));
-            break;
-        case 0x60: // RTS
-            {
-                word orig = PC;
-                cycle(); // end 2
-                byte lo = stack_pop();
-                cycle(); // 3
-                go_to(WORD(lo, HI(PC)));
-                (void) stack_pop();
-                cycle(); // 4
-                byte hi = peek(STACK);
-                word dest = WORD(lo, hi);
-                go_to(dest);
-                cycle(); // 5
-                PC_ADV;
-                cycle(); // 6
-            }
-            break;
-        case 0x61: // ADC, (MEM,x)
-            OP_READ_INDX(do_adc(val));
-            break;
-        case 0x65: // ADC, ZP
-            OP_READ_ZP(do_adc(val));
-            break;
-        case 0x66: // ROR, ZP
-            OP_RMW_ZP(val = do_ror(val));
-            break;
-        case 0x68: // PLA
-            cycle();
-            (void) stack_pop();
-            cycle();
-            ff(ACC = peek(STACK));
-            cycle();
-            break;
-        case 0x69: // ADC, imm
-            OP_READ_IMM(do_adc(val));
-            break;
-        case 0x6A: // ROR, impl.
-            OP_RMW_IMPL(ACC = do_ror(ACC));
-            break;
-        case 0x6C: // JMP ()
-            {
-                byte lo = immed;
-                PC_ADV;
-                cycle(); // 2
-                byte hi = pc_get_adv();
-                word addr = WORD(lo,hi);
-                cycle(); // 3
-                lo = peek(addr);
-                cycle(); // 4
-                if (machine_is_enhanced_iie()) {
-                    hi = peek(addr+1);
-                } else {
-                    // 6502 page-crossing BUG!!
-                    hi = peek(WORD(LO(addr+1),HI(addr)));
-                }
-                word dest = WORD(lo, hi);
-                go_to(dest);
-                cycle(); // 5
-            }
-            break;
-        case 0x6D: // ADC, abs
-            OP_READ_ABS(do_adc(val));
-            break;
-        case 0x6E: // ROR, abs
-            OP_RMW_ABS(val = do_ror(val));
-            break;
-        case 0x70: // BVS
-            OP_BRANCH(PTEST(POVERFL));
-            break;
-        case 0x71: // ADC, (MEM),y
-            OP_READ_INDY(do_adc(val));
-            break;
-        case 0x75: // ADC, ZP,x
-            OP_READ_ZP_IDX(XREG, do_adc(val));
-            break;
-        case 0x76: // ROR, ZP,x
-            OP_RMW_ZP_IDX(XREG, val = do_ror(val));
-            break;
-        case 0x78: // SEI
-            OP_RMW_IMPL(PPUT(PINT, 1));
-            break;
-        case 0x79: // ADC MEM,y
-            OP_READ_ABS_IDX(YREG, do_adc(val));
-            break;
-        case 0x7D: // ADC, MEM,x
-            OP_READ_ABS_IDX(XREG, do_adc(val));
-            break;
-        case 0x7E: // ROR, MEM,x
-            OP_RMW_ABS_IDX(XREG, val = do_ror(val));
-            break;
-        case 0x81: // STA, (MEM,x)
-            OP_WRITE_INDX(ACC);
-            break;
-        case 0x84: // STY, ZP
-            OP_WRITE_ZP(YREG);
-            break;
-        case 0x85: // STA, ZP
-            OP_WRITE_ZP(ACC);
-            break;
-        case 0x86: // STX, ZP
-            OP_WRITE_ZP(XREG);
-            break;
-        case 0x88: // DEY
-            OP_RMW_IMPL(ff(--YREG));
-            break;
-        case 0x8A: // TXA
-            OP_RMW_IMPL(ff(ACC = XREG));
-            break;
-        case 0x8C: // STY, abs
-            OP_WRITE_ABS(YREG);
-            break;
-        case 0x8D: // STA, abs
-            OP_WRITE_ABS(ACC);
-            break;
-        case 0x8E: // STX, abs
-            OP_WRITE_ABS(XREG);
-            break;
-        case 0x90: // BCC
-            OP_BRANCH(!PTEST(PCARRY));
-            break;
-        case 0x91: // STA, (MEM),y
-            OP_WRITE_INDY(ACC);
-            break;
-        case 0x94: // STY, ZP,x
-            OP_WRITE_ZP_IDX(XREG, YREG);
-            break;
-        case 0x95: // STA, ZP,x
-            OP_WRITE_ZP_IDX(XREG, ACC);
-            break;
-        case 0x96: // STX, ZP,y
-            OP_WRITE_ZP_IDX(YREG, XREG);
-            break;
-        case 0x98: // TYA
-            OP_RMW_IMPL(ff(ACC = YREG));
-            break;
-        case 0x99: // STA, MEM,y
-            OP_WRITE_ABS_IDX(YREG, ACC);
-            break;
-        case 0x9A: // TXS
-            OP_RMW_IMPL(SP = XREG); // No flag changes!
-            break;
-        case 0x9D: // STA, MEM,x
-            OP_WRITE_ABS_IDX(XREG, ACC);
-            break;
-        case 0xA0: // LDY, immed.
-            OP_READ_IMM(ff(YREG = val));
-            break;
-        case 0xA1: // LDA, (MEM,x)
-            OP_READ_INDX(ff(ACC = val));
-            break;
-        case 0xA2: // LDX, immed.
-            OP_READ_IMM(ff(XREG = val));
-            break;
-        case 0xA4: // LDY, ZP
-            OP_READ_ZP(ff(YREG = val));
-            break;
-        case 0xA5: // LDA, ZP
-            OP_READ_ZP(ff(ACC = val));
-            break;
-        case 0xA6: // LDX, ZP
-            OP_READ_ZP(ff(XREG = val));
-            break;
-        case 0xA8: // TAY
-            OP_RMW_IMPL(ff(YREG = ACC));
-            break;
-        case 0xA9: // LDA, immed.
-            OP_READ_IMM(ff(ACC = val));
-            break;
-        case 0xAA: // TAX
-            OP_RMW_IMPL(ff(XREG = ACC));
-            break;
-        case 0xAC: // LDY, abs
-            OP_READ_ABS(ff(YREG = val));
-            break;
-        case 0xAD: // LDA, abs
-            OP_READ_ABS(ff(ACC = val));
-            break;
-        case 0xAE: // LDX, abs
-            OP_READ_ABS(ff(XREG = val));
-            break;
-        case 0xB0: // BCS
-            OP_BRANCH(PTEST(PCARRY));
-            break;
-        case 0xB1: // LDA, (MEM),y
-            OP_READ_INDY(ff(ACC = val));
-            break;
-        case 0xB4: // LDY, ZP,x
-            OP_READ_ZP_IDX(XREG, ff(YREG = val));
-            break;
-        case 0xB5: // LDA, ZP,x
-            OP_READ_ZP_IDX(XREG, ff(ACC = val));
-            break;
-        case 0xB6: // LDX, ZP,y
-            OP_READ_ZP_IDX(YREG, ff(XREG = val));
-            break;
-        case 0xB8: // CLV
-            OP_RMW_IMPL(PPUT(POVERFL, 0));
-            break;
-        case 0xB9: // LDA, MEM,y
-            OP_READ_ABS_IDX(YREG, ff(ACC = val));
-            break;
-        case 0xBA: // TSX
-            OP_RMW_IMPL(ff(XREG = SP));
-            break;
-        case 0xBC: // LDY MEM,x
-            OP_READ_ABS_IDX(XREG, ff(YREG = val));
-            break;
-        case 0xBD: // LDA MEM,x
-            OP_READ_ABS_IDX(XREG, ff(ACC = val));
-            break;
-        case 0xBE: // LDX MEM,y
-            OP_READ_ABS_IDX(YREG, ff(XREG = val));
-            break;
-        case 0xC0: // CPY, immed.
-            OP_READ_IMM(do_cmp(YREG, val));
-            break;
-        case 0xC1: // CMP, (MEM,x)
-            OP_READ_INDX(do_cmp(ACC, val));
-            break;
-        case 0xC2: // UNDOCUMENTED: NOP, immed.
-            // Used in BITSY.BOOT. Perhaps to distiguish
-            //  a 65816?
-            OP_READ_IMM();
-            break;
-        case 0xC4: // CPY, ZP
-            OP_READ_ZP(do_cmp(YREG, val));
-            break;
-        case 0xC5: // CMP, ZP
-            OP_READ_ZP(do_cmp(ACC, val));
-            break;
-        case 0xC6: // DEC, ZP
-            OP_RMW_ZP(ff(--val));
-            break;
-        case 0xC8: // INY, impl.
-            OP_RMW_IMPL(ff(++YREG));
-            break;
-        case 0xC9: // CMP, immed.
-            OP_READ_IMM(do_cmp(ACC, val));
-            break;
-        case 0xCA: // DEX, immed.
-            OP_RMW_IMPL(ff(--XREG));
-            break;
-        case 0xCC: // CPY, abs.
-            OP_READ_ABS(do_cmp(YREG, val));
-            break;
-        case 0xCD: // CMP, abs.
-            OP_READ_ABS(do_cmp(ACC, val));
-            break;
-        case 0xCE: // DEC, abs.
-            OP_RMW_ABS(ff(--val));
-            break;
-        case 0xD0: // BNE
-            OP_BRANCH(!PTEST(PZERO));
-            break;
-        case 0xD1: // CMP, (MEM),y
-            OP_READ_INDY(do_cmp(ACC, val));
-            break;
-        case 0xD5: // CMP, ZP,x
-            OP_READ_ZP_IDX(XREG, do_cmp(ACC, val));
-            break;
-        case 0xD6: // DEC, ZP,x
-            OP_RMW_ZP_IDX(XREG, ff(--val));
-            break;
-        case 0xD8: // CLD
-            OP_RMW_IMPL(PPUT(PDEC, 0));
-            break;
-        case 0xD9: // CMP, MEM,y
-            OP_READ_ABS_IDX(YREG, do_cmp(ACC, val));
-            break;
-        case 0xDD: // CMP, MEM,x
-            OP_READ_ABS_IDX(XREG, do_cmp(ACC, val));
-            break;
-        case 0xDE: // DEC, MEM,x
-            OP_RMW_ABS_IDX(XREG, ff(--val));
-            break;
-        case 0xE0: // CPX, immed.
-            OP_READ_IMM(do_cmp(XREG, val));
-            break;
-        case 0xE1: // SBC, (MEM,x)
-            OP_READ_INDX(do_sbc(val));
-            break;
-        case 0xE4: // CPX, ZP
-            OP_READ_ZP(do_cmp(XREG, val));
-            break;
-        case 0xE5: // SBC, ZP
-            OP_READ_ZP(do_sbc(val));
-            break;
-        case 0xE6: // INC, ZP
-            OP_RMW_ZP(ff(++val));
-            break;
-        case 0xE8: // INX (impl.)
-            OP_RMW_IMPL(ff(++XREG));
-            break;
-        case 0xE9: // SBC, immed.
-            OP_READ_IMM(do_sbc(val));
-            break;
-        case 0xEA: // NOP
-            OP_RMW_IMPL(); // empty statement
-            break;
-        case 0xEC: // CPX, abs.
-            OP_READ_ABS(do_cmp(XREG, val));
-            break;
-        case 0xED: // SBC, abs.
-            OP_READ_ABS(do_sbc(val));
-            break;
-        case 0xEE: // INC, abs.
-            OP_RMW_ABS(ff(++val));
-            break;
-        case 0xF0: // BEQ
-            OP_BRANCH(PTEST(PZERO));
-            break;
-        case 0xF1: // SBC, (MEM),y
-            OP_READ_INDY(do_sbc(val));
-            break;
-        case 0xF5: // SBC, ZP,x
-            OP_READ_ZP_IDX(XREG, do_sbc(val));
-            break;
-        case 0xF6: // INC, ZP,x
-            OP_RMW_ZP_IDX(XREG, ff(++val));
-            break;
-        case 0xF8: // SED
-            OP_RMW_IMPL(PPUT(PDEC, 1));
-            break;
-        case 0xF9: // SBC, MEM,y
-            OP_READ_ABS_IDX(YREG, do_sbc(val));
-            break;
-        case 0xFD: // SBC, MEM,x
-            OP_READ_ABS_IDX(XREG, do_sbc(val));
-            break;
-        case 0xFE: // INC, MEM,x
-            OP_RMW_ABS_IDX(XREG, ff(++val));
-            break;
-        case 0x00: // BRK
-            handle_brk_or_illegal(op);
-            break;
-        default:
-            return false; // NOT handled.
+    cycle_events = event_has_handlers(EV_CYCLE);
+    if (cycle_events) {
+        return is_65C02? step_65C02_exact : step_6502_exact;
+    } else {
+        return is_65C02? step_65C02_fast : step_6502_fast;
     }
-    return true; // handled.
 }
 
 void cpu_step(void)
 {
-    /* Cycle references taken from https://www.nesdev.org/6502_cpu.txt. */
-    byte op = pc_get_adv();
-    cycle(); // end 1
+    select_step()();
+}
 
-    byte immed = peek(PC);
+void cpu_full_step(void (*step)(void))
+{
+    // Provide hooks the opportunity to alter the PC, here
+    do {
+        current_pc_val = PC;
+        event_fire(EV_PRESTEP);
+        debugger();
+    } while (current_pc_val != PC); // dbgr is allowed to change pc, too
+                                    // and since it was  user-requested,
+                                    // doesn't get count-limited.
+
+    event_fire(EV_STEP);
+    step();
+}
 
-    bool handled = false;
-    if (machine_is_enhanced_iie()) {
-        handled = cpu_step_65C02(op, immed);
-    }
-    if (!handled) {
-        handled = cpu_step_6502(op, immed);
-    }
-    if (!handled) {
-        handle_brk_or_illegal(op);
+void cpu_run(uintmax_t cycle_end)
+{
+    void (*const step)(void) = select_step();
+    while (cycle_count < cycle_end) {
+        sched_run_due();
+        // Run straight through to whichever comes first: the end, or
+        // the next scheduled deadline.
+        uintmax_t next = sched_next();
+        uintmax_t stop = cycle_end;
+        if (next < cycle_base + cycle_end)
+            stop = next - cycle_base;
+        do {
+            if (block_usable()) {
+                block_run(step, stop);
+            } else {
+                cpu_full_step(step);
+            }
+        } while (cycle_count < stop);
     }
-
-    ++instr_count;
 }
@@ -6,37 +6,78 @@
 
 #include "bobbin-internal.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <stdbool.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+// Breakpoints are kept in a list (which gives them their numbers),
+// and also in two bitmaps, so that the per-instruction check is a
+// single lookup: one of PCs to stop at, and one of locations being
+// watched. Watched locations get POKE events; a write to one is
+// noted, and the watchpoints are checked before the next
+// instruction. (Only the CPU's writes go through poke(), so a change
+// made with poke_sneaky() or mem_put(), such as by --load, the
+// debugger, or --fast-cout, isn't seen.) A breakpoint's condition is
+// only looked at once the breakpoint has been hit.
+
+#define MAX_CONDS   4
+
+enum { COND_A, COND_X, COND_Y, COND_SP, COND_P, COND_MEM };
+enum { OP_EQ, OP_NE, OP_LT, OP_LE, OP_GT, OP_GE };
+
+struct bp_cond {
+    int what;
+    word addr;      // for COND_MEM
+    int op;
+    byte val;
+};
+
 typedef struct Breakpoint Breakpoint;
 struct Breakpoint {
     word loc;
     bool is_watchpoint;
     byte val;
     bool enabled;
+    int nconds;
+    struct bp_cond conds[MAX_CONDS];
+    char *cond_text;
     Breakpoint *next;
 };
 
-Breakpoint *bp_head = NULL;
+MACHINE_LOCAL Breakpoint *bp_head = NULL;
+
+static MACHINE_LOCAL byte bp_pcs[0x10000 / 8];
+static MACHINE_LOCAL byte wp_locs[0x10000 / 8];
+static MACHINE_LOCAL bool wp_written = false;
 
-static char linebuf[256];
+#define BIT_ISSET(bits, a)  ((bits)[(a) >> 3] & (1 << ((a) & 7)))
+#define BIT_SET(bits, a)    ((bits)[(a) >> 3] |= (1 << ((a) & 7)))
 
-static bool debugging_flag = false;
-static bool print_message = true;
-static bool go_until_rts = false;
-static bool cont_dest_flag = false;
-static byte stack_min;
-static word cont_dest;
+static MACHINE_LOCAL char linebuf[256];
+
+static MACHINE_LOCAL bool debugging_flag = false;
+static MACHINE_LOCAL bool print_message = true;
+static MACHINE_LOCAL bool go_until_rts = false;
+static MACHINE_LOCAL bool cont_dest_flag = false;
+static MACHINE_LOCAL byte stack_min;
+static MACHINE_LOCAL word cont_dest;
 
 bool debugging(void)
 {
     return debugging_flag;
 }
 
+bool debugger_needs_steps(void)
+{
+    // Breakpoint PCs are declared with event_step_pc(), and watched
+    // writes end the current block, so neither needs every step.
+    return debugging_flag || go_until_rts
+        || cont_dest_flag || sigint_received;
+}
+
 void dbg_on(void)
 {
     event_fire(EV_UNHOOK);
@@ -44,7 +85,132 @@ void dbg_on(void)
     print_message = true;
 }
 
-static void breakpoint_set_(word loc, bool wp)
+static void wp_poke(Event *e)
+{
+    if (e->type == EV_POKE && BIT_ISSET(wp_locs, e->loc)) {
+        wp_written = true;
+        block_stop();
+    }
+}
+
+static void bp_recompute(void)
+{
+    // Take back the PCs declared last time, before declaring afresh.
+    for (unsigned long pc = 0; pc != 0x10000; ++pc) {
+        if (BIT_ISSET(bp_pcs, pc)) event_unstep_pc(pc);
+    }
+    memset(bp_pcs, 0, sizeof bp_pcs);
+    memset(wp_locs, 0, sizeof wp_locs);
+    event_unreghandler(wp_poke);
+    for (Breakpoint *bp = bp_head; bp != NULL; bp = bp->next) {
+        if (!bp->enabled) {
+            // skip this one
+        } else if (bp->is_watchpoint) {
+            BIT_SET(wp_locs, bp->loc);
+            event_reghandler_range(wp_poke, EV_MASK(EV_POKE),
+                                   bp->loc, bp->loc);
+        } else if (!BIT_ISSET(bp_pcs, bp->loc)) {
+            BIT_SET(bp_pcs, bp->loc);
+            event_step_pc(bp->loc);
+        }
+    }
+    // Cached blocks may run right through a new breakpoint.
+    block_invalidate_all();
+}
+
+static bool parse_cond(const char *s, struct bp_cond *c, const char **endp)
+{
+    char *end;
+    while (*s == ' ') ++s;
+    if (!strncasecmp(s, "SP", 2)) {
+        c->what = COND_SP;
+        s += 2;
+    } else if (*s == '[') {
+        c->what = COND_MEM;
+        unsigned long a = strtoul(s+1, &end, 16);
+        if (end == s+1 || *end != ']' || a > 0xFFFF) return false;
+        c->addr = a;
+        s = end + 1;
+    } else {
+        switch (toupper(*s)) {
+            case 'A': c->what = COND_A; break;
+            case 'X': c->what = COND_X; break;
+            case 'Y': c->what = COND_Y; break;
+            case 'P': c->what = COND_P; break;
+            default:  return false;
+        }
+        ++s;
+    }
+
+    while (*s == ' ') ++s;
+    static const struct { const char *str; int op; } ops[] = {
+        // (two-character operators first)
+        {"==", OP_EQ}, {"!=", OP_NE}, {"<=", OP_LE}, {">=", OP_GE},
+        {"=", OP_EQ}, {"<", OP_LT}, {">", OP_GT},
+    };
+    size_t i;
+    for (i = 0; i != sizeof ops / sizeof ops[0]; ++i) {
+        size_t n = strlen(ops[i].str);
+        if (!strncmp(s, ops[i].str, n)) {
+            c->op = ops[i].op;
+            s += n;
+            break;
+        }
+    }
+    if (i == sizeof ops / sizeof ops[0]) return false;
+
+    while (*s == ' ') ++s;
+    if (*s == '$') ++s;
+    unsigned long v = strtoul(s, &end, 16);
+    if (end == s || v > 0xFF) return false;
+    c->val = v;
+    *endp = end;
+    return true;
+}
+
+// Parses "COND [&& COND]...", where COND is, e.g., "A==05",
+// "SP<F0", or "[0300]!=FF" (values in hex).
+static bool parse_conds(const char *s, Breakpoint *bp)
+{
+    bp->nconds = 0;
+    for (;;) {
+        if (bp->nconds == MAX_CONDS) return false;
+        if (!parse_cond(s, &bp->conds[bp->nconds++], &s)) return false;
+        while (*s == ' ') ++s;
+        if (*s == '\0') return true;
+        if (strncmp(s, "&&", 2)) return false;
+        s += 2;
+    }
+}
+
+static bool conds_hold(const Breakpoint *bp)
+{
+    for (int i = 0; i != bp->nconds; ++i) {
+        const struct bp_cond *c = &bp->conds[i];
+        int v;
+        switch (c->what) {
+            case COND_A:    v = ACC; break;
+            case COND_X:    v = XREG; break;
+            case COND_Y:    v = YREG; break;
+            case COND_SP:   v = SP; break;
+            case COND_P:    v = PFLAGS; break;
+            default:        v = peek_sneaky(c->addr); break;
+        }
+        bool ok;
+        switch (c->op) {
+            case OP_EQ: ok = v == c->val; break;
+            case OP_NE: ok = v != c->val; break;
+            case OP_LT: ok = v <  c->val; break;
+            case OP_LE: ok = v <= c->val; break;
+            case OP_GT: ok = v >  c->val; break;
+            default:    ok = v >= c->val; break;
+        }
+        if (!ok) return false;
+    }
+    return true;
+}
+
+static void breakpoint_set_(word loc, bool wp, const char *cond)
 {
     Breakpoint *bp = xalloc(sizeof *bp);
 
@@ -52,6 +218,17 @@ static void breakpoint_set_(word loc, bool wp)
     bp->enabled = true;
     bp->next = NULL;
     bp->is_watchpoint = wp;
+    bp->nconds = 0;
+    bp->cond_text = NULL;
+    if (cond != NULL) {
+        if (!parse_conds(cond, bp)) {
+            printf("ERR: couldn't parse condition \"%s\".\n", cond);
+            free(bp);
+            return;
+        }
+        bp->cond_text = xalloc(strlen(cond) + 1);
+        strcpy(bp->cond_text, cond);
+    }
     if (wp) {
         bp->val = peek_sneaky(loc);
     }
@@ -64,28 +241,37 @@ static void breakpoint_set_(word loc, bool wp)
         for (tail = bp_head; tail->next != NULL; tail = tail->next) {}
         tail->next = bp;
     }
+    bp_recompute();
 
     if (wp) {
-        printf("Watchpoint set for $%04X (cur val is $%02X).\n",
+        printf("Watchpoint set for $%04X (cur val is $%02X)",
                (unsigned int)bp->loc, (unsigned int)bp->val);
     } else {
-        printf("Breakpoint set for $%04X.\n", (unsigned int)bp->loc);
+        printf("Breakpoint set for $%04X", (unsigned int)bp->loc);
     }
+    if (bp->cond_text) {
+        printf(", if %s", bp->cond_text);
+    }
+    puts(".");
 }
 
 void breakpoint_set(word loc)
 {
-    breakpoint_set_(loc, false);
+    breakpoint_set_(loc, false, NULL);
+}
+
+bool breakpoints_set(void)
+{
+    return bp_head != NULL;
 }
 
 void watchpoint_set(word loc)
 {
-    breakpoint_set_(loc, true);
+    breakpoint_set_(loc, true, NULL);
 }
 
 static bool bp_reached(void)
 {
-    byte op = peek_sneaky(current_pc());
     if (go_until_rts && SP >= stack_min) {
         go_until_rts = false;
         event_fire(EV_UNHOOK); // Early, so the below message is visible
@@ -100,28 +286,40 @@ static bool bp_reached(void)
         return true;
     }
 
-    Breakpoint *bp;
     word pc = current_pc();
+    if (!wp_written && !BIT_ISSET(bp_pcs, pc))
+        return false;
+    bool check_watches = wp_written;
+    wp_written = false;
+
+    // Report the first one that fires, but go on updating the
+    // values of the remaining watchpoints.
+    bool fired = false;
+    Breakpoint *bp;
     int i;
     for (bp = bp_head, i = 1; bp != NULL; ++i, bp = bp->next) {
-        byte val = peek_sneaky(bp->loc);
         if (!bp->enabled) {
             // skip this one
-        } else if (bp->is_watchpoint && val != bp->val) {
+        } else if (bp->is_watchpoint) {
+            if (!check_watches) continue;
+            byte val = peek_sneaky(bp->loc);
+            if (val == bp->val) continue;
+            byte old = bp->val;
+            bp->val = val;
+            if (fired || !conds_hold(bp)) continue;
+            fired = true;
             event_fire(EV_UNHOOK); // Early, so the below message is visible
             printf("Watchpoint %d fired:\n", i);
             printf("Value changed at $%04X ($%02X -> $%02X).\n",
-                   (unsigned int)(bp->loc), (unsigned int)bp->val,
+                   (unsigned int)(bp->loc), (unsigned int)old,
                    (unsigned int)val);
-            bp->val = val;
-            return true;
-        } else if (!bp->is_watchpoint && pc == bp->loc) {
+        } else if (!fired && pc == bp->loc && conds_hold(bp)) {
+            fired = true;
             event_fire(EV_UNHOOK); // Early, so the below message is visible
             printf("Breakpoint %d at $%04X.\n", i, current_pc());
-            return true;
         }
     }
-    return false;
+    return fired;
 }
 
 static inline void bp_disable(int num)
@@ -131,6 +329,7 @@ static inline void bp_disable(int num)
     for (bp = bp_head, i = 1; bp != NULL; ++i, bp = bp->next) {
         if (i == num) {
             bp->enabled = false;
+            bp_recompute();
             printf("Breakpoint %d disabled.\n", i);
             return;
         }
@@ -148,6 +347,7 @@ static inline void bp_enable(int num)
             if (bp->is_watchpoint) {
                 bp->val = peek_sneaky(bp->loc);
             }
+            bp_recompute();
             printf("Breakpoint %d enabled.\n", i);
             return;
         }
@@ -155,6 +355,14 @@ static inline void bp_enable(int num)
     printf("ERR: no such breakpoint #%d.\n", num);
 }
 
+// The condition in "b 300 if A==05", or NULL if none.
+static const char *bp_cond_arg(const char *s)
+{
+    while (*s == ' ') ++s;
+    if (strncmp(s, "if ", 3)) return NULL;
+    return s + 3;
+}
+
 static inline void preface_read(word loc)
 {
     printf("\n%04X:", loc);
@@ -257,6 +465,7 @@ void debugger(void)
 
     go_until_rts = false;
     cont_dest_flag = false;
+    until_cancel();
 
     sigint_received = 0;
 
@@ -330,8 +539,9 @@ void debugger(void)
             }
         } else if (linebuf[0] == 'b' && linebuf[1] == ' ') {
             // FIXME: very crude.
-            unsigned long bploc = strtoul(&linebuf[2], NULL, 16);
-            breakpoint_set(bploc);
+            char *end;
+            unsigned long bploc = strtoul(&linebuf[2], &end, 16);
+            breakpoint_set_(bploc, false, bp_cond_arg(end));
         } else if (HAVE("n")) {
             byte op = peek_sneaky(current_pc());
             if (op == 0x20) {
@@ -347,10 +557,11 @@ void debugger(void)
         } else if (linebuf[0] == 'w' && linebuf[1] == ' ') {
             char *end;
             unsigned long dest = strtoul(&linebuf[2], &end, 16);
-            if (*end != '\0') {
+            const char *cond = bp_cond_arg(end);
+            if (*end != '\0' && cond == NULL) {
                 fputs("ERR: Garbage at end of 'w' command.\n", stdout);
             }
-            watchpoint_set(dest);
+            breakpoint_set_(dest, true, cond);
         } else if (memcmp(linebuf, "disable", 7) == 0) {
             if (linebuf[7] == ' ') {
                 char *end;
@@ -373,6 +584,9 @@ void debugger(void)
                 }
                 bp_enable(dest);
             }
+        } else if (!strncmp(linebuf, "until ", 6)) {
+            if (until_start(&linebuf[6]))
+                loop = debugging_flag = false;
         } else if (HAVE("rts")) {
             // Run until stack is two higher than current
             fputs("Continuing until RTS...\n", stdout);
@@ -6,6 +6,7 @@
 
 #include "bobbin-internal.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -21,6 +22,7 @@ struct dlypc_record {
     unsigned long           load_loc;
     int                     jump_loc;
     bool                    basic_fixup;
+    bool                    basic_text; // --run-basic's, to tokenize
 };
 
 // Template record for copying to new records.
@@ -31,188 +33,29 @@ struct dlypc_record initrec = {
     .load_loc = 0,
     .jump_loc = INVALID_LOC,
     .basic_fixup = false,
+    .basic_text = false,
 };
 
-struct dlypc_record *head = NULL;
-struct dlypc_record *tail = NULL;
-struct dlypc_record *cur  = NULL;
+MACHINE_LOCAL struct dlypc_record *head = NULL;
+MACHINE_LOCAL struct dlypc_record *tail = NULL;
+MACHINE_LOCAL struct dlypc_record *cur  = NULL;
 
 /********************/
 
-static bool check_asoft_link(const byte *buf, size_t start, size_t sz,
-                             word w, long *chlenp)
+static void fixup_asoft_ptrs(word load_loc, size_t sz)
 {
-    long chlen;
-    bool val = true;
-    for (chlen = 0; chlen < 65536; ++chlen) {
-        if (w == 0x0000) {
-            val = true;
-            break;
-        } else if (w < start || w > start + sz - sizeof(word)) {
-            val = false;
-            break;
-        } else {
-            // next link
-            w = WORD(buf[w - start], buf[w - start + 1]);
-        }
-    }
-    if (chlen == 65536)
-        chlen = -1;
-    if (val)
-        *chlenp = chlen;
-    return val;
-}
-
-static void adjust_asoft_start(const char *fname, const byte **bufp,
-                               size_t *szp, word load_loc) {
-    /*
-       If we're loading an AppleSoft BASIC file, there is some
-       possibility that the first two bytes are not actually part of
-       the AppleSoft program to load, but are a word representing
-       the size of the file, minus one (= size of program, plus one?)
-       Apparently this is how Apple DOS stores the file, and there
-       are tokenizer programs that output this way.
-
-       In every case where we determine tha word 0 is a file length and
-       not the first BASIC link, we complain with a warning to avoid
-       tokenizers that prefix a file length header word.
-
-       If word zero is not the file length, word zero is the first BASIC
-       link. But check it anyway, and error if it's invalid.
-
-       Otheriwse, if word zero is not a valid BASIC link, then we assume
-       it's a file length and skip it.
-
-       Otherwise, if word zero is a valid BASIC link, and word one is not,
-       we assume word zero is the first BASIC link (and word one is
-       the first line number).
-
-       If both word zero and word one are valid BASIC links, we
-       use word zero, UNLESS it appears to have a loop in the chain
-       while word one doesn't, in which case we use word one.
-
-       The notion of a "valid BASIC link" is determined as:
-         (a) it refers to a memory location that resides within the
-             loaded file's range, or else has the value zero.
-         (b) if it refers to a memory location, the value at that
-             location must itself a valid BASIC link (this definition
-             is recursive)
-       Chain linkage is only followed up to 65,535 links. If linkage
-       exceeds this number (may be a looping chain), it is still
-       considered a "valid BASIC link", but the chain length is reported
-       as -1, for the purposes of comparing chain lengths (see above, in
-       the case where both words zero and one are "valid BASIC links").
-
-       Note that things like backwards-links, or links that jump forward
-       by more than 256 bytes, or line numbers whose values jump around,
-       are not checked (even though it is not normally possible to
-       create such programs), because people do pull shenanigans with
-       the BASIC program representation, and we want to be as permissive
-       as possible.
-
-       It is possible, though unlikely, for a value to be both a valid
-       file length, *and* a valid BASIC link, if the file length is
-       greater than the --load-at location (or default $801), and the
-       value of that file length as a memory pointer just so happens to
-       fall at a valid link.
-
-       It is similarly possible, though unlikely, for a value to be both
-       a valid line number, and a valid BASIC link.
-    */
-    if (*szp < sizeof (word)) {
-        DIE(0, "--load-basic-bin: file \"%s\" has insufficient length (%zu)\n",
-            fname, *szp);
-        DIE(2, "  to be a valid AppleSoft BASIC program binary.\n");
-    }
-
-    INFO("Determining whether AppleSoft program in file \"%s\" begins\n",
-         fname);
-    INFO("  at the first word, or the second.\n");
-
-    bool adjusted = false;
-    const word lenval = (*szp)-1;
-    word w0 = WORD((*bufp)[0], (*bufp)[1]);
-    long w0chain;
-    bool w0valid = check_asoft_link(*bufp, load_loc, *szp,
-                                    w0, &w0chain);
-#define VPFX "    ..."
-    if (w0valid) {
-        VERBOSE(VPFX "word 0 is a valid BASIC chain of length %ld.\n",
-                w0chain);
-    } else {
-        VERBOSE(VPFX "word 0 is not a valid BASIC chain.\n");
-    }
-
-    bool is_lenval = (w0 == lenval);
-    VERBOSE(VPFX "word 0 is%s a valid file length.\n", is_lenval? "" : " not");
-    if (is_lenval) {
-        // Nothing to do yet, futher checking is required.
-    } else if (!w0valid) {
-        // Not the length value, but also not a valid BASIC link. Error.
-        DIE(0, "First word of --load-basic-bin file \"%s\" is neither a\n",
-            fname);
-        DIE(0, "  valid filesize value, nor a valid AppleSoft link!\n");
-        DIE(2, "  Not a valud AppleSoft BASIC program binary.\n");
-    } else {
-        // is not the length value, but is a BASIC link. We have enough info.
-        goto no_adjust;
-    }
-
-    // From here on out, we know word zero was a valid file length!
-
-    long w1chain = -1;
-    bool w1valid =
-        (*szp > 2 * sizeof (word)) // don't read word 1 if it doesn't exist
-        && check_asoft_link(*bufp + sizeof (word), load_loc,
-                            *szp - sizeof (word),
-                            WORD((*bufp)[2], (*bufp)[3]), // w1
-                            &w1chain);
-    if (w1valid) {
-        VERBOSE(VPFX "word 1 is a valid BASIC chain of length %ld.\n",
-                w1chain);
-    } else {
-        VERBOSE(VPFX "word 1 is not a valid BASIC chain.\n");
-    }
-
-    if (w0valid) {
-        // handled further below
-    } else if (!w1valid) {
-        DIE(0, "Neither word 0 nor word 1 are valid AppleSoft BASIC links.\n");
-        DIE(0, "--load-basic-bin file \"%s\" is not an AppleSoft BASIC\n",
-            fname);
-        DIE(2, "  program binary.\n");
-    } else {
-        goto adjust; // word 0 is the length value, is not a valid link.
-    }
-
-    // Okay, both word 0 and word 1 are vaild BASIC links...
-    WARN("AMBIGUOUS BASIC FILE! Word 0 and word 1 of --load-basic-bin\n");
-    WARN("  file \"%s\" are BOTH valid program starts, but word 0\n",
-         fname);
-    WARN("  could ALSO be a valid file length header.\n");
-    WARN("If the program listing appears to be wrong, please use a\n");
-    WARN("  different AppleSoft tokenizer program\n");
-    WARN("  (such as `bobbin --tokenize`), and start with a line\n");
-    WARN("  number below 2000.\n");
-    if (w0chain == -1 && w1chain != -1) {
-        WARN("Using word 1, as word 0 appears to be an infinite chain.\n");
-        goto adjust;
-    }
-    goto no_adjust;
-
-#undef VPFX
-adjust:
-    WARN("file-length prefix detected for AppleSoft binary\n");
-    WARN("  file \"%s\". Please use a tokenizer\n",
-         fname);
-    WARN("  that doesn't write this prefix (such as bobbin --tokenize.\n");
-    adjusted = true;
-    *bufp += 2;
-    *szp -= 2;
-    // fall through
-no_adjust:
-    INFO("Determination: AppleSoft program begins at word %s.\n",
-         adjusted? "one" : "zero");
+    poke_sneaky(ZP_TXTTAB, LO(load_loc)   /* s/b $01 */);
+    poke_sneaky(ZP_TXTTAB+1, HI(load_loc) /* s/b $08 */);
+    byte lo = LO(load_loc + sz);
+    byte hi = HI(load_loc + sz);
+    poke_sneaky(ZP_VARTAB, lo);
+    poke_sneaky(ZP_VARTAB+1, hi);
+    poke_sneaky(ZP_PRGEND, lo);
+    poke_sneaky(ZP_PRGEND+1, hi);
+    poke_sneaky(ZP_ARYTAB, lo);
+    poke_sneaky(ZP_ARYTAB+1, hi);
+    poke_sneaky(ZP_STREND, lo);
+    poke_sneaky(ZP_STREND+1, hi);
 }
 
 static void load_file_into_mem(const char *fname, word load_loc,
@@ -231,7 +74,7 @@ static void load_file_into_mem(const char *fname, word load_loc,
 
     usebuf = allocbuf;
     if (basic_fixup) {
-        adjust_asoft_start(fname, &usebuf, &sz, load_loc);
+        asoft_adjust_start(fname, &usebuf, &sz, load_loc);
     }
 
     if ((sz + load_loc) > (128 * 1024)) {
@@ -253,29 +96,40 @@ static void load_file_into_mem(const char *fname, word load_loc,
     if (basic_fixup) {
         // This was an AppleSoft BASIC file. Fixup some
         // zero-page values.
-        poke_sneaky(ZP_TXTTAB, LO(load_loc)   /* s/b $01 */);
-        poke_sneaky(ZP_TXTTAB+1, HI(load_loc) /* s/b $08 */);
-        byte lo = LO(load_loc + sz);
-        byte hi = HI(load_loc + sz);
-        poke_sneaky(ZP_VARTAB, lo);
-        poke_sneaky(ZP_VARTAB+1, hi);
-        poke_sneaky(ZP_PRGEND, lo);
-        poke_sneaky(ZP_PRGEND+1, hi);
-        poke_sneaky(ZP_ARYTAB, lo);
-        poke_sneaky(ZP_ARYTAB+1, hi);
-        poke_sneaky(ZP_STREND, lo);
-        poke_sneaky(ZP_STREND+1, hi);
+        fixup_asoft_ptrs(load_loc, sz);
         INFO("--load-basic-bin: AppleSoft settings adjusted.\n");
         VERBOSE("BASIC program start = $%X, end = $%X.\n",
                 (unsigned int)(load_loc),
-                (unsigned int)WORD(lo, hi));
+                (unsigned int)(word)(load_loc + sz));
     }
 
     munmap(allocbuf, allocsz);
 }
 
+// --run-basic: tokenizes the program (as if it were typed in at the
+// prompt), and puts it in place.
+static void load_basic_text(const char *fname, word load_loc) {
+    errno = 0;
+    FILE *f = fopen(fname, "r");
+    if (f == NULL) {
+        int err = errno;
+        DIE(1, "--run-basic: Couldn't open \"%s\": %s\n", fname,
+            strerror(err));
+    }
+    size_t sz;
+    byte *prog = asoft_tokenize(f, load_loc, word_at(ZP_MEMSIZE),
+                                ASOFT_COMMENTS | ASOFT_LAST_LINE, &sz);
+    fclose(f);
+    mem_put(prog, load_loc, sz);
+    fixup_asoft_ptrs(load_loc, sz);
+    free(prog);
+    INFO("BASIC Program loaded. Running.\n");
+}
+
 static void process_record(struct dlypc_record *rec) {
-    if (rec->load_fname != NULL)
+    if (rec->basic_text)
+        load_basic_text(rec->load_fname, rec->load_loc);
+    else if (rec->load_fname != NULL)
         load_file_into_mem(rec->load_fname, rec->load_loc, rec->basic_fixup);
     if (rec->jump_loc != INVALID_LOC) {
         INFO("Jumping PC to $%04X (--jump-to).\n",
@@ -299,6 +153,16 @@ static void process_invalids(void)
     }
 }
 
+// The first record that waits for a PC: where --snapshot-cache
+// snapshots.
+static struct dlypc_record *snap_point(void)
+{
+    struct dlypc_record *rec = head;
+    while (rec != NULL && rec->delay_pc == INVALID_LOC)
+        rec = rec->next;
+    return rec;
+}
+
 static void delay_step(Event *e)
 {
     if (e && e->type != EV_PRESTEP)
@@ -310,6 +174,10 @@ static void delay_step(Event *e)
         if (cur->delay_pc != INVALID_LOC) {
             INFO("PC reached trigger at %04X (--delay-until-pc).\n",
                  (unsigned int)cur->delay_pc);
+            if (cur == snap_point()) {
+                snapshot_reached();
+                forksrv_reached();
+            }
         }
         process_record(cur);
         cur = cur->next;
@@ -339,13 +207,14 @@ static void ensure_tail_exists(void)
 /********** External-Linkage Functions **********/
 
 void dlypc_init(void) {
-    event_reghandler(delay_step);
+    event_reghandler_for(delay_step, EV_MASK(EV_PRESTEP) | EV_FLAG_SOME_PCS);
 }
 
 void dlypc_delay_until(word loc) {
     // --delay-pc-until always starts a new "moment"/record
     alloc_rec_at_tail();
     tail->delay_pc = loc;
+    event_step_pc(loc);
 }
 
 void dlypc_load(const char *fname) {
@@ -376,6 +245,14 @@ void dlypc_load_basic(const char *fname) {
     tail->basic_fixup = true;
 }
 
+void dlypc_run_basic(const char *fname) {
+    // Typed in at the first INPUT, as it would be.
+    dlypc_delay_until(MON_KEYIN);
+    dlypc_load(fname);
+    tail->load_loc = LOC_ASOFT_PROG;
+    tail->basic_text = true;
+}
+
 void dlypc_load_at(word loc) {
     ensure_tail_exists();
     tail->load_loc = loc;
@@ -391,6 +268,49 @@ void dlypc_reboot(void) {
     process_invalids();
 }
 
+bool dlypc_has_snap_point(void) {
+    return snap_point() != NULL;
+}
+
+void dlypc_snap_key(void) {
+    struct dlypc_record *point = snap_point();
+    for (struct dlypc_record *rec = head; rec != point; rec = rec->next) {
+        if (rec->load_fname != NULL)
+            snapshot_key_add_file(rec->load_fname);
+        snapshot_key_add(&rec->load_loc, sizeof rec->load_loc);
+        snapshot_key_add(&rec->jump_loc, sizeof rec->jump_loc);
+        snapshot_key_add(&rec->basic_fixup, sizeof rec->basic_fixup);
+        snapshot_key_add(&rec->basic_text, sizeof rec->basic_text);
+    }
+    snapshot_key_add(&point->delay_pc, sizeof point->delay_pc);
+}
+
+void dlypc_snap_restored(void) {
+    cur = snap_point();
+}
+
+bool dlypc_loaded_before_snap_point(const char *fname) {
+    struct dlypc_record *point = snap_point();
+    if (point == NULL) return false; // (there's no boot to wait for)
+    for (struct dlypc_record *rec = head; rec != point; rec = rec->next) {
+        if (rec->load_fname != NULL && STREQ(rec->load_fname, fname))
+            return true;
+    }
+    return false;
+}
+
+void dlypc_warm_reload(void) {
+    if (snap_point() != NULL) {
+        // Back to the point, just before its files were loaded.
+        snapshot_warm_restore();
+    } else {
+        // Everything's loaded before the boot; just load it again,
+        // over the running machine.
+        cur = head;
+        process_invalids();
+    }
+}
+
 // iterator abstraction for traversing the files to be loaded
 struct dlypc_file_iter {
     struct dlypc_record *r;
@@ -8,7 +8,7 @@
 
 #include <stdio.h>
 
-
+MACHINE_LOCAL byte (*disasm_peek)(word loc) = peek_sneaky;
 
 static const char *get_op_mnem_65C02(byte op)
 {
@@ -572,7 +572,7 @@ static void pracc_abs(FILE *f, word addr)
 {
     fprintf(f, "%04X: ", addr);
     for (int i=0; i!=5; ++i) {
-        byte b = peek_sneaky(addr++);
+        byte b = disasm_peek(addr++);
         fprintf(f, " %02X", b);
     }
 }
@@ -581,8 +581,8 @@ static void pracc_zp(FILE *f, byte addr)
 {
     fprintf(f, "%02X: %02X %02X   ",
             addr,
-            peek_sneaky(addr),
-            peek_sneaky(LO(addr+1)));
+            disasm_peek(addr),
+            disasm_peek(LO(addr+1)));
 }
 
 static void print_access(FILE *f, word pc, const Registers *regs,
@@ -611,16 +611,16 @@ static void print_access(FILE *f, word pc, const Registers *regs,
         case T_INDY:
             {
                 pracc_zp(f, m[0]);
-                byte lo = peek_sneaky(m[0]);
-                byte hi = peek_sneaky(m[0]+1);
+                byte lo = disasm_peek(m[0]);
+                byte hi = disasm_peek(m[0]+1);
                 pracc_abs(f, WORD(lo, hi) + regs->y);
             }
             break;
         case T_INDX:
             {
                 pracc_zp(f, LO(m[0] + regs->x));
-                byte lo = peek_sneaky(m[0]);
-                byte hi = peek_sneaky(m[0]+1);
+                byte lo = disasm_peek(m[0]);
+                byte hi = disasm_peek(m[0]+1);
                 pracc_abs(f, WORD(lo, hi));
             }
             break;
@@ -630,8 +630,8 @@ static void print_access(FILE *f, word pc, const Registers *regs,
         case T_ZP_IND:
             {
                 pracc_zp(f, m[0]);
-                byte lo = peek_sneaky(m[0]);
-                byte hi = peek_sneaky(m[0]+1);
+                byte lo = disasm_peek(m[0]);
+                byte hi = disasm_peek(m[0]+1);
                 pracc_abs(f, WORD(lo, hi));
             }
             break;
@@ -639,8 +639,8 @@ static void print_access(FILE *f, word pc, const Registers *regs,
             {
                 word w = WORD(m[0], m[1]) + regs->x;
                 pracc_abs(f, w);
-                byte lo = peek_sneaky(w);
-                byte hi = peek_sneaky(w+1);
+                byte lo = disasm_peek(w);
+                byte hi = disasm_peek(w+1);
                 pracc_abs(f, WORD(lo, hi));
             }
             break;
@@ -649,11 +649,76 @@ static void print_access(FILE *f, word pc, const Registers *regs,
     }
 }
 
+int disasm_refs(word pc, const Registers *regs, DisasmRef refs[3])
+{
+    // Must agree with print_access(), above.
+    byte m[2] = { disasm_peek(pc+1), disasm_peek(pc+2) };
+    int n = 0;
+#define ABS(a)  (refs[n++] = (DisasmRef){ (a), 5, false })
+#define ZP(a)   (refs[n++] = (DisasmRef){ (a), 2, true })
+#define PTR(a)  (refs[n++] = (DisasmRef){ (a), 2, false })
+    switch (get_op_type(disasm_peek(pc))) {
+        case T_ZP:
+            ABS(WORD(m[0], 0));
+            break;
+        case T_ABSOLUTE:
+        case T_JMP_IND:
+            ABS(WORD(m[0], m[1]));
+            break;
+        case T_ZP_X:
+            ABS(WORD(LO(m[0] + regs->x), 0));
+            break;
+        case T_ZP_Y:
+            ABS(WORD(LO(m[0] + regs->y), 0));
+            break;
+        case T_ABS_X:
+            ABS(WORD(m[0], m[1]) + regs->x);
+            break;
+        case T_ABS_Y:
+            ABS(WORD(m[0], m[1]) + regs->y);
+            break;
+        case T_INDY:
+            ZP(m[0]);
+            PTR(m[0]);
+            ABS(WORD(disasm_peek(m[0]), disasm_peek(m[0]+1)) + regs->y);
+            break;
+        case T_INDX:
+            ZP(LO(m[0] + regs->x));
+            PTR(m[0]);
+            ABS(WORD(disasm_peek(m[0]), disasm_peek(m[0]+1)));
+            break;
+        case T_ZP_IND:
+            ZP(m[0]);
+            PTR(m[0]);
+            ABS(WORD(disasm_peek(m[0]), disasm_peek(m[0]+1)));
+            break;
+        case T_JMP_ABS_X_IND:
+            {
+                word w = WORD(m[0], m[1]) + regs->x;
+                ABS(w);
+                ABS(WORD(disasm_peek(w), disasm_peek(w+1)));
+            }
+            break;
+        default:
+            ;
+    }
+#undef ABS
+#undef ZP
+#undef PTR
+    return n;
+}
+
+int disasm_op_len(byte op)
+{
+    int t = get_op_type(op);
+    return t == T_UNKNOWN? 0 : 1 + n_oprnd[t];
+}
+
 word print_disasm(FILE *f, word pc, const Registers *regs)
 {
     byte m[3];
     for (int i=0; i != (sizeof m); ++i) {
-        m[i] = peek_sneaky(pc+i);
+        m[i] = disasm_peek(pc+i);
     }
 
     const char *mnem = get_op_mnem(m[0]);
@@ -0,0 +1,307 @@
+//  embed.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// The library side of ./configure --enable-embed: the API in embed.h,
+// for programs that run machines on threads of their own.
+//
+// In this build, every variable that holds machine state is
+// MACHINE_LOCAL (thread-local), so each thread that calls
+// bobbin_embed_start() gets a separate machine, set up just as
+// bobbin_run() would set one up. What the whole process shares is left
+// alone, and the options that would need it are refused. Rather than
+// the "simple" or "tty" interface, which belong to the process's own
+// terminal, an embedded machine has the "embed" interface, below: keys
+// come from a queue, and COUT output goes to a buffer.
+//
+// A machine that would exit the process (a DIE(), a --trap-success...)
+// stops instead: bobbin_exit() long-jumps back out to the API call that
+// was running it. Whatever the machine was in the middle of is
+// abandoned, so it never runs again; but its memory can still be read.
+
+#include "bobbin-internal.h"
+#include "embed.h"
+
+#include <setjmp.h>
+
+extern void do_config(int, char **);
+
+#define KEYQ_SIZE   1024
+#define OUTQ_SIZE   (64 * 1024)
+
+static MACHINE_LOCAL bool embedded;
+static MACHINE_LOCAL int stop_status = BOBBIN_RUNNING;
+static MACHINE_LOCAL jmp_buf *stop_jmp; // while there's a machine running
+
+static MACHINE_LOCAL int start_argc;
+static MACHINE_LOCAL char **start_argv;
+static MACHINE_LOCAL unsigned long frames_left;
+
+static MACHINE_LOCAL byte keyq[KEYQ_SIZE];
+static MACHINE_LOCAL size_t keyq_head, keyq_tail;
+static MACHINE_LOCAL byte last_key;
+static MACHINE_LOCAL bool key_seen; // only a key that's been read is taken
+
+static MACHINE_LOCAL char outq[OUTQ_SIZE];
+static MACHINE_LOCAL size_t outq_head, outq_used;
+
+void embed_exit(int st)
+{
+    if (stop_jmp == NULL) return;
+    stop_status = st;
+    longjmp(*stop_jmp, 1);
+}
+
+// Runs FN on the machine, unless it's already stopped, and returns
+// BOBBIN_RUNNING, or the status it stopped with.
+static int guarded(void (*fn)(void))
+{
+    jmp_buf jb;
+    if (stop_status != BOBBIN_RUNNING) return stop_status;
+    if (setjmp(jb) == 0) {
+        stop_jmp = &jb;
+        fn();
+    }
+    stop_jmp = NULL;
+    return stop_status;
+}
+
+/********** The "embed" interface **********/
+
+static void embed_output(int c)
+{
+    if (outq_used == OUTQ_SIZE) {
+        // Nobody's fetching; lose the oldest.
+        outq_head = (outq_head + 1) % OUTQ_SIZE;
+        --outq_used;
+    }
+    outq[(outq_head + outq_used) % OUTQ_SIZE] = c;
+    ++outq_used;
+}
+
+static void embed_step(void)
+{
+    if (current_pc() != MON_COUT1) return;
+    int c = util_toascii(ACC);
+    if (c == '\r') {
+        embed_output('\n');
+    } else if (util_isprint(c) || c == '\t' || c == '\b') {
+        embed_output(c);
+    }
+}
+
+static void embed_peek(Event *e)
+{
+    word a = e->loc & 0xFFF0;
+    bool got_key = keyq_head != keyq_tail;
+
+    if (a == SS_KBD) {
+        e->val = got_key? util_fromascii(keyq[keyq_head]) : last_key;
+        key_seen = got_key;
+        iface_kbd_polled(got_key);
+    } else if ((!machine_is_iie() && a == SS_KBDSTROBE)
+               || e->loc == SS_KBDSTROBE) {
+        if (key_seen) {
+            key_seen = false;
+            last_key = util_fromascii(keyq[keyq_head]) & 0x7F;
+            keyq_head = (keyq_head + 1) % KEYQ_SIZE;
+        }
+    }
+}
+
+static void iface_embed_event(Event *e)
+{
+    static const word step_pcs[] = { MON_COUT1 };
+
+    switch (e->type) {
+        case EV_INIT:
+            if (!embedded) {
+                DIE(2, "the \"embed\" interface is only for programs"
+                    " using libbobbin.\n");
+            }
+            event_iface_bus_range(0xC000, 0xC0FF); // keyboard and strobe
+            event_iface_step_pcs(step_pcs, 1);
+            break;
+        case EV_STEP:
+            embed_step();
+            break;
+        case EV_PEEK:
+            embed_peek(e);
+            break;
+        case EV_POKE:
+            if ((e->loc & 0xFFF0) == SS_KBDSTROBE) {
+                Event pe = { .type = EV_PEEK, .loc = SS_KBDSTROBE };
+                embed_peek(&pe);
+            }
+            break;
+        default:
+            ; // Nothing
+    }
+}
+
+IfaceDesc embedInterface = {
+    .event = iface_embed_event,
+};
+
+/********** The API **********/
+
+// Options that depend on what the whole process shares.
+static void refuse_options(void)
+{
+    const char *opt =
+        cfg.interface && !STREQ(cfg.interface, "embed")? "--iface"
+        : cfg.inputfile?            "--input"
+        : cfg.outputfile?           "--output"
+        : cfg.runbasicfile?         "--run-basic"
+        : cfg.tokenize?             "--tokenize"
+        : cfg.detokenize?           "--detokenize"
+        : cfg.decode_trace?         "--decode-trace"
+        : cfg.remain_after_pipe?    "--remain"
+        : cfg.remain_tty?           "--remain-tty"
+        : cfg.bot_mode?             "--bot-mode"
+        : cfg.trap_print_on?        "--trap-print"
+        : cfg.debug_on_brk?         "--debug-on-brk"
+        : breakpoints_set()?        "--breakpoint"
+        : cfg.uthernet2_set?        "--uthernet2"
+        : cfg.trace_binary?         "--trace-binary"
+        : cfg.bench_frames?         "--bench"
+        : cfg.stats?                "--stats"
+        : cfg.profile_file?         "--profile"
+        : cfg.coverage_file?        "--coverage"
+        : cfg.watch?                "--watch"
+        : cfg.screen_shm?           "--screen-shm"
+        : cfg.control_socket?       "--control-socket"
+        : cfg.fork_server?          "--fork-server"
+        : cfg.fork_job?             "--fork-job"
+        : cfg.disk_overlay_commit?  "--disk-overlay-commit"
+        : NULL;
+    if (opt) {
+        DIE(2, "%s can't be used by an embedded machine.\n", opt);
+    }
+}
+
+// As bobbin_run() does, less what only a whole process does.
+static void start(void)
+{
+    events_init();
+    dlypc_init();
+    do_config(start_argc, start_argv);
+    refuse_options();
+    cfg.interface = "embed";
+
+    machine_init();
+    hooks_init();
+    interfaces_init();
+    periph_init();
+    mem_init();
+    snapshot_init();
+    dlypc_reboot();
+    interfaces_start();
+    flight_init();
+    event_fire(EV_RESET);
+    snapshot_boot();
+}
+
+int bobbin_embed_start(int argc, char **argv)
+{
+    if (embedded) {
+        fprintf(stderr, "%s: bobbin_embed_start() called twice on one"
+                " thread.\n", program_name);
+        return 2;
+    }
+    embedded = true;
+    program_name = argc > 0? argv[0] : "bobbin";
+    // (do_config() moves the argv pointers past each option's dashes.)
+    start_argc = argc;
+    start_argv = xalloc((argc + 1) * sizeof *argv);
+    memcpy(start_argv, argv, argc * sizeof *argv);
+    start_argv[argc] = NULL;
+    return guarded(start);
+}
+
+static void run_frames(void)
+{
+    for (; frames_left != 0; --frames_left) {
+        bobbin_frame();
+    }
+}
+
+int bobbin_embed_run(unsigned long frames)
+{
+    frames_left = frames;
+    return guarded(run_frames);
+}
+
+void bobbin_embed_keys(const char *keys, size_t n)
+{
+    for (size_t i = 0; i != n; ++i) {
+        size_t next = (keyq_tail + 1) % KEYQ_SIZE;
+        if (next == keyq_head) {
+            WARN("embedded key queue full, dropping character\n");
+            continue;
+        }
+        keyq[keyq_tail] = keys[i] == '\r'? '\n' : keys[i];
+        keyq_tail = next;
+    }
+}
+
+size_t bobbin_embed_output(char *buf, size_t sz)
+{
+    size_t n = 0;
+    for (; n != sz && outq_used != 0; ++n, --outq_used) {
+        buf[n] = outq[outq_head];
+        outq_head = (outq_head + 1) % OUTQ_SIZE;
+    }
+    return n;
+}
+
+void bobbin_embed_peek(uint16_t addr, void *buf, size_t n)
+{
+    byte *p = buf;
+    for (size_t i = 0; i != n; ++i) {
+        p[i] = peek_sneaky(addr + i);
+    }
+}
+
+static MACHINE_LOCAL const void *poke_buf;
+static MACHINE_LOCAL uint16_t poke_addr;
+static MACHINE_LOCAL size_t poke_n;
+
+static void do_poke(void)
+{
+    mem_poke_buf(poke_buf, poke_addr, poke_n);
+}
+
+void bobbin_embed_poke(uint16_t addr, const void *buf, size_t n)
+{
+    // (A write to a soft switch can set a machine off on anything.)
+    poke_buf = buf;
+    poke_addr = addr;
+    poke_n = n;
+    (void) guarded(do_poke);
+}
+
+uint64_t bobbin_embed_cycles(void)
+{
+    return cycles_now();
+}
+
+uint32_t bobbin_embed_screen(char text[24][80])
+{
+    uint32_t flags;
+    const byte *rgb;
+    int w, h;
+    return screen_current(&flags, text, &rgb, &w, &h);
+}
+
+int bobbin_embed_save_state(const char *fname)
+{
+    return snapshot_save_file(fname);
+}
+
+int bobbin_embed_load_state(const char *fname)
+{
+    return snapshot_load_file(fname);
+}
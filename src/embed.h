@@ -0,0 +1,79 @@
+//  embed.h
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// API of libbobbin.a (built with ./configure --enable-embed), for
+// programs that run emulated Apple IIs themselves, rather than running
+// bobbin. This header has no dependencies on the rest of bobbin.
+//
+// Each thread of the program may run one machine. Every call below
+// acts on the calling thread's machine; machines on different threads
+// share nothing, and need no locking. A machine can't move between
+// threads, and lasts as long as its thread does.
+//
+//      bobbin_embed_start(argc, argv); // options, as for bobbin
+//      bobbin_embed_keys("PRINT 6*7\r", 10);
+//      while (bobbin_embed_run(1) == BOBBIN_RUNNING) {
+//          n = bobbin_embed_output(buf, sizeof buf);
+//          ...
+//      }
+//
+// Options that work through something the whole process shares (stdin
+// and stdout, the terminal, sockets, files written at exit, the
+// --uthernet2 network thread) are refused. Messages, and the reason for
+// a machine that has stopped, go to stderr, as bobbin's would.
+//
+// Link with libbobbin.a, and the libraries bobbin itself was linked
+// with (for instance, -lbobbin -lcurses -lpthread).
+
+#ifndef BOBBIN_EMBED_H
+#define BOBBIN_EMBED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BOBBIN_RUNNING  (-1)
+
+// Sets up this thread's machine from bobbin's command-line options
+// (argv[0] is the name to use in messages), and resets it. Returns
+// BOBBIN_RUNNING, or an exit status >= 0 if the options were bad, or the
+// machine stopped while starting up.
+extern int bobbin_embed_start(int argc, char **argv);
+
+// Runs the machine for FRAMES video frames (60 to an emulated second;
+// with no pause for the real-time clock). Returns BOBBIN_RUNNING, or,
+// once it has stopped (for a --trap-success, say, or an error), the
+// exit status bobbin would have exited with.
+extern int bobbin_embed_run(unsigned long frames);
+
+// Types KEYS on the keyboard; '\r' or '\n' is RETURN. Keys are
+// queued, and read by the machine one at a time, as it's ready for them.
+extern void bobbin_embed_keys(const char *keys, size_t n);
+
+// Fetches (as ASCII, with '\n' for RETURN) up to SZ characters the
+// machine has printed through the firmware's COUT routine since the
+// last call, and returns how many. The oldest is lost if more than
+// 64K go unfetched.
+extern size_t bobbin_embed_output(char *buf, size_t sz);
+
+// Memory, as the CPU sees it. Peeks have no soft-switch side effects;
+// pokes do, as a write by the CPU would (and so a machine that has
+// stopped ignores them).
+extern void bobbin_embed_peek(uint16_t addr, void *buf, size_t n);
+extern void bobbin_embed_poke(uint16_t addr, const void *buf, size_t n);
+
+// Cycles emulated since the machine started (1.023MHz).
+extern uint64_t bobbin_embed_cycles(void);
+
+// Fills in the text page as it appears on the screen now, and returns
+// the video mode (SCREEN_TEXT40, etc., as in screen-shm.h).
+extern uint32_t bobbin_embed_screen(char text[24][80]);
+
+// Saves or restores the machine's entire state (as the debugger's
+// save-state and load-state do). Return 0, or an errno value.
+extern int bobbin_embed_save_state(const char *fname);
+extern int bobbin_embed_load_state(const char *fname);
+
+#endif // BOBBIN_EMBED_H
@@ -8,115 +8,197 @@
 
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
-struct timedfn {
-    void (*fn)(void);
-    unsigned int frames_left;
-    struct timedfn *next;
+struct handler {
+    event_handler fn;
+    byte pages[256/8];
+        /* For PEEK and POKE: the address pages this handler wants
+           to receive bus events for. */
+    bool all_pcs;
+        /* For PRESTEP and STEP: false if the handler only cares about
+           the PCs it has declared via event_step_pc(). */
+    struct handler *next;
 };
-struct timedfn *tmhead = NULL;
-bool timer_access = false;
-
-void frame_timer_cancel(void (*fn)(void))
-{
-    assert(!timer_access);
-    timer_access = true;
-    struct timedfn *p;
-    struct timedfn **prevnext = &tmhead;
-    for (p = tmhead; p != NULL; p = p->next) {
-        if (p->fn == fn) {
-            *prevnext = p->next;
-            free(p);
-            break;
+
+// One handler list per event type, so that firing an event only ever
+// visits the handlers that actually asked for it.
+static MACHINE_LOCAL struct handler *heads[EV_NUM_TYPES];
+
+// Pages the interface wants for PEEK and POKE.
+static MACHINE_LOCAL byte iface_pages[256];
+static MACHINE_LOCAL bool iface_pages_set;
+
+// PCs that someone needs PRESTEP/STEP events at, for --block-cache,
+// and how many have asked for each (sticking at 255).
+static MACHINE_LOCAL byte step_pcs[0x10000 / 8];
+static MACHINE_LOCAL byte step_pc_refs[0x10000];
+static MACHINE_LOCAL bool iface_step_all;
+static MACHINE_LOCAL bool handlers_step_all;
+
+// Nonzero for each page that some handler (or the interface) wants
+// PEEK/POKE events for. peek() and poke() check this before firing.
+MACHINE_LOCAL byte event_bus_pages[256];
+
+MACHINE_LOCAL uintmax_t event_count;
+
+static const Event evinit = {
+    .suppress = false,
+    .val = -1,
+};
+
+static inline bool page_isset(const byte *bits, byte pg)
+{
+    return (bits[pg >> 3] & (1 << (pg & 7))) != 0;
+}
+
+static void bus_pages_recompute(void)
+{
+    for (int pg = 0; pg != 256; ++pg) {
+        bool want = iface_pages[pg];
+        for (int t = EV_PEEK; !want && t <= EV_POKE; ++t) {
+            for (struct handler *h = heads[t]; h != NULL; h = h->next) {
+                if (page_isset(h->pages, pg)) {
+                    want = true;
+                    break;
+                }
+            }
         }
-        prevnext = &p->next;
+        event_bus_pages[pg] = want;
     }
-    timer_access = false;
-    return;
 }
 
-static struct timedfn *frame_timer_reset_(unsigned int time, void (*fn)(void))
+static void step_all_recompute(void)
 {
-    struct timedfn *p;
-    for (p = tmhead; p != NULL; p = p->next) {
-        if (p->fn == fn) {
-            p->frames_left = time;
-            break;
+    handlers_step_all = false;
+    for (int t = EV_PRESTEP; t <= EV_STEP; ++t) {
+        for (struct handler *h = heads[t]; h != NULL; h = h->next) {
+            if (h->all_pcs) handlers_step_all = true;
         }
     }
-    return p;
 }
 
-void frame_timer_reset(unsigned int time, void (*fn)(void))
+void events_init(void)
 {
-    (void) frame_timer_reset_(time, fn);
+    // No-op for now
 }
 
-void frame_timer(unsigned int time, void (*fn)(void))
+void event_reghandler_range(event_handler fn, unsigned long mask,
+                            word start, word end)
 {
-    // Try to reset timer if it exists
-    struct timedfn *p = frame_timer_reset_(time, fn);
-
-    // Otherwise, create
-    if (p == NULL) {
-        struct timedfn *newtm = xalloc(sizeof *newtm);
-        newtm->fn = fn;
-        newtm->frames_left = time;
-        newtm->next = tmhead;
-        tmhead = newtm;
+    for (int t = 0; t != EV_NUM_TYPES; ++t) {
+        if (!(mask & EV_MASK(t))) continue;
+        struct handler *h;
+        for (h = heads[t]; h != NULL && h->fn != fn; h = h->next)
+            ;
+        if (h == NULL) {
+            h = xalloc(sizeof *h);
+            h->fn = fn;
+            memset(h->pages, 0, sizeof h->pages);
+            h->all_pcs = !(mask & EV_FLAG_SOME_PCS);
+            h->next = heads[t];
+            heads[t] = h;
+        }
+        for (unsigned int pg = start >> 8; pg <= (end >> 8); ++pg) {
+            h->pages[pg >> 3] |= 1 << (pg & 7);
+        }
+    }
+    if (mask & EV_MASK_BUS) {
+        bus_pages_recompute();
     }
+    step_all_recompute();
 }
 
-void frame_timer_countdown(void)
+void event_reghandler_for(event_handler fn, unsigned long mask)
 {
-    struct timedfn *p;
-    struct timedfn **prevnext = &tmhead;
-    for (p = tmhead; p != NULL; ) {
-        if (--(p->frames_left) == 0) {
-            p->fn();
-            *prevnext = p->next;
-            free(p);
-            p = *prevnext;
-        } else {
-            prevnext = &(p->next);
-            p = *prevnext;
+    event_reghandler_range(fn, mask, 0x0000, 0xFFFF);
+}
+
+void event_reghandler(event_handler fn)
+{
+    event_reghandler_for(fn, EV_MASK_DEFAULT);
+}
+
+void event_unreghandler(event_handler fn)
+{
+    for (int t = 0; t != EV_NUM_TYPES; ++t) {
+        struct handler **prevnext = &heads[t];
+        while (*prevnext != NULL) {
+            struct handler *h = *prevnext;
+            if (h->fn == fn) {
+                *prevnext = h->next;
+                free(h);
+            } else {
+                prevnext = &h->next;
+            }
         }
     }
+    bus_pages_recompute();
+    step_all_recompute();
 }
 
-struct handler {
-    event_handler fn;
-    struct handler *next;
-};
+void event_step_pc(word pc)
+{
+    if (step_pc_refs[pc] != 0xFF) ++step_pc_refs[pc];
+    step_pcs[pc >> 3] |= 1 << (pc & 7);
+}
 
-static struct handler *head = NULL;
+void event_unstep_pc(word pc)
+{
+    if (step_pc_refs[pc] == 0 || step_pc_refs[pc] == 0xFF) return;
+    if (--step_pc_refs[pc] == 0)
+        step_pcs[pc >> 3] &= ~(1 << (pc & 7));
+}
 
-static const Event evinit = {
-    .suppress = false,
-    .val = -1,
-};
+bool event_step_pc_wanted(word pc)
+{
+    return (step_pcs[pc >> 3] & (1 << (pc & 7))) != 0;
+}
 
-void events_init(void)
+bool event_step_everywhere(void)
 {
-    // No-op for now
+    return iface_step_all || handlers_step_all;
 }
 
-void event_reghandler(event_handler fn)
+void event_iface_reset(void)
 {
-    struct handler *h = xalloc(sizeof *h);
-    h->fn = fn;
-    h->next = head;
-    head = h;
+    memset(iface_pages, 0, sizeof iface_pages);
+    iface_pages_set = false;
+    iface_step_all = true;
+    bus_pages_recompute();
 }
 
-void event_unreghandler(event_handler h)
+void event_iface_bus_range(word start, word end)
 {
-    // XXX Currently unimplemented
+    memset(&iface_pages[start >> 8], 1, (end >> 8) - (start >> 8) + 1);
+    iface_pages_set = true;
+    bus_pages_recompute();
 }
 
-void dispatch(Event *e)
+void event_iface_step_pcs(const word *pcs, size_t n)
+{
+    for (size_t i = 0; i != n; ++i) {
+        event_step_pc(pcs[i]);
+    }
+    iface_step_all = false;
+}
+
+void event_iface_defaults(void)
+{
+    // An interface that didn't say which pages it wants, gets them all.
+    if (!iface_pages_set)
+        event_iface_bus_range(0x0000, 0xFFFF);
+}
+
+bool event_has_handlers(EventType type)
+{
+    return heads[type] != NULL;
+}
+
+static void dispatch(Event *e)
 {
     struct handler *h;
+    ++event_count;
     if (e->type == EV_PRESTEP) {
         word pc;
         const unsigned int max_count = 100;
@@ -126,12 +208,21 @@ void dispatch(Event *e)
                 DIE(1,"PC changed during prestep %u times!\n", max_count);
             }
             pc = PC;
-            for (h = head; pc == PC && h != NULL; h = h->next) {
+            for (h = heads[EV_PRESTEP]; pc == PC && h != NULL; h = h->next) {
+                STAT_INC(handlers_visited);
                 h->fn(e);
             }
         } while (pc != PC);
+    } else if (e->type == EV_PEEK || e->type == EV_POKE) {
+        byte pg = e->loc >> 8;
+        for (h = heads[e->type]; h != NULL; h = h->next) {
+            STAT_INC(handlers_visited);
+            if (page_isset(h->pages, pg))
+                h->fn(e);
+        }
     } else {
-        for (h = head; h != NULL; h = h->next) {
+        for (h = heads[e->type]; h != NULL; h = h->next) {
+            STAT_INC(handlers_visited);
             h->fn(e);
         }
     }
@@ -144,9 +235,8 @@ static bool for_iface_only(EventType t)
 
 void event_fire(EventType type)
 {
-    Event *e = xalloc(sizeof *e);
-    *e = evinit;
-    e->type = type;
+    Event e = evinit;
+    e.type = type;
 
     // special handling
     switch (type) {
@@ -158,6 +248,7 @@ void event_fire(EventType type)
                             // adjust, as this must happen after any
                             // cpu_reset() does, else --jump-to may
                             // get ignored.
+            snapshot_boot();
             event_fire(EV_DISPLAY_TOUCH);
         }
             break;
@@ -171,82 +262,86 @@ void event_fire(EventType type)
             ;
     }
 
-    iface_fire(e);
+    iface_fire(&e);
 
-    if (!(e->type == EV_FRAME || e->type == EV_CYCLE // dispatched specially
-          || for_iface_only(e->type))) {
-        dispatch(e);
-    }
-    if (e->type == EV_FRAME) {
-        frame_timer_countdown();
+    if (!for_iface_only(e.type)) {
+        dispatch(&e);
     }
 
     if (type == EV_STEP) {
         // Not allowed to change PC in STEP, PEEK, POKE events...
         assert(PC == current_pc());
     }
+}
 
-    free(e);
+// Fill in the aux/acctype details of a PEEK or POKE, but only if
+// someone is going to look at them: mem_get_true_access() is far
+// too costly to run on every bus access for nothing.
+static void resolve_access(Event *e, bool wr)
+{
+    if (heads[e->type] == NULL && !iface_wants_access_detail())
+        return;
+    size_t bufloc; // throw-away
+    mem_get_true_access(e->loc, wr, &bufloc, &e->aux, &e->acctype);
+    e->aloc = e->loc | (e->aux? LOC_AUX_START : 0);
 }
 
 int event_fire_peek(word loc)
 {
-    Event *e = xalloc(sizeof *e);
-    *e = evinit;
-    e->type = EV_PEEK;
-    e->loc = loc;
-    size_t bufloc; // throw-away
-    mem_get_true_access(loc, false, &bufloc, &e->aux, &e->acctype);
-    e->aloc = loc | (e->aux? LOC_AUX_START : 0);
+    Event e = evinit;
+    e.type = EV_PEEK;
+    e.loc = e.aloc = loc;
+    STAT_INC(peek_events);
+    resolve_access(&e, false);
     word pc = PC; // may not eq current_instruction, if we're in the midst
                   //  of some CPU thing
-    iface_fire(e);
-    dispatch(e);
+    if (iface_pages[loc >> 8])
+        iface_fire(&e);
+    dispatch(&e);
     assert(pc == PC);
-    int val = e->val;
-    free(e);
-    return val;
+    return e.val;
 }
 
 bool event_fire_poke(word loc, byte val)
 {
-    Event *e = xalloc(sizeof *e);
-    *e = evinit;
-    e->type = EV_POKE;
-    e->loc = loc;
-    size_t bufloc; // throw-away
-    mem_get_true_access(loc, true, &bufloc, &e->aux, &e->acctype);
-    e->aloc = loc | (e->aux? LOC_AUX_START : 0);
-    e->val = val;
+    Event e = evinit;
+    e.type = EV_POKE;
+    e.loc = e.aloc = loc;
+    STAT_INC(poke_events);
+    resolve_access(&e, true);
+    e.val = val;
     word pc = PC; // may not eq current_instruction, if we're in the midst
                   //  of some CPU thing
-    iface_fire(e);
-    dispatch(e);
+    if (iface_pages[loc >> 8])
+        iface_fire(&e);
+    dispatch(&e);
     assert(pc == PC);
-    bool suppress = e->suppress;
-    free(e);
-    return suppress;
+    return e.suppress;
 }
 
 void event_fire_disk_active(int val)
 {
-    Event *e = xalloc(sizeof *e);
-    *e = evinit;
-    e->type = EV_DISK_ACTIVE;
-    e->val = val;
+    Event e = evinit;
+    e.type = EV_DISK_ACTIVE;
+    e.val = val;
+
+    iface_fire(&e);
+}
 
-    iface_fire(e);
-    free(e);
+void event_fire_cycle(void)
+{
+    // Not sent to interfaces: only to handlers that asked for it.
+    Event e = evinit;
+    e.type = EV_CYCLE;
+    dispatch(&e);
 }
 
 void event_fire_switch(SoftSwitchFlagPos f)
 {
-    Event *e = xalloc(sizeof *e);
-    *e = evinit;
-    e->type = EV_SWITCH;
-    e->val = f;
+    Event e = evinit;
+    e.type = EV_SWITCH;
+    e.val = f;
 
-    iface_fire(e);
-    dispatch(e);
-    free(e);
+    iface_fire(&e);
+    dispatch(&e);
 }
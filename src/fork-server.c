@@ -0,0 +1,420 @@
+//  fork-server.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// --fork-server: boot once, then fork() a copy of the ready machine for
+// each job, so that a job starts in about the time a fork takes, rather
+// than re-reading ROMs and disks and booting. Memory and ROM are
+// shared copy-on-write with the server; so are the disk images, since
+// the server turns on --disk-overlay (or every job would be writing
+// the same image files at once).
+//
+// The server listens on a Unix-domain socket from startup; clients that
+// connect before the machine is ready just wait in the backlog. Once
+// the first --delay-until point is reached, the server stops there, and
+// accepts jobs.
+//
+// A job is sent (by `bobbin --fork-job`) as one message carrying the
+// client's stdin, stdout and stderr (SCM_RIGHTS), and a u32
+// (little-endian) length followed by that many bytes of options, each
+// NUL-terminated, as they'd be given on the command line. The server
+// forks; the child takes the descriptors as its own, adds the job's
+// options to the --delay-until list, and carries on from the ready point.
+// When the child exits, the server sends back its exit status (128 plus
+// the signal number, if killed) as a u32, and closes the connection.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#define MAX_JOB_ARGS    0x10000
+
+struct job {
+    struct job *    next;
+    pid_t           pid;
+    int             conn;   // to the client, for the exit status
+};
+
+static int listen_fd = -1;
+static pid_t server_pid;
+static struct job *jobs;
+static int child_pipe[2] = { -1, -1 };  // signals wake the server
+static volatile sig_atomic_t stop_received;
+
+static void put32(byte *p, unsigned long v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+static unsigned long get32(const byte *p)
+{
+    return p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16)
+        | ((unsigned long)p[3] << 24);
+}
+
+static bool read_all(int fd, byte *buf, size_t len)
+{
+    while (len) {
+        ssize_t n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool write_all(int fd, const byte *buf, size_t len)
+{
+    while (len) {
+        ssize_t n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        buf += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void forksrv_at_exit(void)
+{
+    // (Every job inherits this; only the server should remove the socket.)
+    if (getpid() == server_pid)
+        (void) unlink(cfg.fork_server);
+}
+
+static void handle_chld(int s)
+{
+    int saved = errno;
+    (void) write(child_pipe[1], "", 1);
+    errno = saved;
+}
+
+static void handle_stop(int s)
+{
+    stop_received = true;
+    handle_chld(s);
+}
+
+static void set_addr(struct sockaddr_un *addr, const char *path,
+                     const char *opt)
+{
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof addr->sun_path) {
+        DIE(2, "--%s: path too long: \"%s\"\n", opt, path);
+    }
+    strcpy(addr->sun_path, path);
+}
+
+void forksrv_init(void)
+{
+    if (cfg.fork_server == NULL) return;
+
+    if (!dlypc_has_snap_point()) {
+        DIE(2, "--fork-server needs a --delay-until point, to serve from.\n");
+    }
+    // (Nor with --trace-binary: a forked job wouldn't have its
+    // writer thread.)
+    if (cfg.watch || cfg.control_socket || cfg.screen_shm
+        || cfg.uthernet2_thread || cfg.disk_overlay_commit
+        || cfg.trace_binary) {
+        DIE(2, "--fork-server can't be used with --watch, --control-socket,"
+            " --screen-shm,\n  --uthernet2-thread, --disk-overlay-commit"
+            " or --trace-binary.\n");
+    }
+
+    // Each job's disk writes are its own. (The images haven't been
+    // opened yet.)
+    cfg.disk_overlay = true;
+
+    struct sockaddr_un addr;
+    set_addr(&addr, cfg.fork_server, "fork-server");
+    errno = 0;
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        DIE(1, "--fork-server: couldn't create socket: %s\n",
+            strerror(errno));
+    }
+    (void) unlink(cfg.fork_server);
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof addr) < 0
+        || listen(listen_fd, SOMAXCONN) < 0) {
+        DIE(1, "--fork-server: couldn't listen on \"%s\": %s\n",
+            cfg.fork_server, strerror(errno));
+    }
+    server_pid = getpid();
+    atexit(forksrv_at_exit);
+}
+
+static void reap_jobs(void)
+{
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        unsigned long code = WIFEXITED(status)? WEXITSTATUS(status)
+            : WIFSIGNALED(status)? 128 + WTERMSIG(status) : 1;
+        for (struct job **jp = &jobs; *jp != NULL; jp = &(*jp)->next) {
+            struct job *j = *jp;
+            if (j->pid != pid) continue;
+            byte buf[4];
+            put32(buf, code);
+            (void) write_all(j->conn, buf, sizeof buf);
+            close(j->conn);
+            *jp = j->next;
+            free(j);
+            break;
+        }
+    }
+}
+
+// Reads a job from CONN: its descriptors into FDS, and its options,
+// which point into *BUFP. Returns NULL if the client didn't send a
+// proper job.
+static char **recv_job(int conn, int fds[3], char **bufp)
+{
+    byte lenbuf[4];
+    struct iovec iov = { .iov_base = lenbuf, .iov_len = sizeof lenbuf };
+    union {
+        struct cmsghdr  hdr;
+        char            buf[CMSG_SPACE(3 * sizeof (int))];
+    } ctl;
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = ctl.buf, .msg_controllen = sizeof ctl.buf,
+    };
+
+    // The descriptors come with the first byte; the rest of the length
+    // may follow separately.
+    ssize_t n;
+    do {
+        n = recvmsg(conn, &msg, 0);
+    } while (n < 0 && errno == EINTR);
+    struct cmsghdr *c = n > 0? CMSG_FIRSTHDR(&msg) : NULL;
+    if (c == NULL || c->cmsg_level != SOL_SOCKET
+        || c->cmsg_type != SCM_RIGHTS
+        || c->cmsg_len != CMSG_LEN(3 * sizeof (int))) {
+        // Don't keep whatever descriptors did come.
+        for (; c != NULL; c = CMSG_NXTHDR(&msg, c)) {
+            if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+                continue;
+            size_t nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof (int);
+            for (size_t i = 0; i != nfds; ++i) {
+                int fd;
+                memcpy(&fd, CMSG_DATA(c) + i * sizeof fd, sizeof fd);
+                close(fd);
+            }
+        }
+        return NULL;
+    }
+    memcpy(fds, CMSG_DATA(c), 3 * sizeof (int));
+    if (!read_all(conn, lenbuf + n, sizeof lenbuf - n)) goto bad;
+
+    size_t len = get32(lenbuf);
+    if (len > MAX_JOB_ARGS) goto bad;
+    char *args = xalloc(len + 1);
+    if (!read_all(conn, (byte *)args, len)) {
+        free(args);
+        goto bad;
+    }
+    args[len] = '\0';
+
+    // Split into a NULL-terminated vector.
+    size_t count = 0;
+    for (size_t i = 0; i != len; ++i) {
+        if (args[i] == '\0') ++count;
+    }
+    char **v = xalloc((count + 1) * sizeof *v);
+    size_t k = 0;
+    for (size_t i = 0; i < len; i += strlen(args + i) + 1) {
+        if (k == count) break; // (an unterminated last option)
+        v[k++] = args + i;
+    }
+    v[k] = NULL;
+    *bufp = args;
+    return v;
+
+bad:
+    for (int i = 0; i != 3; ++i) close(fds[i]);
+    return NULL;
+}
+
+// In a new child: become the job, and return to run it.
+static void become_job(int conn, const int fds[3], char **args)
+{
+    close(listen_fd);
+    close(conn);
+    for (struct job *j = jobs; j != NULL; j = j->next) close(j->conn);
+    close(child_pipe[0]);
+    close(child_pipe[1]);
+    signal(SIGCHLD, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL); // (as the simple interface has it, non-interactive)
+
+    for (int i = 0; i != 3; ++i) {
+        if (dup2(fds[i], i) < 0) exit(1);
+    }
+    for (int i = 0; i != 3; ++i) {
+        if (fds[i] > STDERR_FILENO) close(fds[i]);
+    }
+    // The simple interface expects its input non-blocking.
+    (void) fcntl(0, F_SETFL, fcntl(0, F_GETFL) | O_NONBLOCK);
+    simple_new_input();
+    trace_fork_job();
+
+    do_job_config(args);
+}
+
+void forksrv_reached(void)
+{
+    if (listen_fd < 0) return;
+    if (!STREQ(cfg.interface, "simple")) {
+        DIE(2, "--fork-server needs the \"simple\" interface.\n");
+    }
+
+    errno = 0;
+    if (pipe(child_pipe) < 0) {
+        DIE(1, "--fork-server: couldn't make a pipe: %s\n", strerror(errno));
+    }
+    (void) fcntl(child_pipe[0], F_SETFL, O_NONBLOCK);
+    (void) fcntl(child_pipe[1], F_SETFL, O_NONBLOCK);
+    signal(SIGCHLD, handle_chld);
+    signal(SIGINT, handle_stop);
+    signal(SIGTERM, handle_stop);
+    INFO("--fork-server: ready; serving jobs on \"%s\".\n", cfg.fork_server);
+
+    for (;;) /* ever */ {
+        struct pollfd pfd[2] = {
+            { .fd = listen_fd, .events = POLLIN },
+            { .fd = child_pipe[0], .events = POLLIN },
+        };
+        if (poll(pfd, 2, -1) < 0 && errno != EINTR) {
+            DIE(1, "--fork-server: poll failed: %s\n", strerror(errno));
+        }
+        if (stop_received) {
+            INFO("--fork-server: stopping.\n");
+            exit(0);
+        }
+        if (pfd[1].revents) {
+            char drain[64];
+            while (read(child_pipe[0], drain, sizeof drain) > 0)
+                ;
+        }
+        reap_jobs();
+        if (!(pfd[0].revents & POLLIN)) continue;
+
+        int conn = accept(listen_fd, NULL, NULL);
+        if (conn < 0) continue;
+        int fds[3];
+        char *buf;
+        char **args = recv_job(conn, fds, &buf);
+        if (args == NULL) {
+            WARN("--fork-server: bad job request; ignored.\n");
+            close(conn);
+            continue;
+        }
+
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid == 0) {
+            become_job(conn, fds, args);
+            return;
+        }
+        for (int i = 0; i != 3; ++i) close(fds[i]);
+        free(buf);
+        free(args);
+        if (pid < 0) {
+            WARN("--fork-server: couldn't fork: %s\n", strerror(errno));
+            close(conn);
+            continue;
+        }
+        struct job *j = xalloc(sizeof *j);
+        j->pid = pid;
+        j->conn = conn;
+        j->next = jobs;
+        jobs = j;
+    }
+}
+
+/********** The client (--fork-job) **********/
+
+int forksrv_job(char **argv)
+{
+    // Send every option but --fork-job itself.
+    size_t len = 0;
+    for (char **v = argv + 1; *v != NULL; ++v) len += strlen(*v) + 1;
+    byte *msg = xalloc(4 + len);
+    size_t pos = 4;
+    for (char **v = argv + 1; *v != NULL; ++v) {
+        const char *name = *v;
+        while (*name == '-') ++name;
+        if (!strncmp(name, "fork-job", 8)) {
+            if (name[8] == '\0' && v[1] != NULL) ++v;
+            if (name[8] == '\0' || name[8] == '=') continue;
+        }
+        size_t n = strlen(*v) + 1;
+        memcpy(msg + pos, *v, n);
+        pos += n;
+    }
+    put32(msg, pos - 4);
+
+    struct sockaddr_un addr;
+    set_addr(&addr, cfg.fork_job, "fork-job");
+    errno = 0;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof addr) < 0) {
+        DIE(1, "--fork-job: couldn't connect to \"%s\": %s\n", cfg.fork_job,
+            strerror(errno));
+    }
+
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    struct iovec iov = { .iov_base = msg, .iov_len = 1 };
+    union {
+        struct cmsghdr  hdr;
+        char            buf[CMSG_SPACE(sizeof fds)];
+    } ctl;
+    memset(&ctl, 0, sizeof ctl);
+    struct msghdr mh = {
+        .msg_iov = &iov, .msg_iovlen = 1,
+        .msg_control = ctl.buf, .msg_controllen = sizeof ctl.buf,
+    };
+    struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof fds);
+    memcpy(CMSG_DATA(c), fds, sizeof fds);
+
+    ssize_t n;
+    do {
+        n = sendmsg(fd, &mh, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    if (n != 1 || !write_all(fd, msg + 1, pos - 1)) {
+        DIE(1, "--fork-job: couldn't send the job: %s\n", strerror(errno));
+    }
+    free(msg);
+
+    byte status[4];
+    if (!read_all(fd, status, sizeof status)) {
+        DIE(1, "--fork-job: lost the server before the job finished.\n");
+    }
+    close(fd);
+    return (int)get32(status);
+}
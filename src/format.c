@@ -23,7 +23,7 @@ DiskFormatDesc disk_format_load(const char *path)
     }
     byte *buf;
     size_t sz;
-    int err = mmapfile(path, &buf, &sz, O_RDWR);
+    int err = overlay_map(path, &buf, &sz);
     if (buf == NULL) {
         DIE(1,"Couldn't load/mmap disk %s: %s\n",
             path, strerror(err));
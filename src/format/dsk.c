@@ -12,6 +12,7 @@
 #include <string.h>
 
 #include <sys/mman.h>
+#include <unistd.h>
 
 #define NIBBLE_SECTOR_SIZE  416
 #define NIBBLE_TRACK_SIZE   6656
@@ -20,17 +21,24 @@
 #define VOLUME_NUMBER       254
 #define DSK_TRACK_SIZE      (DSK_SECTOR_SIZE * MAX_SECTORS)
 
+// Tracks are only nibblized once the head reaches them, and at most
+// this many clean ones are kept around (dirty tracks always stay,
+// until they've been written back).
+#define MAX_CLEAN_TRACKS    8
+
 struct dskprivdat {
     const char *path;
     byte *realbuf;
-    byte *buf;
+    byte *tracks[NUM_TRACKS];   // nibblized; NULL until first needed
+    unsigned long last_used[NUM_TRACKS];
+    unsigned long use_clock;
+    int nresident;
+    int cur_track;              // tracks[cur_track] is resident
     const byte *secmap;
     int bytenum;
     uint64_t dirty_tracks;
 };
-static const struct dskprivdat datinit = { 0 };
 
-static const size_t nib_disksz = 232960;
 static const size_t dsk_disksz = 143360;
 
 //  DOS 3.3 Physical sector order (index is physical sector,
@@ -77,7 +85,7 @@ static const int DETRANS62[] = {
       -1, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F
 };
 
-static void realign_tracks(DiskFormatDesc *desc)
+static void realign_track(DiskFormatDesc *desc, int t)
 {
     /*
        When we unpack a .dsk into nibblized form, it's
@@ -111,44 +119,44 @@ static void realign_tracks(DiskFormatDesc *desc)
 
        We handle this by seeking forward to the first sector-field
        start boundary (D5 AA 96) that we can find, and make that
-       the new "start" of our track. It doesn't matter if it's a
+       the new "start" of track t. It doesn't matter if it's a
        false-start that doesn't start a real sector-field, because one
        thing we know for *sure* is that first D5 can't be found
        in the middle of a legitimate header or data field.
     */
 
     struct dskprivdat *dat = desc->privdat;
-    byte *buf = dat->buf;
-    byte *secbuf = xalloc(NIBBLE_TRACK_SIZE);
-    for (int t=0; t != NUM_TRACKS; ++t) {
-        byte *tstart = buf + (t * NIBBLE_TRACK_SIZE);
-        byte *tend   = buf + ((t + 1) * NIBBLE_TRACK_SIZE);
-        byte *talign;
-        for (talign = tstart; talign <= (tend - 3); ++talign) {
-            if (talign[0] == 0xD5 && talign[1] == 0xAA && talign[2] == 0x96) {
-                if (talign == tstart) {
-                    // Nothing to do, already aligned.
-                } else {
-                    size_t rollsz = talign - tstart;
-                    memcpy(secbuf, tstart, rollsz);
-                    memmove(tstart, talign, tend-talign);
-                    memcpy(tend - rollsz, secbuf, rollsz);
-                }
-                break; // handle next track
+    byte secbuf[NIBBLE_TRACK_SIZE];
+    byte *tstart = dat->tracks[t];
+    byte *tend   = tstart + NIBBLE_TRACK_SIZE;
+    byte *talign;
+    for (talign = tstart; talign <= (tend - 3); ++talign) {
+        if (talign[0] == 0xD5 && talign[1] == 0xAA && talign[2] == 0x96) {
+            if (talign == tstart) {
+                // Nothing to do, already aligned.
+            } else {
+                size_t rollsz = talign - tstart;
+                memcpy(secbuf, tstart, rollsz);
+                memmove(tstart, talign, tend-talign);
+                memcpy(tend - rollsz, secbuf, rollsz);
             }
+            break;
         }
     }
-    free(secbuf);
 }
 
-static void implodeDo(DiskFormatDesc *desc)
+// Translates nibblized track t back into the disk image. A sector
+// can't span two tracks, once they're realigned, so each track can
+// be done on its own.
+static void implode_track(DiskFormatDesc *desc, int t_want)
 {
     struct dskprivdat *dat = desc->privdat;
 
-    realign_tracks(desc);
+    realign_track(desc, t_want);
 
-    const byte *rd = dat->buf; // nibble buf
-    const byte *end = dat->buf + nib_disksz;
+    const byte *tbuf = dat->tracks[t_want];
+    const byte *rd = tbuf;
+    const byte *end = rd + NIBBLE_TRACK_SIZE;
 
     bool warned = false;
 
@@ -174,15 +182,15 @@ header:
         rd += 2;
 
         if (checkSum != (v ^ t ^ s)) {
-            WARN("Sector header checksum failed, t=%d s=%s"
-                 " at nibblized byte %zu.\n", t, s, rd - dat->buf);
+            WARN("Sector header checksum failed, t=%d s=%d"
+                 " at nibblized byte %zu.\n", t, s, (size_t)(rd - tbuf));
             WARN("Probable disk corruption for %s\n", dat->path);
         }
 
-        byte truet = (rd - dat->buf)/NIBBLE_TRACK_SIZE;
+        byte truet = t_want;
         if (t != truet) {
             WARN("Sector header lying about track number"
-                 " at nibblized pos %zu\n", (size_t)(rd - dat->buf));
+                 " at nibblized pos %zu\n", (size_t)(rd - tbuf));
             WARN("  (says %d but we're on track %d). Skipping sector.\n",
                  (int)t, (int)truet);
             continue;
@@ -196,7 +204,13 @@ header:
 
         const int data_field_sz = 0x15A; //counts prologue, not epilogue
         for (;;) {
-            if (rd >= (end - 0x15A)) goto bail;
+            // A header too near the end of the track for its data
+            // field is only corrupt if it's the disk's last track
+            // (the others would just find the next track's header).
+            if (rd >= (end - data_field_sz)) {
+                if (t_want == NUM_TRACKS - 1) goto bail;
+                goto done;
+            }
             if (rd[0] == 0xD5 && rd[1] == 0xAA) {
                 if (rd[2] == 0x96) goto header;
                 if (rd[2] == 0xAD) break;
@@ -226,7 +240,7 @@ header:
                 if (val == -1 && !warned) {
                     warned = true;
                     WARN("Untranslatable nibble at (nibblized) pos %zu,"
-                         " disk %s.\n", (size_t)(rd - dat->buf), dat->path);
+                         " disk %s.\n", (size_t)(rd - tbuf), dat->path);
                     if (rd <= end - 4) {
                         WARN("%02X %02X %02X %02X [%02X] %02X %02X %02X\n",
                              rd[-4], rd[-3], rd[-2], rd[-1],
@@ -286,32 +300,103 @@ done:
     return;
 }
 
-static void spin(DiskFormatDesc *desc, bool b)
+// Writes the dirty tracks back to the image. The image is a shared
+// mapping of the file, so that's enough to put them in the file; the
+// msync() only asks for them to reach storage. With MS_ASYNC it just
+// starts that, so the guest never waits on host I/O here. (Eject
+// waits, with MS_SYNC.)
+static void write_back(DiskFormatDesc *desc, int msflags)
 {
     struct dskprivdat *dat = desc->privdat;
-    if (!b && dat->dirty_tracks != 0) {
-        implodeDo(desc);
-        // For now, sync the entire disk
+    const uintptr_t pgmask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+    for (int t = 0; t != NUM_TRACKS; ++t) {
+        if (!(dat->dirty_tracks & ((uint64_t)1 << t))) continue;
+        implode_track(desc, t);
+
+        byte *tbuf = dat->realbuf + (t * DSK_TRACK_SIZE);
+        byte *start = (byte *)((uintptr_t)tbuf & ~pgmask);
         errno = 0;
-        int err = msync(dat->realbuf, dsk_disksz, MS_SYNC);
+        int err = msync(start, (tbuf + DSK_TRACK_SIZE) - start, msflags);
         if (err < 0) {
             DIE(1,"Couldn't sync to disk file %s: %s\n",
-                cfg.disk, strerror(errno));
+                dat->path, strerror(errno));
         }
-        dat->dirty_tracks = 0;
     }
+    dat->dirty_tracks = 0;
+}
+
+static void spin(DiskFormatDesc *desc, bool b)
+{
+    struct dskprivdat *dat = desc->privdat;
+    if (!b && dat->dirty_tracks != 0) {
+        write_back(desc, MS_ASYNC);
+    }
+}
+
+static void explode_track(byte *nibbleBuf, const byte *dskBuf,
+                          const byte *secmap, int t);
+
+static bool evict_a_clean_track(struct dskprivdat *dat)
+{
+    int victim = -1;
+    for (int t = 0; t != NUM_TRACKS; ++t) {
+        if (dat->tracks[t] == NULL || t == dat->cur_track
+            || (dat->dirty_tracks & ((uint64_t)1 << t)))
+            continue;
+        if (victim < 0 || dat->last_used[t] < dat->last_used[victim])
+            victim = t;
+    }
+    if (victim < 0) return false;
+    free(dat->tracks[victim]);
+    dat->tracks[victim] = NULL;
+    --dat->nresident;
+    return true;
+}
+
+// The nibblized form of the track under the head, made on first use.
+static byte *head_track(DiskFormatDesc *desc)
+{
+    struct dskprivdat *dat = desc->privdat;
+    int t = desc->halftrack/2;
+    if (t == dat->cur_track)
+        return dat->tracks[t];
+
+    dat->cur_track = t;
+    dat->last_used[t] = ++dat->use_clock;
+    if (dat->tracks[t] == NULL) {
+        int nclean = dat->nresident;
+        for (int i = 0; i != NUM_TRACKS; ++i)
+            if (dat->dirty_tracks & ((uint64_t)1 << i)) --nclean;
+        for (; nclean >= MAX_CLEAN_TRACKS; --nclean)
+            if (!evict_a_clean_track(dat)) break;
+        dat->tracks[t] = xalloc(NIBBLE_TRACK_SIZE);
+        ++dat->nresident;
+        explode_track(dat->tracks[t], dat->realbuf, dat->secmap, t);
+    }
+    return dat->tracks[t];
 }
 
 static byte read_byte(DiskFormatDesc *desc)
 {
     struct dskprivdat *dat = desc->privdat;
-    size_t pos = (desc->halftrack/2) * NIBBLE_TRACK_SIZE;
-    pos += (dat->bytenum % NIBBLE_TRACK_SIZE);
-    byte val = dat->buf[pos];
+    size_t pos = (dat->bytenum % NIBBLE_TRACK_SIZE);
+    byte val = head_track(desc)[pos];
     dat->bytenum = (dat->bytenum + 1) % NIBBLE_TRACK_SIZE;
     return val;
 }
 
+static long tell(DiskFormatDesc *desc)
+{
+    struct dskprivdat *dat = desc->privdat;
+    return dat->bytenum;
+}
+
+static void seek(DiskFormatDesc *desc, long pos)
+{
+    struct dskprivdat *dat = desc->privdat;
+    dat->bytenum = pos % NIBBLE_TRACK_SIZE;
+}
+
 static void write_byte(DiskFormatDesc *desc, byte val)
 {
     struct dskprivdat *dat = desc->privdat;
@@ -319,21 +404,68 @@ static void write_byte(DiskFormatDesc *desc, byte val)
         // D2DBG("dodged write $%02X", val);
         return; // must have high bit
     }
-    dat->dirty_tracks |= 1 << (desc->halftrack/2);
-    size_t pos = (desc->halftrack/2) * NIBBLE_TRACK_SIZE;
-    pos += (dat->bytenum % NIBBLE_TRACK_SIZE);
+    byte *tbuf = head_track(desc);
+    dat->dirty_tracks |= (uint64_t)1 << (desc->halftrack/2);
+    size_t pos = (dat->bytenum % NIBBLE_TRACK_SIZE);
 
     //D2DBG("write byte $%02X at pos $%04zX", (unsigned int)val, pos);
 
-    dat->buf[pos] = val;
+    tbuf[pos] = val;
     dat->bytenum = (dat->bytenum + 1) % NIBBLE_TRACK_SIZE;
 }
 
+// --fast-rwts: whole sectors, straight to and from the image. A
+// nibblized track that's been written to is translated back first,
+// so that a read sees what was written; and a track that's had a
+// sector written this way is dropped, to be nibblized afresh.
+static bool read_sector(DiskFormatDesc *desc, int t, int phys, byte *buf)
+{
+    struct dskprivdat *dat = desc->privdat;
+    if (t < 0 || t >= NUM_TRACKS || phys < 0 || phys >= MAX_SECTORS)
+        return false;
+    if (dat->dirty_tracks & ((uint64_t)1 << t))
+        implode_track(desc, t);
+    memcpy(buf, dat->realbuf + (t * DSK_TRACK_SIZE)
+           + (dat->secmap[phys] * DSK_SECTOR_SIZE), DSK_SECTOR_SIZE);
+    return true;
+}
+
+static bool write_sector(DiskFormatDesc *desc, int t, int phys,
+                         const byte *buf)
+{
+    struct dskprivdat *dat = desc->privdat;
+    if (t < 0 || t >= NUM_TRACKS || phys < 0 || phys >= MAX_SECTORS)
+        return false;
+    if (dat->dirty_tracks & ((uint64_t)1 << t)) {
+        implode_track(desc, t);
+        dat->dirty_tracks &= ~((uint64_t)1 << t);
+    }
+    byte *data = dat->realbuf + (t * DSK_TRACK_SIZE)
+        + (dat->secmap[phys] * DSK_SECTOR_SIZE);
+    memcpy(data, buf, DSK_SECTOR_SIZE);
+    if (dat->tracks[t] != NULL) {
+        free(dat->tracks[t]);
+        dat->tracks[t] = NULL;
+        --dat->nresident;
+        if (dat->cur_track == t) dat->cur_track = -1;
+    }
+
+    const uintptr_t pgmask = (uintptr_t)sysconf(_SC_PAGESIZE) - 1;
+    byte *start = (byte *)((uintptr_t)data & ~pgmask);
+    (void) msync(start, (data + DSK_SECTOR_SIZE) - start, MS_ASYNC);
+    return true;
+}
+
 static void eject(DiskFormatDesc *desc)
 {
     // free dat->path and dat, and unmap disk image
     struct dskprivdat *dat = desc->privdat;
-    (void) munmap(dat->buf, dsk_disksz);
+    write_back(desc, MS_ASYNC); // (in case it was ejected while spinning)
+    (void) msync(dat->realbuf, dsk_disksz, MS_SYNC);
+    overlay_release(dat->realbuf);
+    (void) munmap(dat->realbuf, dsk_disksz);
+    for (int t = 0; t != NUM_TRACKS; ++t)
+        free(dat->tracks[t]);
     free((void*)dat->path);
     free(dat);
 }
@@ -417,22 +549,20 @@ static void explodeSector(byte vol, byte track, byte sector,
     *nibSec = wr;
 }
 
-static void explodeDsk(byte *nibbleBuf, byte *dskBuf, const byte *secmap)
+static void explode_track(byte *nibbleBuf, const byte *dskBuf,
+                          const byte *secmap, int t)
 {
-    for (int t = 0; t < NUM_TRACKS; ++t) {
-        byte *writePtr = nibbleBuf;
-        for (int phys_sector = 0; phys_sector < MAX_SECTORS; ++phys_sector) {
-            const byte dos_sector = secmap[phys_sector];
-            const size_t off = ((MAX_SECTORS * t + dos_sector)
-                                * DSK_SECTOR_SIZE);
-            explodeSector(VOLUME_NUMBER, t, phys_sector,
-                          &writePtr, &dskBuf[off]);
-        }
-        assert(writePtr - nibbleBuf <= NIBBLE_TRACK_SIZE);
-        for (; writePtr != (nibbleBuf + NIBBLE_TRACK_SIZE); ++writePtr) {
-            *writePtr = 0xFF;
-        }
-        nibbleBuf += NIBBLE_TRACK_SIZE;
+    byte *writePtr = nibbleBuf;
+    for (int phys_sector = 0; phys_sector < MAX_SECTORS; ++phys_sector) {
+        const byte dos_sector = secmap[phys_sector];
+        const size_t off = ((MAX_SECTORS * t + dos_sector)
+                            * DSK_SECTOR_SIZE);
+        explodeSector(VOLUME_NUMBER, t, phys_sector,
+                      &writePtr, &dskBuf[off]);
+    }
+    assert(writePtr - nibbleBuf <= NIBBLE_TRACK_SIZE);
+    for (; writePtr != (nibbleBuf + NIBBLE_TRACK_SIZE); ++writePtr) {
+        *writePtr = 0xFF;
     }
 }
 
@@ -448,10 +578,10 @@ DiskFormatDesc dsk_insert(const char *path, byte *buf, size_t sz)
     memcpy(pathcp, path, len);
 
     struct dskprivdat *dat = xalloc(sizeof *dat);
-    *dat = datinit;
+    memset(dat, 0, sizeof *dat);
     dat->realbuf = buf;
     dat->path = pathcp;
-    dat->buf = xalloc(nib_disksz);
+    dat->cur_track = -1; // nothing's nibblized yet
 
     const char *ext = get_file_ext(path);
     if (STREQCASE(ext, "PO"))  {
@@ -461,7 +591,6 @@ DiskFormatDesc dsk_insert(const char *path, byte *buf, size_t sz)
         INFO("Opening %s as DO.\n", cfg.disk);
         dat->secmap = DO;
     }
-    explodeDsk(dat->buf, dat->realbuf, dat->secmap);
 
     return (DiskFormatDesc){
         .privdat = dat,
@@ -469,5 +598,9 @@ DiskFormatDesc dsk_insert(const char *path, byte *buf, size_t sz)
         .read_byte = read_byte,
         .write_byte = write_byte,
         .eject = eject,
+        .tell = tell,
+        .seek = seek,
+        .read_sector = read_sector,
+        .write_sector = write_sector,
     };
 }
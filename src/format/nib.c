@@ -51,6 +51,18 @@ static byte read_byte(DiskFormatDesc *desc)
     return val;
 }
 
+static long tell(DiskFormatDesc *desc)
+{
+    struct nibprivdat *dat = desc->privdat;
+    return dat->bytenum;
+}
+
+static void seek(DiskFormatDesc *desc, long pos)
+{
+    struct nibprivdat *dat = desc->privdat;
+    dat->bytenum = pos % NIBBLE_TRACK_SIZE;
+}
+
 static void write_byte(DiskFormatDesc *desc, byte val)
 {
     struct nibprivdat *dat = desc->privdat;
@@ -72,6 +84,7 @@ static void eject(DiskFormatDesc *desc)
 {
     // free dat->path and dat, and unmap disk image
     struct nibprivdat *dat = desc->privdat;
+    overlay_release(dat->buf);
     (void) munmap(dat->buf, nib_disksz);
     free((void*)dat->path);
     free(dat);
@@ -99,5 +112,7 @@ DiskFormatDesc nib_insert(const char *path, byte *buf, size_t sz)
         .read_byte = read_byte,
         .write_byte = write_byte,
         .eject = eject,
+        .tell = tell,
+        .seek = seek,
     };
 }
@@ -1,8 +1,8 @@
 //  hgr-export.c
 //
 //  Graphics export for Bobbin Apple II emulator.
-//  Supports HGR (Hi-Res) and GR (Lo-Res) modes.
-//  Output formats: ASCII art and PPM image.
+//  Supports HGR (Hi-Res), GR (Lo-Res), DHGR and DGR modes.
+//  Output formats: ASCII art, PPM image and PNG image.
 //
 //  Copyright (c) 2025.
 //  This code is licensed under the MIT license.
@@ -106,335 +106,262 @@ static word hgr_line_addr(int line, word base)
     return base + (group * 0x400) + (third * 0x28) + (row_in_group * 0x80);
 }
 
-// Get a single pixel from HGR memory (0 or 1 for mono)
-static int hgr_get_pixel(word base, int x, int y)
-{
-    if (x < 0 || x >= HGR_WIDTH || y < 0 || y >= HGR_HEIGHT) {
-        return 0;
-    }
-
-    word line_addr = hgr_line_addr(y, base);
-    int byte_offset = x / 7;
-    int bit_offset = x % 7;  // Bits 0-6 are pixels, bit 7 is color
+// GR memory layout is same as text screen (interleaved)
+// Each byte contains 2 vertically-stacked pixels:
+//   - Low nibble (bits 0-3) = top pixel
+//   - High nibble (bits 4-7) = bottom pixel
 
-    byte data = peek_sneaky(line_addr + byte_offset);
-    return (data >> bit_offset) & 1;
-}
+// Text/GR line addresses (same interleaving pattern)
+static const word GR_LINE_OFFSETS[24] = {
+    0x000, 0x080, 0x100, 0x180, 0x200, 0x280, 0x300, 0x380,  // Lines 0-7
+    0x028, 0x0A8, 0x128, 0x1A8, 0x228, 0x2A8, 0x328, 0x3A8,  // Lines 8-15
+    0x050, 0x0D0, 0x150, 0x1D0, 0x250, 0x2D0, 0x350, 0x3D0,  // Lines 16-23
+};
 
-// Export HGR to ASCII art
-// Uses different density characters based on pixel count in each cell
-int hgr_export_ascii(word base, const char *filename, int scale)
+// Check if aux memory is available (//e with 128KB)
+static bool have_aux_memory(void)
 {
-    FILE *f = fopen(filename, "w");
-    if (!f) {
-        return -1;
-    }
-
-    // Characters for different densities (0-7 pixels lit in a cell)
-    const char *density = " .:-=+*#@";
-
-    // Use 2x2 pixel cells for ASCII output
-    int cell_w = 2;
-    int cell_h = 2;
+    return cfg.amt_ram > AUX_OFFSET;
+}
 
-    if (scale > 1) {
-        cell_w = scale;
-        cell_h = scale;
-    }
+// =============================================================================
+// Frame Rasterizer
+// =============================================================================
 
-    for (int cy = 0; cy < HGR_HEIGHT; cy += cell_h) {
-        for (int cx = 0; cx < HGR_WIDTH; cx += cell_w) {
-            int count = 0;
-            int max_count = 0;
+// Every export renders through here. The display page (main, and aux
+// for the double modes) is copied out of memory in one go, and then
+// expanded a byte at a time through lookup tables, into one RGB buffer
+// (3 bytes per pixel) that all the output formats share.
+//
+// The hardware displays main (or aux) memory regardless of the current
+// memory mappings, so the copy is straight from RAM, not via the bus.
 
-            // Count lit pixels in this cell
-            for (int dy = 0; dy < cell_h && (cy + dy) < HGR_HEIGHT; dy++) {
-                for (int dx = 0; dx < cell_w && (cx + dx) < HGR_WIDTH; dx++) {
-                    count += hgr_get_pixel(base, cx + dx, cy + dy);
-                    max_count++;
-                }
-            }
+#define HGR_PAGE_SIZE   0x2000
+#define GR_PAGE_SIZE    0x0400
 
-            // Map to density character (0-8 scale)
-            int idx = (count * 8) / max_count;
-            if (idx > 8) idx = 8;
-            fputc(density[idx], f);
-        }
-        fputc('\n', f);
-    }
+static MACHINE_LOCAL byte frame_rgb[DHGR_WIDTH * DHGR_HEIGHT * 3];
+static MACHINE_LOCAL byte page_main[HGR_PAGE_SIZE];
+static MACHINE_LOCAL byte page_aux[HGR_PAGE_SIZE];
 
-    fclose(f);
-    return 0;
-}
+static MACHINE_LOCAL word hgr_row_offset[HGR_HEIGHT];
+// The 7 pixels of an HGR (or DHGR) byte, as RGB; bit 7 is ignored.
+static MACHINE_LOCAL byte mono_lut[128][7 * 3];
+// The same for HGR color: [starts on an odd column][byte]. Bit 7
+// selects the color set, and column parity picks the color within it.
+static MACHINE_LOCAL byte color_lut[2][256][7 * 3];
+static MACHINE_LOCAL bool luts_ready = false;
 
-// Export HGR to PPM format (Portable Pixel Map)
-// Simple uncompressed RGB format that's easy to generate
-int hgr_export_ppm(word base, const char *filename, bool color_mode)
+static void init_luts(void)
 {
-    FILE *f = fopen(filename, "wb");
-    if (!f) {
-        return -1;
-    }
-
-    // PPM header: P6 = binary RGB
-    fprintf(f, "P6\n%d %d\n255\n", HGR_WIDTH, HGR_HEIGHT);
+    if (luts_ready) return;
 
     for (int y = 0; y < HGR_HEIGHT; y++) {
-        word line_addr = hgr_line_addr(y, base);
-
-        for (int x = 0; x < HGR_WIDTH; x++) {
-            int byte_offset = x / 7;
-            int bit_offset = x % 7;
-
-            byte data = peek_sneaky(line_addr + byte_offset);
-            int pixel = (data >> bit_offset) & 1;
-
-            if (color_mode) {
-                // Color mode: use Apple II color artifacts
-                int color_set = (data >> 7) & 1;  // Bit 7 selects color set
-                int col_type = (x % 2);           // Even/odd column
-
-                int color_idx;
-                if (!pixel) {
-                    color_idx = 0;  // Black
-                } else {
-                    // Color depends on color set and column parity
-                    color_idx = 1 + color_set * 4 + col_type;
-                    if (color_idx > 7) color_idx = 7;
-                }
-
-                fputc(HGR_COLORS[color_idx][0], f);
-                fputc(HGR_COLORS[color_idx][1], f);
-                fputc(HGR_COLORS[color_idx][2], f);
-            } else {
-                // Mono mode: just white or black
-                byte val = pixel ? 255 : 0;
-                fputc(val, f);
-                fputc(val, f);
-                fputc(val, f);
+        hgr_row_offset[y] = hgr_line_addr(y, 0);
+    }
+    for (int v = 0; v < 256; v++) {
+        int color_set = (v >> 7) & 1;
+        for (int bit = 0; bit < 7; bit++) {
+            int pixel = (v >> bit) & 1;
+            if (v < 128) {
+                memset(&mono_lut[v][bit * 3], pixel ? 255 : 0, 3);
+            }
+            for (int odd = 0; odd < 2; odd++) {
+                int col_type = (odd + bit) % 2;  // x = col * 7 + bit
+                int color_idx = pixel ? 1 + color_set * 4 + col_type : 0;
+                memcpy(&color_lut[odd][v][bit * 3], HGR_COLORS[color_idx], 3);
             }
         }
     }
-
-    fclose(f);
-    return 0;
+    luts_ready = true;
 }
 
-// Export HGR to PNG format
-// This is more complex - we'll use a minimal PNG encoder
-// For now, return -2 to indicate "not implemented"
-int hgr_export_png(word base, const char *filename, bool color_mode)
+// Copy a display page out of main or aux memory. RAM that isn't there
+// reads as zero.
+static void copy_page(word base, size_t size, bool aux, byte *dst)
 {
-    (void)base;
-    (void)filename;
-    (void)color_mode;
-
-    // PNG requires compression (zlib) which adds complexity
-    // For now, recommend using PPM and external conversion
-    return -2;  // Not implemented
-}
-
-// =============================================================================
-// GR (Lo-Res Graphics) Functions
-// =============================================================================
-
-// GR memory layout is same as text screen (interleaved)
-// Each byte contains 2 vertically-stacked pixels:
-//   - Low nibble (bits 0-3) = top pixel
-//   - High nibble (bits 4-7) = bottom pixel
-
-// Text/GR line addresses (same interleaving pattern)
-static const word GR_LINE_OFFSETS[24] = {
-    0x000, 0x080, 0x100, 0x180, 0x200, 0x280, 0x300, 0x380,  // Lines 0-7
-    0x028, 0x0A8, 0x128, 0x1A8, 0x228, 0x2A8, 0x328, 0x3A8,  // Lines 8-15
-    0x050, 0x0D0, 0x150, 0x1D0, 0x250, 0x2D0, 0x350, 0x3D0,  // Lines 16-23
-};
+    const byte *mem = getram();
+    size_t start = (aux ? AUX_OFFSET : 0) + base;
+    size_t have = size;
 
-// Get address for a GR text row (each text row = 2 GR pixel rows)
-static word gr_row_addr(int text_row, word base)
-{
-    if (text_row < 0 || text_row >= 24) return base;
-    return base + GR_LINE_OFFSETS[text_row];
+    if (start + size > cfg.amt_ram) {
+        have = start < cfg.amt_ram ? cfg.amt_ram - start : 0;
+    }
+    memcpy(dst, mem + start, have);
+    memset(dst + have, 0, size - have);
 }
 
-// Get color of a single GR pixel
-static int gr_get_pixel(word base, int x, int y)
+static void render_hgr(word base, bool color_mode)
 {
-    if (x < 0 || x >= GR_WIDTH || y < 0 || y >= GR_HEIGHT) {
-        return 0;
-    }
-
-    int text_row = y / 2;  // Which text row (0-23)
-    int is_bottom = y % 2; // Top or bottom pixel in the byte
-
-    word addr = gr_row_addr(text_row, base) + x;
-    byte data = peek_sneaky(addr);
+    byte *out = frame_rgb;
 
-    if (is_bottom) {
-        return (data >> 4) & 0x0F;  // High nibble
-    } else {
-        return data & 0x0F;          // Low nibble
+    copy_page(base, HGR_PAGE_SIZE, false, page_main);
+    for (int y = 0; y < HGR_HEIGHT; y++) {
+        const byte *row = page_main + hgr_row_offset[y];
+        for (int col = 0; col < HGR_BYTES_PER_LINE; col++) {
+            const byte *px = color_mode ? color_lut[col % 2][row[col]]
+                                        : mono_lut[row[col] & 0x7F];
+            memcpy(out, px, 7 * 3);
+            out += 7 * 3;
+        }
     }
 }
 
-// Export GR to ASCII art
-// Uses hex digits 0-9, A-F to represent colors
-int gr_export_ascii(word base, const char *filename)
+// In DHGR, bytes are interleaved: aux0, main0, aux1, main1, ...
+// Each byte has 7 pixels, so 80 bytes = 560 pixels
+static void render_dhgr(word base)
 {
-    FILE *f = fopen(filename, "w");
-    if (!f) {
-        return -1;
-    }
-
-    // Use hex digits for color values
-    const char *hex = "0123456789ABCDEF";
+    byte *out = frame_rgb;
 
-    for (int y = 0; y < GR_HEIGHT; y++) {
-        for (int x = 0; x < GR_WIDTH; x++) {
-            int color = gr_get_pixel(base, x, y);
-            // Double each character for better aspect ratio
-            fputc(hex[color], f);
-            fputc(hex[color], f);
+    copy_page(base, HGR_PAGE_SIZE, false, page_main);
+    copy_page(base, HGR_PAGE_SIZE, true, page_aux);
+    for (int y = 0; y < DHGR_HEIGHT; y++) {
+        const byte *mrow = page_main + hgr_row_offset[y];
+        const byte *arow = page_aux + hgr_row_offset[y];
+        for (int col = 0; col < HGR_BYTES_PER_LINE; col++) {
+            memcpy(out, mono_lut[arow[col] & 0x7F], 7 * 3);
+            memcpy(out + 7 * 3, mono_lut[mrow[col] & 0x7F], 7 * 3);
+            out += 2 * 7 * 3;
         }
-        fputc('\n', f);
     }
-
-    fclose(f);
-    return 0;
 }
 
-// Export GR to PPM format with true colors
-int gr_export_ppm(word base, const char *filename)
+static byte *put_block(byte *out, int color, int n)
 {
-    FILE *f = fopen(filename, "wb");
-    if (!f) {
-        return -1;
+    for (int i = 0; i < n; i++) {
+        memcpy(out, GR_COLORS[color], 3);
+        out += 3;
     }
+    return out;
+}
 
-    // Scale up for visibility: each GR pixel becomes 7x4 output pixels
-    // This gives 280x192, same as HGR
-    int scale_x = 7;
-    int scale_y = 4;
-    int out_width = GR_WIDTH * scale_x;   // 40 * 7 = 280
-    int out_height = GR_HEIGHT * scale_y; // 48 * 4 = 192
-
-    fprintf(f, "P6\n%d %d\n255\n", out_width, out_height);
-
-    for (int y = 0; y < GR_HEIGHT; y++) {
-        // Repeat each row scale_y times
-        for (int sy = 0; sy < scale_y; sy++) {
+// GR, or (with double) DGR, whose even columns come from aux memory.
+// Each GR pixel becomes a SCALE_X by SCALE_Y block.
+static void render_gr(word base, bool dbl, int scale_x, int scale_y)
+{
+    size_t stride = (size_t)(dbl ? DGR_WIDTH : GR_WIDTH) * scale_x * 3;
+    byte *out = frame_rgb;
+
+    copy_page(base, GR_PAGE_SIZE, false, page_main);
+    if (dbl) copy_page(base, GR_PAGE_SIZE, true, page_aux);
+    for (int text_row = 0; text_row < 24; text_row++) {
+        const byte *mrow = page_main + GR_LINE_OFFSETS[text_row];
+        const byte *arow = page_aux + GR_LINE_OFFSETS[text_row];
+        for (int shift = 0; shift <= 4; shift += 4) {  // top, then bottom
+            byte *line = out;
             for (int x = 0; x < GR_WIDTH; x++) {
-                int color = gr_get_pixel(base, x, y);
-
-                // Repeat each pixel scale_x times
-                for (int sx = 0; sx < scale_x; sx++) {
-                    fputc(GR_COLORS[color][0], f);
-                    fputc(GR_COLORS[color][1], f);
-                    fputc(GR_COLORS[color][2], f);
-                }
+                if (dbl) out = put_block(out, (arow[x] >> shift) & 0x0F, scale_x);
+                out = put_block(out, (mrow[x] >> shift) & 0x0F, scale_x);
+            }
+            for (int sy = 1; sy < scale_y; sy++) {
+                memcpy(out, line, stride);
+                out += stride;
             }
         }
     }
+}
 
-    fclose(f);
-    return 0;
+const byte *gfx_render(GfxMode mode, word base, bool native, int *w, int *h)
+{
+    init_luts();
+    switch (mode) {
+        case GFX_HGR:
+        case GFX_HGR_COLOR:
+            render_hgr(base, mode == GFX_HGR_COLOR);
+            *w = HGR_WIDTH;
+            *h = HGR_HEIGHT;
+            break;
+        case GFX_DHGR:
+            if (!have_aux_memory()) return NULL;
+            render_dhgr(base);
+            *w = DHGR_WIDTH;
+            *h = DHGR_HEIGHT;
+            break;
+        case GFX_GR:
+        case GFX_DGR:
+            if (mode == GFX_DGR && !have_aux_memory()) return NULL;
+            // Scaled up, each GR pixel becomes 7x4 output pixels,
+            // the same size as (D)HGR
+            render_gr(base, mode == GFX_DGR, native ? 1 : 7, native ? 1 : 4);
+            *w = (mode == GFX_DGR ? DGR_WIDTH : GR_WIDTH) * (native ? 1 : 7);
+            *h = GR_HEIGHT * (native ? 1 : 4);
+            break;
+    }
+    return frame_rgb;
 }
 
-// Export GR to PPM at native resolution (40x48)
-int gr_export_ppm_native(word base, const char *filename)
+// =============================================================================
+// Output Formats
+// =============================================================================
+
+// PPM (Portable Pixel Map): simple uncompressed RGB that's easy to generate
+static int write_ppm(const char *filename, const byte *rgb, int w, int h)
 {
     FILE *f = fopen(filename, "wb");
     if (!f) {
         return -1;
     }
 
-    fprintf(f, "P6\n%d %d\n255\n", GR_WIDTH, GR_HEIGHT);
-
-    for (int y = 0; y < GR_HEIGHT; y++) {
-        for (int x = 0; x < GR_WIDTH; x++) {
-            int color = gr_get_pixel(base, x, y);
-            fputc(GR_COLORS[color][0], f);
-            fputc(GR_COLORS[color][1], f);
-            fputc(GR_COLORS[color][2], f);
-        }
-    }
+    // PPM header: P6 = binary RGB
+    fprintf(f, "P6\n%d %d\n255\n", w, h);
+    fwrite(rgb, 3, (size_t)w * h, f);
 
-    fclose(f);
-    return 0;
+    bool err = ferror(f);
+    if (fclose(f) != 0) err = true;
+    return err ? -1 : 0;
 }
 
-// =============================================================================
-// DHGR (Double Hi-Res Graphics) Functions
-// =============================================================================
-
-// DHGR uses both main and aux memory, interleaved by byte:
-// - Even byte columns (0,2,4...) come from AUX memory
-// - Odd byte columns (1,3,5...) come from MAIN memory
-// Total 80 bytes per line (40 aux + 40 main) = 560 pixels
-
-// Check if aux memory is available (//e with 128KB)
-static bool have_aux_memory(void)
+static int export_ppm(GfxMode mode, word base, bool native, const char *filename)
 {
-    return cfg.amt_ram > AUX_OFFSET;
+    int w, h;
+    const byte *rgb = gfx_render(mode, base, native, &w, &h);
+    if (!rgb) return -3;  // No aux memory
+    return write_ppm(filename, rgb, w, h);
 }
 
-// Get a single pixel from DHGR memory (0 or 1 for mono)
-static int dhgr_get_pixel(word base, int x, int y)
+static int export_png(GfxMode mode, word base, const char *filename)
 {
-    if (x < 0 || x >= DHGR_WIDTH || y < 0 || y >= DHGR_HEIGHT) {
-        return 0;
-    }
-
-    const byte *mem = getram();
-    word line_addr = hgr_line_addr(y, base);
-
-    // In DHGR, bytes are interleaved: aux0, main0, aux1, main1, ...
-    // Each byte has 7 pixels, so 80 bytes = 560 pixels
-    int byte_col = x / 7;      // Which byte (0-79)
-    int bit = x % 7;           // Which bit within byte (0-6)
-
-    // Even byte columns from aux, odd from main
-    word addr;
-    if (byte_col % 2 == 0) {
-        // Even byte column -> aux memory
-        addr = AUX_OFFSET + line_addr + (byte_col / 2);
-    } else {
-        // Odd byte column -> main memory
-        addr = line_addr + (byte_col / 2);
-    }
-
-    byte data = mem[addr];
-    return (data >> bit) & 1;
+    int w, h;
+    const byte *rgb = gfx_render(mode, base, false, &w, &h);
+    if (!rgb) return -3;  // No aux memory
+    return png_write(filename, rgb, w, h);
 }
 
-// Export DHGR to ASCII art
-int dhgr_export_ascii(word base, const char *filename, int scale)
+// ASCII art from a mono render
+// Uses different density characters based on pixel count in each cell
+static int export_density_ascii(GfxMode mode, word base, const char *filename,
+                                int scale)
 {
-    if (!have_aux_memory()) {
-        return -3;  // No aux memory
-    }
+    int w, h;
+    const byte *rgb = gfx_render(mode, base, false, &w, &h);
+    if (!rgb) return -3;  // No aux memory
 
     FILE *f = fopen(filename, "w");
     if (!f) {
         return -1;
     }
 
+    // Characters for different densities (0-7 pixels lit in a cell)
     const char *density = " .:-=+*#@";
+
+    // Use 2x2 pixel cells for ASCII output
     int cell_w = (scale > 1) ? scale : 2;
     int cell_h = (scale > 1) ? scale : 2;
 
-    for (int cy = 0; cy < DHGR_HEIGHT; cy += cell_h) {
-        for (int cx = 0; cx < DHGR_WIDTH; cx += cell_w) {
+    for (int cy = 0; cy < h; cy += cell_h) {
+        for (int cx = 0; cx < w; cx += cell_w) {
             int count = 0;
             int max_count = 0;
 
-            for (int dy = 0; dy < cell_h && (cy + dy) < DHGR_HEIGHT; dy++) {
-                for (int dx = 0; dx < cell_w && (cx + dx) < DHGR_WIDTH; dx++) {
-                    count += dhgr_get_pixel(base, cx + dx, cy + dy);
+            // Count lit pixels in this cell
+            for (int dy = 0; dy < cell_h && (cy + dy) < h; dy++) {
+                const byte *px = rgb + ((size_t)(cy + dy) * w + cx) * 3;
+                for (int dx = 0; dx < cell_w && (cx + dx) < w; dx++) {
+                    count += px[dx * 3] != 0;
                     max_count++;
                 }
             }
 
+            // Map to density character (0-8 scale)
             int idx = (count * 8) / max_count;
             if (idx > 8) idx = 8;
             fputc(density[idx], f);
@@ -446,28 +373,33 @@ int dhgr_export_ascii(word base, const char *filename, int scale)
     return 0;
 }
 
-// Export DHGR to PPM (mono)
-int dhgr_export_ppm(word base, const char *filename)
+// ASCII art of GR/DGR colors, as hex digits 0-9, A-F
+static int export_hex_ascii(word base, bool dbl, const char *filename)
 {
-    if (!have_aux_memory()) {
+    if (dbl && !have_aux_memory()) {
         return -3;  // No aux memory
     }
 
-    FILE *f = fopen(filename, "wb");
+    FILE *f = fopen(filename, "w");
     if (!f) {
         return -1;
     }
 
-    fprintf(f, "P6\n%d %d\n255\n", DHGR_WIDTH, DHGR_HEIGHT);
+    const char *hex = "0123456789ABCDEF";
 
-    for (int y = 0; y < DHGR_HEIGHT; y++) {
-        for (int x = 0; x < DHGR_WIDTH; x++) {
-            int pixel = dhgr_get_pixel(base, x, y);
-            byte val = pixel ? 255 : 0;
-            fputc(val, f);
-            fputc(val, f);
-            fputc(val, f);
+    copy_page(base, GR_PAGE_SIZE, false, page_main);
+    if (dbl) copy_page(base, GR_PAGE_SIZE, true, page_aux);
+    for (int y = 0; y < GR_HEIGHT; y++) {
+        const byte *mrow = page_main + GR_LINE_OFFSETS[y / 2];
+        const byte *arow = page_aux + GR_LINE_OFFSETS[y / 2];
+        int shift = (y % 2) * 4;  // Top or bottom pixel in the byte
+        for (int x = 0; x < GR_WIDTH; x++) {
+            int color = (mrow[x] >> shift) & 0x0F;
+            // Double each GR character for better aspect ratio
+            fputc(hex[dbl ? (arow[x] >> shift) & 0x0F : color], f);
+            fputc(hex[color], f);
         }
+        fputc('\n', f);
     }
 
     fclose(f);
@@ -475,132 +407,105 @@ int dhgr_export_ppm(word base, const char *filename)
 }
 
 // =============================================================================
-// DGR (Double Lo-Res Graphics) Functions
+// HGR (Hi-Res Graphics) Functions
 // =============================================================================
 
-// DGR uses both main and aux memory, interleaved by column:
-// - Even columns (0,2,4...) come from AUX memory
-// - Odd columns (1,3,5...) come from MAIN memory
-// Total 80 columns, each byte still has 2 pixels (top/bottom nibbles)
-
-// Get color of a single DGR pixel
-static int dgr_get_pixel(word base, int x, int y)
+int hgr_export_ascii(word base, const char *filename, int scale)
 {
-    if (x < 0 || x >= DGR_WIDTH || y < 0 || y >= DGR_HEIGHT) {
-        return 0;
-    }
+    return export_density_ascii(GFX_HGR, base, filename, scale);
+}
 
-    const byte *mem = getram();
+int hgr_export_ppm(word base, const char *filename, bool color_mode)
+{
+    return export_ppm(color_mode ? GFX_HGR_COLOR : GFX_HGR, base, false,
+                      filename);
+}
 
-    int text_row = y / 2;  // Which text row (0-23)
-    int is_bottom = y % 2; // Top or bottom pixel in the byte
-    int main_col = x / 2;  // Column in main/aux memory (0-39)
-    bool is_aux = (x % 2 == 0);  // Even columns from aux
+int hgr_export_png(word base, const char *filename, bool color_mode)
+{
+    return export_png(color_mode ? GFX_HGR_COLOR : GFX_HGR, base, filename);
+}
 
-    word addr = gr_row_addr(text_row, base) + main_col;
-    if (is_aux) {
-        addr += AUX_OFFSET;
-    }
+// =============================================================================
+// GR (Lo-Res Graphics) Functions
+// =============================================================================
 
-    byte data = mem[addr];
+int gr_export_ascii(word base, const char *filename)
+{
+    return export_hex_ascii(base, false, filename);
+}
 
-    if (is_bottom) {
-        return (data >> 4) & 0x0F;  // High nibble
-    } else {
-        return data & 0x0F;          // Low nibble
-    }
+// Scaled up to 280x192, same as HGR
+int gr_export_ppm(word base, const char *filename)
+{
+    return export_ppm(GFX_GR, base, false, filename);
 }
 
-// Export DGR to ASCII art (hex digits)
-int dgr_export_ascii(word base, const char *filename)
+// Native resolution (40x48)
+int gr_export_ppm_native(word base, const char *filename)
 {
-    if (!have_aux_memory()) {
-        return -3;  // No aux memory
-    }
+    return export_ppm(GFX_GR, base, true, filename);
+}
 
-    FILE *f = fopen(filename, "w");
-    if (!f) {
-        return -1;
-    }
+int gr_export_png(word base, const char *filename)
+{
+    return export_png(GFX_GR, base, filename);
+}
 
-    const char *hex = "0123456789ABCDEF";
+// =============================================================================
+// DHGR (Double Hi-Res Graphics) Functions
+// =============================================================================
 
-    for (int y = 0; y < DGR_HEIGHT; y++) {
-        for (int x = 0; x < DGR_WIDTH; x++) {
-            int color = dgr_get_pixel(base, x, y);
-            fputc(hex[color], f);
-        }
-        fputc('\n', f);
-    }
+// DHGR uses both main and aux memory, interleaved by byte:
+// - Even byte columns (0,2,4...) come from AUX memory
+// - Odd byte columns (1,3,5...) come from MAIN memory
+// Total 80 bytes per line (40 aux + 40 main) = 560 pixels
 
-    fclose(f);
-    return 0;
+int dhgr_export_ascii(word base, const char *filename, int scale)
+{
+    return export_density_ascii(GFX_DHGR, base, filename, scale);
 }
 
-// Export DGR to PPM (scaled to 560x192 for consistent size)
-int dgr_export_ppm(word base, const char *filename)
+// Mono
+int dhgr_export_ppm(word base, const char *filename)
 {
-    if (!have_aux_memory()) {
-        return -3;  // No aux memory
-    }
-
-    FILE *f = fopen(filename, "wb");
-    if (!f) {
-        return -1;
-    }
+    return export_ppm(GFX_DHGR, base, false, filename);
+}
 
-    // Scale up: each DGR pixel becomes 7x4 output pixels
-    // This gives 560x192, same as DHGR
-    int scale_x = 7;
-    int scale_y = 4;
-    int out_width = DGR_WIDTH * scale_x;   // 80 * 7 = 560
-    int out_height = DGR_HEIGHT * scale_y; // 48 * 4 = 192
+int dhgr_export_png(word base, const char *filename)
+{
+    return export_png(GFX_DHGR, base, filename);
+}
 
-    fprintf(f, "P6\n%d %d\n255\n", out_width, out_height);
+// =============================================================================
+// DGR (Double Lo-Res Graphics) Functions
+// =============================================================================
 
-    for (int y = 0; y < DGR_HEIGHT; y++) {
-        for (int sy = 0; sy < scale_y; sy++) {
-            for (int x = 0; x < DGR_WIDTH; x++) {
-                int color = dgr_get_pixel(base, x, y);
+// DGR uses both main and aux memory, interleaved by column:
+// - Even columns (0,2,4...) come from AUX memory
+// - Odd columns (1,3,5...) come from MAIN memory
+// Total 80 columns, each byte still has 2 pixels (top/bottom nibbles)
 
-                for (int sx = 0; sx < scale_x; sx++) {
-                    fputc(GR_COLORS[color][0], f);
-                    fputc(GR_COLORS[color][1], f);
-                    fputc(GR_COLORS[color][2], f);
-                }
-            }
-        }
-    }
+int dgr_export_ascii(word base, const char *filename)
+{
+    return export_hex_ascii(base, true, filename);
+}
 
-    fclose(f);
-    return 0;
+// Scaled to 560x192, same as DHGR
+int dgr_export_ppm(word base, const char *filename)
+{
+    return export_ppm(GFX_DGR, base, false, filename);
 }
 
-// Export DGR to PPM at native resolution (80x48)
+// Native resolution (80x48)
 int dgr_export_ppm_native(word base, const char *filename)
 {
-    if (!have_aux_memory()) {
-        return -3;  // No aux memory
-    }
-
-    FILE *f = fopen(filename, "wb");
-    if (!f) {
-        return -1;
-    }
-
-    fprintf(f, "P6\n%d %d\n255\n", DGR_WIDTH, DGR_HEIGHT);
-
-    for (int y = 0; y < DGR_HEIGHT; y++) {
-        for (int x = 0; x < DGR_WIDTH; x++) {
-            int color = dgr_get_pixel(base, x, y);
-            fputc(GR_COLORS[color][0], f);
-            fputc(GR_COLORS[color][1], f);
-            fputc(GR_COLORS[color][2], f);
-        }
-    }
+    return export_ppm(GFX_DGR, base, true, filename);
+}
 
-    fclose(f);
-    return 0;
+int dgr_export_png(word base, const char *filename)
+{
+    return export_png(GFX_DGR, base, filename);
 }
 
 // =============================================================================
@@ -702,8 +607,12 @@ bool hgr_command_do(const char *line, printer pr)
             break;
 
         case 3:  // PNG
-            pr("PNG export not yet implemented. Use PPM and convert:\n");
-            pr("  convert %s output.png\n", filename);
+            result = hgr_export_png(base, filename, false);  // mono mode
+            if (result == 0) {
+                pr("Saved %s to PNG file \"%s\" (280x192, mono).\n", page, filename);
+            } else {
+                pr("ERR: Could not save to \"%s\": %s\n", filename, strerror(errno));
+            }
             break;
     }
 
@@ -713,21 +622,18 @@ bool hgr_command_do(const char *line, printer pr)
 // Color mode variants
 bool hgr_command_do_color(const char *line, printer pr)
 {
-    const char *SAVE_HGR_PPM_COLOR = "save-hgr-ppm-color ";
-    const char *SAVE_HGR2_PPM_COLOR = "save-hgr2-ppm-color ";
-
     word base = 0;
     const char *filename = NULL;
+    bool png = false;
 
-    size_t len1 = strlen(SAVE_HGR_PPM_COLOR);
-    size_t len2 = strlen(SAVE_HGR2_PPM_COLOR);
-
-    if (!memcmp(line, SAVE_HGR_PPM_COLOR, len1)) {
+    if ((filename = check_prefix(line, "save-hgr-ppm-color ")) != NULL) {
         base = HGR1_BASE;
-        filename = line + len1;
-    } else if (!memcmp(line, SAVE_HGR2_PPM_COLOR, len2)) {
+    } else if ((filename = check_prefix(line, "save-hgr2-ppm-color ")) != NULL) {
         base = HGR2_BASE;
-        filename = line + len2;
+    } else if ((filename = check_prefix(line, "save-hgr-png-color ")) != NULL) {
+        base = HGR1_BASE; png = true;
+    } else if ((filename = check_prefix(line, "save-hgr2-png-color ")) != NULL) {
+        base = HGR2_BASE; png = true;
     } else {
         return false;
     }
@@ -739,11 +645,13 @@ bool hgr_command_do_color(const char *line, printer pr)
         return true;
     }
 
-    int result = hgr_export_ppm(base, filename, true);  // color mode
+    int result = png ? hgr_export_png(base, filename, true)  // color mode
+                     : hgr_export_ppm(base, filename, true);
     const char *page = (base == HGR1_BASE) ? "HGR1" : "HGR2";
 
     if (result == 0) {
-        pr("Saved %s to PPM file \"%s\" (280x192, color).\n", page, filename);
+        pr("Saved %s to %s file \"%s\" (280x192, color).\n", page,
+           png ? "PNG" : "PPM", filename);
     } else {
         pr("ERR: Could not save to \"%s\": %s\n", filename, strerror(errno));
     }
@@ -756,7 +664,7 @@ bool gr_command_do(const char *line, printer pr)
 {
     word base = 0;
     const char *filename = NULL;
-    int cmd_type = 0;  // 1=ascii, 2=ppm (scaled), 3=ppm (native)
+    int cmd_type = 0;  // 1=ascii, 2=ppm (scaled), 3=ppm (native), 4=png
 
     // GR1 ASCII
     if (!cmd_type && (filename = check_prefix(line, "save-gr-ascii ")) != NULL) {
@@ -779,6 +687,11 @@ bool gr_command_do(const char *line, printer pr)
         base = GR1_BASE; cmd_type = 3;
     }
 
+    // GR1 PNG (scaled)
+    if (!cmd_type && (filename = check_prefix(line, "save-gr-png ")) != NULL) {
+        base = GR1_BASE; cmd_type = 4;
+    }
+
     // GR2 ASCII
     if (!cmd_type && (filename = check_prefix(line, "save-gr2-ascii ")) != NULL) {
         base = GR2_BASE; cmd_type = 1;
@@ -800,6 +713,11 @@ bool gr_command_do(const char *line, printer pr)
         base = GR2_BASE; cmd_type = 3;
     }
 
+    // GR2 PNG (scaled)
+    if (!cmd_type && (filename = check_prefix(line, "save-gr2-png ")) != NULL) {
+        base = GR2_BASE; cmd_type = 4;
+    }
+
     if (!cmd_type) {
         return false;  // Not a GR command
     }
@@ -842,6 +760,15 @@ bool gr_command_do(const char *line, printer pr)
                 pr("ERR: Could not save to \"%s\": %s\n", filename, strerror(errno));
             }
             break;
+
+        case 4:  // PNG scaled
+            result = gr_export_png(base, filename);
+            if (result == 0) {
+                pr("Saved %s to PNG file \"%s\" (280x192, 16 colors).\n", page, filename);
+            } else {
+                pr("ERR: Could not save to \"%s\": %s\n", filename, strerror(errno));
+            }
+            break;
     }
 
     return true;
@@ -852,7 +779,7 @@ bool dhgr_command_do(const char *line, printer pr)
 {
     word base = 0;
     const char *filename = NULL;
-    int cmd_type = 0;  // 1=ascii, 2=ppm
+    int cmd_type = 0;  // 1=ascii, 2=ppm, 3=png
 
     // DHGR1 ASCII
     if (!cmd_type && (filename = check_prefix(line, "save-dhgr-ascii ")) != NULL) {
@@ -870,6 +797,11 @@ bool dhgr_command_do(const char *line, printer pr)
         base = HGR1_BASE; cmd_type = 2;
     }
 
+    // DHGR1 PNG
+    if (!cmd_type && (filename = check_prefix(line, "save-dhgr-png ")) != NULL) {
+        base = HGR1_BASE; cmd_type = 3;
+    }
+
     // DHGR2 ASCII
     if (!cmd_type && (filename = check_prefix(line, "save-dhgr2-ascii ")) != NULL) {
         base = HGR2_BASE; cmd_type = 1;
@@ -886,6 +818,11 @@ bool dhgr_command_do(const char *line, printer pr)
         base = HGR2_BASE; cmd_type = 2;
     }
 
+    // DHGR2 PNG
+    if (!cmd_type && (filename = check_prefix(line, "save-dhgr2-png ")) != NULL) {
+        base = HGR2_BASE; cmd_type = 3;
+    }
+
     if (!cmd_type) {
         return false;  // Not a DHGR command
     }
@@ -923,6 +860,15 @@ bool dhgr_command_do(const char *line, printer pr)
                 pr("ERR: Could not save to \"%s\": %s\n", filename, strerror(errno));
             }
             break;
+
+        case 3:  // PNG
+            result = dhgr_export_png(base, filename);
+            if (result == 0) {
+                pr("Saved %s to PNG file \"%s\" (560x192, mono).\n", page, filename);
+            } else {
+                pr("ERR: Could not save to \"%s\": %s\n", filename, strerror(errno));
+            }
+            break;
     }
 
     return true;
@@ -933,7 +879,7 @@ bool dgr_command_do(const char *line, printer pr)
 {
     word base = 0;
     const char *filename = NULL;
-    int cmd_type = 0;  // 1=ascii, 2=ppm (scaled), 3=ppm (native)
+    int cmd_type = 0;  // 1=ascii, 2=ppm (scaled), 3=ppm (native), 4=png
 
     // DGR1 ASCII
     if (!cmd_type && (filename = check_prefix(line, "save-dgr-ascii ")) != NULL) {
@@ -956,6 +902,11 @@ bool dgr_command_do(const char *line, printer pr)
         base = GR1_BASE; cmd_type = 3;
     }
 
+    // DGR1 PNG (scaled)
+    if (!cmd_type && (filename = check_prefix(line, "save-dgr-png ")) != NULL) {
+        base = GR1_BASE; cmd_type = 4;
+    }
+
     // DGR2 ASCII
     if (!cmd_type && (filename = check_prefix(line, "save-dgr2-ascii ")) != NULL) {
         base = GR2_BASE; cmd_type = 1;
@@ -977,6 +928,11 @@ bool dgr_command_do(const char *line, printer pr)
         base = GR2_BASE; cmd_type = 3;
     }
 
+    // DGR2 PNG (scaled)
+    if (!cmd_type && (filename = check_prefix(line, "save-dgr2-png ")) != NULL) {
+        base = GR2_BASE; cmd_type = 4;
+    }
+
     if (!cmd_type) {
         return false;  // Not a DGR command
     }
@@ -1023,6 +979,15 @@ bool dgr_command_do(const char *line, printer pr)
                 pr("ERR: Could not save to \"%s\": %s\n", filename, strerror(errno));
             }
             break;
+
+        case 4:  // PNG scaled
+            result = dgr_export_png(base, filename);
+            if (result == 0) {
+                pr("Saved %s to PNG file \"%s\" (560x192, 16 colors).\n", page, filename);
+            } else {
+                pr("ERR: Could not save to \"%s\": %s\n", filename, strerror(errno));
+            }
+            break;
     }
 
     return true;
@@ -22,10 +22,11 @@ static void trap_step(Event *e)
         regs.pc = WORD(lo, hi)+1;
         regs.pc -= 3; // back up to the instr that "called" us.
         util_print_state(stderr, regs.pc, &regs);
-        exit(3);
+        flight_dump("--trap-failure");
+        bobbin_exit(3);
     } else if (cfg.trap_success_on && current_pc() == cfg.trap_success) {
         fputs(".-= !!! REPORT SUCCESS !!! =-.\n", stderr);
-        exit(0);
+        bobbin_exit(0);
     }
 }
 
@@ -43,7 +44,7 @@ static void read_rb_params(struct rb_params *p, word addr)
     p->blocknum = WORD(peek_sneaky(addr + 4), peek_sneaky(addr + 5));
 }
 
-static byte last_unitNum;
+static MACHINE_LOCAL byte last_unitNum;
 static void prodos_hook(Event *e)
 {
     byte unitNum = peek_sneaky(0x43);
@@ -61,8 +62,8 @@ static void prodos_hook(Event *e)
     }
 }
 
-static FILE *memlog;
-static SoftSwitches savedsw;
+static MACHINE_LOCAL FILE *memlog;
+static MACHINE_LOCAL SoftSwitches savedsw;
 static void log_prodos_switches(Event *e)
 {
     switch (e->type) {
@@ -110,10 +111,15 @@ void hooks_init(void)
     memlog = fopen("memlog.log", "w");
     if (memlog == NULL) DIE(1,"Couldn't open memlog.\n");
     memset(savedsw, 0, (sizeof savedsw)/(sizeof savedsw[0]));
-    event_reghandler(log_prodos_switches);
+    event_reghandler_for(log_prodos_switches,
+                         EV_MASK(EV_RESET) | EV_MASK(EV_SWITCH));
+    event_reghandler_range(log_prodos_switches, EV_MASK_BUS, 0xC000, 0xC0FF);
+    event_reghandler_range(log_prodos_switches, EV_MASK_BUS, 0xD000, 0xDFFF);
 #endif
 
     if (cfg.trap_failure_on || cfg.trap_success_on) {
-        event_reghandler(trap_step);
+        event_reghandler_for(trap_step, EV_MASK(EV_STEP) | EV_FLAG_SOME_PCS);
+        if (cfg.trap_failure_on) event_step_pc(cfg.trap_failure);
+        if (cfg.trap_success_on) event_step_pc(cfg.trap_success);
     }
 }
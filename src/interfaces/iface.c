@@ -6,6 +6,8 @@
 
 #include "bobbin-internal.h"
 
+#include <errno.h>
+#include <poll.h>
 #include <stdio.h>
 #include <unistd.h>
 
@@ -13,8 +15,11 @@ extern IfaceDesc simpleInterface;
 #ifdef HAVE_LIBCURSES
 extern IfaceDesc ttyInterface;
 #endif
+#ifdef BOBBIN_EMBED
+extern IfaceDesc embedInterface;
+#endif
 
-static IfaceDesc *iii = NULL;
+static MACHINE_LOCAL IfaceDesc *iii = NULL;
 
 static struct if_t {
     const char *name;
@@ -24,6 +29,9 @@ static struct if_t {
     {"tty", &ttyInterface},
 #endif
     {"simple", &simpleInterface},
+#ifdef BOBBIN_EMBED
+    {"embed", &embedInterface},
+#endif
 };
 
 void iface_fire(Event *e)
@@ -32,6 +40,67 @@ void iface_fire(Event *e)
         iii->event(e);
 }
 
+bool iface_wants_access_detail(void)
+{
+    return iii->bus_detail;
+}
+
+void iface_snap_save(Snapshot *s)
+{
+    if (iii->snap_save)
+        iii->snap_save(s);
+}
+
+void iface_snap_restore(const Snapshot *s)
+{
+    if (iii->snap_restore)
+        iii->snap_restore(s);
+}
+
+/********** Keyboard-idle detection **********/
+
+// A guest waiting for a key (the monitor's KEYIN, say) reads the
+// keyboard over a thousand times a frame, and does little else; a
+// program that's doing real work between reads, nowhere near that.
+#define IDLE_MIN_POLLS  1000
+#define IDLE_MIN_FRAMES 2
+
+static MACHINE_LOCAL unsigned long idle_polls;    // empty keyboard reads, this frame
+static MACHINE_LOCAL unsigned int  idle_frames;   // consecutive frames that were idle
+
+void iface_kbd_polled(bool got_key)
+{
+    if (got_key) {
+        idle_polls = 0;
+        idle_frames = 0;
+    } else {
+        ++idle_polls;
+    }
+}
+
+bool iface_idle_wait(long ns)
+{
+    if (idle_polls >= IDLE_MIN_POLLS) {
+        if (idle_frames < IDLE_MIN_FRAMES) ++idle_frames;
+    } else {
+        idle_frames = 0;
+    }
+    idle_polls = 0;
+
+    if (idle_frames < IDLE_MIN_FRAMES || !iii->idle_wait)
+        return false;
+    STAT_INC(frames_idle);
+    return iii->idle_wait(ns);
+}
+
+bool iface_wait_fd(int fd, long ns)
+{
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    // (A signal, such as SIGINT for the debugger, also ends the wait.)
+    int n = poll(&pfd, 1, (int)(ns / 1000000));
+    return n == 0 || (n < 0 && errno == EINTR);
+}
+
 static
 void load_interface(void)
 {
@@ -80,9 +149,15 @@ void interfaces_init(void)
     if (iii == NULL) {
         DIE(2,"unsupported interface \"%s\".\n", cfg.interface);
     }
+    if (cfg.fast_cout && (iii != &simpleInterface || cfg.remain_tty)) {
+        // (The other interfaces show the screen it doesn't write.)
+        DIE(2,"--fast-cout needs the \"simple\" interface.\n");
+    }
 
+    event_iface_reset();
     Event e = { .type = EV_INIT };
     iface_fire(&e);
+    event_iface_defaults();
 }
 
 void interfaces_start(void)
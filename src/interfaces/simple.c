@@ -43,6 +43,8 @@ static enum {
     RB_RUNNING,
 } runbasic_state = RB_NONE;
 static FILE *tokenf;
+static bool run_basic_native; // --run-basic, tokenized by asoft.c
+static bool output_pending; // --fast-cout output, not yet flushed
 static unsigned long line_number = 0;
 
 enum mon_rom_check_status {
@@ -78,6 +80,16 @@ void simple_inject_keys(const char *keys, size_t len)
     }
 }
 
+// A --fork-server job has just been handed a fresh stdin: forget
+// whatever the server read (or failed to read) from its own.
+void simple_new_input(void)
+{
+    eof_found = false;
+    lbuf_start = lbuf_end = linebuf;
+    inputfd = 0;
+    line_number = 0;
+}
+
 // Check if injection queue has characters
 static inline bool inject_queue_has_chars(void)
 {
@@ -247,7 +259,7 @@ static void tokenize(void)
     }
     WARN("Tokenized data written to %s.\n",
          cfg.outputfile? cfg.outputfile : "standard output");
-    exit(0);
+    bobbin_exit(0);
 }
 
 static void tokenize_err(void)
@@ -261,6 +273,19 @@ static void tokenize_err(void)
     // Remainder of DIE will be printed by the emulated machine.
 }
 
+static void type_run_command(void)
+{
+    runbasic_state = RB_RUN_COMMAND;
+    // Set up the RUN command in the input buffer
+    linebuf[0] = 'R';
+    linebuf[1] = 'U';
+    linebuf[2] = 'N';
+    linebuf[3] = '\n';
+    linebuf[4] = '\0';
+    lbuf_start = linebuf;
+    lbuf_end = linebuf + 4;
+}
+
 int read_char(void)
 {
     int c = 0;
@@ -325,6 +350,11 @@ recheck:
         // no input
     } else if (debugging()) {
         // Don't try to read any characters
+    } else if (run_basic_native && runbasic_state == RB_LOAD_BASIC) {
+        // The first read is at the first INPUT, by which time delay-pc
+        // has put the program in place.
+        type_run_command();
+        c = util_fromascii('R');
     } else {
         errno = 0;
         ssize_t nbytes = read(inputfd, &linebuf, sizeof linebuf);
@@ -362,15 +392,7 @@ recheck:
                 // Transition to stdin.
                 (void) close(inputfd);
                 inputfd = 0;
-                runbasic_state = RB_RUN_COMMAND;
-                // Set up the RUN command in the input buffer
-                linebuf[0] = 'R';
-                linebuf[1] = 'U';
-                linebuf[2] = 'N';
-                linebuf[3] = '\n';
-                linebuf[4] = '\0';
-                lbuf_start = linebuf;
-                lbuf_end = linebuf + 4;
+                type_run_command();
                 c = util_fromascii('R');
                 INFO("BASIC Program loaded. Running.\n");
             } else if (cfg.remain_after_pipe) {
@@ -481,7 +503,7 @@ void consume_char(void)
             if (curlnsz > 0)
                 putchar('\n');
         }
-        exit(0);
+        bobbin_exit(0);
     }
 
     if (sigint_received) {
@@ -518,7 +540,12 @@ void consume_char(void)
 
 static void handle_run_basic(void)
 {
-    if (cfg.runbasicfile) {
+    if (cfg.runbasicfile && run_basic_native) {
+        // delay-pc tokenizes and loads the program; all there is to
+        // type is the RUN.
+        runbasic_state = RB_LOAD_BASIC;
+        INFO("Reading BASIC program from \"%s\"...\n", cfg.runbasicfile);
+    } else if (cfg.runbasicfile) {
         errno = 0;
         inputfd = open(cfg.runbasicfile, O_RDONLY);
         if (inputfd < 0) {
@@ -530,8 +557,25 @@ static void handle_run_basic(void)
     }
 }
 
+// Every PC that iface_simple_prestep() or iface_simple_step()
+// reacts to.
+static const word step_pcs[] = {
+    MON_MONZ, MON_COUT1, MON_NXTCHR, MON_GETLNZ, MON_GETLN, MON_GO,
+    INT_SETPROMPT, FP_RESTART, FP_LIST, FP_NEWSTT,
+    FP_ERROR2, FP_NOT_NUMBERED, FP_LINE_EXISTS, FP_CK_PAST_LINE,
+};
+
 static void iface_simple_init(void)
 {
+    event_iface_bus_range(0xC000, 0xC0FF); // keyboard and strobe
+    event_iface_step_pcs(step_pcs, (sizeof step_pcs)/(sizeof step_pcs[0]));
+    if (cfg.trap_print_on) {
+        event_step_pc(cfg.trap_print);
+    }
+    if (cfg.runbasicfile && !cfg.rom_tokenizer && machine_has_applesoft()) {
+        run_basic_native = true;
+        dlypc_run_basic(cfg.runbasicfile);
+    }
     handle_run_basic();
 }
 
@@ -540,7 +584,12 @@ static void iface_simple_start(void)
     line_number = 0;
     curlnsz = 0;
 
-    setvbuf(stdout, NULL, _IONBF, 0);
+    if (cfg.fast_cout) {
+        // Flushed each frame, and whenever the guest waits for input.
+        setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+    } else {
+        setvbuf(stdout, NULL, _IONBF, 0);
+    }
 
     // Always set stdin non-blocking so we don't hang waiting for input
     // This allows the emulator to keep running even when no input is available
@@ -572,7 +621,7 @@ static void iface_simple_start(void)
     } else if (cfg.detokenize) {
         output_suppressed = SUPPRESS_ALWAYS;
         suppress_input = true;
-    } else if (isatty(0) && !inputfd) {
+    } else if (isatty(0) && !inputfd && !cfg.runbasicfile) {
         set_interactive();
     }
 
@@ -640,6 +689,86 @@ void vidout(void)
     }
 }
 
+static void flush_output(void)
+{
+    if (output_pending) {
+        fflush(stdout);
+        output_pending = false;
+    }
+}
+
+static void fast_cout_vtab(byte cv)
+{
+    // As BASCALC (plus WNDLFT) does, for the text line's address.
+    word bas = 0x400 + (cv & 7) * 0x80 + ((cv >> 3) & 3) * 0x28;
+    poke_sneaky(ZP_CV, cv);
+    poke_sneaky(ZP_BASL, LO(bas) + peek_sneaky(ZP_WNDLFT));
+    poke_sneaky(ZP_BASL + 1, HI(bas));
+}
+
+static void fast_cout_lf(void)
+{
+    // The firmware would scroll, at the bottom of the window.
+    // We don't: nothing's drawing the screen.
+    byte cv = peek_sneaky(ZP_CV) + 1;
+    if (cv >= peek_sneaky(ZP_WNDBTM))
+        cv = peek_sneaky(ZP_WNDBTM) - 1;
+    fast_cout_vtab(cv);
+}
+
+// --fast-cout: does COUT1's job, in place of the firmware. The
+// character goes to (buffered) stdout, as vidout() would send it, and
+// the cursor moves as the firmware would move it, but the text page
+// isn't touched, and never scrolled. Then returns to COUT1's caller.
+static void fast_cout(void)
+{
+    vidout();
+    output_pending = true;
+
+    byte c = ACC;
+    byte ch = peek_sneaky(ZP_CH);
+    // Carry is left as the firmware's last compare (or VTAB's add)
+    // leaves it: clear, once a character is stored or the cursor
+    // moves down.
+    bool carry = false;
+    if (c >= 0xA0 || c < 0x80) {
+        // Would be stored on the screen, and the cursor advanced.
+        if (++ch >= peek_sneaky(ZP_WNDWDTH)) {
+            ch = 0;
+            fast_cout_lf();
+        }
+    } else if (c == 0x8D) {
+        ch = 0;
+        fast_cout_lf();
+    } else if (c == 0x8A) {
+        fast_cout_lf();
+    } else if (c == 0x88) {
+        carry = true;
+        if (--ch & 0x80) {
+            // Back to the end of the line above.
+            ch = peek_sneaky(ZP_WNDWDTH) - 1;
+            byte cv = peek_sneaky(ZP_CV);
+            if (cv > peek_sneaky(ZP_WNDTOP)) {
+                fast_cout_vtab(cv - 1);
+                carry = false;
+            }
+        }
+    } else {
+        // Other controls are only compared with BEL.
+        carry = c >= 0x87;
+    }
+    poke_sneaky(ZP_CH, ch);
+
+    // COUT1 leaves A, X and Y as they were; its last act is LDY YSAV1.
+    poke_sneaky(ZP_YSAV1, YREG);
+    PPUT(PCARRY, carry);
+    PPUT(PZERO, YREG == 0);
+    PPUT(PNEG, (YREG & 0x80) != 0);
+    byte lo = stack_pop_sneaky();
+    byte hi = stack_pop_sneaky();
+    go_to(WORD(lo, hi)+1);
+}
+
 static void suppress_output(void)
 {
     // Suppress output until current emulated routine returns.
@@ -704,8 +833,11 @@ static void iface_simple_prestep(void)
                 go_to(INT_BASIC);
             }
         }
+    } else if (cfg.fast_cout && current_pc() == MON_COUT1) {
+        fast_cout();
     } else if (cfg.trap_print_on && current_pc() == cfg.trap_print) {
         putchar(ACC); // No translation, this is ASCII.
+        output_pending = true;
         // Now enact a return
         byte lo = stack_pop_sneaky();
         byte hi = stack_pop_sneaky();
@@ -773,7 +905,7 @@ static void iface_simple_step(void)
                 if (curlnsz > 0)
                     putchar('\n');
                 INFO("BASIC Program has exited. Done.\n");
-                exit(0);
+                bobbin_exit(0);
             }
             if (!interactive && mem_match(FP_RESTART, 8, 0x20, 0xFB, 0xDA,
                           0xA2, 0xDD, 0x20, 0x2E, 0xD5)) {
@@ -798,7 +930,7 @@ static void iface_simple_step(void)
             break;
         case FP_NEWSTT:
             if (cfg.detokenize && detoken_state == LIST_DOING_LIST) {
-                exit(0); // done listing!
+                bobbin_exit(0); // done listing!
             }
             break;
     }
@@ -810,6 +942,12 @@ static void iface_simple_peek(Event *e)
 
     if (a == SS_KBD) {
         e->val = read_char();
+        bool got_key = (e->val & 0x80) || inject_queue_has_chars();
+        iface_kbd_polled(got_key);
+        if (!got_key) {
+            flush_output();
+            until_input_idle();
+        }
     } else if ((!machine_is_iie() && a == SS_KBDSTROBE)
                || e->loc == SS_KBDSTROBE) {
         consume_char();
@@ -825,6 +963,7 @@ static void iface_simple_poke(Event *e)
 
 static void iface_simple_unhook(void)
 {
+    flush_output();
     if (!interactive && (cfg.remain_after_pipe || cfg.remain_tty)) {
         set_interactive();
     }
@@ -868,6 +1007,9 @@ static void iface_simple_event(Event *e)
         case EV_STEP:
             iface_simple_step();
             break;
+        case EV_FRAME:
+            flush_output();
+            break;
         case EV_PEEK:
             iface_simple_peek(e);
             break;
@@ -885,7 +1027,7 @@ static void iface_simple_event(Event *e)
                 INFO("Disk inactive, exiting.\n");
                 if (curlnsz > 0)
                     putchar('\n');
-                exit(0);
+                bobbin_exit(0);
             }
             break;
         default:
@@ -893,6 +1035,52 @@ static void iface_simple_event(Event *e)
     }
 }
 
+static bool iface_simple_idle_wait(long ns)
+{
+    if (debugging() || inject_queue_has_chars() || lbuf_start < lbuf_end
+        || eof_found || exit_on_spindown || suppress_input)
+        return false;
+    return iface_wait_fd(inputfd, ns);
+}
+
+// What a snapshot must carry: a restored run skips the GETLN call
+// that would have set up suppression of the echoed input.
+struct simple_snap {
+    int     output_suppressed;
+    bool    ensure_line_start;
+};
+
+static void iface_simple_snap_save(Snapshot *s)
+{
+    struct simple_snap ss = {
+        .output_suppressed = output_suppressed,
+        .ensure_line_start = ensure_line_start,
+    };
+    snap_put(s, "simple", &ss, sizeof ss);
+}
+
+static void iface_simple_snap_restore(const Snapshot *s)
+{
+    const struct simple_snap *ss = snap_get(s, "simple", sizeof *ss);
+    if (ss == NULL) return;
+    // --detokenize suppresses everything, snapshot or no.
+    if (output_suppressed != SUPPRESS_ALWAYS)
+        output_suppressed = ss->output_suppressed;
+    ensure_line_start = ss->ensure_line_start;
+}
+
+// Keeps our messages (on stderr) in order with --fast-cout's output.
+static bool iface_simple_squawk(int level, bool cont, const char *fmt,
+                                va_list args)
+{
+    flush_output();
+    return false;
+}
+
 IfaceDesc simpleInterface = {
     .event = iface_simple_event,
+    .squawk = iface_simple_squawk,
+    .snap_save = iface_simple_snap_save,
+    .snap_restore = iface_simple_snap_restore,
+    .idle_wait = iface_simple_idle_wait,
 };
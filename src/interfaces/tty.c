@@ -40,9 +40,16 @@ static int badterm_attr;
 static int cols = 40;
 static byte typed_char = '\0';
 
+// Text cells that need repainting at the next frame: a bit per row, and
+// the span of (memory) columns within each dirty row.
+static unsigned long dirty_rows = 0;
+static byte dirty_lo[24];
+static byte dirty_hi[24];
+// Flashing cells, as of their last paint: a bit per column, per row.
+static uint64_t flash_cells[24];
+
 static void draw_border(void);
 static void do_overlay(int offset);
-static void repaint_flash(bool flash);
 static void refresh_video(bool flash);
 static void clear_overlay(void);
 static void do_overlay_timer(void);
@@ -126,73 +133,104 @@ static void do_overlay(int offset)
     int err = copywin(msgwin, stdscr, 0, 0, maxy - 1 - y + (x? 0: 1) - offset, 0, maxy-1, maxx-1, false);
 }
 
-static void repaint_flash(bool flash)
+static void mark_dirty(int y, int lo, int hi)
 {
-    const byte *mem = getram();
+    if (dirty_rows & (1UL << y)) {
+        if (lo < dirty_lo[y]) dirty_lo[y] = lo;
+        if (hi > dirty_hi[y]) dirty_hi[y] = hi;
+    } else {
+        dirty_rows |= 1UL << y;
+        dirty_lo[y] = lo;
+        dirty_hi[y] = hi;
+    }
+}
 
-    saved_flash = flash;
-    attrset(A_NORMAL);
-    if (flash) attron(A_REVERSE);
+static void mark_all_dirty(void)
+{
     for (int y=0; y != 24; ++y) {
-        word base = get_line_base(text_page, y);
-        for (int x=0; x != 40; ++x) {
-            byte c = mem[base + x];
-            if (util_isflashing(c)) {
-                byte cd = util_todisplay(c);
-                mvaddch(y, x, cd);
-            }
-        }
+        mark_dirty(y, 0, 39);
     }
-    attrset(A_NORMAL);
 }
 
-static void refresh_video80(void)
+static void mark_flash_dirty(void)
 {
-    attrset(A_NORMAL);
-    const byte *membuf = getram();
-    bool have_aux = cfg.amt_ram > LOC_AUX_START;
     for (int y=0; y != 24; ++y) {
-        word base = get_line_base(0x4, y);
-        move(y, 0);
-        for (byte x=0; x != 80; ++x) {
-            bool even = have_aux && (x % 2 == 0);
-            byte mx = x >> 1;
-            byte c = membuf[(base | (even? LOC_AUX_START : 0)) + mx];
-            byte cd = util_todisplay(c);
-            bool cfl = util_isreversed(c, false);
-            addch(cd | (cfl? A_REVERSE: 0));
-        }
+        uint64_t fl = flash_cells[y];
+        if (fl == 0) continue;
+        int lo = 0, hi = 39;
+        while (!(fl & ((uint64_t)1 << lo))) ++lo;
+        while (!(fl & ((uint64_t)1 << hi))) --hi;
+        mark_dirty(y, lo, hi);
     }
-
-    do_overlay(0);
 }
 
-static void refresh_video(bool flash)
+// Paints memory columns lo through hi of text row y. In 80-column
+// mode, each memory column is two screen cells (aux, then main).
+static void paint_row(int y, int lo, int hi)
 {
     const byte *mem = getram();
+    word base = get_line_base(text_page, y);
+
+    attrset(A_NORMAL);
+    if (cols == 80) {
+        bool have_aux = cfg.amt_ram > LOC_AUX_START;
+        move(y, lo * 2);
+        for (int mx=lo; mx <= hi; ++mx) {
+            for (int even=1; even >= 0; --even) {
+                byte c = mem[(base | (have_aux && even? LOC_AUX_START : 0))
+                             + mx];
+                byte cd = util_todisplay(c);
+                bool cfl = util_isreversed(c, false);
+                addch(cd | (cfl? A_REVERSE: 0));
+            }
+        }
+        return;
+    }
+    move(y, lo);
+    for (int x=lo; x <= hi; ++x) {
+        byte c = mem[base + x];
+        byte cd = util_todisplay(c);
+        bool cfl = util_isreversed(c, saved_flash);
+        uint64_t bit = (uint64_t)1 << x;
+        if (util_isflashing(c)) {
+            flash_cells[y] |= bit;
+        } else {
+            flash_cells[y] &= ~bit;
+        }
+        addch(cd | (cfl? A_REVERSE: 0));
+    }
+}
 
+static bool term_too_small(void)
+{
     if (COLS < cols || LINES < 24) {
         clear();
         attron(badterm_attr);
         printw("Terminal too small. Please resize.\n");
         attrset(A_NORMAL);
-        return;
+        return true;
     }
-    if (cols == 80) {
-        refresh_video80();
-        return;
+    return false;
+}
+
+// Repaints just the dirty cells.
+static void paint_dirty(void)
+{
+    unsigned long rows = dirty_rows;
+    dirty_rows = 0;
+    if (term_too_small()) return;
+    for (int y=0; y != 24; ++y) {
+        if (rows & (1UL << y)) paint_row(y, dirty_lo[y], dirty_hi[y]);
     }
+}
+
+static void refresh_video(bool flash)
+{
     saved_flash = flash;
-    attrset(A_NORMAL);
+    dirty_rows = 0;
+    if (term_too_small()) return;
     for (int y=0; y != 24; ++y) {
-        word base = get_line_base(text_page, y);
-        move(y, 0);
-        for (int x=0; x != 40; ++x) {
-            byte c = mem[base + x];
-            byte cd = util_todisplay(c);
-            bool cfl = util_isreversed(c, flash);
-            addch(cd | (cfl? A_REVERSE: 0));
-        }
+        paint_row(y, 0, 39);
     }
 
     do_overlay(0);
@@ -346,8 +384,12 @@ static void if_tty_switch(void)
         altcharset = swget(ss, ss_altcharset);
     }
 
-    refresh_all = refresh_all || (prev_page != text_page || prevcols != cols
-        || oldcharset != altcharset);
+    if (prevcols != cols) {
+        // Different layout; start from a clean screen.
+        refresh_all = true;
+    } else if (prev_page != text_page || oldcharset != altcharset) {
+        mark_all_dirty();
+    }
 }
 
 static void if_tty_peek(Event *e)
@@ -356,6 +398,7 @@ static void if_tty_peek(Event *e)
 
     if (a == SS_KBD) {
         e->val = read_char();
+        iface_kbd_polled((e->val & 0x80) != 0);
     }
     else if (a == SS_KBDSTROBE) {
         if (!machine_is_iie() || e->loc == SS_KBDSTROBE) {
@@ -387,6 +430,8 @@ static void if_tty_poke(Event *e)
        && !(COLS < cols || LINES < 24)) {
         x %= 40;
         byte y = get_line_for_addr(loc);
+        // (Writes aren't drawn here: the cell is repainted, from
+        //  memory, at the next frame.)
 
 #if 0
         int d = util_toascii(val);
@@ -396,30 +441,19 @@ static void if_tty_poke(Event *e)
         prsw();
 #endif
         if (cols == 80) {
-            x *= 2;
-            if ((e->aloc & LOC_AUX_START) == 0) {
-                if (cfg.amt_ram != 0x20000) {
-                    // This write is going to aux mem, but
-                    //  we don't HAVE aux mem. Ignore it.
-                    return;
-                }
-                x += 1; // main
+            if ((e->aloc & LOC_AUX_START) == 0
+                && cfg.amt_ram != 0x20000) {
+                // This write is going to aux mem, but
+                //  we don't HAVE aux mem. Ignore it.
+                // (Without an 80-column card, both cells of
+                //  the pair show main memory; see paint_row().)
+                return;
             }
         } else if ((e->aloc & LOC_AUX_START) != 0) {
             return; // Don't process; it's going somewhere
                     // we aren't displaying.
         }
-        int c = util_todisplay(val);
-        bool flash = (cols == 80)
-            || swget(ss, ss_altcharset)? false : saved_flash;
-        if (util_isreversed(val, flash)) c |= A_REVERSE;
-        mvaddch(y, x, c);
-        if (cols == 80 && cfg.amt_ram <= LOC_AUX_START) {
-            // We're in 80-column mode, but don't have an 80-column
-            // card! ...Mirror the character to both cells.
-            mvaddch(y, x-1, c);
-        }
-        refresh_overlay = true;
+        mark_dirty(y, x, x);
     } else if ((loc & 0xFFF0) == 0xC010) {
         typed_char &= 0x7F;
         if (sigint_received == 1) sigint_received = 0;
@@ -512,8 +546,8 @@ static void if_tty_frame(void)
     do_overlay_timer();
     if (cols == 80 || swget(ss, ss_altcharset)) flash = false;
     if (flash != saved_flash) {
-        repaint_flash(flash);
-        refresh_overlay = true;
+        saved_flash = flash;
+        mark_flash_dirty();
     }
     if (sigwinch_received) {
         sigwinch_received = false;
@@ -524,6 +558,11 @@ static void if_tty_frame(void)
     if (refresh_all) {
         refresh_all = false;
         redraw(true, 0);
+    } else if (dirty_rows) {
+        refresh_overlay = false;
+        paint_dirty();
+        do_overlay(0);
+        refresh();
     } else if (refresh_overlay) {
         refresh_overlay = false;
         do_overlay(0);
@@ -542,10 +581,8 @@ static void if_tty_step(void)
 
 static void if_tty_display_touched(void)
 {
-    if (stdscr) {
-        refresh_video(saved_flash);
-        refresh();
-    }
+    // Many bytes may have changed at once; repaint at the next frame.
+    if (stdscr) mark_all_dirty();
 }
 
 static void if_tty_disk_active(int val)
@@ -578,6 +615,14 @@ static void if_tty_event(Event *e)
     }
 
     switch (e->type) {
+        case EV_INIT:
+            event_iface_bus_range(0x0400, 0x0BFF); // text pages 1 and 2
+            event_iface_bus_range(0xC000, 0xC0FF); // keyboard, buttons
+            {
+                static const word bell = 0xFBDD; // see if_tty_step()
+                event_iface_step_pcs(&bell, 1);
+            }
+            break;
         case EV_START:
             if_tty_start();
             break;
@@ -634,7 +679,15 @@ static void if_tty_event(Event *e)
     }
 }
 
+static bool if_tty_idle_wait(long ns)
+{
+    if (unhooked) return false;
+    return iface_wait_fd(STDIN_FILENO, ns);
+}
+
 IfaceDesc ttyInterface = {
     .event = if_tty_event,
     .squawk= if_tty_squawk,
+    .bus_detail = true,
+    .idle_wait = if_tty_idle_wait,
 };
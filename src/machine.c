@@ -93,9 +93,9 @@ static const Alias aliases[] = {
     { ENHANCED_SUMS, ENHANCED_ALIASES },
 };
 
-static Sha256SumPtrPtr   acceptable_sums = NULL;
+static MACHINE_LOCAL Sha256SumPtrPtr   acceptable_sums = NULL;
 
-static size_t expected_size;
+static MACHINE_LOCAL size_t expected_size;
 
 static const char *find_alias(const char *machine)
 {
@@ -174,9 +174,10 @@ bool validate_rom(unsigned char *buf, size_t sz)
     return false;
 }
 
-const char *default_romfname;
-static bool is_iie = false;
-static bool is_enhanced_iie = false;
+MACHINE_LOCAL const char *default_romfname;
+static MACHINE_LOCAL bool is_iie = false;
+static MACHINE_LOCAL bool is_enhanced_iie = false;
+static MACHINE_LOCAL bool has_applesoft = true;
 
 void machine_init(void)
 {
@@ -213,11 +214,14 @@ void machine_init(void)
     if (orig == ORIGINAL_TAG) {
         default_romfname = "apple2.rom";
         expected_size = 12 * 1024;
+        has_applesoft = false;
     }
     if (orig == PLUS_TAG) {
         default_romfname = "apple2plus.rom";
         expected_size = 12 * 1024;
     }
+
+    cpu_select_machine();
 }
 
 size_t expected_rom_size(void)
@@ -239,3 +243,8 @@ bool machine_has_mousetext(void)
 {
     return is_enhanced_iie;
 }
+
+bool machine_has_applesoft(void)
+{
+    return has_applesoft;
+}
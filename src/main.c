@@ -7,19 +7,29 @@
 #include "bobbin-internal.h"
 
 #include <stddef.h> // NULL
+#include <string.h>
 
 extern void do_config(int, char **);
 
-const char *program_name;
-
 int main(int argc, char **argv)
 {
     events_init(); // make sure events are initialized before dlypc
     dlypc_init();
 
     program_name = *argv;
+    // (do_config() moves the argv pointers past each option's dashes.)
+    char **orig_argv = xalloc((argc + 1) * sizeof *argv);
+    memcpy(orig_argv, argv, (argc + 1) * sizeof *argv);
     do_config(argc, argv);
 
+    if (cfg.fork_job) {
+        return forksrv_job(orig_argv);
+    }
+
+    if (cfg.decode_trace) {
+        return trace_decode(cfg.decode_trace, stdout);
+    }
+
     bobbin_run();
 
     return 0;
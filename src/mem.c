@@ -21,12 +21,37 @@
 // Enough of a RAM buffer to provide 128k
 //  Note: memory at 0xC000 thru 0xCFFF, and 0x1C000 thru 0x1CFFF,
 //  are read at alternate banks of RAM for locations $D000 - $DFFF
-static byte membuf[128 * 1024];
+static MACHINE_LOCAL byte membuf[128 * 1024];
 
-SoftSwitches ss;
+MACHINE_LOCAL SoftSwitches ss;
 
 // Pointer to firmware, mapped into the Apple starting at $D000
-static unsigned char *rombuf;
+static MACHINE_LOCAL unsigned char *rombuf;
+
+// Page tables: where each 256-byte page of the address space
+// currently maps, for reads and for writes. Rebuilt by mem_remap()
+// whenever a switch that affects the mapping is changed, so that
+// mem_get_true_access() and the sneaky accessors needn't re-derive it
+// on every access.
+struct pagemap {
+    size_t          base;   // bufloc of the start of the page
+    bool            aux;
+    MemAccessType   acc;
+};
+static MACHINE_LOCAL struct pagemap rdmap[256];
+static MACHINE_LOCAL struct pagemap wrmap[256];
+
+// Host memory for each page, for peek_sneaky() and poke_sneaky().
+// A NULL in rdpage means the page needs special handling
+// (I/O, slot ROMs, missing RAM). Writes that have nowhere to go
+// are aimed at discard_page.
+static MACHINE_LOCAL byte *rdpage[256];
+static MACHINE_LOCAL byte *wrpage[256];
+static MACHINE_LOCAL byte discard_page[256];
+
+// For each page, the --block-cache host page that writes land in,
+// or -1 if they don't land in RAM.
+static MACHINE_LOCAL int wrcode[256];
 
 static const char * const switch_names[] = {
     "LC_PREWRITE",
@@ -60,7 +85,7 @@ static const char * const rom_dirs[] = {
     "./roms",        // also not a dirname; we'll use bobbin's dir instead
     ROMSRCHDIR,
 };
-static const char * const *romdirp = rom_dirs;
+static MACHINE_LOCAL const char * const *romdirp = rom_dirs;
 static const char * const * const romdend = rom_dirs + (sizeof rom_dirs)/(sizeof rom_dirs[0]);
 
 const byte *getram(void)
@@ -76,6 +101,7 @@ void mem_put(const byte *buf, unsigned long start, size_t sz) {
               oldsz, sz);
     }
     memcpy(&membuf[start], buf, sz);
+    block_invalidate_all();
     // Trigger screen refresh. We could be smart and only
     // send this if we know we actually touched the screen, but... meh.
     event_fire(EV_DISPLAY_TOUCH);
@@ -101,11 +127,28 @@ bool swget(SoftSwitches ss, SoftSwitchFlagPos pos)
     return (ss[bynum] >> bitnum) & 0x01;
 }
 
+static bool affects_mapping(SoftSwitchFlagPos pos)
+{
+    switch (pos) {
+        case ss_text:
+        case ss_mixed:
+        case ss_altcharset:
+        case ss_eightycol:
+        case ss_vertblank:
+            return false;
+        default:
+            return true;
+    }
+}
+
 static void swsetfire(SoftSwitches ss, SoftSwitchFlagPos pos, bool val)
 {
     bool oldval = swget(ss, pos);
     swset(ss, pos, val);
     if (oldval != val) {
+        STAT_INC(switch_flips[pos]);
+        if (affects_mapping(pos))
+            mem_remap();
         event_fire_switch(pos);
     }
 }
@@ -144,7 +187,7 @@ const char *mem_get_acctype_name(MemAccessType m)
 }
 
 static const char *get_try_rom_path(const char *fname) {
-    static char buf[256];
+    static MACHINE_LOCAL char buf[256];
     const char *env;
     const char *dir;
 
@@ -238,6 +281,8 @@ static void load_machine_rom(void)
 
 static void fillmem(void)
 {
+    block_invalidate_all();
+
     /* Immitate the on-boot memory pattern. */
     for (size_t z=0; z != sizeof membuf; ++z) {
         if (!(z & 0x2))
@@ -273,6 +318,7 @@ void mem_init(void)
     }
 
     mem_init_langcard();
+    mem_remap();
 }
 
 void mem_reset(void)
@@ -281,6 +327,28 @@ void mem_reset(void)
     memset(ss, 0, (sizeof ss)/(sizeof ss[0]));
     ss[0] = preserve;
     swset(ss, ss_text, true);
+    mem_remap();
+}
+
+void mem_snap_save(Snapshot *s)
+{
+    snap_put(s, "ram", membuf, sizeof membuf);
+    snap_put(s, "switches", ss, sizeof ss);
+}
+
+void mem_snap_restore(const Snapshot *s)
+{
+    const void *ram = snap_get(s, "ram", sizeof membuf);
+    const void *sw = snap_get(s, "switches", sizeof ss);
+    if (ram) memcpy(membuf, ram, sizeof membuf);
+    if (sw) memcpy(ss, sw, sizeof ss);
+    block_invalidate_all();
+    mem_remap();
+}
+
+void mem_snap_key(void)
+{
+    if (rombuf) snapshot_key_add(rombuf, expected_rom_size());
 }
 
 void mem_reboot(void)
@@ -289,7 +357,7 @@ void mem_reboot(void)
 
     mem_init_langcard();
 
-    mem_reset();
+    mem_reset(); // (remaps)
 }
 
 static bool is_aux_mem(word loc, bool wr)
@@ -320,19 +388,9 @@ static bool is_aux_mem(word loc, bool wr)
     return aux;
 }
 
-void mem_get_true_access(word loc, bool wr, size_t *bufloc, bool *in_aux, MemAccessType *access)
+static void compute_access(word loc, bool wr, size_t *bufloc, bool *in_aux,
+                           MemAccessType *access)
 {
-    size_t dummy_loc;
-    bool dummy_aux;
-    MemAccessType dummy_access;
-
-    // Allow caller to use NULL for any of the pointers.
-    //  Note that some of these have to exist because they're used
-    //  for state within this function. So we just ensure they all do.
-    if (!bufloc) bufloc = &dummy_loc;
-    if (!in_aux) in_aux = &dummy_aux;
-    if (!access) access = &dummy_access;
-
     if (loc < SS_START) {
         *access = MA_MAIN;
         *bufloc = loc;
@@ -366,6 +424,59 @@ void mem_get_true_access(word loc, bool wr, size_t *bufloc, bool *in_aux, MemAcc
     }
 }
 
+void mem_remap(void)
+{
+    for (unsigned int pg = 0; pg != 256; ++pg) {
+        word loc = pg << 8;
+        struct pagemap *r = &rdmap[pg];
+        struct pagemap *w = &wrmap[pg];
+        compute_access(loc, false, &r->base, &r->aux, &r->acc);
+        compute_access(loc, true, &w->base, &w->aux, &w->acc);
+        coverage_remap(pg, r->acc, r->aux);
+
+        if (loc >= SS_START && loc < LOC_SLOTS_END) {
+            rdpage[pg] = NULL;
+        } else if (loc >= cfg.amt_ram && loc < SS_START) {
+            rdpage[pg] = NULL;
+        } else if (r->acc == MA_ROM) {
+            rdpage[pg] = &rombuf[r->base];
+        } else {
+            rdpage[pg] = &membuf[r->base];
+        }
+
+        if (w->acc != MA_ROM && w->acc != MA_SLOTS
+            && (!w->aux || cfg.amt_ram > LOC_AUX_START)) {
+            wrpage[pg] = &membuf[w->base];
+            wrcode[pg] = w->base >> 8;
+        } else {
+            wrpage[pg] = discard_page;
+            wrcode[pg] = -1;
+        }
+    }
+}
+
+long mem_code_key(word loc)
+{
+    const struct pagemap *m = &rdmap[loc >> 8];
+    if (rdpage[loc >> 8] == NULL) {
+        return -1;
+    } else if (m->acc == MA_ROM) {
+        return BLOCK_ROM_KEY + m->base + (loc & 0xFF);
+    } else {
+        return m->base + (loc & 0xFF);
+    }
+}
+
+void mem_get_true_access(word loc, bool wr, size_t *bufloc, bool *in_aux, MemAccessType *access)
+{
+    STAT_INC(true_access_calls);
+    // Allow caller to use NULL for any of the pointers.
+    const struct pagemap *m = wr? &wrmap[loc >> 8] : &rdmap[loc >> 8];
+    if (bufloc) *bufloc = m->base + (loc & 0xFF);
+    if (in_aux) *in_aux = m->aux;
+    if (access) *access = m->acc;
+}
+
 static int maybe_language_card(word loc, bool wr)
 {
     if ((loc & 0xFFF0) != SS_LANG_CARD) return -1;
@@ -558,7 +669,7 @@ static int switch_reads(word loc)
 
 byte peek(word loc)
 {
-    int t = event_fire_peek(loc);
+    int t = event_bus_wanted(loc)? event_fire_peek(loc) : -1;
     if (t < 0) maybe_language_card(loc, false);
     if (t < 0) t = slot_access_switches(loc, -1);
     if (t < 0) {
@@ -571,9 +682,9 @@ byte peek(word loc)
 
 byte peek_sneaky(word loc)
 {
-    int t = -1; // PEEK_SNEAKY event handler?
-    if (t >= 0) {
-        return (byte) t;
+    const byte *pgmem = rdpage[loc >> 8];
+    if (pgmem != NULL) {
+        return pgmem[loc & 0xFF];
     }
 
     byte *mem;
@@ -606,7 +717,7 @@ byte peek_sneaky(word loc)
 
 void poke(word loc, byte val)
 {
-    if (event_fire_poke(loc, val))
+    if (event_bus_wanted(loc) && event_fire_poke(loc, val))
         return;
     trace_write(loc, val);
     if (maybe_language_card(loc, true) >= 0)
@@ -622,15 +733,59 @@ void poke_sneaky(word loc, byte val)
 {
     // XXX should handle slot-area writes
 
-    size_t bufloc;
-    bool aux;
-    MemAccessType acc;
-    mem_get_true_access(loc, true, &bufloc, &aux, &acc);
+    wrpage[loc >> 8][loc & 0xFF] = val;
 
-    if (acc != MA_ROM && acc != MA_SLOTS
-        && (!aux || cfg.amt_ram > LOC_AUX_START)) {
+    int hpg = wrcode[loc >> 8];
+    if (hpg >= 0 && block_code_pages[hpg]) {
+        block_invalidate_page(hpg);
+    }
+}
 
-        membuf[bufloc] = val;
+// Bulk transfers, for peripherals that DMA-style fill or drain a
+// buffer. Each page that's plain RAM (or ROM, for reading), and that
+// no one wants bus events for, is copied whole; anything else (I/O,
+// slot ROMs, watched pages) goes a byte at a time through peek() and
+// poke(), exactly as if the CPU had done it.
+void mem_peek_buf(byte *buf, word start, size_t sz)
+{
+    unsigned long loc = start;
+    unsigned long end = loc + sz;
+    while (loc < end) {
+        unsigned long pgend = (loc | 0xFF) + 1;
+        size_t n = (pgend < end? pgend : end) - loc;
+        const byte *pgmem = rdpage[(loc >> 8) & 0xFF];
+        if (pgmem != NULL && !event_bus_wanted(loc)) {
+            memcpy(buf, &pgmem[loc & 0xFF], n);
+        } else {
+            for (size_t i = 0; i != n; ++i)
+                buf[i] = peek(loc + i);
+        }
+        buf += n;
+        loc += n;
+    }
+}
+
+void mem_poke_buf(const byte *buf, word start, size_t sz)
+{
+    unsigned long loc = start;
+    unsigned long end = loc + sz;
+    while (loc < end) {
+        unsigned long pgend = (loc | 0xFF) + 1;
+        size_t n = (pgend < end? pgend : end) - loc;
+        unsigned int pg = (loc >> 8) & 0xFF;
+        if (wrcode[pg] >= 0 && (loc < SS_START || loc >= LOC_SLOTS_END)
+            && !event_bus_wanted(loc)) {
+            memcpy(&wrpage[pg][loc & 0xFF], buf, n);
+            for (size_t i = 0; i != n; ++i)
+                trace_write(loc + i, buf[i]);
+            if (block_code_pages[wrcode[pg]])
+                block_invalidate_page(wrcode[pg]);
+        } else {
+            for (size_t i = 0; i != n; ++i)
+                poke(loc + i, buf[i]);
+        }
+        buf += n;
+        loc += n;
     }
 }
 
@@ -0,0 +1,133 @@
+//  overlay.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// --disk-overlay: map disk images (Disk II and SmartPort alike)
+// copy-on-write, so that many emulators, or --fork-server jobs, can share
+// one base image without writing to it.
+//
+// The image is opened read-only and mapped MAP_PRIVATE. Reads come
+// straight from the page cache, shared with every other process using
+// the image; the first write to any page gives this process its own
+// copy of just that page. The kernel's page tables are the block map,
+// and nothing reaches the file, unless --disk-overlay-commit asks for
+// the changed blocks to be written back when the image is ejected, or
+// at exit.
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define COMMIT_BLOCK    4096
+
+struct overlay {
+    struct overlay *    next;
+    char *              fname;
+    byte *              buf;
+    size_t              sz;
+};
+
+static struct overlay *overlays;
+static bool at_exit_set;
+
+// Writes back the blocks of O that differ from its file.
+static void commit(struct overlay *o)
+{
+    errno = 0;
+    int fd = open(o->fname, O_RDWR);
+    if (fd < 0) {
+        WARN("--disk-overlay-commit: couldn't open \"%s\": %s\n",
+             o->fname, strerror(errno));
+        return;
+    }
+    static byte block[COMMIT_BLOCK];
+    unsigned long nblocks = 0;
+    for (size_t pos = 0; pos < o->sz; pos += COMMIT_BLOCK) {
+        size_t n = o->sz - pos < COMMIT_BLOCK? o->sz - pos : COMMIT_BLOCK;
+        if (pread(fd, block, n, pos) == (ssize_t)n
+            && memcmp(block, o->buf + pos, n) == 0) {
+            continue;
+        }
+        errno = 0;
+        if (pwrite(fd, o->buf + pos, n, pos) != (ssize_t)n) {
+            WARN("--disk-overlay-commit: couldn't write \"%s\": %s\n",
+                 o->fname, strerror(errno));
+            break;
+        }
+        ++nblocks;
+    }
+    close(fd);
+    INFO("--disk-overlay-commit: %lu changed block(s) written to \"%s\".\n",
+         nblocks, o->fname);
+}
+
+static void overlay_at_exit(void)
+{
+    for (struct overlay *o = overlays; o != NULL; o = o->next) {
+        commit(o);
+    }
+}
+
+int overlay_map(const char *fname, byte **buf, size_t *sz)
+{
+    if (!cfg.disk_overlay && !cfg.disk_overlay_commit) {
+        return mmapfile(fname, buf, sz, O_RDWR);
+    }
+
+    *buf = NULL;
+    errno = 0;
+    int fd = open(fname, O_RDONLY);
+    if (fd < 0) return errno;
+
+    struct stat st;
+    int err = 0;
+    if (fstat(fd, &st) < 0) {
+        err = errno;
+    } else {
+        void *p = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            err = errno;
+        } else {
+            *buf = p;
+            *sz = st.st_size;
+        }
+    }
+    close(fd);
+    if (*buf == NULL || !cfg.disk_overlay_commit) return err;
+
+    struct overlay *o = xalloc(sizeof *o);
+    o->fname = xalloc(strlen(fname) + 1);
+    strcpy(o->fname, fname);
+    o->buf = *buf;
+    o->sz = *sz;
+    o->next = overlays;
+    overlays = o;
+    if (!at_exit_set) {
+        at_exit_set = true;
+        atexit(overlay_at_exit);
+    }
+    return 0;
+}
+
+void overlay_release(byte *buf)
+{
+    for (struct overlay **op = &overlays; *op != NULL; op = &(*op)->next) {
+        struct overlay *o = *op;
+        if (o->buf != buf) continue;
+        commit(o);
+        *op = o->next;
+        free(o->fname);
+        free(o);
+        return;
+    }
+}
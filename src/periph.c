@@ -8,7 +8,7 @@
 
 #include <assert.h>
 
-static PeriphDesc *slot[8];
+static MACHINE_LOCAL PeriphDesc *slot[8];
 
 extern PeriphDesc disk2card;
 extern PeriphDesc smartport;
@@ -60,6 +60,36 @@ void periph_rom_poke(word loc, byte val)
     // XXX
 }
 
+bool periph_snap_save(Snapshot *s)
+{
+    bool ok = true;
+    for (int i = 0; i != (sizeof slot)/(sizeof slot[0]); ++i) {
+        if (slot[i] && slot[i]->snap_save && !slot[i]->snap_save(s))
+            ok = false;
+    }
+    return ok;
+}
+
+void periph_snap_restore(const Snapshot *s)
+{
+    for (int i = 0; i != (sizeof slot)/(sizeof slot[0]); ++i) {
+        if (slot[i] && slot[i]->snap_restore)
+            slot[i]->snap_restore(s);
+    }
+}
+
+void periph_snap_key(void)
+{
+    for (int i = 0; i != (sizeof slot)/(sizeof slot[0]); ++i) {
+        // Which card is in the slot...
+        int present = slot[i] != NULL;
+        snapshot_key_add(&present, sizeof present);
+        // ...and anything it loads.
+        if (slot[i] && slot[i]->snap_key)
+            slot[i]->snap_key();
+    }
+}
+
 int periph_slot_reg(unsigned int slotnum, PeriphDesc *card)
 {
     if (slotnum > (sizeof slot)/(sizeof slot[0]))
@@ -26,19 +26,19 @@
 # define D2DBG(...)
 #endif
 
-static bool initialized;
-static bool motor_on;
-static bool drive_two;
-static bool write_mode;
-static DiskFormatDesc disk1;
-static DiskFormatDesc disk2;
-static byte data_register; // only used for write
-static byte *rombuf;
+static MACHINE_LOCAL bool initialized;
+static MACHINE_LOCAL bool motor_on;
+static MACHINE_LOCAL bool drive_two;
+static MACHINE_LOCAL bool write_mode;
+static MACHINE_LOCAL DiskFormatDesc disk1;
+static MACHINE_LOCAL DiskFormatDesc disk2;
+static MACHINE_LOCAL byte data_register; // only used for write
+static MACHINE_LOCAL byte *rombuf;
 static const size_t dsk_disksz = 143360;
-static int pr_count;
-static bool steppers[4];
-static int cog1 = 0;
-static int cog2 = 0;
+static MACHINE_LOCAL int pr_count;
+static MACHINE_LOCAL bool steppers[4];
+static MACHINE_LOCAL int cog1 = 0;
+static MACHINE_LOCAL int cog2 = 0;
 
 static inline DiskFormatDesc *active_disk_obj(void)
 {
@@ -55,6 +55,11 @@ int active_disk(void)
     return drive_two? 2 : 1;
 }
 
+// Entry points for --fast-rwts
+#define RWTS_ENTRY          0xBD00
+#define PRODOS_DRV_ENTRY    0xD000
+static void fast_rwts_event(Event *e);
+
 static void init(void)
 {
     if (initialized) return;
@@ -71,6 +76,13 @@ static void init(void)
     if (cfg.disk2) {
         disk2 = disk_format_load(cfg.disk2);
     }
+
+    if (cfg.fast_rwts) {
+        event_reghandler_for(fast_rwts_event,
+                             EV_MASK(EV_PRESTEP) | EV_FLAG_SOME_PCS);
+        event_step_pc(RWTS_ENTRY);
+        event_step_pc(PRODOS_DRV_ENTRY);
+    }
 }
 
 int eject_disk(int drive)
@@ -176,8 +188,33 @@ static void turn_off_motor(void)
     event_fire_disk_active(0);
 }
 
-static int lastsw = -1;
-static int lastpc = -1;
+// After a motor-off ($C0x8), the motor keeps spinning until there's
+// been no controller access for a second. Rather than pushing the
+// deadline back on every access, each access just notes the time, and
+// the timer checks it when it comes due.
+#define MOTOR_OFF_CYCLES    (60 * CYCLES_PER_FRAME)
+static MACHINE_LOCAL uintmax_t last_access;
+static void motor_timer_due(void);
+static MACHINE_LOCAL SchedTimer motor_timer = SCHED_TIMER(motor_timer_due);
+
+static void motor_timer_due(void)
+{
+    uintmax_t quiet = cycles_now() - last_access;
+    if (quiet < MOTOR_OFF_CYCLES) {
+        sched_at(&motor_timer, last_access + MOTOR_OFF_CYCLES);
+    } else {
+        turn_off_motor();
+    }
+}
+
+static void motor_off_soon(void)
+{
+    last_access = cycles_now();
+    sched_in(&motor_timer, MOTOR_OFF_CYCLES);
+}
+
+static MACHINE_LOCAL int lastsw = -1;
+static MACHINE_LOCAL int lastpc = -1;
 static byte handler(word loc, int val, int ploc, int psw)
 {
     byte ret = 0;
@@ -202,7 +239,7 @@ static byte handler(word loc, int val, int ploc, int psw)
         lastpc = current_pc();
     }
 
-    frame_timer_reset(60, turn_off_motor);
+    last_access = cycles_now();
     D2DBG("disk sw $%02X, PC = $%04X   ", psw, lastpc);
     if (val != -1)
         data_register = val; // ANY write sets data register
@@ -210,13 +247,13 @@ static byte handler(word loc, int val, int ploc, int psw)
         stepper_motor(psw);
     } else switch (psw) {
         case 0x08:
-            if (motor_on) {
-                frame_timer(60, turn_off_motor);
+            if (motor_on && !sched_pending(&motor_timer)) {
+                motor_off_soon();
             }
             break;
         case 0x09:
         {
-            frame_timer_cancel(turn_off_motor);
+            sched_cancel(&motor_timer);
             motor_on = true;
             DiskFormatDesc *disk = active_disk_obj();
             disk->spin(disk, true);
@@ -257,6 +294,7 @@ static byte handler(word loc, int val, int ploc, int psw)
                 //  to read a byte. But for now we do so only
                 //  through the sanctioned switch for that purpose.
                 ret = data_register = disk->read_byte(disk);
+                STAT_INC(disk_nibbles);
             }
         }
             break;
@@ -286,7 +324,229 @@ static byte handler(word loc, int val, int ploc, int psw)
     return ret;
 }
 
+/********** --fast-rwts **********/
+
+// Rather than have DOS 3.3's RWTS or ProDOS's Disk II driver find
+// each sector by reading nibbles, --fast-rwts recognizes their entry
+// points, does the whole read or write against the image, and returns
+// to the caller as they would have. Only formats that can hand over
+// whole sectors (.dsk/.do/.po) take part: .nib images, and anything
+// we don't recognize, go the exact way.
+//
+// The head isn't moved, and neither are the routines' own notes of
+// where it is, so that whatever next goes the exact way finds the
+// two still agreeing.
+
+// Logical sector -> physical sector
+static const byte dos_phys[] = {
+    0x0, 0xD, 0xB, 0x9, 0x7, 0x5, 0x3, 0x1,
+    0xE, 0xC, 0xA, 0x8, 0x6, 0x4, 0x2, 0xF
+};
+static const byte prodos_phys[] = {
+    0x0, 0x2, 0x4, 0x6, 0x8, 0xA, 0xC, 0xE,
+    0x1, 0x3, 0x5, 0x7, 0x9, 0xB, 0xD, 0xF
+};
+
+static bool code_matches(word loc, const int *sig, size_t n)
+{
+    for (size_t i = 0; i != n; ++i) {
+        if (sig[i] != -1 && peek_sneaky(loc + i) != sig[i]) return false;
+    }
+    return true;
+}
+
+// One sector between memory at loc and the image; false if the
+// image can't do it.
+static bool xfer_sector(DiskFormatDesc *disk, bool wr, int t, int phys,
+                        word loc)
+{
+    byte buf[256];
+    if (wr) {
+        mem_peek_buf(buf, loc, sizeof buf);
+        return disk->write_sector(disk, t, phys, buf);
+    }
+    if (!disk->read_sector(disk, t, phys, buf)) return false;
+    mem_poke_buf(buf, loc, sizeof buf);
+    return true;
+}
+
+static bool fast_dos_rwts(void)
+{
+    static const int sig[] = {
+        0x84, 0x48, 0x85, 0x49, 0xA0, 0x02, 0x8C, 0xF8, 0x06,
+    };
+    if (!code_matches(RWTS_ENTRY, sig, sizeof sig / sizeof sig[0]))
+        return false;
+
+    word iob = WORD(YREG, ACC);
+    byte slot = peek_sneaky(iob + 1);
+    byte drive = peek_sneaky(iob + 2);
+    byte vol = peek_sneaky(iob + 3);
+    byte t = peek_sneaky(iob + 4);
+    byte sec = peek_sneaky(iob + 5);
+    word buffer = word_at(iob + 8);
+    byte cmd = peek_sneaky(iob + 0xC);
+    if (slot != 0x60 || (drive != 1 && drive != 2) || sec >= 16
+        || t >= NUM_TRACKS || (cmd != 1 && cmd != 2))
+        return false;
+
+    DiskFormatDesc *disk = drive == 2? &disk2 : &disk1;
+    if (disk->read_sector == NULL) return false;
+
+    byte err = 0;
+    if (vol != 0 && vol != 254) {
+        err = 0x20;     // volume mismatch
+    } else if (cmd == 2 && disk->writeprot) {
+        err = 0x10;
+    } else if (!xfer_sector(disk, cmd == 2, t, dos_phys[sec], buffer)) {
+        return false;
+    }
+
+    poke(iob + 0xD, err);
+    poke(iob + 0xE, 254);   // volume found
+    ACC = err;
+    XREG = slot;
+    PPUT(PCARRY, err != 0);
+    return true;
+}
+
+static bool fast_prodos_driver(void)
+{
+    static const int sig[] = {
+        0xD8, 0x20, -1, -1, 0xBD, 0x8E, 0xC0,
+    };
+    byte cmd = peek_sneaky(0x42);
+    byte unit = peek_sneaky(0x43);
+    // Only if this is where ProDOS sends this slot-6 unit.
+    if ((unit & 0x70) != 0x60 || word_at(0xBF10 + (unit >> 3)) != PC
+        || !code_matches(PC, sig, sizeof sig / sizeof sig[0])
+        || (cmd != 1 && cmd != 2))
+        return false;
+
+    DiskFormatDesc *disk = (unit & 0x80)? &disk2 : &disk1;
+    word buffer = WORD(peek_sneaky(0x44), peek_sneaky(0x45));
+    word blk = WORD(peek_sneaky(0x46), peek_sneaky(0x47));
+    if (disk->read_sector == NULL || blk >= NUM_TRACKS * 8)
+        return false;
+
+    byte err = 0;
+    if (cmd == 2 && disk->writeprot) {
+        err = 0x2B;     // write-protected
+    } else {
+        int t = blk / 8;
+        int sec = (blk % 8) * 2;
+        if (!xfer_sector(disk, cmd == 2, t, prodos_phys[sec], buffer)
+            || !xfer_sector(disk, cmd == 2, t, prodos_phys[sec+1],
+                            buffer + 256))
+            err = 0x27; // I/O error
+    }
+
+    ACC = err;
+    PPUT(PCARRY, err != 0);
+    return true;
+}
+
+static void fast_rwts_event(Event *e)
+{
+    static MACHINE_LOCAL bool told_dos, told_prodos;
+    if (e->type != EV_PRESTEP) return;
+    bool done = false;
+    if (PC == RWTS_ENTRY) {
+        done = fast_dos_rwts();
+        if (done && !told_dos) {
+            INFO("--fast-rwts: satisfying DOS 3.3 RWTS calls directly.\n");
+            told_dos = true;
+        }
+    } else if (PC == PRODOS_DRV_ENTRY) {
+        done = fast_prodos_driver();
+        if (done && !told_prodos) {
+            INFO("--fast-rwts: satisfying ProDOS disk driver calls"
+                 " directly.\n");
+            told_prodos = true;
+        }
+    }
+    if (done) {
+        // Both routines turn the motor off on the way out.
+        if (motor_on && !sched_pending(&motor_timer)) {
+            motor_off_soon();
+        }
+        PPUT(PDEC, false);
+        rts();
+    }
+}
+
+struct disk2_snap {
+    bool motor_on;
+    bool drive_two;
+    bool write_mode;
+    byte data_register;
+    bool steppers[4];
+    int cog1;
+    int cog2;
+    unsigned int halftrack[2];
+    long pos[2];
+};
+
+static bool snap_save(Snapshot *s)
+{
+    struct disk2_snap d = {
+        .motor_on = motor_on,
+        .drive_two = drive_two,
+        .write_mode = write_mode,
+        .data_register = data_register,
+        .cog1 = cog1,
+        .cog2 = cog2,
+        .halftrack = { disk1.halftrack, disk2.halftrack },
+        .pos = { disk1.tell? disk1.tell(&disk1) : 0,
+                 disk2.tell? disk2.tell(&disk2) : 0 },
+    };
+    memcpy(d.steppers, steppers, sizeof steppers);
+    snap_put(s, "disk2", &d, sizeof d);
+    return true;
+}
+
+static void snap_restore(const Snapshot *s)
+{
+    const struct disk2_snap *d = snap_get(s, "disk2", sizeof *d);
+    if (d == NULL) return;
+
+    if (motor_on) {
+        // Quietly: we're not really spinning down.
+        sched_cancel(&motor_timer);
+        DiskFormatDesc *disk = active_disk_obj();
+        disk->spin(disk, false);
+        motor_on = false;
+    }
+    drive_two = d->drive_two;
+    write_mode = d->write_mode;
+    data_register = d->data_register;
+    memcpy(steppers, d->steppers, sizeof steppers);
+    cog1 = d->cog1;
+    cog2 = d->cog2;
+    disk1.halftrack = d->halftrack[0];
+    disk2.halftrack = d->halftrack[1];
+    if (disk1.seek) disk1.seek(&disk1, d->pos[0]);
+    if (disk2.seek) disk2.seek(&disk2, d->pos[1]);
+    if (d->motor_on) {
+        motor_on = true;
+        DiskFormatDesc *disk = active_disk_obj();
+        disk->spin(disk, true);
+        event_fire_disk_active(drive_two? 2 : 1);
+        motor_off_soon();
+    }
+}
+
+static void snap_key(void)
+{
+    // The images as they are now, before anything's been written.
+    if (cfg.disk) snapshot_key_add_file(cfg.disk);
+    if (cfg.disk2) snapshot_key_add_file(cfg.disk2);
+}
+
 PeriphDesc disk2card = {
     init,
     handler,
+    snap_save,
+    snap_restore,
+    snap_key,
 };
@@ -51,12 +51,12 @@ typedef struct {
     int delta_y;
 } MouseState;
 
-static MouseState mouse = {0};
-static unsigned int slot_num = 4;  // Default to slot 4
+static MACHINE_LOCAL MouseState mouse = {0};
+static MACHINE_LOCAL unsigned int slot_num = 4;  // Default to slot 4
 
 // ROM data - loaded from file
-static byte mouse_rom[MOUSE_ROM_SIZE];
-static bool rom_loaded = false;
+static MACHINE_LOCAL byte mouse_rom[MOUSE_ROM_SIZE];
+static MACHINE_LOCAL bool rom_loaded = false;
 
 // Forward declarations
 static void load_mouse_rom(void);
@@ -310,7 +310,21 @@ unsigned int mouse_get_slot(void)
     return slot_num;
 }
 
+static bool snap_save(Snapshot *s)
+{
+    snap_put(s, "mouse", &mouse, sizeof mouse);
+    return true;
+}
+
+static void snap_restore(const Snapshot *s)
+{
+    const MouseState *m = snap_get(s, "mouse", sizeof mouse);
+    if (m) mouse = *m;
+}
+
 PeriphDesc mousecard = {
     init,
     handler,
+    snap_save,
+    snap_restore,
 };
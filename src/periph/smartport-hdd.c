@@ -10,7 +10,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-#include <sys/stat.h>
+#include <fcntl.h>
 
 #define SP_DO_READ  0
 #define SP_DO_WRITE 1
@@ -31,20 +31,27 @@
 
 struct SPDev {
     const char *fname;
-    FILE       *fh;
-    off_t       sz;
+    byte       *buf;        // the image, mapped (shared)
+    size_t      sz;
     byte        bsz[3];
 };
 
 const static unsigned int MAX_NDEV = 4;
-unsigned int ndev = 0;
-static struct SPDev devices[4];
+MACHINE_LOCAL unsigned int ndev = 0;
+static MACHINE_LOCAL struct SPDev devices[4];
 
 // Bytes to identify this slot as a SmartPort card.
 static const byte id_bytes[] = { 0xA9, 0x20, 0xA9, 0x00,
                                  0xA9, 0x03, 0xA9, 0x00 };
 
 // Entry points
+// Frames after the last block access during which the controller
+// still counts as busy, for --disk-accel: a ProDOS program loading a
+// file makes many calls in a row, with a little work between each.
+#define SP_BUSY_FRAMES  30
+static MACHINE_LOCAL bool io_seen = false;
+static MACHINE_LOCAL uintmax_t last_io_frame;
+
 static const byte smartport_ep  = 0x20;
 static const byte prodos_ep     = smartport_ep - 3;
 
@@ -179,106 +186,69 @@ static void handle_status(word params)
     }
 }
 
-static void write_block(byte unit, off_t blkpos, word buffer)
+bool smartport_busy(void)
 {
-    if (unit == 0 || unit > ndev) {
-        WARN("Bad write_black unit number %d\n", (int)unit);
-        RETURN_ERROR(DevDiscon);
-    }
-
-    if (buffer > 0x10000 - 512) {
-        WARN("Bad buffer $%04lX provided to write_block\n",
-             (unsigned long)buffer);
-        RETURN_ERROR(BadBuf);
-    }
-
-    struct SPDev *d = &devices[unit-1];
-    off_t sekpos = blkpos * 512;
-    size_t newloc;
-    mem_get_true_access(buffer, false /* reading */,
-                        &newloc, NULL, NULL);
-    DEBUG("write_block, unit=%d, blk=%zu, buf=%04lX, REALbuf=%04zX\n", (int)unit,
-          (size_t)blkpos, (unsigned long)buffer, newloc);
-    errno = 0;
-    DEBUG("fseeko(\"%s\", %zu, SEEK_SET)\n", d->fname, (size_t)sekpos);
-    if (fseeko(d->fh, sekpos, SEEK_SET) < 0) {
-        int err = errno;
-        WARN("Bad smartport block requested for \"%s\", offset %zu: %s\n",
-             d->fname, (size_t)sekpos, strerror(err));
-        RETURN_ERROR(BadBlock);
-    }
-
-    byte buf[512];
-    //const byte *buf = getram();
-
-    // We do an inefficient loop bc it's an easy way
-    // to ensure everything comes from where it actually ought to, in the case
-    // of crossing mapping boundaries (up to 3 different regions of
-    // memory are possible)
-    for (word i=0; i != 512; ++i) {
-        buf[i] = peek(buffer+i);
-    }
-
-    errno = 0;
-    if (fwrite(buf, 1, 512, d->fh) < 512) {
-        int err = errno;
-        DIE(1, "Couldn't write 512 bytes at offset %zu in hdd \"%s\": %s.\n",
-            (size_t)sekpos, d->fname, strerror(err));
-    }
+    return io_seen && frame_count - last_io_frame < SP_BUSY_FRAMES;
+}
 
-    PPUT(PCARRY, false);
+static void note_io(void)
+{
+    io_seen = true;
+    last_io_frame = frame_count;
 }
 
-static void read_block(byte unit, off_t blkpos, word buffer)
+// Moves nbytes between memory at buffer and the image, starting at
+// block blkpos. Most calls move one block; the SmartPort READ and
+// WRITE calls can move several in one go.
+static bool transfer(byte unit, off_t blkpos, word buffer, size_t nbytes,
+                     bool rw)
 {
+    const char *what = rw == SP_DO_READ? "read" : "write";
+    note_io();
     if (unit == 0 || unit > ndev) {
-        WARN("Bad read_black unit number %d\n", (int)unit);
+        WARN("Bad %s_block unit number %d\n", what, (int)unit);
         RETURN_ERROR(DevDiscon);
+        return false;
     }
 
-    if (buffer > 0x10000 - 512) {
-        WARN("Bad buffer $%04lX provided to read_block\n",
-             (unsigned long)buffer);
+    if (buffer + nbytes > 0x10000) {
+        WARN("Bad buffer $%04lX provided to %s_block\n",
+             (unsigned long)buffer, what);
         RETURN_ERROR(BadBuf);
+        return false;
     }
 
     struct SPDev *d = &devices[unit-1];
-    off_t sekpos = blkpos * 512;
-    size_t newloc;
-    mem_get_true_access(buffer, true /* writing */,
-                        &newloc, NULL, NULL);
-    DEBUG("read_block, unit=%d, blk=%zu, buf=%04lX, REALbuf=%04zX\n", (int)unit,
-          (size_t)blkpos, (unsigned long)buffer, newloc);
-    errno = 0;
-    DEBUG("fseeko(\"%s\", %zu, SEEK_SET)\n", d->fname, (size_t)sekpos);
-    if (fseeko(d->fh, sekpos, SEEK_SET) < 0) {
-        int err = errno;
-        WARN("Bad smartport block requested for \"%s\", offset %zu: %s.\n",
-             d->fname, (size_t)sekpos, strerror(err));
+    size_t pos = (size_t)blkpos * 512;
+    DEBUG("%s_block, unit=%d, blk=%zu, buf=%04lX, bytes=%zu\n", what,
+          (int)unit, (size_t)blkpos, (unsigned long)buffer, nbytes);
+    if (pos > d->sz || nbytes > d->sz - pos) {
+        WARN("Bad smartport block requested for \"%s\", offset %zu.\n",
+             d->fname, pos);
         RETURN_ERROR(BadBlock);
+        return false;
     }
 
-    byte buf[512];
-    errno = 0;
-    if (fread(buf, 1, 512, d->fh) < 512) {
-        int err = errno;
-        DIE(1, "Couldn't read 512 bytes at offset %zu in hdd \"%s\": %s.\n",
-            (size_t)sekpos, d->fname, strerror(err));
-    }
-#if 0
-    DEBUG("fread BUFFER: %02X %02X %02X %02X %02X %02X %02X %02X\n",
-          buf[0], buf[1], buf[2], buf[3], buf[4], buf[5], buf[6], buf[7]);
-#endif
-    // We do an inefficient loop bc it's an easy way
-    // to ensure everything goes where it actually ought to, in the case
-    // of crossing mapping boundaries (up to 3 different regions of
-    // memory are possible)
-    for (word i=0; i != 512; ++i) {
-        poke(buffer+i, buf[i]);
+    // The image is mapped, so this is the whole job: no host I/O
+    // happens until the kernel writes the pages back.
+    if (rw == SP_DO_READ) {
+        mem_poke_buf(d->buf + pos, buffer, nbytes);
+    } else {
+        mem_peek_buf(d->buf + pos, buffer, nbytes);
     }
-    //mem_put(buf, newloc, 512);
 
     PPUT(PCARRY, false);
+    return true;
+}
+
+static void write_block(byte unit, off_t blkpos, word buffer)
+{
+    (void) transfer(unit, blkpos, buffer, 512, SP_DO_WRITE);
+}
+
+static void read_block(byte unit, off_t blkpos, word buffer)
+{
+    (void) transfer(unit, blkpos, buffer, 512, SP_DO_READ);
 }
 
 static void handle_sp_rw_block(word params, bool rw)
@@ -296,6 +266,7 @@ static void handle_sp_rw_block(word params, bool rw)
              rw == SP_DO_READ? "read" : "write",
              (int)pcount);
         RETURN_ERROR(BadPCnt);
+        return;
     }
 
     off_t blkpos = (blkhi << 16) | (blkmd << 8) | blklo;
@@ -305,6 +276,36 @@ static void handle_sp_rw_block(word params, bool rw)
         write_block(unit, blkpos, WORD(buflo, bufhi));
 }
 
+// SmartPort READ ($08) and WRITE ($09): like READ BLOCK and WRITE
+// BLOCK, but with a byte count, so that a run of blocks can be moved
+// in one call.
+static void handle_sp_rw_bytes(word params, bool rw)
+{
+    byte pcount = peek(params++);
+    byte unit   = peek(params++);
+    byte buflo  = peek(params++);
+    byte bufhi  = peek(params++);
+    byte cntlo  = peek(params++);
+    byte cnthi  = peek(params++);
+    byte blklo  = peek(params++);
+    byte blkmd  = peek(params++);
+    byte blkhi  = peek(params++);
+
+    if (pcount != 4) {
+        WARN("Bad %s pcount: %d\n", rw == SP_DO_READ? "read" : "write",
+             (int)pcount);
+        RETURN_ERROR(BadPCnt);
+        return;
+    }
+
+    off_t blkpos = (blkhi << 16) | (blkmd << 8) | blklo;
+    word count = WORD(cntlo, cnthi);
+    if (transfer(unit, blkpos, WORD(buflo, bufhi), count, rw)) {
+        XREG = cntlo; // bytes transferred
+        YREG = cnthi;
+    }
+}
+
 static void handle_smartport_entry(void)
 {
     // Get the return value off the stack
@@ -341,6 +342,12 @@ static void handle_smartport_entry(void)
         case 0x02:
             handle_sp_rw_block(params, SP_DO_WRITE);
             break;
+        case 0x08:
+            handle_sp_rw_bytes(params, SP_DO_READ);
+            break;
+        case 0x09:
+            handle_sp_rw_bytes(params, SP_DO_WRITE);
+            break;
 /*
         case 0x03:
             handle_format(params);
@@ -351,12 +358,6 @@ static void handle_smartport_entry(void)
         case 0x05:
             handle_init(params);
             break;
-        case 0x08:
-            handle_read(params);
-            break;
-        case 0x09:
-            handle_write(params);
-            break;
 */
         default:
             DEBUG("Unsupported SmartPort call: 0x%0X\n", (unsigned int)fn);
@@ -509,27 +510,16 @@ static void init(void)
         return;
 
     for (struct SPDev *d = devices; d != devices + ndev; ++d) {
-        errno = 0;
-        d->fh = fopen(d->fname, "rb+");
-        int err = errno;
-        if (!d->fh) {
+        int err = overlay_map(d->fname, &d->buf, &d->sz);
+        if (d->buf == NULL) {
             DIE(1, "Couldn't open hdd file \"%s\": %s\n", d->fname,
                 strerror(err));
         }
 
-        int fd = fileno(d->fh);
-        errno = 0;
-        struct stat s;
-        if (fstat(fd, &s) < 0) {
-            err = errno;
-            DIE(1, "Couldn't stat hdd file \"%s\": %s\n", d->fname,
-                strerror(err));
-        }
-
-        d->sz = s.st_size;
         unsigned long bcount = d->sz / 512;
         if (bcount * 512 != d->sz) {
-            DIE(1, "HDD image file \"%s\" is not a multiple of 512 in length.\n");
+            DIE(1, "HDD image file \"%s\" is not a multiple of 512 in length.\n",
+                d->fname);
         }
         for (int i=0; i!=3; ++i) {
             d->bsz[i] = bcount & 0xFF;
@@ -537,7 +527,10 @@ static void init(void)
         }
     }
 
-    event_reghandler(handle_event);
+    event_reghandler_for(handle_event, EV_MASK(EV_PRESTEP) | EV_FLAG_SOME_PCS);
+    event_step_pc(0xC500);
+    event_step_pc(0xC500 | smartport_ep);
+    event_step_pc(0xC500 | prodos_ep);
 }
 
 static byte handler(word loc, int val, int ploc, int psw)
@@ -624,7 +617,19 @@ void smartport_add_image(const char *fname)
     d->fname = fname;
 }
 
+static void snap_key(void)
+{
+    // The card itself has no state beyond its images; but what's
+    // been read from them does.
+    for (unsigned int i = 0; i != ndev; ++i) {
+        snapshot_key_add_file(devices[i].fname);
+    }
+}
+
 PeriphDesc smartport = {
     init,
     handler,
+    NULL,
+    NULL,
+    snap_key,
 };
@@ -17,10 +17,20 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
 
 // W5100 Register Addresses (internal memory map)
 #define W5100_MR        0x0000  // Mode Register
@@ -93,14 +103,15 @@
 #define Sn_SR_IPRAW         0x32
 #define Sn_SR_MACRAW        0x42
 
-// TX/RX Buffer addresses (default: 2KB per socket)
+// TX/RX Buffer addresses (split between the sockets by TMSR/RMSR)
 #define W5100_TX_BASE   0x4000  // TX buffer base
 #define W5100_TX_SIZE   0x2000  // 8KB total TX buffer
 #define W5100_RX_BASE   0x6000  // RX buffer base
 #define W5100_RX_SIZE   0x2000  // 8KB total RX buffer
 
-// Per-socket buffer sizes (default 2KB each)
-#define SOCK_BUF_SIZE   0x0800  // 2KB per socket
+// Most a single (MACRAW) frame we'll build or accept, with its
+// two-byte W5100 length prefix.
+#define FRAME_MAX       1600
 
 // Apple II I/O soft switch offsets
 // For slot N: $C0n4 = Mode, $C0n5 = Addr Hi, $C0n6 = Addr Lo, $C0n7 = Data
@@ -120,12 +131,81 @@
 typedef struct {
     int fd;                     // Host BSD socket fd (-1 if not open)
     bool connecting;            // Non-blocking connect in progress
-    byte rx_buf[4096];          // Local receive buffer
-    word rx_head;               // Receive buffer head
-    word rx_tail;               // Receive buffer tail
+    // The RX ring holds the data itself (in u2.memory); these are
+    // W5100-style free-running pointers into it, as Sn_RX_RD is.
+    word rx_rd;                 // Guest's read pointer, as of its last RECV
+    word rx_wr;                 // Where the next received byte goes
     bool macraw_mode;           // In MACRAW mode (raw Ethernet)
+    short revents;              // fd's readiness, as of the last check
 } SocketState;
 
+// A program reads several status registers in a row, and may spin on
+// them. Status reads are answered from the state we last brought up
+// to date, and the host is asked about all the sockets at once (in a
+// single poll()) at most this often: about a quarter of a millisecond.
+#define SOCK_POLL_CYCLES    256
+static uintmax_t ready_stale_at;
+
+// With --uthernet2-thread, TCP sockets' host fds belong to a network
+// thread instead, so that nothing the host network does can hold up
+// emulation. Each socket talks to it through single-producer,
+// single-consumer queues: commands and TX data one way, RX data the
+// other (lock-free, with free-running counters: a side only ever
+// writes its own end). The thread publishes the socket's status, along
+// with the sequence number of the last command it has carried out;
+// the emulated W5100 only takes that status up once the thread has
+// caught up with all it was told.
+#define NET_QSIZE   0x2000      // (a power of two)
+#define NET_NCMDS   16
+
+typedef struct {
+    byte buf[NET_QSIZE];
+    uint32_t head;              // Advanced by the producer
+    uint32_t tail;              // Advanced by the consumer
+} NetQueue;
+
+typedef enum {
+    NET_OPEN,
+    NET_LISTEN,
+    NET_CONNECT,
+    NET_CLOSE,
+} NetOp;
+
+typedef struct {
+    NetOp op;
+    uint32_t seq;
+    struct sockaddr_in addr;    // LISTEN (port only) and CONNECT
+} NetCmd;
+
+typedef struct {
+    // Emulation thread -> network thread
+    NetCmd cmds[NET_NCMDS];
+    uint32_t cmd_head, cmd_tail;
+    NetQueue tx;
+    // Network thread -> emulation thread
+    NetQueue rx;
+    uint32_t status;            // (seq << 8) | Sn_SR
+    uint32_t rx_reset_at;       // rx.head, as of the last OPEN
+    // The emulation thread's own
+    bool open;
+    bool need_reset;            // Skip whatever's in rx up to rx_reset_at
+    uint32_t seq;               // Of the last command sent
+    uint32_t seen;              // Last status taken up
+    bool sending;               // Some of the last SEND is still to go
+    word send_to;               // (Sn_TX_WR as of that SEND)
+    // The network thread's own
+    int fd;
+    byte sr;                    // Last status published
+    uint32_t done_seq;          // Of the last command carried out
+} NetSock;
+
+#define LOAD_ACQ(p)     __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define STORE_REL(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static NetSock net_socks[4];
+static bool net_running;
+static int net_wake[2] = { -1, -1 };   // Pipe that rouses the thread
+
 // Virtual DHCP state
 typedef enum {
     DHCP_IDLE,
@@ -162,11 +242,25 @@ static unsigned int slot_num = 3;  // Default to slot 3
 static void socket_command(int socknum, byte cmd);
 static void socket_poll(int socknum);
 static void virtual_tcp_poll(int socknum);
+static void refresh_sockets(void);
+static void net_open(int socknum);
+static void net_close(int socknum);
+static void net_socket_command(int socknum, byte cmd);
+static void net_sync(int socknum);
+static void net_start(void);
 static word get_socket_base(int socknum);
 static word get_tx_base(int socknum);
 static word get_rx_base(int socknum);
+static word get_tx_size(int socknum);
+static word get_rx_size(int socknum);
+static int ring_iov(word base, word size, word ptr, word len,
+                    struct iovec iov[2]);
+static word rx_ring_free(int socknum);
+static bool rx_ring_put(int socknum, const byte *data, word len);
+static void ring_get(word base, word size, word ptr, byte *dst, word len);
 static void handle_macraw_send(int socknum);
 static void inject_dhcp_response(int socknum, bool is_ack);
+static word vtcp_room(int socknum);
 
 //=============================================================================
 // Virtual DHCP Implementation
@@ -246,6 +340,10 @@ static void inject_dhcp_response(int socknum, bool is_ack);
 #define TCP_URGENT      18      // Urgent pointer (2 bytes)
 #define TCP_HEADER_LEN  20      // Minimum header length
 
+// What wraps each chunk of data we hand the guest, in the RX ring
+#define TCP_PKT_OVERHEAD (2 + ETH_HEADER_LEN + IPH_HEADER_LEN + TCP_HEADER_LEN)
+#define TCP_PAYLOAD_MAX  1400
+
 // TCP flags
 #define TCP_FIN         0x01
 #define TCP_SYN         0x02
@@ -270,6 +368,7 @@ static struct {
     bool established;           // Connection is established
     bool fin_sent;              // We sent FIN
     bool fin_received;          // We received FIN
+    short revents;              // fd's readiness, as of the last check
 } virtual_tcp = { .fd = -1 };
 
 // Forward declarations for TCP
@@ -337,11 +436,8 @@ static int detect_dhcp_type(byte *frame, int len)
 // Build and inject a DHCP response (offer or ack)
 static void inject_dhcp_response(int socknum, bool is_ack)
 {
-    SocketState *ss = &u2.sockets[socknum];
-    word base = get_socket_base(socknum);
-
-    // Build response packet in rx_buf
-    byte *pkt = ss->rx_buf;
+    // Build response packet, then queue it in the RX ring
+    byte pkt[FRAME_MAX];
     int pos = 0;
 
     // W5100 MACRAW prepends 2 bytes for packet length
@@ -482,9 +578,11 @@ static void inject_dhcp_response(int socknum, bool is_ack)
     pkt[0] = (pos >> 8) & 0xFF;
     pkt[1] = pos & 0xFF;
 
-    // Update RX buffer state
-    ss->rx_head = 0;
-    ss->rx_tail = pos;
+    if (!rx_ring_put(socknum, pkt, pos)) {
+        DEBUG("Uthernet II: RX ring full, DHCP %s dropped\n",
+              is_ack ? "ACK" : "OFFER");
+        return;
+    }
 
     DEBUG("Uthernet II: Injected DHCP %s (%d bytes)\n",
           is_ack ? "ACK" : "OFFER", pos);
@@ -519,9 +617,8 @@ static void handle_arp_packet(int socknum, byte *frame, int len)
 
 static void inject_arp_reply(int socknum, byte *request_frame)
 {
-    SocketState *ss = &u2.sockets[socknum];
-    // Write to ss->rx_buf (same as DHCP does)
-    byte *pkt = ss->rx_buf;
+    // Build the reply, then queue it in the RX ring (as DHCP does)
+    byte pkt[FRAME_MAX];
 
     byte *req_arp = request_frame + ETH_HEADER_LEN;
     int pos = 2;  // Skip W5100 length prefix
@@ -563,9 +660,10 @@ static void inject_arp_reply(int socknum, byte *request_frame)
     pkt[0] = (pos >> 8) & 0xFF;
     pkt[1] = pos & 0xFF;
 
-    // Update RX buffer state
-    ss->rx_head = 0;
-    ss->rx_tail = pos;
+    if (!rx_ring_put(socknum, pkt, pos)) {
+        DEBUG("Uthernet II: RX ring full, ARP reply dropped\n");
+        return;
+    }
 
     DEBUG("Uthernet II: Injected ARP reply (%d bytes)\n", pos);
 }
@@ -733,9 +831,11 @@ static void handle_tcp_packet(int socknum, byte *frame, int len)
             // Check for response data from host
             if (virtual_tcp.fd >= 0) {
                 struct pollfd pfd = { virtual_tcp.fd, POLLIN, 0 };
-                while (poll(&pfd, 1, 50) > 0) {  // Small timeout to gather data
-                    byte recv_buf[1400];
-                    ssize_t got = recv(virtual_tcp.fd, recv_buf, sizeof(recv_buf), 0);
+                word room;
+                while ((room = vtcp_room(socknum)) > 0
+                       && poll(&pfd, 1, 50) > 0) {  // Small timeout to gather data
+                    byte recv_buf[TCP_PAYLOAD_MAX];
+                    ssize_t got = recv(virtual_tcp.fd, recv_buf, room, 0);
                     if (got > 0) {
                         DEBUG("Uthernet II: TCP received %zd bytes from host\n", got);
                         inject_tcp_response(socknum, TCP_ACK_FLAG | TCP_PSH, recv_buf, got);
@@ -776,15 +876,26 @@ static void handle_tcp_packet(int socknum, byte *frame, int len)
     }
 }
 
+// How much host data we can pass along to the guest in one packet,
+// given what's free in its RX ring.
+static word vtcp_room(int socknum)
+{
+    word room = rx_ring_free(socknum);
+    if (room <= TCP_PKT_OVERHEAD) return 0;
+    room -= TCP_PKT_OVERHEAD;
+    return room < TCP_PAYLOAD_MAX? room : TCP_PAYLOAD_MAX;
+}
+
 static void inject_tcp_response(int socknum, byte flags, byte *data, int data_len)
 {
-    SocketState *ss = &u2.sockets[socknum];
-    // Write to ss->rx_buf, APPENDING to existing data
-    byte *pkt = ss->rx_buf;
+    // Build the packet, then append it to whatever's in the RX ring
+    byte pkt[FRAME_MAX];
+    if (data_len > FRAME_MAX - TCP_PKT_OVERHEAD) {
+        DEBUG("Uthernet II: TCP response too big (%d bytes)\n", data_len);
+        return;
+    }
 
-    // Start writing at current tail position (append, don't overwrite)
-    int pkt_base = ss->rx_tail;
-    int pos = pkt_base + 2;  // Skip W5100 length prefix for this packet
+    int pos = 2;  // Skip W5100 length prefix for this packet
 
     // Ethernet header
     memcpy(&pkt[pos + ETH_DST], virtual_tcp.remote_mac, 6);
@@ -865,16 +976,18 @@ static void inject_tcp_response(int socknum, byte flags, byte *data, int data_le
     pkt[tcp_start + TCP_CHECKSUM] = tcp_cksum >> 8;
     pkt[tcp_start + TCP_CHECKSUM + 1] = tcp_cksum & 0xFF;
 
-    // W5100 length prefix for THIS packet (at pkt_base)
-    int pkt_len = pos - pkt_base;  // Length of this packet including prefix
-    pkt[pkt_base + 0] = (pkt_len >> 8) & 0xFF;
-    pkt[pkt_base + 1] = pkt_len & 0xFF;
+    // W5100 length prefix (includes itself)
+    int pkt_len = pos;
+    pkt[0] = (pkt_len >> 8) & 0xFF;
+    pkt[1] = pkt_len & 0xFF;
 
-    // Update RX buffer state - APPEND, don't reset head
-    ss->rx_tail = pos;  // New tail is at end of this packet
+    if (!rx_ring_put(socknum, pkt, pkt_len)) {
+        DEBUG("Uthernet II: RX ring full, TCP response dropped\n");
+        return;
+    }
 
-    DEBUG("Uthernet II: Injected TCP response (flags=0x%02X, data=%d, pkt=%d bytes) RX: head=%d tail=%d\n",
-          flags, data_len, pkt_len, ss->rx_head, ss->rx_tail);
+    DEBUG("Uthernet II: Injected TCP response (flags=0x%02X, data=%d, pkt=%d bytes)\n",
+          flags, data_len, pkt_len);
 }
 
 // Poll virtual TCP connection for incoming data from host
@@ -884,13 +997,14 @@ static void virtual_tcp_poll(int socknum)
         return;
     }
 
-    SocketState *ss = &u2.sockets[socknum];
-
-    // Check for data from host
-    struct pollfd pfd = { virtual_tcp.fd, POLLIN, 0 };
-    if (poll(&pfd, 1, 0) > 0) {
-        byte recv_buf[1400];
-        ssize_t got = recv(virtual_tcp.fd, recv_buf, sizeof(recv_buf), 0);
+    // Check for data from host (leaving it there, if the guest hasn't
+    // room for it yet)
+    short revents = virtual_tcp.revents;
+    virtual_tcp.revents = 0;
+    word room = vtcp_room(socknum);
+    if (revents != 0 && room > 0) {
+        byte recv_buf[TCP_PAYLOAD_MAX];
+        ssize_t got = recv(virtual_tcp.fd, recv_buf, room, 0);
 
         if (got > 0) {
             DEBUG("Uthernet II: TCP received %zd bytes from host (poll)\n", got);
@@ -914,27 +1028,23 @@ static void virtual_tcp_poll(int socknum)
 static void handle_macraw_send(int socknum)
 {
     word base = get_socket_base(socknum);
-    SocketState *ss = &u2.sockets[socknum];
 
     // Get TX pointers
     word tx_rd = WORD(u2.memory[base + Sn_TX_RD + 1], u2.memory[base + Sn_TX_RD]);
     word tx_wr = WORD(u2.memory[base + Sn_TX_WR + 1], u2.memory[base + Sn_TX_WR]);
-    word tx_base = get_tx_base(socknum);
-    word tx_mask = SOCK_BUF_SIZE - 1;
 
     // Calculate frame size
-    int frame_len = (tx_wr - tx_rd) & tx_mask;
-    if (frame_len <= 0 || frame_len > 1600) {
+    int frame_len = (word)(tx_wr - tx_rd);
+    if (frame_len <= 0 || frame_len > get_tx_size(socknum)
+        || frame_len > FRAME_MAX) {
         DEBUG("Uthernet II: MACRAW invalid frame len %d\n", frame_len);
         return;
     }
 
     // Read frame from TX buffer
-    byte frame[1600];
-    for (int i = 0; i < frame_len; i++) {
-        word addr = tx_base + ((tx_rd - tx_base + i) & tx_mask);
-        frame[i] = u2.memory[addr];
-    }
+    byte frame[FRAME_MAX];
+    ring_get(get_tx_base(socknum), get_tx_size(socknum), tx_rd,
+             frame, frame_len);
 
     // Update TX read pointer
     u2.memory[base + Sn_TX_RD + 0] = HI(tx_wr);
@@ -1014,6 +1124,9 @@ static void w5100_reset(void)
         if (u2.initialized && u2.sockets[i].fd > 2) {
             close(u2.sockets[i].fd);
         }
+        if (net_socks[i].open) {
+            net_close(i);
+        }
     }
 
     memset(&u2, 0, sizeof(u2));
@@ -1078,8 +1191,8 @@ static void w5100_reset(void)
         u2.memory[base + Sn_TX_WR + 1] = LO(tx_base);
 
         // TX Free Size = full buffer
-        u2.memory[base + Sn_TX_FSR + 0] = HI(SOCK_BUF_SIZE);
-        u2.memory[base + Sn_TX_FSR + 1] = LO(SOCK_BUF_SIZE);
+        u2.memory[base + Sn_TX_FSR + 0] = HI(get_tx_size(i));
+        u2.memory[base + Sn_TX_FSR + 1] = LO(get_tx_size(i));
 
         // Initialize RX pointers
         word rx_base = get_rx_base(i);
@@ -1093,8 +1206,8 @@ static void w5100_reset(void)
         // Initialize socket state (fd was already closed above if needed)
         u2.sockets[i].fd = -1;
         u2.sockets[i].connecting = false;
-        u2.sockets[i].rx_head = 0;
-        u2.sockets[i].rx_tail = 0;
+        u2.sockets[i].rx_rd = rx_base;
+        u2.sockets[i].rx_wr = rx_base;
     }
 
     u2.initialized = true;
@@ -1106,14 +1219,99 @@ static word get_socket_base(int socknum)
     return W5100_S0_BASE + (socknum * 0x100);
 }
 
+// TMSR and RMSR give each socket, in turn, 1, 2, 4 or 8KB of the
+// 8KB TX or RX area (two bits apiece, socket 0 lowest). A socket
+// that no longer fits gets nothing.
+static word ring_offset(byte msr, int socknum)
+{
+    word off = 0;
+    for (int i = 0; i != socknum; ++i) {
+        off += 0x400 << ((msr >> (2 * i)) & 3);
+    }
+    return off;
+}
+
+static word ring_size(byte msr, int socknum)
+{
+    word size = 0x400 << ((msr >> (2 * socknum)) & 3);
+    word off = ring_offset(msr, socknum);
+    return (off + size <= W5100_TX_SIZE)? size : 0;
+}
+
 static word get_tx_base(int socknum)
 {
-    return W5100_TX_BASE + (socknum * SOCK_BUF_SIZE);
+    return W5100_TX_BASE + ring_offset(u2.memory[W5100_TMSR], socknum);
 }
 
 static word get_rx_base(int socknum)
 {
-    return W5100_RX_BASE + (socknum * SOCK_BUF_SIZE);
+    return W5100_RX_BASE + ring_offset(u2.memory[W5100_RMSR], socknum);
+}
+
+static word get_tx_size(int socknum)
+{
+    return ring_size(u2.memory[W5100_TMSR], socknum);
+}
+
+static word get_rx_size(int socknum)
+{
+    return ring_size(u2.memory[W5100_RMSR], socknum);
+}
+
+// Describes the len bytes at ring pointer ptr, in a ring of the given
+// base and size, as one or two spans of u2.memory (two, if they wrap
+// past the end). Returns how many spans it filled in.
+static int ring_iov(word base, word size, word ptr, word len,
+                    struct iovec iov[2])
+{
+    if (size == 0 || len == 0) return 0;
+    if (len > size) len = size;
+    word off = ptr & (size - 1);
+    word first = size - off;
+    if (first > len) first = len;
+
+    iov[0].iov_base = &u2.memory[base + off];
+    iov[0].iov_len = first;
+    if (first == len) return 1;
+    iov[1].iov_base = &u2.memory[base];
+    iov[1].iov_len = len - first;
+    return 2;
+}
+
+static void ring_get(word base, word size, word ptr, byte *dst, word len)
+{
+    struct iovec iov[2];
+    int n = ring_iov(base, size, ptr, len, iov);
+    for (int i = 0; i != n; ++i) {
+        memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+        dst += iov[i].iov_len;
+    }
+}
+
+// Room left in a socket's RX ring, past what the guest has yet to RECV.
+static word rx_ring_free(int socknum)
+{
+    SocketState *ss = &u2.sockets[socknum];
+    word used = ss->rx_wr - ss->rx_rd;
+    word size = get_rx_size(socknum);
+    return (used < size)? size - used : 0;
+}
+
+// Appends len bytes to a socket's RX ring, all or nothing.
+static bool rx_ring_put(int socknum, const byte *data, word len)
+{
+    SocketState *ss = &u2.sockets[socknum];
+    if (len > rx_ring_free(socknum)) return false;
+
+    struct iovec iov[2];
+    int n = ring_iov(get_rx_base(socknum), get_rx_size(socknum),
+                     ss->rx_wr, len, iov);
+    for (int i = 0; i != n; ++i) {
+        memcpy(iov[i].iov_base, data, iov[i].iov_len);
+        data += iov[i].iov_len;
+    }
+    ss->rx_wr += len;
+    return true;
 }
 
 static byte w5100_read(word addr)
@@ -1129,14 +1327,11 @@ static byte w5100_read(word addr)
         int socknum = (addr - W5100_S0_BASE) / 0x100;
         int offset = (addr - W5100_S0_BASE) % 0x100;
 
+        if (socknum < 4 && cycles_now() >= ready_stale_at) {
+            ready_stale_at = cycles_now() + SOCK_POLL_CYCLES;
+            refresh_sockets();
+        }
         if (socknum < 4) {
-            // Poll for socket state changes
-            socket_poll(socknum);
-            // Also poll virtual TCP for MACRAW mode
-            if (u2.sockets[socknum].macraw_mode) {
-                virtual_tcp_poll(socknum);
-            }
-
             // Handle special read-only registers
             word base = get_socket_base(socknum);
 
@@ -1146,7 +1341,9 @@ static byte w5100_read(word addr)
                                  u2.memory[base + Sn_TX_RD]);
                 word tx_wr = WORD(u2.memory[base + Sn_TX_WR + 1],
                                  u2.memory[base + Sn_TX_WR]);
-                word fsr = SOCK_BUF_SIZE - ((tx_wr - tx_rd) & (SOCK_BUF_SIZE - 1));
+                word used = tx_wr - tx_rd;
+                word size = get_tx_size(socknum);
+                word fsr = (used < size)? size - used : 0;
 
                 if (offset == Sn_TX_FSR) {
                     return HI(fsr);
@@ -1158,11 +1355,11 @@ static byte w5100_read(word addr)
             if (offset == Sn_RX_RSR || offset == Sn_RX_RSR + 1) {
                 // RX Received Size - return buffered amount
                 SocketState *ss = &u2.sockets[socknum];
-                word rsr = (ss->rx_tail - ss->rx_head) & 0x0FFF;
+                word rsr = ss->rx_wr - ss->rx_rd;
 
                 if (rsr > 0) {
-                    DEBUG("Uthernet II: Socket %d RX_RSR=%d (tail=%d head=%d)\n",
-                          socknum, rsr, ss->rx_tail, ss->rx_head);
+                    DEBUG("Uthernet II: Socket %d RX_RSR=%d (wr=0x%04X rd=0x%04X)\n",
+                          socknum, rsr, ss->rx_wr, ss->rx_rd);
                 }
 
                 if (offset == Sn_RX_RSR) {
@@ -1174,22 +1371,7 @@ static byte w5100_read(word addr)
         }
     }
 
-    // RX buffer read - return from local buffer or u2.memory (for MACRAW virtual)
-    if (addr >= W5100_RX_BASE && addr < W5100_RX_BASE + W5100_RX_SIZE) {
-        int socknum = (addr - W5100_RX_BASE) / SOCK_BUF_SIZE;
-        if (socknum < 4) {
-            SocketState *ss = &u2.sockets[socknum];
-
-            // Direct offset into socket's RX buffer
-            word rx_base = get_rx_base(socknum);
-            word buf_offset = (addr - rx_base) & (SOCK_BUF_SIZE - 1);
-
-            if (buf_offset < sizeof(ss->rx_buf)) {
-                return ss->rx_buf[buf_offset];
-            }
-        }
-    }
-
+    // (Received data is placed straight into the RX rings.)
     return u2.memory[addr];
 }
 
@@ -1246,6 +1428,57 @@ static void w5100_write(word addr, byte val)
     u2.memory[addr] = val;
 }
 
+// The host address a socket's Sn_DIPR/Sn_DPORT stand for.
+static void socket_dest(int socknum, struct sockaddr_in *addr)
+{
+    word base = get_socket_base(socknum);
+    memset(addr, 0, sizeof *addr);
+    addr->sin_family = AF_INET;
+
+    // Build destination IP from W5100 registers
+    byte ip0 = u2.memory[base + Sn_DIPR + 0];
+    byte ip1 = u2.memory[base + Sn_DIPR + 1];
+    byte ip2 = u2.memory[base + Sn_DIPR + 2];
+    byte ip3 = u2.memory[base + Sn_DIPR + 3];
+
+    // Virtual network redirect: 192.168.64.x or 192.168.65.x -> localhost
+    // This allows Apple II software to connect to "gateway" addresses
+    // which actually reach the host running the emulator
+    if (ip0 == 192 && ip1 == 168 && (ip2 == 64 || ip2 == 65)) {
+        DEBUG("Uthernet II: Redirecting %d.%d.%d.%d to localhost\n",
+              ip0, ip1, ip2, ip3);
+        addr->sin_addr.s_addr = htonl(0x7F000001);  // 127.0.0.1
+    } else {
+        addr->sin_addr.s_addr = htonl(
+            (ip0 << 24) | (ip1 << 16) | (ip2 << 8) | ip3);
+    }
+
+    addr->sin_port = htons(WORD(u2.memory[base + Sn_DPORT + 1],
+                                u2.memory[base + Sn_DPORT]));
+
+    DEBUG("Uthernet II: Socket %d connecting to %d.%d.%d.%d:%d\n",
+          socknum, ip0, ip1, ip2, ip3, ntohs(addr->sin_port));
+}
+
+// RECV: the software has read up to Sn_RX_RD.
+static void rx_commit(int socknum)
+{
+    word base = get_socket_base(socknum);
+    SocketState *ss = &u2.sockets[socknum];
+    word rx_rd = WORD(u2.memory[base + Sn_RX_RD + 1],
+                     u2.memory[base + Sn_RX_RD]);
+
+    INFO("Uthernet II: Socket %d RECV: rx_rd=0x%04X->0x%04X, wr=0x%04X\n",
+         socknum, ss->rx_rd, rx_rd, ss->rx_wr);
+
+    // Frees up the ring space the software has read (but
+    // no further than what's actually been received)
+    if ((word)(rx_rd - ss->rx_rd) > (word)(ss->rx_wr - ss->rx_rd)) {
+        rx_rd = ss->rx_wr;
+    }
+    ss->rx_rd = rx_rd;
+}
+
 static void socket_command(int socknum, byte cmd)
 {
     word base = get_socket_base(socknum);
@@ -1255,10 +1488,36 @@ static void socket_command(int socknum, byte cmd)
     DEBUG("Uthernet II: Socket %d command 0x%02X (mode=0x%02X)\n",
           socknum, cmd, mode);
 
+    // Sockets opened under --uthernet2-thread are the network thread's.
+    if (net_socks[socknum].open) {
+        if (cmd == Sn_CR_OPEN) {
+            net_close(socknum);
+        } else {
+            net_socket_command(socknum, cmd);
+            u2.memory[base + Sn_CR] = 0;
+            return;
+        }
+    }
+
     switch (cmd) {
         case Sn_CR_OPEN: {
+            // Start both rings out empty, at their bases (which move,
+            // if TMSR/RMSR did)
+            word tx_base = get_tx_base(socknum);
+            u2.memory[base + Sn_TX_RD + 0] = HI(tx_base);
+            u2.memory[base + Sn_TX_RD + 1] = LO(tx_base);
+            u2.memory[base + Sn_TX_WR + 0] = HI(tx_base);
+            u2.memory[base + Sn_TX_WR + 1] = LO(tx_base);
+            word rx_base = get_rx_base(socknum);
+            ss->rx_rd = ss->rx_wr = rx_base;
+            u2.memory[base + Sn_RX_RD + 0] = HI(rx_base);
+            u2.memory[base + Sn_RX_RD + 1] = LO(rx_base);
+
             // Open socket based on mode
-            if (mode == Sn_MR_TCP) {
+            if (mode == Sn_MR_TCP && net_running) {
+                net_open(socknum);
+                u2.memory[base + Sn_SR] = Sn_SR_INIT;
+            } else if (mode == Sn_MR_TCP) {
                 ss->fd = socket(AF_INET, SOCK_STREAM, 0);
                 if (ss->fd >= 0) {
                     // Set non-blocking
@@ -1288,14 +1547,6 @@ static void socket_command(int socknum, byte cmd)
                 // No actual host socket needed for virtual DHCP
                 ss->fd = -1;  // No real socket
                 ss->macraw_mode = true;
-                ss->rx_head = 0;
-                ss->rx_tail = 0;
-
-                // Initialize RX_RD pointer to buffer base
-                word rx_base = get_rx_base(socknum);
-                u2.memory[base + Sn_RX_RD + 0] = HI(rx_base);
-                u2.memory[base + Sn_RX_RD + 1] = LO(rx_base);
-
                 u2.memory[base + Sn_SR] = Sn_SR_MACRAW;
                 INFO("Uthernet II: Socket 0 opened (MACRAW mode=0x%02X) RX_RD=0x%04X\n",
                      mode, rx_base);
@@ -1313,6 +1564,10 @@ static void socket_command(int socknum, byte cmd)
                 addr.sin_port = htons(WORD(u2.memory[base + Sn_PORT + 1],
                                           u2.memory[base + Sn_PORT]));
 
+                // (Don't let an earlier run's connection, lingering in
+                // TIME_WAIT, keep us from listening on the port again.)
+                int one = 1;
+                setsockopt(ss->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
                 if (bind(ss->fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
                     if (listen(ss->fd, 1) == 0) {
                         u2.memory[base + Sn_SR] = Sn_SR_LISTEN;
@@ -1328,37 +1583,7 @@ static void socket_command(int socknum, byte cmd)
             if (ss->fd >= 0 && u2.memory[base + Sn_SR] == Sn_SR_INIT) {
                 // Connect to destination
                 struct sockaddr_in addr;
-                memset(&addr, 0, sizeof(addr));
-                addr.sin_family = AF_INET;
-
-                // Build destination IP from W5100 registers
-                byte ip0 = u2.memory[base + Sn_DIPR + 0];
-                byte ip1 = u2.memory[base + Sn_DIPR + 1];
-                byte ip2 = u2.memory[base + Sn_DIPR + 2];
-                byte ip3 = u2.memory[base + Sn_DIPR + 3];
-
-                // Virtual network redirect: 192.168.64.x or 192.168.65.x -> localhost
-                // This allows Apple II software to connect to "gateway" addresses
-                // which actually reach the host running the emulator
-                if (ip0 == 192 && ip1 == 168 && (ip2 == 64 || ip2 == 65)) {
-                    DEBUG("Uthernet II: Redirecting %d.%d.%d.%d to localhost\n",
-                          ip0, ip1, ip2, ip3);
-                    addr.sin_addr.s_addr = htonl(0x7F000001);  // 127.0.0.1
-                } else {
-                    addr.sin_addr.s_addr = htonl(
-                        (ip0 << 24) | (ip1 << 16) | (ip2 << 8) | ip3);
-                }
-
-                addr.sin_port = htons(WORD(u2.memory[base + Sn_DPORT + 1],
-                                          u2.memory[base + Sn_DPORT]));
-
-                DEBUG("Uthernet II: Socket %d connecting to %d.%d.%d.%d:%d\n",
-                      socknum,
-                      u2.memory[base + Sn_DIPR + 0],
-                      u2.memory[base + Sn_DIPR + 1],
-                      u2.memory[base + Sn_DIPR + 2],
-                      u2.memory[base + Sn_DIPR + 3],
-                      ntohs(addr.sin_port));
+                socket_dest(socknum, &addr);
 
                 int ret = connect(ss->fd, (struct sockaddr *)&addr, sizeof(addr));
                 if (ret == 0) {
@@ -1387,8 +1612,7 @@ static void socket_command(int socknum, byte cmd)
             }
             ss->connecting = false;
             ss->macraw_mode = false;
-            ss->rx_head = 0;
-            ss->rx_tail = 0;
+            ss->rx_wr = ss->rx_rd;
             u2.memory[base + Sn_SR] = Sn_SR_CLOSED;
             DEBUG("Uthernet II: Socket %d closed\n", socknum);
             break;
@@ -1408,20 +1632,14 @@ static void socket_command(int socknum, byte cmd)
                 word tx_wr = WORD(u2.memory[base + Sn_TX_WR + 1],
                                  u2.memory[base + Sn_TX_WR]);
 
-                // Calculate send size
-                word tx_base = get_tx_base(socknum);
-                word send_size = (tx_wr - tx_rd) & (SOCK_BUF_SIZE - 1);
-
-                if (send_size > 0) {
-                    // Gather data from circular buffer
-                    byte sendbuf[SOCK_BUF_SIZE];
-                    for (word i = 0; i < send_size; i++) {
-                        word addr = tx_base + ((tx_rd - tx_base + i) & (SOCK_BUF_SIZE - 1));
-                        sendbuf[i] = u2.memory[addr];
-                    }
-
-                    // Send to host socket
-                    ssize_t sent = send(ss->fd, sendbuf, send_size, 0);
+                // Send straight out of the ring (in up to two pieces,
+                // if it wraps); whatever the host won't take yet stays
+                // there until the next SEND.
+                struct iovec iov[2];
+                int n = ring_iov(get_tx_base(socknum), get_tx_size(socknum),
+                                 tx_rd, tx_wr - tx_rd, iov);
+                if (n > 0) {
+                    ssize_t sent = writev(ss->fd, iov, n);
                     if (sent > 0) {
                         // Update TX read pointer
                         tx_rd = (tx_rd + sent);
@@ -1439,37 +1657,7 @@ static void socket_command(int socknum, byte cmd)
             // Works for both regular sockets and MACRAW mode
             if (ss->fd >= 0 || ss->macraw_mode) {
                 // RECV command: software is acknowledging it has read data
-                word rx_rd = WORD(u2.memory[base + Sn_RX_RD + 1],
-                                 u2.memory[base + Sn_RX_RD]);
-                word rx_base = get_rx_base(socknum);
-
-                // Calculate what the software claims to have read
-                word claimed_read = (rx_rd - rx_base) & (SOCK_BUF_SIZE - 1);
-
-                INFO("Uthernet II: Socket %d RECV: rx_rd=0x%04X, head=%d->%d, tail=%d\n",
-                     socknum, rx_rd, ss->rx_head, claimed_read, ss->rx_tail);
-
-                // For MACRAW mode: advance head by amount consumed
-                // Only clear buffer if completely empty
-                if (ss->macraw_mode) {
-                    int consumed = (claimed_read - ss->rx_head) & (SOCK_BUF_SIZE - 1);
-                    if (consumed > 0) {
-                        ss->rx_head += consumed;
-                        INFO("Uthernet II: MACRAW consumed %d bytes, head=%d tail=%d remaining=%d\n",
-                             consumed, ss->rx_head, ss->rx_tail, ss->rx_tail - ss->rx_head);
-
-                        // If buffer is now empty, reset to start for efficiency
-                        if (ss->rx_head >= ss->rx_tail) {
-                            ss->rx_head = 0;
-                            ss->rx_tail = 0;
-                            u2.memory[base + Sn_RX_RD + 0] = HI(rx_base);
-                            u2.memory[base + Sn_RX_RD + 1] = LO(rx_base);
-                            INFO("Uthernet II: MACRAW buffer empty, reset\n");
-                        }
-                    }
-                } else if (claimed_read != ss->rx_head) {
-                    ss->rx_head = claimed_read;
-                }
+                rx_commit(socknum);
             }
             break;
         }
@@ -1487,11 +1675,12 @@ static void socket_poll(int socknum)
     if (ss->fd < 0) {
         return;
     }
+    short revents = ss->revents;
+    ss->revents = 0;
 
     // Check for connect completion
     if (ss->connecting) {
-        struct pollfd pfd = { ss->fd, POLLOUT, 0 };
-        if (poll(&pfd, 1, 0) > 0) {
+        if (revents != 0) {
             int err = 0;
             socklen_t len = sizeof(err);
             getsockopt(ss->fd, SOL_SOCKET, SO_ERROR, &err, &len);
@@ -1510,19 +1699,16 @@ static void socket_poll(int socknum)
 
     // Check for incoming data (if established)
     if (u2.memory[base + Sn_SR] == Sn_SR_ESTABLISHED) {
-        struct pollfd pfd = { ss->fd, POLLIN, 0 };
-        if (poll(&pfd, 1, 0) > 0) {
-            // Room in local buffer?
-            word space = sizeof(ss->rx_buf) - ((ss->rx_tail - ss->rx_head) & 0x0FFF);
-            if (space > 0) {
-                // Read into circular buffer
-                word write_pos = ss->rx_tail & (sizeof(ss->rx_buf) - 1);
-                word can_read = sizeof(ss->rx_buf) - write_pos;
-                if (can_read > space) can_read = space;
-
-                ssize_t got = recv(ss->fd, &ss->rx_buf[write_pos], can_read, 0);
+        if (revents & (POLLIN | POLLHUP | POLLERR)) {
+            // Read straight into the free part of the RX ring (the
+            // host keeps the rest until the guest makes room)
+            struct iovec iov[2];
+            int n = ring_iov(get_rx_base(socknum), get_rx_size(socknum),
+                             ss->rx_wr, rx_ring_free(socknum), iov);
+            if (n > 0) {
+                ssize_t got = readv(ss->fd, iov, n);
                 if (got > 0) {
-                    ss->rx_tail = (ss->rx_tail + got) & 0x0FFF;
+                    ss->rx_wr += got;
                     DEBUG("Uthernet II: Socket %d received %zd bytes\n",
                           socknum, got);
                 } else if (got == 0) {
@@ -1536,8 +1722,7 @@ static void socket_poll(int socknum)
 
     // Check for incoming connections (if listening)
     if (u2.memory[base + Sn_SR] == Sn_SR_LISTEN) {
-        struct pollfd pfd = { ss->fd, POLLIN, 0 };
-        if (poll(&pfd, 1, 0) > 0) {
+        if (revents & POLLIN) {
             struct sockaddr_in client_addr;
             socklen_t addrlen = sizeof(client_addr);
             int newfd = accept(ss->fd, (struct sockaddr *)&client_addr, &addrlen);
@@ -1557,6 +1742,494 @@ static void socket_poll(int socknum)
     }
 }
 
+// Asks the host, in one go, which sockets (and the MACRAW virtual
+// TCP connection) have something for us; then brings each one's
+// W5100 state up to date.
+static void refresh_sockets(void)
+{
+    struct pollfd pfds[5];
+    SocketState *who[5];
+    nfds_t n = 0;
+
+    for (int i = 0; i != 4; ++i) {
+        if (net_socks[i].open) net_sync(i);
+    }
+
+    for (int i = 0; i != 4; ++i) {
+        SocketState *ss = &u2.sockets[i];
+        ss->revents = 0;
+        if (ss->fd < 0) continue;
+        pfds[n] = (struct pollfd){ ss->fd, ss->connecting? POLLOUT : POLLIN, 0 };
+        who[n++] = ss;
+    }
+    bool vtcp = virtual_tcp.fd >= 0 && virtual_tcp.established;
+    virtual_tcp.revents = 0;
+    if (vtcp) {
+        pfds[n] = (struct pollfd){ virtual_tcp.fd, POLLIN, 0 };
+        who[n++] = NULL;
+    }
+    if (n == 0) return;
+
+    if (poll(pfds, n, 0) > 0) {
+        for (nfds_t i = 0; i != n; ++i) {
+            if (who[i] != NULL)
+                who[i]->revents = pfds[i].revents;
+            else
+                virtual_tcp.revents = pfds[i].revents;
+        }
+    }
+
+    for (int i = 0; i != 4; ++i) {
+        socket_poll(i);
+        if (u2.sockets[i].macraw_mode) {
+            virtual_tcp_poll(i);
+        }
+    }
+}
+
+//=============================================================================
+// Network Thread (--uthernet2-thread)
+//=============================================================================
+
+static int q_spans(NetQueue *q, uint32_t pos, uint32_t len,
+                   struct iovec iov[2])
+{
+    if (len == 0) return 0;
+    uint32_t off = pos & (NET_QSIZE - 1);
+    uint32_t first = NET_QSIZE - off;
+    if (first > len) first = len;
+
+    iov[0].iov_base = &q->buf[off];
+    iov[0].iov_len = first;
+    if (first == len) return 1;
+    iov[1].iov_base = q->buf;
+    iov[1].iov_len = len - first;
+    return 2;
+}
+
+// The free part of a queue (for its producer)
+static int q_space(NetQueue *q, struct iovec iov[2])
+{
+    uint32_t tail = LOAD_ACQ(&q->tail);
+    return q_spans(q, q->head, NET_QSIZE - (q->head - tail), iov);
+}
+
+// What's waiting in a queue (for its consumer)
+static int q_data(NetQueue *q, struct iovec iov[2])
+{
+    uint32_t head = LOAD_ACQ(&q->head);
+    return q_spans(q, q->tail, head - q->tail, iov);
+}
+
+static void q_produced(NetQueue *q, size_t n)
+{
+    STORE_REL(&q->head, q->head + (uint32_t)n);
+}
+
+static void q_consumed(NetQueue *q, size_t n)
+{
+    STORE_REL(&q->tail, q->tail + (uint32_t)n);
+}
+
+// Copies as much of src as will fit into dst; returns how much that was.
+static size_t iov_copy(const struct iovec *dst, int ndst,
+                       const struct iovec *src, int nsrc)
+{
+    size_t total = 0, doff = 0;
+    int di = 0;
+    for (int si = 0; si != nsrc; ++si) {
+        size_t soff = 0;
+        while (soff != src[si].iov_len && di != ndst) {
+            size_t n = src[si].iov_len - soff;
+            if (n > dst[di].iov_len - doff) n = dst[di].iov_len - doff;
+            memcpy((byte *)dst[di].iov_base + doff,
+                   (byte *)src[si].iov_base + soff, n);
+            soff += n;
+            doff += n;
+            total += n;
+            if (doff == dst[di].iov_len) {
+                ++di;
+                doff = 0;
+            }
+        }
+    }
+    return total;
+}
+
+// ----- The emulation thread's side -----
+
+static void net_wakeup(void)
+{
+    // (If the pipe's full, the thread has a wakeup coming anyway.)
+    ssize_t r = write(net_wake[1], "", 1);
+    (void) r;
+}
+
+static void net_send_cmd(int socknum, NetOp op, const struct sockaddr_in *addr)
+{
+    NetSock *ns = &net_socks[socknum];
+    // The thread never blocks on carrying out a command, so the queue
+    // won't stay full for long.
+    while (ns->cmd_head - LOAD_ACQ(&ns->cmd_tail) == NET_NCMDS) {
+        sched_yield();
+    }
+    NetCmd *c = &ns->cmds[ns->cmd_head % NET_NCMDS];
+    c->op = op;
+    c->seq = ++ns->seq & 0xFFFFFF;
+    if (addr != NULL) c->addr = *addr;
+    STORE_REL(&ns->cmd_head, ns->cmd_head + 1);
+    net_wakeup();
+}
+
+static void net_open(int socknum)
+{
+    NetSock *ns = &net_socks[socknum];
+    ns->open = true;
+    ns->need_reset = true;
+    ns->sending = false;
+    net_send_cmd(socknum, NET_OPEN, NULL);
+}
+
+static void net_close(int socknum)
+{
+    net_send_cmd(socknum, NET_CLOSE, NULL);
+    net_socks[socknum].open = false;
+}
+
+// Hands the thread whatever of the last SEND it hasn't had yet (as
+// much as its queue has room for), moving Sn_TX_RD past it.
+static void net_push_tx(int socknum)
+{
+    NetSock *ns = &net_socks[socknum];
+    word base = get_socket_base(socknum);
+    word tx_rd = WORD(u2.memory[base + Sn_TX_RD + 1],
+                      u2.memory[base + Sn_TX_RD]);
+
+    struct iovec src[2], dst[2];
+    int nsrc = ring_iov(get_tx_base(socknum), get_tx_size(socknum),
+                        tx_rd, ns->send_to - tx_rd, src);
+    int ndst = q_space(&ns->tx, dst);
+    size_t n = iov_copy(dst, ndst, src, nsrc);
+    if (n == 0) return;
+
+    q_produced(&ns->tx, n);
+    tx_rd += n;
+    u2.memory[base + Sn_TX_RD + 0] = HI(tx_rd);
+    u2.memory[base + Sn_TX_RD + 1] = LO(tx_rd);
+    ns->sending = (tx_rd != ns->send_to);
+    net_wakeup();
+}
+
+static void net_socket_command(int socknum, byte cmd)
+{
+    NetSock *ns = &net_socks[socknum];
+    SocketState *ss = &u2.sockets[socknum];
+    word base = get_socket_base(socknum);
+    byte *sr = &u2.memory[base + Sn_SR];
+    struct sockaddr_in addr;
+
+    // The W5100 moves on to the next state straight away; the thread
+    // reports back how it actually went.
+    switch (cmd) {
+        case Sn_CR_LISTEN:
+            if (*sr != Sn_SR_INIT) break;
+            memset(&addr, 0, sizeof addr);
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = INADDR_ANY;
+            addr.sin_port = htons(WORD(u2.memory[base + Sn_PORT + 1],
+                                       u2.memory[base + Sn_PORT]));
+            net_send_cmd(socknum, NET_LISTEN, &addr);
+            *sr = Sn_SR_LISTEN;
+            break;
+
+        case Sn_CR_CONNECT:
+            if (*sr != Sn_SR_INIT) break;
+            socket_dest(socknum, &addr);
+            net_send_cmd(socknum, NET_CONNECT, &addr);
+            *sr = Sn_SR_SYNSENT;
+            break;
+
+        case Sn_CR_DISCON:
+        case Sn_CR_CLOSE:
+            net_close(socknum);
+            ss->rx_wr = ss->rx_rd;
+            *sr = Sn_SR_CLOSED;
+            DEBUG("Uthernet II: Socket %d closed\n", socknum);
+            break;
+
+        case Sn_CR_SEND:
+            if (*sr != Sn_SR_ESTABLISHED) break;
+            ns->send_to = WORD(u2.memory[base + Sn_TX_WR + 1],
+                               u2.memory[base + Sn_TX_WR]);
+            ns->sending = true;
+            net_push_tx(socknum);
+            break;
+
+        case Sn_CR_RECV:
+            rx_commit(socknum);
+            net_sync(socknum);
+            break;
+    }
+}
+
+// Takes up what the thread has published for a socket: its status
+// (once the thread has caught up with our commands), and as much RX
+// data as fits in the ring. Also passes along any TX data the queue
+// had no room for, before.
+static void net_sync(int socknum)
+{
+    NetSock *ns = &net_socks[socknum];
+    SocketState *ss = &u2.sockets[socknum];
+
+    uint32_t st = LOAD_ACQ(&ns->status);
+    if ((st >> 8) != (ns->seq & 0xFFFFFF)) return;
+    if (ns->need_reset) {
+        // Anything before this came in on an earlier connection.
+        STORE_REL(&ns->rx.tail, LOAD_ACQ(&ns->rx_reset_at));
+        ns->need_reset = false;
+    }
+    if (st != ns->seen) {
+        ns->seen = st;
+        u2.memory[get_socket_base(socknum) + Sn_SR] = st & 0xFF;
+    }
+
+    struct iovec src[2], dst[2];
+    int nsrc = q_data(&ns->rx, src);
+    int ndst = ring_iov(get_rx_base(socknum), get_rx_size(socknum),
+                        ss->rx_wr, rx_ring_free(socknum), dst);
+    bool was_full = (ns->rx.head - ns->rx.tail == NET_QSIZE);
+    size_t n = iov_copy(dst, ndst, src, nsrc);
+    if (n != 0) {
+        ss->rx_wr += n;
+        q_consumed(&ns->rx, n);
+        // A full queue stops the thread reading; tell it there's room.
+        if (was_full) net_wakeup();
+    }
+
+    if (ns->sending) net_push_tx(socknum);
+}
+
+// ----- The network thread's side -----
+
+static void net_publish(NetSock *ns, byte sr)
+{
+    ns->sr = sr;
+    STORE_REL(&ns->status, (ns->done_seq << 8) | sr);
+}
+
+static void net_drop_fd(NetSock *ns)
+{
+    if (ns->fd >= 0) close(ns->fd);
+    ns->fd = -1;
+}
+
+static void net_flush_tx(NetSock *ns)
+{
+    if (ns->sr != Sn_SR_ESTABLISHED && ns->sr != Sn_SR_CLOSE_WAIT) return;
+    struct iovec iov[2];
+    int n = q_data(&ns->tx, iov);
+    if (n == 0) return;
+
+    struct msghdr msg = { .msg_iov = iov, .msg_iovlen = n };
+    ssize_t sent = sendmsg(ns->fd, &msg, MSG_NOSIGNAL);
+    if (sent > 0) {
+        q_consumed(&ns->tx, sent);
+    } else if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+               && errno != EINTR) {
+        // Nowhere for it to go.
+        q_consumed(&ns->tx, iov[0].iov_len + (n == 2? iov[1].iov_len : 0));
+    }
+}
+
+static void net_fill_rx(NetSock *ns)
+{
+    struct iovec iov[2];
+    int n = q_space(&ns->rx, iov);
+    if (n == 0) return;
+
+    ssize_t got = readv(ns->fd, iov, n);
+    if (got > 0) {
+        q_produced(&ns->rx, got);
+    } else if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK
+                            && errno != EINTR)) {
+        net_publish(ns, Sn_SR_CLOSE_WAIT);
+    }
+}
+
+static void net_do_cmd(NetSock *ns, const NetCmd *c)
+{
+    ns->done_seq = c->seq;
+    switch (c->op) {
+        case NET_OPEN: {
+            net_drop_fd(ns);
+            // Nothing still queued belongs to the new connection.
+            struct iovec iov[2];
+            int n = q_data(&ns->tx, iov);
+            q_consumed(&ns->tx, n == 0? 0 : iov[0].iov_len
+                                            + (n == 2? iov[1].iov_len : 0));
+            STORE_REL(&ns->rx_reset_at, ns->rx.head);
+
+            ns->fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (ns->fd >= 0) {
+                int flags = fcntl(ns->fd, F_GETFL, 0);
+                fcntl(ns->fd, F_SETFL, flags | O_NONBLOCK);
+            }
+            net_publish(ns, ns->fd >= 0? Sn_SR_INIT : Sn_SR_CLOSED);
+            break;
+        }
+
+        case NET_LISTEN: {
+            int one = 1;
+            setsockopt(ns->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+            if (bind(ns->fd, (const struct sockaddr *)&c->addr,
+                     sizeof c->addr) == 0 && listen(ns->fd, 1) == 0) {
+                net_publish(ns, Sn_SR_LISTEN);
+            } else {
+                net_drop_fd(ns);
+                net_publish(ns, Sn_SR_CLOSED);
+            }
+            break;
+        }
+
+        case NET_CONNECT: {
+            int ret = connect(ns->fd, (const struct sockaddr *)&c->addr,
+                              sizeof c->addr);
+            if (ret == 0) {
+                net_publish(ns, Sn_SR_ESTABLISHED);
+            } else if (errno == EINPROGRESS) {
+                net_publish(ns, Sn_SR_SYNSENT);
+            } else {
+                net_drop_fd(ns);
+                net_publish(ns, Sn_SR_CLOSED);
+            }
+            break;
+        }
+
+        case NET_CLOSE:
+            net_flush_tx(ns);
+            net_drop_fd(ns);
+            net_publish(ns, Sn_SR_CLOSED);
+            break;
+    }
+}
+
+static void net_ready(NetSock *ns, short revents)
+{
+    if (ns->sr == Sn_SR_SYNSENT) {
+        int err = 0;
+        socklen_t len = sizeof err;
+        getsockopt(ns->fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err == 0) {
+            net_publish(ns, Sn_SR_ESTABLISHED);
+        } else {
+            net_drop_fd(ns);
+            net_publish(ns, Sn_SR_CLOSED);
+        }
+    } else if (ns->sr == Sn_SR_LISTEN) {
+        int newfd = accept(ns->fd, NULL, NULL);
+        if (newfd >= 0) {
+            close(ns->fd);
+            ns->fd = newfd;
+            int flags = fcntl(ns->fd, F_GETFL, 0);
+            fcntl(ns->fd, F_SETFL, flags | O_NONBLOCK);
+            net_publish(ns, Sn_SR_ESTABLISHED);
+        }
+    } else {
+        if (ns->sr == Sn_SR_ESTABLISHED
+            && (revents & (POLLIN | POLLHUP | POLLERR))) {
+            net_fill_rx(ns);
+        }
+        if (revents & (POLLOUT | POLLHUP | POLLERR)) net_flush_tx(ns);
+    }
+}
+
+#ifdef HAVE_PTHREAD
+static void *net_thread(void *arg)
+{
+    (void) arg;
+    for (;;) {
+        struct pollfd pfds[5];
+        NetSock *who[5];
+        nfds_t n = 0;
+
+        pfds[n] = (struct pollfd){ net_wake[0], POLLIN, 0 };
+        who[n++] = NULL;
+        for (int i = 0; i != 4; ++i) {
+            NetSock *ns = &net_socks[i];
+            uint32_t tail;
+            while ((tail = ns->cmd_tail) != LOAD_ACQ(&ns->cmd_head)) {
+                net_do_cmd(ns, &ns->cmds[tail % NET_NCMDS]);
+                STORE_REL(&ns->cmd_tail, tail + 1);
+            }
+            net_flush_tx(ns);
+            if (ns->fd < 0) continue;
+
+            struct iovec iov[2];
+            short events = 0;
+            if (ns->sr == Sn_SR_SYNSENT) {
+                events = POLLOUT;
+            } else if (ns->sr == Sn_SR_LISTEN) {
+                events = POLLIN;
+            } else if (ns->sr == Sn_SR_ESTABLISHED
+                       || ns->sr == Sn_SR_CLOSE_WAIT) {
+                // (Not reading while the queue's full: the emulator
+                // wakes us when it makes room.)
+                if (ns->sr == Sn_SR_ESTABLISHED && q_space(&ns->rx, iov) != 0)
+                    events |= POLLIN;
+                if (q_data(&ns->tx, iov) != 0) events |= POLLOUT;
+            }
+            if (events == 0) continue;
+            pfds[n] = (struct pollfd){ ns->fd, events, 0 };
+            who[n++] = ns;
+        }
+
+        if (poll(pfds, n, -1) < 0) continue;
+        if (pfds[0].revents != 0) {
+            char buf[64];
+            while (read(net_wake[0], buf, sizeof buf) > 0)
+                ;
+        }
+        for (nfds_t i = 1; i != n; ++i) {
+            if (pfds[i].revents != 0) net_ready(who[i], pfds[i].revents);
+        }
+    }
+    return NULL;
+}
+#endif
+
+static void net_start(void)
+{
+#ifdef HAVE_PTHREAD
+    if (net_running) return;
+    if (pipe(net_wake) < 0) {
+        DIE(2, "Uthernet II: couldn't create pipe: %s\n", strerror(errno));
+    }
+    for (int i = 0; i != 2; ++i) {
+        int flags = fcntl(net_wake[i], F_GETFL, 0);
+        fcntl(net_wake[i], F_SETFL, flags | O_NONBLOCK);
+    }
+    for (int i = 0; i != 4; ++i) {
+        net_socks[i].fd = -1;
+    }
+
+    // Signals are for the emulation thread.
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    pthread_t thr;
+    int err = pthread_create(&thr, NULL, net_thread, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (err) {
+        DIE(2, "Uthernet II: couldn't start network thread: %s\n",
+            strerror(err));
+    }
+    pthread_detach(thr);
+    net_running = true;
+#else
+    WARN("--uthernet2-thread: built without thread support; ignored.\n");
+#endif
+}
+
 static byte handler(word loc, int val, int ploc, int psw)
 {
     // We only handle soft switches ($C0nX)
@@ -1648,6 +2321,7 @@ static void init(void)
 {
     DEBUG("Uthernet II: Initializing in slot %d\n", slot_num);
     w5100_reset();
+    if (cfg.uthernet2_thread) net_start();
 }
 
 // Public configuration function
@@ -1658,7 +2332,32 @@ void uthernet2_set_slot(unsigned int slot)
     }
 }
 
+static bool snap_save(Snapshot *s)
+{
+    // Live host connections can't be snapshotted.
+    for (int i = 0; i != 4; ++i) {
+        if (u2.sockets[i].fd >= 0 || net_socks[i].open) return false;
+    }
+    if (virtual_tcp.fd >= 0) return false;
+
+    snap_put(s, "uthernet", &u2, sizeof u2);
+    return true;
+}
+
+static void snap_restore(const Snapshot *s)
+{
+    const Uthernet2State *st = snap_get(s, "uthernet", sizeof u2);
+    if (st == NULL) return;
+    for (int i = 0; i != 4; ++i) {
+        if (u2.sockets[i].fd >= 0) close(u2.sockets[i].fd);
+        if (net_socks[i].open) net_close(i);
+    }
+    u2 = *st; // (saved with no sockets open)
+}
+
 PeriphDesc uthernet2 = {
     init,
     handler,
+    snap_save,
+    snap_restore,
 };
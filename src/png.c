@@ -0,0 +1,244 @@
+//  png.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// A small, self-contained PNG writer for 8-bit RGB images (the graphics
+// exports use it), so that no zlib is needed.
+//
+// The image data is compressed with fixed-Huffman deflate, using a
+// greedy LZ77 match against the most recent position with the same
+// three bytes. Apple II screens are mostly long runs and repeated
+// rows, which that catches nearly all of; the output is typically a
+// few percent of the raw size. Each row gets PNG filter type 0 (none).
+
+#include "bobbin-internal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HASH_BITS   15
+#define HASH_SIZE   (1 << HASH_BITS)
+#define WINDOW      32768
+#define MIN_MATCH   3
+#define MAX_MATCH   258
+
+typedef struct {
+    byte    *buf;
+    size_t  len;
+    unsigned long   bits;
+    int     nbits;
+} BitWriter;
+
+static void put_bits(BitWriter *bw, unsigned long val, int n)
+{
+    bw->bits |= val << bw->nbits;
+    bw->nbits += n;
+    while (bw->nbits >= 8) {
+        bw->buf[bw->len++] = bw->bits & 0xFF;
+        bw->bits >>= 8;
+        bw->nbits -= 8;
+    }
+}
+
+// Huffman codes go out most-significant bit first; everything else in
+// deflate is least-significant first.
+static void put_code(BitWriter *bw, unsigned code, int n)
+{
+    unsigned rev = 0;
+    for (int i=0; i != n; ++i) {
+        rev = (rev << 1) | ((code >> i) & 1);
+    }
+    put_bits(bw, rev, n);
+}
+
+static void put_litlen(BitWriter *bw, int sym)
+{
+    if (sym < 144)      put_code(bw, 0x30 + sym, 8);
+    else if (sym < 256) put_code(bw, 0x190 + (sym - 144), 9);
+    else if (sym < 280) put_code(bw, sym - 256, 7);
+    else                put_code(bw, 0xC0 + (sym - 280), 8);
+}
+
+static const unsigned short len_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const byte len_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const unsigned short dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+static const byte dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static void put_match(BitWriter *bw, unsigned len, unsigned dist)
+{
+    int i = 28;
+    while (len_base[i] > len) --i;
+    put_litlen(bw, 257 + i);
+    put_bits(bw, len - len_base[i], len_extra[i]);
+
+    i = 29;
+    while (dist_base[i] > dist) --i;
+    put_code(bw, i, 5);
+    put_bits(bw, dist - dist_base[i], dist_extra[i]);
+}
+
+static unsigned hash3(const byte *p)
+{
+    return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (HASH_SIZE - 1);
+}
+
+// Compresses IN as a single fixed-Huffman block into OUT, which must
+// have room for the worst case: a 3-byte match can take 31 bits.
+static size_t deflate_fixed(const byte *in, size_t len, byte *out)
+{
+    static MACHINE_LOCAL long head[HASH_SIZE];
+    BitWriter bw = { out, 0, 0, 0 };
+
+    for (size_t i=0; i != HASH_SIZE; ++i) head[i] = -1;
+
+    put_bits(&bw, 1, 1); // BFINAL
+    put_bits(&bw, 1, 2); // BTYPE = fixed Huffman
+
+    size_t pos = 0;
+    while (pos < len) {
+        size_t mlen = 0;
+        size_t mdist = 0;
+        if (len - pos >= MIN_MATCH) {
+            unsigned h = hash3(in + pos);
+            long cand = head[h];
+            head[h] = pos;
+            if (cand >= 0 && pos - cand <= WINDOW) {
+                size_t max = len - pos;
+                if (max > MAX_MATCH) max = MAX_MATCH;
+                while (mlen < max && in[cand + mlen] == in[pos + mlen])
+                    ++mlen;
+                mdist = pos - cand;
+            }
+        }
+        if (mlen >= MIN_MATCH) {
+            put_match(&bw, mlen, mdist);
+            // Keep the hash chain current through the match.
+            for (size_t end = pos + mlen; ++pos < end; ) {
+                if (len - pos >= MIN_MATCH) head[hash3(in + pos)] = pos;
+            }
+        } else {
+            put_litlen(&bw, in[pos++]);
+        }
+    }
+    put_litlen(&bw, 256); // end of block
+    if (bw.nbits) put_bits(&bw, 0, 8 - bw.nbits);
+    return bw.len;
+}
+
+static MACHINE_LOCAL unsigned long crc_table[256];
+
+static unsigned long crc32_update(unsigned long crc, const byte *p, size_t n)
+{
+    if (crc_table[1] == 0) {
+        for (unsigned long i=0; i != 256; ++i) {
+            unsigned long c = i;
+            for (int k=0; k != 8; ++k) {
+                c = (c & 1)? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+            }
+            crc_table[i] = c;
+        }
+    }
+    crc ^= 0xFFFFFFFFUL;
+    while (n--) {
+        crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFUL;
+}
+
+static unsigned long adler32(const byte *p, size_t n)
+{
+    unsigned long a = 1, b = 0;
+    while (n--) {
+        a = (a + *p++) % 65521;
+        b = (b + a) % 65521;
+    }
+    return (b << 16) | a;
+}
+
+static void put_be32(byte *p, unsigned long v)
+{
+    p[0] = (v >> 24) & 0xFF;
+    p[1] = (v >> 16) & 0xFF;
+    p[2] = (v >> 8) & 0xFF;
+    p[3] = v & 0xFF;
+}
+
+static void write_chunk(FILE *f, const char *type, const byte *data,
+                        size_t len)
+{
+    byte hdr[8];
+    put_be32(hdr, len);
+    memcpy(hdr + 4, type, 4);
+    fwrite(hdr, 1, sizeof hdr, f);
+    if (len) fwrite(data, 1, len, f);
+
+    byte crc[4];
+    put_be32(crc, crc32_update(crc32_update(0, hdr + 4, 4), data, len));
+    fwrite(crc, 1, sizeof crc, f);
+}
+
+int png_write(const char *filename, const byte *rgb, int w, int h)
+{
+    static const byte sig[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    size_t stride = (size_t)w * 3;
+    size_t rawlen = (stride + 1) * h;
+
+    // Rows, each prefixed with its filter type.
+    byte *raw = xalloc(rawlen);
+    for (int y=0; y != h; ++y) {
+        byte *row = raw + y * (stride + 1);
+        row[0] = 0;
+        memcpy(row + 1, rgb + y * stride, stride);
+    }
+
+    // zlib stream: header, deflate data, Adler-32 of the raw data.
+    byte *z = xalloc(rawlen + rawlen / 2 + 64);
+    size_t zlen = 0;
+    z[zlen++] = 0x78;
+    z[zlen++] = 0x01;
+    zlen += deflate_fixed(raw, rawlen, z + zlen);
+    put_be32(z + zlen, adler32(raw, rawlen));
+    zlen += 4;
+    free(raw);
+
+    FILE *f = fopen(filename, "wb");
+    if (!f) {
+        free(z);
+        return -1;
+    }
+
+    byte ihdr[13];
+    put_be32(ihdr, w);
+    put_be32(ihdr + 4, h);
+    ihdr[8] = 8;    // bit depth
+    ihdr[9] = 2;    // color type: RGB
+    ihdr[10] = 0;   // compression: deflate
+    ihdr[11] = 0;   // filter method
+    ihdr[12] = 0;   // no interlace
+
+    fwrite(sig, 1, sizeof sig, f);
+    write_chunk(f, "IHDR", ihdr, sizeof ihdr);
+    write_chunk(f, "IDAT", z, zlen);
+    write_chunk(f, "IEND", NULL, 0);
+    free(z);
+
+    bool err = ferror(f);
+    if (fclose(f) != 0) err = true;
+    return err? -1 : 0;
+}
@@ -0,0 +1,299 @@
+//  profile.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// Guest-code profiler, for --profile.
+//
+// Counts executions and cycles for every PC, separately for each bank
+// the code was fetched from (so that, e.g., language-card bank 1 and
+// bank 2 code at $D000 aren't lumped together). At the same time,
+// builds a call tree by watching the stack: a JSR or BRK opens a new
+// frame, which is closed again once the stack pointer climbs back
+// above where it was when the frame was opened (by RTS, RTI, or by
+// the code discarding its return address).
+//
+// Results are written as a hot-spot listing (FILE), and as collapsed
+// stacks that flamegraph tools accept (FILE.folded).
+
+#include "bobbin-internal.h"
+
+#include <errno.h>
+
+#define NBANKS      (2 * MA_LANG_CARD)  // (MemAccessType, aux) pairs
+#define MAX_DEPTH   256
+#define HOT_SPOTS   64
+
+struct pcstat {
+    uintmax_t   cycles;
+    uintmax_t   execs;
+};
+
+struct cnode {
+    word            addr;
+    byte            bank;
+    uintmax_t       cycles;     // spent in this frame itself
+    struct cnode    *parent;
+    struct cnode    *child;
+    struct cnode    *sibling;
+};
+
+static struct pcstat *banks[NBANKS];    // allocated on first use
+static struct cnode root;
+
+static struct {
+    struct cnode    *node;
+    byte            ret_sp;     // SP after this frame returns
+} frames[MAX_DEPTH];
+static int depth;
+
+// The instruction currently executing (seen in the last STEP).
+static struct pcstat *cur_stat;
+static struct cnode *cur_node = &root;
+static uintmax_t last_cycles;
+static bool call_pending;
+static byte call_sp;
+
+static int bank_of(word pc)
+{
+    bool aux;
+    MemAccessType acc;
+    mem_get_true_access(pc, false, NULL, &aux, &acc);
+    return (acc - 1) * 2 + (aux? 1 : 0);
+}
+
+static const char *bank_name(int bank)
+{
+    static char buf[16];
+    snprintf(buf, sizeof buf, "%s%s", (bank & 1)? "AUX:" : "",
+             mem_get_acctype_name(bank / 2 + 1));
+    return buf;
+}
+
+static struct cnode *child_of(struct cnode *n, word addr, byte bank)
+{
+    struct cnode **prevnext = &n->child;
+    for (struct cnode *c = n->child; c != NULL; c = c->sibling) {
+        if (c->addr == addr && c->bank == bank) {
+            // Move to front; calls tend to repeat.
+            *prevnext = c->sibling;
+            c->sibling = n->child;
+            n->child = c;
+            return c;
+        }
+        prevnext = &c->sibling;
+    }
+    struct cnode *c = xalloc(sizeof *c);
+    c->addr = addr;
+    c->bank = bank;
+    c->cycles = 0;
+    c->parent = n;
+    c->child = NULL;
+    c->sibling = n->child;
+    n->child = c;
+    return c;
+}
+
+// Charge the cycles since the last STEP to the instruction that ran.
+static void account(void)
+{
+    uintmax_t delta = cycle_count >= last_cycles?
+        cycle_count - last_cycles : cycle_count;
+    last_cycles = cycle_count;
+    if (cur_stat != NULL) {
+        cur_stat->cycles += delta;
+    }
+    cur_node->cycles += delta;
+}
+
+static void profile_step(void)
+{
+    account();
+
+    word pc = current_pc();
+    byte sp = theCpu.regs.sp;
+    int bank = bank_of(pc);
+
+    // Close any frames whose return address has been popped.
+    while (depth > 0 && frames[depth-1].ret_sp <= sp) {
+        cur_node = frames[--depth].node->parent;
+    }
+    if (call_pending) {
+        call_pending = false;
+        if (sp < call_sp && depth < MAX_DEPTH) {
+            cur_node = child_of(cur_node, pc, bank);
+            frames[depth].node = cur_node;
+            frames[depth].ret_sp = call_sp;
+            ++depth;
+        }
+    }
+
+    if (banks[bank] == NULL) {
+        banks[bank] = xalloc(0x10000 * sizeof (struct pcstat));
+        memset(banks[bank], 0, 0x10000 * sizeof (struct pcstat));
+    }
+    cur_stat = &banks[bank][pc];
+    ++cur_stat->execs;
+
+    byte op = peek_sneaky(pc);
+    if (op == 0x20 || op == 0x00) { // JSR, BRK
+        call_pending = true;
+        call_sp = sp;
+    }
+}
+
+static void profile_event(Event *e)
+{
+    switch (e->type) {
+        case EV_STEP:
+            profile_step();
+            break;
+        case EV_FRAME:
+            // cycle_count is about to start again from zero.
+            account();
+            last_cycles = 0;
+            break;
+        default:
+            ;
+    }
+}
+
+static void free_children(struct cnode *n)
+{
+    struct cnode *c = n->child;
+    while (c != NULL) {
+        struct cnode *next = c->sibling;
+        free_children(c);
+        free(c);
+        c = next;
+    }
+    n->child = NULL;
+}
+
+void profile_reset(void)
+{
+    for (int b = 0; b != NBANKS; ++b) {
+        if (banks[b] != NULL)
+            memset(banks[b], 0, 0x10000 * sizeof (struct pcstat));
+    }
+    free_children(&root);
+    root.cycles = 0;
+    depth = 0;
+    cur_node = &root;
+    cur_stat = NULL;
+    call_pending = false;
+    last_cycles = cycle_count;
+}
+
+static void write_folded_node(FILE *f, const struct cnode *n,
+                              char *path, size_t len)
+{
+    const size_t base = len;
+    // Each frame adds at most ";AUX:LCARD:FFFF" to the path.
+    if (n != &root) {
+        len += sprintf(path + len, ";%s:%04X", bank_name(n->bank),
+                       (unsigned int)n->addr);
+    }
+    if (n->cycles != 0) {
+        fprintf(f, "%s %ju\n", path, n->cycles);
+    }
+    for (const struct cnode *c = n->child; c != NULL; c = c->sibling) {
+        write_folded_node(f, c, path, len);
+    }
+    path[base] = '\0';
+}
+
+struct hot {
+    uintmax_t   cycles;
+    uintmax_t   execs;
+    word        pc;
+    byte        bank;
+};
+
+static void write_hot_spots(FILE *f)
+{
+    struct hot top[HOT_SPOTS];
+    size_t ntop = 0;
+    uintmax_t total = 0;
+
+    // Keep the HOT_SPOTS busiest PCs, by insertion into a sorted list.
+    for (int b = 0; b != NBANKS; ++b) {
+        if (banks[b] == NULL) continue;
+        for (unsigned long pc = 0; pc != 0x10000; ++pc) {
+            const struct pcstat *s = &banks[b][pc];
+            if (s->execs == 0) continue;
+            total += s->cycles;
+            if (ntop == HOT_SPOTS && s->cycles <= top[ntop-1].cycles)
+                continue;
+            size_t i = ntop < HOT_SPOTS? ntop++ : ntop - 1;
+            for (; i > 0 && top[i-1].cycles < s->cycles; --i) {
+                top[i] = top[i-1];
+            }
+            top[i] = (struct hot){ s->cycles, s->execs, pc, b };
+        }
+    }
+
+    fprintf(f, "%ju cycles profiled. Busiest instructions:\n\n", total);
+    fprintf(f, "%12s %6s %12s  %-10s %s\n",
+            "CYCLES", "%", "EXECS", "BANK", "INSTRUCTION");
+    for (size_t i = 0; i != ntop; ++i) {
+        fprintf(f, "%12ju %6.2f %12ju  %-10s ", top[i].cycles,
+                total? 100.0 * top[i].cycles / total : 0.0,
+                top[i].execs, bank_name(top[i].bank));
+        // Note: disassembles from the *current* memory mapping.
+        (void) print_disasm(f, top[i].pc, &theCpu.regs);
+    }
+}
+
+int profile_write(const char *fname)
+{
+    account();
+
+    errno = 0;
+    FILE *f = fopen(fname, "w");
+    if (f == NULL) {
+        WARN("Couldn't open profile file \"%s\": %s\n", fname,
+             strerror(errno));
+        return -1;
+    }
+    write_hot_spots(f);
+    fclose(f);
+
+    char *folded = xalloc(strlen(fname) + sizeof ".folded");
+    sprintf(folded, "%s.folded", fname);
+    errno = 0;
+    f = fopen(folded, "w");
+    if (f == NULL) {
+        WARN("Couldn't open profile file \"%s\": %s\n", folded,
+             strerror(errno));
+        free(folded);
+        return -1;
+    }
+    char *path = xalloc(sizeof "bobbin" + MAX_DEPTH * sizeof ";AUX:LCARD:FFFF");
+    strcpy(path, "bobbin");
+    write_folded_node(f, &root, path, strlen(path));
+    free(path);
+    fclose(f);
+    free(folded);
+    return 0;
+}
+
+bool profiling(void)
+{
+    return cfg.profile_file != NULL;
+}
+
+static void profile_at_exit(void)
+{
+    (void) profile_write(cfg.profile_file);
+}
+
+void profile_init(void)
+{
+    if (!profiling()) return;
+
+    event_reghandler_for(profile_event,
+                         EV_MASK(EV_STEP) | EV_MASK(EV_FRAME));
+    atexit(profile_at_exit);
+}
@@ -0,0 +1,117 @@
+//  sched.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// Timed work, keyed on the absolute emulated cycle (cycles_now()).
+//
+// Timers are owned by whoever schedules them (usually as statics), and
+// the heap only holds pointers to them, in a fixed-size array: nothing
+// here ever allocates. cpu_run() asks for the earliest deadline, runs
+// instructions uninterrupted until it's reached, and then calls
+// sched_run_due().
+
+#include "bobbin-internal.h"
+
+#include <stdint.h>
+
+#define SCHED_MAX   32
+
+MACHINE_LOCAL uintmax_t cycle_base = 0;
+
+static MACHINE_LOCAL SchedTimer *heap[SCHED_MAX];
+static MACHINE_LOCAL int nheap = 0;
+
+void cycles_rebase(void)
+{
+    cycle_base += cycle_count;
+    cycle_count = 0;
+}
+
+static inline void place(SchedTimer *t, int i)
+{
+    heap[i] = t;
+    t->slot = i;
+}
+
+static void sift_up(int i)
+{
+    SchedTimer *t = heap[i];
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (heap[parent]->when <= t->when) break;
+        place(heap[parent], i);
+        i = parent;
+    }
+    place(t, i);
+}
+
+static void sift_down(int i)
+{
+    SchedTimer *t = heap[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= nheap) break;
+        if (child + 1 < nheap && heap[child + 1]->when < heap[child]->when)
+            ++child;
+        if (t->when <= heap[child]->when) break;
+        place(heap[child], i);
+        i = child;
+    }
+    place(t, i);
+}
+
+static void remove_at(int i)
+{
+    SchedTimer *last = heap[--nheap];
+    heap[i]->slot = -1;
+    if (i == nheap) return;
+    place(last, i);
+    sift_up(i);
+    sift_down(last->slot);
+}
+
+void sched_at(SchedTimer *t, uintmax_t when)
+{
+    if (t->slot >= 0) {
+        // Already scheduled: just move it.
+        t->when = when;
+        sift_up(t->slot);
+        sift_down(t->slot);
+        return;
+    }
+    if (nheap == SCHED_MAX) {
+        DIE(1, "too many scheduled timers (max %d).\n", SCHED_MAX);
+    }
+    t->when = when;
+    place(t, nheap++);
+    sift_up(t->slot);
+}
+
+void sched_in(SchedTimer *t, uintmax_t cycles)
+{
+    sched_at(t, cycles_now() + cycles);
+}
+
+void sched_cancel(SchedTimer *t)
+{
+    if (t->slot >= 0)
+        remove_at(t->slot);
+}
+
+uintmax_t sched_next(void)
+{
+    return nheap? heap[0]->when : UINTMAX_MAX;
+}
+
+void sched_run_due(void)
+{
+    uintmax_t now = cycles_now();
+    while (nheap && heap[0]->when <= now) {
+        SchedTimer *t = heap[0];
+        remove_at(0);
+        STAT_INC(sched_calls);
+        t->fn(); // (may reschedule t)
+    }
+}
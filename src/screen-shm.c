@@ -0,0 +1,281 @@
+//  screen-shm.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// --screen-shm: publish the screen into a POSIX shared-memory ring
+// (laid out as in screen-shm.h), so that other programs can watch it
+// without stopping the emulator.
+//
+// Writes to the display pages, and display switch changes, mark the
+// screen dirty; every --screen-shm-every frames, a dirty screen is
+// rendered (via gfx_render(), for graphics) and compared, row by row,
+// with the last frame published. If anything differs, the frame goes
+// into the next slot, and only the rows that changed since that slot
+// was last written are copied into it.
+
+#include "bobbin-internal.h"
+#include "screen-shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Catch screen changes that don't come as POKEs (mem_put(), loading
+// a snapshot...) at least this often.
+#define RESCAN_FRAMES   60
+
+static ScreenShmHeader *shm_hdr;
+static ScreenShmSlot *shm_slots;
+static size_t shm_size;
+static char *shm_name;
+
+static bool dirty = true;
+static unsigned long frames_left;
+static unsigned long rescan_left;
+static uint64_t seq;
+
+// The screen as last published, and the frame at which each row last
+// changed.
+static MACHINE_LOCAL uint32_t cur_mode = (uint32_t)-1;
+static MACHINE_LOCAL uint32_t cur_flags;
+static MACHINE_LOCAL int cur_w, cur_h;
+static MACHINE_LOCAL char cur_text[24][80];
+static MACHINE_LOCAL byte cur_rgb[SCREEN_SHM_MAX_W * SCREEN_SHM_MAX_H * 3];
+static uint64_t text_row_seq[24];
+static uint64_t row_seq[SCREEN_SHM_MAX_H];
+
+static void shm_at_exit(void)
+{
+    (void) shm_unlink(shm_name);
+}
+
+static void shm_create(void)
+{
+    // POSIX wants shared-memory object names to start with a slash.
+    shm_name = xalloc(strlen(cfg.screen_shm) + 2);
+    strcpy(shm_name, cfg.screen_shm[0] == '/'? "" : "/");
+    strcat(shm_name, cfg.screen_shm);
+
+    errno = 0;
+    int fd = shm_open(shm_name, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        DIE(1, "--screen-shm: couldn't open \"%s\": %s\n", shm_name,
+            strerror(errno));
+    }
+    shm_size = sizeof *shm_hdr
+        + SCREEN_SHM_SLOTS * sizeof *shm_slots;
+    // (Truncating to zero first clears whatever a previous run left.)
+    if (ftruncate(fd, 0) < 0 || ftruncate(fd, shm_size) < 0) {
+        DIE(1, "--screen-shm: couldn't size \"%s\": %s\n", shm_name,
+            strerror(errno));
+    }
+    void *p = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   fd, 0);
+    if (p == MAP_FAILED) {
+        DIE(1, "--screen-shm: couldn't map \"%s\": %s\n", shm_name,
+            strerror(errno));
+    }
+    close(fd);
+    atexit(shm_at_exit);
+
+    shm_hdr = p;
+    shm_slots = (ScreenShmSlot *)(shm_hdr + 1);
+    shm_hdr->version = SCREEN_SHM_VERSION;
+    shm_hdr->nslots = SCREEN_SHM_SLOTS;
+    shm_hdr->slot_offset = sizeof *shm_hdr;
+    shm_hdr->slot_size = sizeof *shm_slots;
+    __atomic_store_n(&shm_hdr->latest, 0, __ATOMIC_RELAXED);
+    // Magic last, so it only shows up once the rest is filled in.
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(shm_hdr->magic, SCREEN_SHM_MAGIC, sizeof shm_hdr->magic);
+}
+
+// What the video hardware is showing, and where from.
+static uint32_t screen_mode(uint32_t *flags, word *base)
+{
+    bool aux = cfg.amt_ram > LOC_AUX_START;
+    bool eighty = swget(ss, ss_eightycol) && aux;
+    // (With 80STORE on, PAGE2 selects aux memory, not the display page.)
+    bool page2 = swget(ss, ss_page2) && !swget(ss, ss_eightystore);
+
+    *flags = page2? SCREEN_PAGE2 : 0;
+    if (swget(ss, ss_text)) {
+        *base = page2? 0x0800 : 0x0400;
+        return eighty? SCREEN_TEXT80 : SCREEN_TEXT40;
+    }
+    if (swget(ss, ss_mixed)) *flags |= SCREEN_MIXED;
+    if (swget(ss, ss_hires)) {
+        *base = page2? 0x4000 : 0x2000;
+        return eighty? SCREEN_DHGR : SCREEN_HGR;
+    }
+    *base = page2? 0x0800 : 0x0400;
+    return eighty? SCREEN_DGR : SCREEN_GR;
+}
+
+static void read_text(char text[24][80], word page, bool eighty)
+{
+    const byte *mem = getram();
+
+    memset(text, ' ', 24 * 80);
+    for (int y = 0; y != 24; ++y) {
+        word base = page + (y % 8) * 0x80 + (y / 8) * 0x28;
+        if (eighty) {
+            for (int x = 0; x != 80; ++x) {
+                text[y][x] = util_todisplay(
+                    mem[(x % 2 == 0? LOC_AUX_START : 0) + base + x/2]);
+            }
+        } else {
+            for (int x = 0; x != 40; ++x) {
+                text[y][x] = util_todisplay(mem[base + x]);
+            }
+        }
+    }
+}
+
+static void publish(uint64_t n, uint32_t text_changed, const byte *changed)
+{
+    ScreenShmSlot *s = &shm_slots[n % SCREEN_SHM_SLOTS];
+    uint64_t old = s->seq; // (we're the only writer)
+    size_t stride = (size_t)cur_w * 3;
+
+    __atomic_store_n(&s->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    // Bring the slot up to date from frame OLD, which it last held.
+    bool all = old == 0 || s->mode != cur_mode
+        || s->width != (uint32_t)cur_w || s->height != (uint32_t)cur_h;
+    for (int y = 0; y != 24; ++y) {
+        if (all || text_row_seq[y] > old)
+            memcpy(s->text[y], cur_text[y], sizeof s->text[y]);
+    }
+    for (int y = 0; y != cur_h; ++y) {
+        if (all || row_seq[y] > old)
+            memcpy(s->rgb + y * stride, cur_rgb + y * stride, stride);
+    }
+    s->frame = frame_count;
+    s->mode = cur_mode;
+    s->flags = cur_flags;
+    s->width = cur_w;
+    s->height = cur_h;
+    s->text_rows_changed = text_changed;
+    memcpy(s->rows_changed, changed, sizeof s->rows_changed);
+
+    __atomic_store_n(&s->seq, n, __ATOMIC_RELEASE);
+    __atomic_store_n(&shm_hdr->latest, n, __ATOMIC_RELEASE);
+}
+
+uint32_t screen_current(uint32_t *flags, char text[24][80],
+                        const byte **rgb, int *w, int *h)
+{
+    word base;
+    uint32_t mode = screen_mode(flags, &base);
+    bool double_mode = mode == SCREEN_DGR || mode == SCREEN_DHGR;
+
+    *rgb = NULL;
+    *w = *h = 0;
+    switch (mode) {
+        case SCREEN_HGR:  *rgb = gfx_render(GFX_HGR_COLOR, base, false, w, h);
+                          break;
+        case SCREEN_DHGR: *rgb = gfx_render(GFX_DHGR, base, false, w, h);
+                          break;
+        case SCREEN_GR:   *rgb = gfx_render(GFX_GR, base, false, w, h);
+                          break;
+        case SCREEN_DGR:  *rgb = gfx_render(GFX_DGR, base, false, w, h);
+                          break;
+        default:
+            ;
+    }
+    read_text(text, (*flags & SCREEN_PAGE2)? 0x0800 : 0x0400,
+              mode == SCREEN_TEXT80 || double_mode);
+    return mode;
+}
+
+static void screen_scan(void)
+{
+    uint32_t flags;
+    char text[24][80];
+    const byte *rgb;
+    int w, h;
+    uint32_t mode = screen_current(&flags, text, &rgb, &w, &h);
+
+    uint64_t n = seq + 1;
+    bool all = mode != cur_mode || w != cur_w || h != cur_h;
+    bool any = all || flags != cur_flags;
+    uint32_t text_changed = 0;
+    byte changed[SCREEN_SHM_MAX_H / 8] = { 0 };
+    size_t stride = (size_t)w * 3;
+
+    for (int y = 0; y != 24; ++y) {
+        if (all || memcmp(cur_text[y], text[y], sizeof text[y]) != 0) {
+            memcpy(cur_text[y], text[y], sizeof text[y]);
+            text_row_seq[y] = n;
+            text_changed |= 1UL << y;
+            any = true;
+        }
+    }
+    for (int y = 0; y != h; ++y) {
+        const byte *row = rgb + y * stride;
+        if (all || memcmp(cur_rgb + y * stride, row, stride) != 0) {
+            memcpy(cur_rgb + y * stride, row, stride);
+            row_seq[y] = n;
+            changed[y / 8] |= 1 << (y % 8);
+            any = true;
+        }
+    }
+    if (!any) return;
+
+    cur_mode = mode;
+    cur_flags = flags;
+    cur_w = w;
+    cur_h = h;
+    seq = n;
+    publish(n, text_changed, changed);
+}
+
+static void screen_shm_event(Event *e)
+{
+    switch (e->type) {
+        case EV_POKE:
+        case EV_SWITCH:
+        case EV_RESET:
+        case EV_REBOOT:
+            dirty = true;
+            break;
+        case EV_FRAME:
+            if (--rescan_left == 0) {
+                rescan_left = RESCAN_FRAMES;
+                dirty = true;
+            }
+            if (--frames_left != 0) break;
+            frames_left = cfg.screen_shm_every? cfg.screen_shm_every : 1;
+            if (dirty) {
+                dirty = false;
+                screen_scan();
+            }
+            break;
+        default:
+            ;
+    }
+}
+
+void screen_shm_init(void)
+{
+    if (cfg.screen_shm == NULL) return;
+
+    shm_create();
+    frames_left = 1;
+    rescan_left = RESCAN_FRAMES;
+    event_reghandler_range(screen_shm_event, EV_MASK(EV_POKE),
+                           0x0400, 0x0BFF);  // text/GR pages 1 and 2
+    event_reghandler_range(screen_shm_event, EV_MASK(EV_POKE),
+                           0x2000, 0x5FFF);  // HGR pages 1 and 2
+    event_reghandler_for(screen_shm_event,
+                         EV_MASK(EV_SWITCH) | EV_MASK(EV_RESET)
+                         | EV_MASK(EV_REBOOT) | EV_MASK(EV_FRAME));
+}
@@ -0,0 +1,87 @@
+//  screen-shm.h
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// Layout of the POSIX shared-memory object that --screen-shm publishes
+// the screen into. This header has no dependencies on the rest of
+// bobbin, so that programs reading the screen can use it as is.
+//
+// The object is a ScreenShmHeader, followed (at slot_offset) by
+// nslots ScreenShmSlots, slot_size bytes apiece. Each time the screen
+// changes, bobbin writes the new frame into the next slot in turn, and
+// then sets `latest` to that frame's sequence number (1, 2, 3...); frame
+// number N is always in slot N % nslots.
+//
+// To read the newest frame without copying it, or stopping bobbin:
+//
+//      seq   = atomic load of header->latest (acquire)
+//      slot  = slot (seq % nslots)
+//      if atomic load of slot->seq (acquire) != seq: try again
+//      ... use the slot's contents ...
+//      atomic thread fence (acquire)
+//      if slot->seq != seq: bobbin has since reused the slot; try again
+//
+// bobbin zeroes a slot's seq before rewriting it, and only reuses a slot
+// nslots - 1 frames after it was the latest, so a reader has at least
+// that many emulated frames (or more, if the screen isn't changing) to
+// finish with it.
+
+#ifndef BOBBIN_SCREEN_SHM_H
+#define BOBBIN_SCREEN_SHM_H
+
+#include <stdint.h>
+
+#define SCREEN_SHM_MAGIC    "BOBSCRN"   // (8 bytes, with the NUL)
+#define SCREEN_SHM_VERSION  1
+#define SCREEN_SHM_SLOTS    4
+#define SCREEN_SHM_MAX_W    560
+#define SCREEN_SHM_MAX_H    192
+
+enum {
+    SCREEN_TEXT40,
+    SCREEN_TEXT80,
+    SCREEN_GR,      // 280x192 RGB, each block 7x4 pixels
+    SCREEN_DGR,     // 560x192
+    SCREEN_HGR,     // 280x192, color artifacts
+    SCREEN_DHGR,    // 560x192, mono
+};
+
+// Flags
+#define SCREEN_MIXED    0x1 // graphics, with 4 rows of text at the bottom
+#define SCREEN_PAGE2    0x2 // showing display page 2
+
+typedef struct {
+    char        magic[8];
+    uint32_t    version;
+    uint32_t    nslots;
+    uint32_t    slot_offset;
+    uint32_t    slot_size;
+    uint64_t    latest;     // newest complete frame; 0 until the first
+} ScreenShmHeader;
+
+typedef struct {
+    uint64_t    seq;        // the frame this slot holds; 0 while rewriting
+    uint64_t    frame;      // emulated frame count (60ths of a second)
+    uint32_t    mode;       // SCREEN_TEXT40, etc.
+    uint32_t    flags;      // SCREEN_MIXED, etc.
+    uint32_t    width;      // of rgb, in pixels; 0 for text modes
+    uint32_t    height;
+
+    // Which rows differ from frame seq - 1: a bit per text row (bit 0
+    // is the top row), and per pixel row (bit y%8 of byte y/8). All
+    // are set when the mode changes.
+    uint32_t    text_rows_changed;
+    uint8_t     rows_changed[SCREEN_SHM_MAX_H / 8];
+
+    // The text page (in any mode), as displayed characters. Only the
+    // first 40 columns are used, outside of 80-column mode.
+    char        text[24][80];
+
+    // Graphics modes: the rendered page, width * height RGB triples,
+    // row after row.
+    uint8_t     rgb[SCREEN_SHM_MAX_W * SCREEN_SHM_MAX_H * 3];
+} ScreenShmSlot;
+
+#endif // BOBBIN_SCREEN_SHM_H
@@ -7,7 +7,7 @@
 #   See the accompanying LICENSE file for details.
 
 function o(s) {
-    print "    \"" s "\\n\"";
+    print "    \"" s "\\n\",";
 }
 
 BEGIN {
@@ -18,7 +18,9 @@ BEGIN {
     print
     print "// this file is read by config.c."
     print
-    print "static const char help_text[] = "
+    print "// (One string per line: the whole text is longer than C99"
+    print "// guarantees a single string literal can be.)"
+    print "static const char *const help_text[] = {"
 }
 
 1 {
@@ -101,7 +103,8 @@ OUTPUT {
 }
 
 /^<!--END-OPTIONS-->/ {
-    print ";"
+    print "    NULL"
+    print "};"
     exit(0);
 }
 
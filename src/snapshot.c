@@ -0,0 +1,303 @@
+//  snapshot.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// Whole-machine snapshots.
+//
+// A snapshot is a short header followed by tagged chunks, one per
+// component (CPU, memory, each peripheral card). Chunks are stored in
+// host byte order and layout: snapshot files are a local cache, and
+// aren't meant to be moved between builds or machines. The cache key
+// includes bobbin's version for the same reason.
+//
+// With --snapshot-cache, the state at the first --delay-until point
+// is saved, keyed by a SHA-256 hash of everything that could have
+// influenced it: the ROM, the disk and hard-drive images, the
+// machine options, and anything loaded before that point. Later runs
+// (and --watch reboots) with the same key start directly from it.
+
+#include "bobbin-internal.h"
+#include "sha-256.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAP_MAGIC      "BOBBNSNP"
+#define SNAP_TAG_SZ     8
+
+struct Snapshot {
+    byte    *buf;
+    size_t  len;
+    size_t  cap;
+};
+
+struct chunkhdr {
+    char        tag[SNAP_TAG_SZ];
+    uint32_t    sz;
+};
+
+static MACHINE_LOCAL Snapshot cached;
+static MACHINE_LOCAL bool have_cached;
+static MACHINE_LOCAL char *cache_path;
+
+static MACHINE_LOCAL struct Sha_256 keysha;
+static MACHINE_LOCAL byte keyhash[SIZE_OF_SHA_256_HASH];
+
+static MACHINE_LOCAL Snapshot warm; // for --watch-warm
+static MACHINE_LOCAL bool have_warm;
+
+/********** Chunks **********/
+
+static void snap_append(Snapshot *s, const void *data, size_t sz)
+{
+    if (s->len + sz > s->cap) {
+        size_t cap = s->cap? s->cap : 64 * 1024;
+        while (cap < s->len + sz) cap *= 2;
+        byte *buf = xalloc(cap);
+        if (s->len) memcpy(buf, s->buf, s->len);
+        free(s->buf);
+        s->buf = buf;
+        s->cap = cap;
+    }
+    memcpy(s->buf + s->len, data, sz);
+    s->len += sz;
+}
+
+void snap_put(Snapshot *s, const char *tag, const void *data, size_t sz)
+{
+    struct chunkhdr h;
+    memset(&h, 0, sizeof h);
+    size_t n = strlen(tag);
+    memcpy(h.tag, tag, n < SNAP_TAG_SZ? n : SNAP_TAG_SZ);
+    h.sz = sz;
+    snap_append(s, &h, sizeof h);
+    snap_append(s, data, sz);
+}
+
+const void *snap_get(const Snapshot *s, const char *tag, size_t sz)
+{
+    size_t pos = sizeof SNAP_MAGIC - 1;
+    while (pos + sizeof (struct chunkhdr) <= s->len) {
+        struct chunkhdr h;
+        memcpy(&h, s->buf + pos, sizeof h);
+        pos += sizeof h;
+        if (h.sz > s->len - pos) break; // truncated
+        if (!strncmp(h.tag, tag, SNAP_TAG_SZ)) {
+            if (h.sz != sz) {
+                WARN("snapshot: \"%s\" state has the wrong size;"
+                     " ignored.\n", tag);
+                return NULL;
+            }
+            return s->buf + pos;
+        }
+        pos += h.sz;
+    }
+    return NULL;
+}
+
+/********** Whole machine **********/
+
+static bool snapshot_take(Snapshot *s)
+{
+    s->len = 0;
+    snap_append(s, SNAP_MAGIC, sizeof SNAP_MAGIC - 1);
+    snap_put(s, "cpu", &theCpu, sizeof theCpu);
+    mem_snap_save(s);
+    iface_snap_save(s);
+    return periph_snap_save(s);
+}
+
+static void snapshot_restore(const Snapshot *s)
+{
+    const Cpu *cpu = snap_get(s, "cpu", sizeof theCpu);
+    if (cpu) theCpu = *cpu;
+    mem_snap_restore(s);
+    iface_snap_restore(s);
+    periph_snap_restore(s);
+    current_pc_val = PC;
+    event_fire(EV_DISPLAY_TOUCH);
+}
+
+static int snapshot_read(Snapshot *s, const char *fname)
+{
+    byte *buf;
+    size_t sz;
+    int err = mmapfile(fname, &buf, &sz, O_RDONLY);
+    if (buf == NULL) return err;
+    if (sz < sizeof SNAP_MAGIC - 1
+        || memcmp(buf, SNAP_MAGIC, sizeof SNAP_MAGIC - 1)) {
+        munmap(buf, sz);
+        return EINVAL;
+    }
+    s->len = 0;
+    snap_append(s, buf, sz);
+    munmap(buf, sz);
+    return 0;
+}
+
+static int snapshot_write(const Snapshot *s, const char *fname)
+{
+    // Write to a temporary name first, so that a concurrent run never
+    // sees a partial snapshot.
+    char *tmp = xalloc(strlen(fname) + 32);
+    sprintf(tmp, "%s.%ld.tmp", fname, (long)getpid());
+    errno = 0;
+    FILE *f = fopen(tmp, "wb");
+    int err = 0;
+    if (f == NULL) {
+        err = errno;
+    } else {
+        if (fwrite(s->buf, 1, s->len, f) != s->len) err = errno? errno : EIO;
+        if (fclose(f) != 0 && !err) err = errno;
+        if (!err && rename(tmp, fname) != 0) err = errno;
+        if (err) (void) unlink(tmp);
+    }
+    free(tmp);
+    return err;
+}
+
+int snapshot_save_file(const char *fname)
+{
+    Snapshot s = { 0 };
+    int err = snapshot_take(&s)? snapshot_write(&s, fname) : EBUSY;
+    free(s.buf);
+    return err;
+}
+
+int snapshot_load_file(const char *fname)
+{
+    Snapshot s = { 0 };
+    int err = snapshot_read(&s, fname);
+    if (!err) snapshot_restore(&s);
+    free(s.buf);
+    return err;
+}
+
+/********** The cache **********/
+
+void snapshot_key_add(const void *data, size_t sz)
+{
+    // Prefix each item with its size, so that ("ab","c") and
+    // ("a","bc") don't hash the same.
+    uint32_t len = sz;
+    sha_256_write(&keysha, &len, sizeof len);
+    sha_256_write(&keysha, data, sz);
+}
+
+static void key_add_str(const char *str)
+{
+    if (str == NULL) str = "";
+    snapshot_key_add(str, strlen(str));
+}
+
+void snapshot_key_add_file(const char *fname)
+{
+    byte *buf;
+    size_t sz;
+    int err = mmapfile(fname, &buf, &sz, O_RDONLY);
+    if (buf == NULL) {
+        // The run will fail on its own soon enough; just make sure
+        // it can't match a snapshot.
+        snapshot_key_add(&err, sizeof err);
+        return;
+    }
+    snapshot_key_add(buf, sz);
+    munmap(buf, sz);
+}
+
+static void compute_key(void)
+{
+    sha_256_init(&keysha, keyhash);
+    key_add_str(PACKAGE_VERSION);
+    key_add_str(cfg.machine);
+    key_add_str(cfg.interface);
+    snapshot_key_add(&cfg.amt_ram, sizeof cfg.amt_ram);
+    bool flags[] = { cfg.load_rom, cfg.lang_card, cfg.hdd_set,
+                     cfg.uthernet2_set, cfg.mouse_set };
+    snapshot_key_add(flags, sizeof flags);
+    mem_snap_key();
+    periph_snap_key();
+    dlypc_snap_key();
+    sha_256_close(&keysha);
+}
+
+void snapshot_init(void)
+{
+    if (cfg.snapshot_dir == NULL) return;
+    if (!dlypc_has_snap_point()) {
+        WARN("--snapshot-cache needs a --delay-until point (or"
+             " --load-basic-bin) to snapshot at; ignored.\n");
+        return;
+    }
+
+    compute_key();
+    char hex[2 * SIZE_OF_SHA_256_HASH + 1];
+    for (int i = 0; i != SIZE_OF_SHA_256_HASH; ++i) {
+        sprintf(&hex[2*i], "%02x", keyhash[i]);
+    }
+    cache_path = xalloc(strlen(cfg.snapshot_dir) + sizeof hex + 8);
+    sprintf(cache_path, "%s/%s.snap", cfg.snapshot_dir, hex);
+
+    int err = snapshot_read(&cached, cache_path);
+    if (!err) {
+        have_cached = true;
+        INFO("Using cached snapshot \"%s\".\n", cache_path);
+    } else {
+        VERBOSE("No cached snapshot \"%s\": %s\n", cache_path,
+                strerror(err));
+    }
+}
+
+void snapshot_boot(void)
+{
+    if (!have_cached) return;
+    snapshot_restore(&cached);
+    dlypc_snap_restored();
+}
+
+void snapshot_reached(void)
+{
+    if (cfg.watch_warm) {
+        // Kept in memory only, and retaken each time, since it's
+        // restored just for loading files that come after this point.
+        have_warm = snapshot_take(&warm);
+    }
+    if (cache_path == NULL || have_cached) return;
+
+    if (!snapshot_take(&cached)) {
+        WARN("Machine state can't be snapshotted here; not caching.\n");
+        cache_path = NULL;
+        return;
+    }
+    have_cached = true; // (also for --watch reboots)
+
+    errno = 0;
+    if (mkdir(cfg.snapshot_dir, 0777) != 0 && errno != EEXIST) {
+        WARN("Couldn't create snapshot cache dir \"%s\": %s\n",
+             cfg.snapshot_dir, strerror(errno));
+        return;
+    }
+    int err = snapshot_write(&cached, cache_path);
+    if (err) {
+        WARN("Couldn't write snapshot \"%s\": %s\n", cache_path,
+             strerror(err));
+    } else {
+        INFO("Saved snapshot \"%s\".\n", cache_path);
+    }
+}
+
+bool snapshot_have_warm(void)
+{
+    return have_warm;
+}
+
+void snapshot_warm_restore(void)
+{
+    snapshot_restore(&warm);
+    dlypc_snap_restored();
+}
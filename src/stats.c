@@ -0,0 +1,80 @@
+//  stats.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+#include "bobbin-internal.h"
+
+#include <stdarg.h>
+
+#ifdef BOBBIN_STATS
+MACHINE_LOCAL struct stats stats;
+
+void stats_print(printer pr)
+{
+    pr("%ju instructions, %ju cycles this frame\n",
+       instr_count, cycle_count);
+    pr("events:      %12ju dispatched\n", event_count);
+    pr("             %12ju PEEK  %12ju POKE\n",
+       stats.peek_events, stats.poke_events);
+    pr("handlers:    %12ju visited\n", stats.handlers_visited);
+    pr("true-access: %12ju calls\n", stats.true_access_calls);
+    pr("disk:        %12ju nibbles read\n", stats.disk_nibbles);
+    pr("scheduler:   %12ju callbacks\n", stats.sched_calls);
+    pr("sleep:       %12ju frames slept, %ju frames late\n",
+       stats.frames_slept, stats.frames_late);
+    pr("             %12ju ns overslept, %ju ns underslept\n",
+       stats.oversleep_ns, stats.undersleep_ns);
+    pr("idle:        %12ju frames waiting on the keyboard\n",
+       stats.frames_idle);
+    pr("block cache: %12ju runs, %ju instructions, %ju decodes\n",
+       stats.block_runs, stats.block_instrs, stats.block_decodes);
+    pr("switch flips:\n");
+    const size_t nsw = (sizeof stats.switch_flips)
+        / (sizeof stats.switch_flips[0]);
+    for (size_t i = 0; i != nsw; ++i) {
+        const char *name = get_switch_name(i);
+        if (name[0] == '<') continue; // not a switch
+        if (stats.switch_flips[i] == 0) continue;
+        pr("    %-12s %12ju\n", name, stats.switch_flips[i]);
+    }
+}
+
+void stats_reset(void)
+{
+    memset(&stats, 0, sizeof stats);
+}
+#else
+void stats_print(printer pr)
+{
+    pr("Statistics not available; rebuild with ./configure"
+       " --enable-stats.\n");
+}
+
+void stats_reset(void)
+{
+}
+#endif
+
+static int stats_eprintf(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int ret = vfprintf(stderr, fmt, args);
+    va_end(args);
+    return ret;
+}
+
+static void stats_at_exit(void)
+{
+    fputs("\n*** bobbin performance counters ***\n", stderr);
+    stats_print(stats_eprintf);
+}
+
+void stats_start(void)
+{
+    if (cfg.stats) {
+        atexit(stats_at_exit);
+    }
+}
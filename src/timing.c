@@ -15,6 +15,7 @@ struct timing_t {
     int     count;
     struct timespec ts;
     long    overslept;
+    long    frame_ns;   // NS_PER_FRAME, scaled by --speed
 };
 
 #ifdef BOBBIN_TIMINGS_DEBUG
@@ -30,6 +31,7 @@ struct timing_t  *timing_init(void)
     t->first_time = true;
     t->count = 0;
     t->overslept = 0;
+    t->frame_ns = (long)(NS_PER_FRAME / cfg.speed);
 
 #ifdef BOBBIN_TIMINGS_DEBUG
     tf = fopen("timings.dbg", "w");
@@ -53,6 +55,15 @@ timing_subtract(struct timespec a, struct timespec b)
 
 void timing_adjust(struct timing_t *t)
 {
+    if (cfg.disk_accel && (drive_spinning() || smartport_busy())) {
+        // Run flat-out while the program waits on a disk. When it
+        // stops, start timing afresh rather than trying to "catch up"
+        // (or pay back) across the accelerated frames.
+        t->first_time = true;
+        t->overslept = 0;
+        return;
+    }
+
     struct timespec now;
     clock_gettime(CLOCK_MONOTONIC, &now);
 
@@ -66,14 +77,15 @@ void timing_adjust(struct timing_t *t)
         return;
     }
 
+    const long budget = t->frame_ns;
     struct timespec elapsed_ts = timing_subtract(now, t->ts);
     long elapsed = elapsed_ts.tv_nsec;
     if (elapsed_ts.tv_sec > 0)
-        elapsed = NS_PER_FRAME; // No more waiting required.
+        elapsed = budget; // No more waiting required.
 
     timdbg("--------------------\n");
-    if (elapsed < NS_PER_FRAME) {
-        long desired = NS_PER_FRAME - elapsed;
+    if (elapsed < budget) {
+        long desired = budget - elapsed;
 
         if (t->overslept >= desired) {
             timdbg("%10ld elapsed\n", elapsed);
@@ -87,7 +99,7 @@ void timing_adjust(struct timing_t *t)
             struct timespec sltime = now;
             sltime.tv_sec = 0;
             timdbg("%10ld elapsed\n%10ld desired\n",
-                   elapsed, (long)NS_PER_FRAME);
+                   elapsed, budget);
             if (t->overslept > 0) {
                 desired -= t->overslept;
                 timdbg("%10ld oversleep BALANCE USED\n",
@@ -105,13 +117,22 @@ void timing_adjust(struct timing_t *t)
             struct timespec new_addtl_ts = timing_subtract(actual, now);
             long new_addtl = new_addtl_ts.tv_nsec;
             if (new_addtl_ts.tv_sec > 0) {
-                new_addtl = NS_PER_FRAME; // If the timer took over a
-                                          // second extra, (maybe we
-                                          // were suspended?),
-                                          // lock it to one second max.
+                new_addtl = budget; // If the timer took over a
+                                    // second extra, (maybe we
+                                    // were suspended?),
+                                    // lock it to one frame max.
             }
+            STAT_INC(frames_slept);
             if (new_addtl > desired) {
+                // At high --speed settings, one oversleep can be worth
+                // several frames' budgets; the balance is drawn down
+                // over the following frames, above.
                 t->overslept = new_addtl - desired;
+                if (t->overslept > NS_PER_FRAME)
+                    t->overslept = NS_PER_FRAME;
+                STAT_ADD(oversleep_ns, t->overslept);
+            } else {
+                STAT_ADD(undersleep_ns, desired - new_addtl);
             }
             timdbg("%10ld actual additional\n%10ld oversleep\n",
                    (long)new_addtl,
@@ -120,6 +141,7 @@ void timing_adjust(struct timing_t *t)
         }
     } else {
         timdbg("Frame took too long naturally, not sleeping any further.\n");
+        STAT_INC(frames_late);
     }
 
     t->ts = now;
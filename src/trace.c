@@ -4,52 +4,391 @@
 //  This code is licensed under the MIT license.
 //  See the accompanying LICENSE file for details.
 
+// With --trace-binary, the trace file holds fixed-size records
+// instead of text: everything the text trace would have shown, but
+// without formatting it. Records collect in a large buffer, which
+// a background thread writes out while the next one fills.
+// --decode-trace turns such a file back into the text format.
+
 #include "bobbin-internal.h"
 
+#include <errno.h>
 #include <stdarg.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+MACHINE_LOCAL bool handler_registered = false;
+
+MACHINE_LOCAL uintmax_t cycle_count = 0;
+
+MACHINE_LOCAL FILE *trfile = NULL;
+
+static MACHINE_LOCAL int traceon = 0;
+
+/********** Binary records **********/
+
+#define TRB_MAGIC       "BOBBNTRC"
+#define TRB_VERSION     1
+#define TRB_STACK_SZ    13      // as shown by util_print_state()
+#define TRB_NRECS       32768   // per buffer
+
+enum {
+    TRB_START = 1,
+    TRB_END,
+    TRB_STEP,
+    TRB_WRITE,
+};
+
+struct trb_header {
+    char        magic[8];
+    byte        version;
+    byte        enhanced;       // disassemble 65C02 opcodes
+    byte        rec_sz;
+    byte        pad[5];
+};
+
+struct trb_ref {
+    word        addr;
+    byte        len;
+    byte        in_page;
+    byte        data[5];
+};
+
+union trb_rec {
+    byte        kind;
+    struct {
+        byte        kind;
+        char        msg[55];
+        uint64_t    instr_count;
+    } start;
+    struct {
+        byte        kind;
+        byte        nrefs;
+        word        pc;
+        uint32_t    delta;      // instructions since the last record
+        byte        a, x, y, sp, p;
+        byte        code[3];
+        byte        stack[TRB_STACK_SZ];
+        struct trb_ref refs[3];
+    } step;
+    struct {
+        byte        kind;
+        byte        val;
+        byte        acc;
+        byte        aux;
+        word        loc;
+        uint32_t    aloc;
+    } write;
+    byte        pad[64];
+};
+
+static union trb_rec *trb_bufs[2];
+static int trb_cur;
+static size_t trb_fill;
+static uintmax_t trb_last_count;
+
+#ifdef HAVE_PTHREAD
+// At most one full buffer is ever waiting for the writer.
+static pthread_t trb_writer;
+static pthread_mutex_t trb_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t trb_cond = PTHREAD_COND_INITIALIZER;
+static union trb_rec *trb_pending;
+static size_t trb_pending_n;
+
+static void *trb_write_thread(void *arg)
+{
+    FILE *f = arg; // the trfile (which is MACHINE_LOCAL)
+    pthread_mutex_lock(&trb_lock);
+    for (;;) {
+        while (trb_pending == NULL)
+            pthread_cond_wait(&trb_cond, &trb_lock);
+        union trb_rec *buf = trb_pending;
+        size_t n = trb_pending_n;
+        pthread_mutex_unlock(&trb_lock);
+
+        errno = 0;
+        if (fwrite(buf, sizeof *buf, n, f) != n)
+            WARN("Couldn't write trace file: %s\n", strerror(errno));
+        fflush(f);
+
+        pthread_mutex_lock(&trb_lock);
+        trb_pending = NULL;
+        pthread_cond_broadcast(&trb_cond);
+    }
+    return NULL;
+}
+
+static void trb_wait_idle(void)
+{
+    pthread_mutex_lock(&trb_lock);
+    while (trb_pending != NULL)
+        pthread_cond_wait(&trb_cond, &trb_lock);
+    pthread_mutex_unlock(&trb_lock);
+}
+
+static void trb_submit(void)
+{
+    pthread_mutex_lock(&trb_lock);
+    while (trb_pending != NULL)
+        pthread_cond_wait(&trb_cond, &trb_lock);
+    trb_pending = trb_bufs[trb_cur];
+    trb_pending_n = trb_fill;
+    pthread_cond_broadcast(&trb_cond);
+    pthread_mutex_unlock(&trb_lock);
+    trb_cur ^= 1;
+    trb_fill = 0;
+}
+#else
+static void trb_wait_idle(void)
+{
+}
+
+static void trb_submit(void)
+{
+    errno = 0;
+    if (fwrite(trb_bufs[trb_cur], sizeof (union trb_rec), trb_fill, trfile)
+        != trb_fill)
+        WARN("Couldn't write trace file: %s\n", strerror(errno));
+    trb_fill = 0;
+}
+#endif
+
+static union trb_rec *trb_new(byte kind)
+{
+    if (trb_fill == TRB_NRECS)
+        trb_submit();
+    union trb_rec *r = &trb_bufs[trb_cur][trb_fill++];
+    memset(r, 0, sizeof *r);
+    r->kind = kind;
+    return r;
+}
+
+static void trb_flush(void)
+{
+    if (trb_fill != 0)
+        trb_submit();
+    trb_wait_idle();
+    fflush(trfile);
+}
+
+static void trb_open(void)
+{
+    struct trb_header h = {
+        .magic = TRB_MAGIC,
+        .version = TRB_VERSION,
+        .enhanced = machine_is_enhanced_iie(),
+        .rec_sz = sizeof (union trb_rec),
+    };
+    errno = 0;
+    if (fwrite(&h, sizeof h, 1, trfile) != 1) {
+        DIE(2, "Couldn't write trace file: %s\n", strerror(errno));
+    }
+    trb_bufs[0] = xalloc(TRB_NRECS * sizeof (union trb_rec));
+    trb_bufs[1] = xalloc(TRB_NRECS * sizeof (union trb_rec));
+#ifdef HAVE_PTHREAD
+    int err = pthread_create(&trb_writer, NULL, trb_write_thread, trfile);
+    if (err) {
+        DIE(2, "Couldn't start trace writer thread: %s\n", strerror(err));
+    }
+#endif
+    atexit(trb_flush);
+}
+
+static void trb_capture(const struct trb_ref *span, byte *data)
+{
+    for (int i = 0; i != span->len; ++i) {
+        word a = span->in_page? WORD(LO(span->addr + i), HI(span->addr))
+            : span->addr + i;
+        data[i] = peek_sneaky(a);
+    }
+}
+
+static void trb_fill_step(union trb_rec *r, uintmax_t *last_count)
+{
+    const Registers *regs = &theCpu.regs;
+    word pc = current_pc();
+    r->step.pc = pc;
+    r->step.delta = instr_count - *last_count;
+    *last_count = instr_count;
+    r->step.a = regs->a;
+    r->step.x = regs->x;
+    r->step.y = regs->y;
+    r->step.sp = regs->sp;
+    r->step.p = regs->p;
+    for (int i = 0; i != 3; ++i)
+        r->step.code[i] = peek_sneaky(pc + i);
+    byte sp = regs->sp - 3;
+    for (int i = 0; i != TRB_STACK_SZ; ++i)
+        r->step.stack[i] = peek_sneaky(WORD(sp++, 0x1));
+
+    DisasmRef refs[3];
+    Registers rr = *regs;
+    rr.pc = pc;
+    int n = disasm_refs(pc, &rr, refs);
+    r->step.nrefs = n;
+    for (int i = 0; i != n; ++i) {
+        struct trb_ref *t = &r->step.refs[i];
+        t->addr = refs[i].addr;
+        t->len = refs[i].len;
+        t->in_page = refs[i].in_page;
+        trb_capture(t, t->data);
+    }
+}
+
+static void trb_fill_write(union trb_rec *r, word loc, byte val)
+{
+    size_t aloc;
+    MemAccessType acc;
+    bool aux;
+    mem_get_true_access(loc, true /* writing */, &aloc, &aux, &acc);
+    r->write.loc = loc;
+    r->write.val = val;
+    r->write.aloc = aloc;
+    r->write.acc = acc;
+    r->write.aux = aux;
+}
+
+/********** Flight recorder **********/
+
+// With --flight-recorder, the most recent records are kept in a
+// ring, instead, and only written out (as text) when something goes
+// wrong.
+
+static MACHINE_LOCAL union trb_rec *ring;
+static MACHINE_LOCAL size_t ring_head;        // where the next record goes
+static MACHINE_LOCAL size_t ring_used;
+static MACHINE_LOCAL uintmax_t ring_last_count;
+
+static union trb_rec *ring_new(byte kind)
+{
+    union trb_rec *r = &ring[ring_head];
+    if (++ring_head == cfg.flight_recorder) ring_head = 0;
+    if (ring_used != cfg.flight_recorder) ++ring_used;
+    memset(r, 0, sizeof *r);
+    r->kind = kind;
+    return r;
+}
+
+static void flight_step(Event *e)
+{
+    trb_fill_step(ring_new(TRB_STEP), &ring_last_count);
+}
+
+void flight_init(void)
+{
+    if (cfg.flight_recorder == 0) return;
+    ring = xalloc(cfg.flight_recorder * sizeof *ring);
+    ring_last_count = instr_count;
+    event_reghandler_for(flight_step, EV_MASK(EV_STEP));
+}
 
-bool handler_registered = false;
+static void dec_render(FILE *out, const union trb_rec *r, uintmax_t *count);
 
-uintmax_t cycle_count = 0;
+void flight_dump(const char *why)
+{
+    static MACHINE_LOCAL bool dumping;
+    if (ring == NULL || ring_used == 0 || dumping) return;
+    dumping = true;
+
+    errno = 0;
+    FILE *f = fopen(cfg.flight_file, "w");
+    if (f == NULL) {
+        WARN("Couldn't open flight recorder file \"%s\": %s\n",
+             cfg.flight_file, strerror(errno));
+        dumping = false;
+        return;
+    }
 
-FILE *trfile = NULL;
+    size_t first = (ring_head + cfg.flight_recorder - ring_used)
+        % cfg.flight_recorder;
+    // Only the newest instruction's count is known outright; work
+    // back from it.
+    uintmax_t count = ring_last_count;
+    for (size_t i = 0; i != ring_used; ++i) {
+        const union trb_rec *r = &ring[(first + i) % cfg.flight_recorder];
+        if (r->kind == TRB_STEP) count -= r->step.delta;
+    }
+
+    fprintf(f, "~~~ FLIGHT RECORDER: %s ~~~\n", why);
+    for (size_t i = 0; i != ring_used; ++i) {
+        dec_render(f, &ring[(first + i) % cfg.flight_recorder], &count);
+    }
+    fprintf(f, "~~~ FLIGHT RECORDER ENDS ~~~\n");
+    fclose(f);
+    WARN("Recent execution written to \"%s\" (%s).\n",
+         cfg.flight_file, why);
+    dumping = false;
+}
 
-static int traceon = 0;
+/********** Tracing **********/
 
 void trace_on(char *format, ...)
 {
     va_list args;
 
     if (trfile == NULL) {
-        trfile = fopen(cfg.trace_file, "w");
+        trfile = fopen(cfg.trace_file, cfg.trace_binary? "wb" : "w");
         if (trfile == NULL) {
             perror("Couldn't open trace file");
-            exit(2);
+            bobbin_exit(2);
+        }
+        if (cfg.trace_binary) {
+            trb_open();
+        } else {
+            setvbuf(trfile, NULL, _IOLBF, 0);
         }
-        setvbuf(trfile, NULL, _IOLBF, 0);
     }
 
-    fprintf(trfile, "\n\n~~~ TRACING STARTED: ");
-    va_start(args, format);
-    vfprintf(trfile, format, args);
-    va_end(args);
-    fprintf(trfile, " ~~~\n");
+    if (cfg.trace_binary) {
+        union trb_rec *r = trb_new(TRB_START);
+        va_start(args, format);
+        vsnprintf(r->start.msg, sizeof r->start.msg, format, args);
+        va_end(args);
+        r->start.instr_count = trb_last_count = instr_count;
+    } else {
+        fprintf(trfile, "\n\n~~~ TRACING STARTED: ");
+        va_start(args, format);
+        vfprintf(trfile, format, args);
+        va_end(args);
+        fprintf(trfile, " ~~~\n");
+    }
     traceon = 1;
     if (!handler_registered) {
         handler_registered = true;
-        event_reghandler(trace_step);
+        event_reghandler_for(trace_step, EV_MASK(EV_STEP));
     }
 }
 
 void trace_off(void)
 {
-    fprintf(trfile, "~~~ TRACING FINISHED ~~~\n");
+    if (cfg.trace_binary) {
+        (void) trb_new(TRB_END);
+        trb_flush();
+    } else {
+        fprintf(trfile, "~~~ TRACING FINISHED ~~~\n");
+    }
     traceon = 0;
 }
 
+void trace_fork_job(void)
+{
+    // (The server flushed its trace before forking us; the copy of it
+    // that we inherited shares the server's file offset.)
+    char *fname = xalloc(strlen(cfg.trace_file) + 24);
+    sprintf(fname, "%s.%ld", cfg.trace_file, (long)getpid());
+    cfg.trace_file = fname;
+    if (trfile != NULL) {
+        fclose(trfile);
+        trfile = NULL;
+        if (traceon) trace_on("--fork-job");
+    }
+}
+
 void trace_step(Event *e)
 {
     if (e->type != EV_STEP) return;
@@ -61,7 +400,9 @@ void trace_step(Event *e)
         trace_off();
     }
 
-    if (traceon) {
+    if (traceon && cfg.trace_binary) {
+        trb_fill_step(trb_new(TRB_STEP), &trb_last_count);
+    } else if (traceon) {
         fprintf(trfile, "%79ju\n", instr_count);
         util_print_state(trfile, current_pc(), &theCpu.regs);
     }
@@ -69,7 +410,12 @@ void trace_step(Event *e)
 
 void trace_write(word loc, byte val)
 {
-    if (traceon) {
+    if (ring != NULL) {
+        trb_fill_write(ring_new(TRB_WRITE), loc, val);
+    }
+    if (traceon && cfg.trace_binary) {
+        trb_fill_write(trb_new(TRB_WRITE), loc, val);
+    } else if (traceon) {
         size_t aloc;
         MemAccessType acc;
         bool aux;
@@ -81,7 +427,7 @@ void trace_write(word loc, byte val)
 
 void trace_read(word loc, byte val)
 {
-    if (traceon) {
+    if (traceon && !cfg.trace_binary) {
         size_t aloc;
         MemAccessType acc;
         mem_get_true_access(loc, false /* reading */, &aloc, NULL, &acc);
@@ -93,7 +439,7 @@ void trace_reg(void)
 {
     if (!handler_registered) {
         handler_registered = true;
-        event_reghandler(trace_step);
+        event_reghandler_for(trace_step, EV_MASK(EV_STEP));
     }
 }
 
@@ -101,3 +447,111 @@ int tracing(void)
 {
     return traceon;
 }
+
+/********** Decoding **********/
+
+static const union trb_rec *dec_rec;
+
+static bool dec_in(const struct trb_ref *span, word loc, byte *val)
+{
+    word off = span->in_page?
+        (HI(loc) == HI(span->addr)? LO(LO(loc) - LO(span->addr)) : 0x100)
+        : (word)(loc - span->addr);
+    if (off >= span->len) return false;
+    *val = span->data[off];
+    return true;
+}
+
+static byte dec_peek(word loc)
+{
+    const union trb_rec *r = dec_rec;
+    byte val;
+    struct trb_ref code = { r->step.pc, 3, false };
+    memcpy(code.data, r->step.code, 3);
+    if (dec_in(&code, loc, &val)) return val;
+
+    // The stack is too long for a trb_ref; same idea.
+    byte sp0 = r->step.sp - 3;
+    if (HI(loc) == 0x1 && LO(LO(loc) - sp0) < TRB_STACK_SZ)
+        return r->step.stack[LO(LO(loc) - sp0)];
+
+    for (int i = 0; i != r->step.nrefs; ++i) {
+        if (dec_in(&r->step.refs[i], loc, &val)) return val;
+    }
+    return 0;   // not recorded (and so, never shown)
+}
+
+static void dec_render(FILE *out, const union trb_rec *r, uintmax_t *count)
+{
+    switch (r->kind) {
+        case TRB_START:
+            fprintf(out, "\n\n~~~ TRACING STARTED: %.*s ~~~\n",
+                    (int)sizeof r->start.msg, r->start.msg);
+            *count = r->start.instr_count;
+            break;
+        case TRB_END:
+            fprintf(out, "~~~ TRACING FINISHED ~~~\n");
+            break;
+        case TRB_STEP:
+            {
+                *count += r->step.delta;
+                Registers regs = {
+                    .pc = r->step.pc, .sp = r->step.sp, .p = r->step.p,
+                    .a = r->step.a, .x = r->step.x, .y = r->step.y,
+                };
+                fprintf(out, "%79ju\n", *count);
+                dec_rec = r;
+                disasm_peek = dec_peek;
+                util_print_state(out, regs.pc, &regs);
+                disasm_peek = peek_sneaky;
+            }
+            break;
+        case TRB_WRITE:
+            fprintf(out, "w @%05zX $%04X :%02X %s%s\n",
+                    (size_t)r->write.aloc, (unsigned int)r->write.loc,
+                    (unsigned int)r->write.val,
+                    mem_get_acctype_name(r->write.acc),
+                    r->write.aux? " (AUX)" : "");
+            break;
+        default:
+            ;
+    }
+}
+
+int trace_decode(const char *fname, FILE *out)
+{
+    errno = 0;
+    FILE *f = fopen(fname, "rb");
+    if (f == NULL) {
+        WARN("Couldn't open trace file \"%s\": %s\n", fname,
+             strerror(errno));
+        return 2;
+    }
+    struct trb_header h;
+    if (fread(&h, sizeof h, 1, f) != 1
+        || memcmp(h.magic, TRB_MAGIC, sizeof h.magic)
+        || h.version != TRB_VERSION || h.rec_sz != sizeof (union trb_rec)) {
+        WARN("\"%s\" isn't a binary trace file from this bobbin.\n",
+             fname);
+        fclose(f);
+        return 2;
+    }
+
+    // The disassembler checks the machine type for 65C02 opcodes.
+    cfg.machine = h.enhanced? "enhanced" : "plus";
+    machine_init();
+
+    union trb_rec r;
+    uintmax_t count = 0;
+    int status = 0;
+    while (fread(&r, sizeof r, 1, f) == 1) {
+        if (r.kind < TRB_START || r.kind > TRB_WRITE) {
+            WARN("Bad record in trace file \"%s\".\n", fname);
+            status = 1;
+            break;
+        }
+        dec_render(out, &r, &count);
+    }
+    fclose(f);
+    return status;
+}
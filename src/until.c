@@ -0,0 +1,284 @@
+//  until.c
+//
+//  Copyright (c) 2025 Micah John Cowan.
+//  This code is licensed under the MIT license.
+//  See the accompanying LICENSE file for details.
+
+// The debugger's "until" command: continue execution until some
+// condition holds, then stop in the debugger and say so. Each kind
+// of condition is checked where it's cheapest to: a PC via
+// event_step_pc(), a memory location from its POKE events, and the
+// screen or frame count once per frame, so that nothing has to poll
+// from outside between instructions.
+
+#include "bobbin-internal.h"
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum until_kind {
+    U_NONE,
+    U_PC,
+    U_MEM_EQ,
+    U_MEM_NE,
+    U_MEM_CHANGES,
+    U_TEXT,
+    U_FRAMES,
+    U_INPUT,
+};
+
+static MACHINE_LOCAL struct {
+    enum until_kind kind;
+    word            addr;
+    byte            val;
+    unsigned long   count;          // for U_FRAMES
+    unsigned long   limit;          // frames; 0 = no limit
+    char            text[81];       // for U_TEXT
+    unsigned long   frames;         // elapsed so far
+    uintmax_t       start_instr;
+    bool            registered;
+    bool            stepped;        // addr declared with event_step_pc()
+} u;
+
+static void until_event(Event *e);
+
+void until_cancel(void)
+{
+    // (until_stop() has already cleared u.kind, so the PC is
+    // remembered separately.)
+    if (u.stepped) {
+        event_unstep_pc(u.addr);
+        u.stepped = false;
+        block_invalidate_all(); // so blocks can run through it again
+    }
+    u.kind = U_NONE;
+    if (u.registered) {
+        // Never from within until_event(): unregistering frees the
+        // handler entry that dispatch is still walking.
+        event_unreghandler(until_event);
+        u.registered = false;
+    }
+}
+
+static void until_stop(const char *fmt, ...)
+{
+    unsigned long frames = u.frames;
+    uintmax_t instrs = instr_count - u.start_instr;
+    u.kind = U_NONE; // debugger() unregisters us, via until_cancel()
+    dbg_on(); // (also unhooks the interface, so this is visible)
+    block_stop();
+
+    va_list args;
+    va_start(args, fmt);
+    fputs("\nUntil: ", stdout);
+    vprintf(fmt, args);
+    va_end(args);
+    printf(" (after %lu frames, %ju instructions).\n", frames, instrs);
+}
+
+static bool screen_contains(const char *str)
+{
+    const byte *mem = getram();
+    bool eighty = swget(ss, ss_eightycol) && cfg.amt_ram > LOC_AUX_START;
+    word page = (swget(ss, ss_page2) && !eighty)? 0x800 : 0x400;
+    char row[81];
+
+    // (Rows are searched one at a time; a match can't span two.)
+    for (int y = 0; y != 24; ++y) {
+        word base = page + (y % 8) * 0x80 + (y / 8) * 0x28;
+        int n = 0;
+        if (eighty) {
+            for (int x = 0; x != 80; ++x) {
+                row[n++] = util_todisplay(
+                    mem[(x % 2 == 0? LOC_AUX_START : 0) + base + x/2]);
+            }
+        } else {
+            for (int x = 0; x != 40; ++x) {
+                row[n++] = util_todisplay(mem[base + x]);
+            }
+        }
+        row[n] = '\0';
+        if (strstr(row, str) != NULL) return true;
+    }
+    return false;
+}
+
+static void until_poke(Event *e)
+{
+    if (e->loc != u.addr) return;
+    byte cur = peek_sneaky(e->loc);
+    switch (u.kind) {
+        case U_MEM_EQ:
+            if (e->val == u.val)
+                until_stop("$%04X is now $%02X", (unsigned int)u.addr,
+                           (unsigned int)e->val);
+            break;
+        case U_MEM_NE:
+            if (e->val != u.val)
+                until_stop("$%04X is now $%02X", (unsigned int)u.addr,
+                           (unsigned int)e->val);
+            break;
+        case U_MEM_CHANGES:
+            if (e->val != cur)
+                until_stop("$%04X changed ($%02X -> $%02X)",
+                           (unsigned int)u.addr, (unsigned int)cur,
+                           (unsigned int)e->val);
+            break;
+        default:
+            ;
+    }
+}
+
+static void until_frame(void)
+{
+    ++u.frames;
+    if (u.kind == U_FRAMES && u.frames >= u.count) {
+        until_stop("%lu frames elapsed", u.count);
+    } else if (u.kind == U_TEXT && screen_contains(u.text)) {
+        until_stop("screen shows \"%s\"", u.text);
+    } else if (u.limit != 0 && u.frames >= u.limit) {
+        until_stop("gave up waiting");
+    }
+}
+
+static void until_event(Event *e)
+{
+    if (u.kind == U_NONE) return;
+    switch (e->type) {
+        case EV_PRESTEP:
+            if (u.kind == U_PC && current_pc() == u.addr)
+                until_stop("PC reached $%04X", (unsigned int)u.addr);
+            break;
+        case EV_POKE:
+            until_poke(e);
+            break;
+        case EV_FRAME:
+            until_frame();
+            break;
+        default:
+            ;
+    }
+}
+
+void until_input_idle(void)
+{
+    if (u.kind == U_INPUT)
+        until_stop("program is waiting for input");
+}
+
+static bool parse_hex(const char **sp, unsigned long max, unsigned long *v)
+{
+    const char *s = *sp;
+    char *end;
+    while (*s == ' ') ++s;
+    if (*s == '$') ++s;
+    *v = strtoul(s, &end, 16);
+    if (end == s || *v > max) return false;
+    *sp = end;
+    return true;
+}
+
+static bool parse_until(const char *s)
+{
+    unsigned long v;
+    while (*s == ' ') ++s;
+    if (!strncmp(s, "pc ", 3)) {
+        s += 3;
+        if (!parse_hex(&s, 0xFFFF, &v)) return false;
+        u.kind = U_PC;
+        u.addr = v;
+    } else if (*s == '[') {
+        ++s;
+        if (!parse_hex(&s, 0xFFFF, &v) || *s != ']') return false;
+        u.addr = v;
+        ++s;
+        while (*s == ' ') ++s;
+        if (!strncmp(s, "changes", 7)) {
+            u.kind = U_MEM_CHANGES;
+            s += 7;
+        } else if (!strncmp(s, "==", 2) || !strncmp(s, "!=", 2)) {
+            u.kind = s[0] == '='? U_MEM_EQ : U_MEM_NE;
+            s += 2;
+            if (!parse_hex(&s, 0xFF, &v)) return false;
+            u.val = v;
+        } else {
+            return false;
+        }
+    } else if (!strncmp(s, "text ", 5)) {
+        s += 5;
+        size_t n = strlen(s);
+        if (n == 0 || n >= sizeof u.text) return false;
+        memcpy(u.text, s, n + 1);
+        s += n;
+        u.kind = U_TEXT;
+    } else if (!strncmp(s, "frames ", 7)) {
+        char *end;
+        s += 7;
+        u.count = strtoul(s, &end, 10);
+        if (end == s || u.count == 0) return false;
+        s = end;
+        u.kind = U_FRAMES;
+    } else if (!strncmp(s, "input", 5)) {
+        s += 5;
+        u.kind = U_INPUT;
+    } else {
+        return false;
+    }
+    while (*s == ' ') ++s;
+    return *s == '\0';
+}
+
+bool until_start(const char *args)
+{
+    until_cancel();
+
+    // An optional " within N" (frames) gives up after that long.
+    char buf[128];
+    if (strlen(args) >= sizeof buf) {
+        printf("ERR: until: condition too long.\n");
+        return false;
+    }
+    strcpy(buf, args);
+    u.limit = 0;
+    char *within = strstr(buf, " within ");
+    if (within != NULL) {
+        char *end;
+        u.limit = strtoul(within + 8, &end, 10);
+        if (end == within + 8 || *end != '\0' || u.limit == 0) {
+            printf("ERR: until: bad \"within\" frame count.\n");
+            return false;
+        }
+        *within = '\0';
+    }
+
+    if (!parse_until(buf)) {
+        u.kind = U_NONE;
+        printf("ERR: until: couldn't parse \"%s\".\n", args);
+        return false;
+    }
+
+    u.frames = 0;
+    u.start_instr = instr_count;
+    event_reghandler_for(until_event, EV_MASK(EV_FRAME));
+    u.registered = true;
+    switch (u.kind) {
+        case U_PC:
+            event_reghandler_for(until_event,
+                                 EV_MASK(EV_PRESTEP) | EV_FLAG_SOME_PCS);
+            event_step_pc(u.addr);
+            u.stepped = true;
+            block_invalidate_all(); // so that no cached run skips it
+            break;
+        case U_MEM_EQ:
+        case U_MEM_NE:
+        case U_MEM_CHANGES:
+            event_reghandler_range(until_event, EV_MASK(EV_POKE),
+                                   u.addr, u.addr);
+            break;
+        default:
+            ;
+    }
+    printf("Continuing until %s...\n", args);
+    return true;
+}
@@ -63,7 +63,8 @@ int mmapfile(const char *fname, byte **buf, size_t *sz, int flags)
         mflags = MAP_SHARED;
     }
     *buf = mmap(NULL, st.st_size, protect, mflags, fd, 0);
-    if (*buf == NULL) {
+    if (*buf == MAP_FAILED) {
+        *buf = NULL;
         err = errno;
         goto bail;
     }
@@ -177,9 +178,9 @@ void util_print_state(FILE *f, word pc, Registers *reg)
     for (int i=0; i != 13; ++i) {
         if (!sp) fprintf(f, "  |");
         if (sp == reg->sp)
-            fprintf(f, "  (%02X)", peek_sneaky(WORD(sp++,0x1)));
+            fprintf(f, "  (%02X)", disasm_peek(WORD(sp++,0x1)));
         else
-            fprintf(f, "  %02X", peek_sneaky(WORD(sp++,0x1)));
+            fprintf(f, "  %02X", disasm_peek(WORD(sp++,0x1)));
     }
     fputc('\n', f);
 
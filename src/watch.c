@@ -1,6 +1,6 @@
 //  watch.c
 //
-//  Copyright (c) 2023-2024 Micah John Cowan.
+//  Copyright (c) 2023-2025 Micah John Cowan.
 //  This code is licensed under the MIT license.
 //  See the accompanying LICENSE file for details.
 
@@ -11,14 +11,23 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#ifdef HAVE_SYS_INOTIFY_H
+#  include <sys/inotify.h>
+#endif
+
 typedef struct WRec {
     struct WRec *next;
     const char *path;
+    const char *name;   // within its directory (for inotify)
+    int wd;             // inotify watch on that directory
     struct stat sbuf;
+    bool changed;
 } WRec;
 
 WRec *wlist = NULL;
 
+// Without inotify (or if it fails us), the files are checked once
+// a second, from a SIGALRM.
 static int inotify_fd = -1;
 
 void setup_watches(void)
@@ -26,6 +35,15 @@ void setup_watches(void)
     if (!cfg.watch) return; // We're not doing watches.
     if (wlist) return; // Don't do setup a second time.
 
+#ifdef HAVE_SYS_INOTIFY_H
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        int err = errno;
+        WARN("Couldn't start inotify (%s); checking watched files"
+             " once a second instead.\n", strerror(err));
+    }
+#endif
+
     // Add watches for all the --load files
     struct dlypc_file_iter *iter = dlypc_file_iter_new();
     const char *fname;
@@ -35,8 +53,39 @@ void setup_watches(void)
     }
     dlypc_file_iter_destroy(iter);
 
-    (void) alarm(1);
+    if (inotify_fd < 0)
+        (void) alarm(1);
+}
+
+#ifdef HAVE_SYS_INOTIFY_H
+static void add_inotify(WRec *rec)
+{
+    // Watch the directory, not the file: an editor or assembler that
+    // writes a new file and renames it over the old one leaves a watch
+    // on the file itself watching the old (now nameless) one.
+    const char *slash = strrchr(rec->path, '/');
+    rec->name = slash? slash + 1 : rec->path;
+    size_t dirlen = slash? (size_t)(slash - rec->path) : 0;
+    char *dir = xalloc(dirlen + 2);
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else if (dirlen == 0) {
+        strcpy(dir, "/");
+    } else {
+        memcpy(dir, rec->path, dirlen);
+        dir[dirlen] = '\0';
+    }
+
+    rec->wd = inotify_add_watch(inotify_fd, dir,
+                                IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (rec->wd < 0) {
+        int err = errno;
+        DIE(1, "Couldn't watch directory \"%s\" for changes: %s.\n",
+            dir, strerror(err));
+    }
+    free(dir);
 }
+#endif
 
 void add_watch(const char *fname)
 {
@@ -53,24 +102,61 @@ void add_watch(const char *fname)
     char *path = xalloc(namelen + 1);
     memcpy(path, fname, namelen + 1);
     rec->path = path;
+    rec->changed = false;
+#ifdef HAVE_SYS_INOTIFY_H
+    if (inotify_fd >= 0)
+        add_inotify(rec);
+#endif
     INFO("Watching \"%s\" for changes.\n", fname);
 
     rec->next = wlist;
     wlist = rec;
 }
 
-bool check_watches(void)
+#ifdef HAVE_SYS_INOTIFY_H
+// Marks the files that inotify says were written (or replaced) since
+// the last call. Just one read(), that finds nothing, in the usual case.
+static void read_inotify(void)
 {
-    if (!sigalrm_received) return false;
+    union {
+        struct inotify_event ev; // (for its alignment)
+        char buf[4096];
+    } evbuf;
+    ssize_t n;
 
-    WRec *rec;
-    const char *changed = NULL;
+    while ((n = read(inotify_fd, evbuf.buf, sizeof evbuf.buf)) > 0) {
+        const char *p = evbuf.buf;
+        while (p < evbuf.buf + n) {
+            struct inotify_event ev;
+            memcpy(&ev, p, sizeof ev);
+            const char *name = p + sizeof ev;
+            p += sizeof ev + ev.len;
+
+            for (WRec *rec = wlist; rec != NULL; rec = rec->next) {
+                if ((ev.mask & IN_Q_OVERFLOW)
+                    || (ev.wd == rec->wd && ev.len != 0
+                        && STREQ(name, rec->name))) {
+                    rec->changed = true;
+                }
+            }
+        }
+    }
+    if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        int err = errno;
+        DIE(1, "Couldn't read inotify events: %s.\n", strerror(err));
+    }
+}
+#endif
+
+// Marks the files whose modification times have changed.
+static void stat_watches(void)
+{
     struct timespec mtime;
 #if defined(__APPLE__) || defined(__NetBSD__)
 // Darwin and NetBSD don't follow the standard naming from POSIX.1-2008
 #  define st_mtim st_mtimespec
 #endif
-    for (rec = wlist; rec != NULL; rec = rec->next) {
+    for (WRec *rec = wlist; rec != NULL; rec = rec->next) {
         mtime = rec->sbuf.st_mtim;
         errno = 0;
         int result = stat(rec->path, &rec->sbuf);
@@ -86,21 +172,55 @@ bool check_watches(void)
         }
         if (mtime.tv_sec != rec->sbuf.st_mtim.tv_sec
             || mtime.tv_nsec != rec->sbuf.st_mtim.tv_nsec) {
-            // Note the changed file, keep looking for more (so as not
-            // to retrigger belatedly on another file, after reboot).
-            changed = rec->path;
+            rec->changed = true;
         }
     }
+}
 
-    if (changed) {
-        WARN("Rewrite event for watched file \"%s\". Restarting...\n", changed);
-        event_fire(EV_REBOOT);
+// --watch-warm: reload without a reboot, if nothing that was changed
+// was loaded during the boot (and there's a machine to reload into).
+static bool can_reload(void)
+{
+    for (WRec *rec = wlist; rec != NULL; rec = rec->next) {
+        if (rec->changed && dlypc_loaded_before_snap_point(rec->path))
+            return false;
+    }
+    return !dlypc_has_snap_point() || snapshot_have_warm();
+}
+
+bool check_watches(void)
+{
+#ifdef HAVE_SYS_INOTIFY_H
+    if (inotify_fd >= 0) {
+        read_inotify();
+    } else
+#endif
+    {
+        if (!sigalrm_received) return false;
+        stat_watches();
+        sigalrm_received = 0;
+        (void) alarm(1);
     }
-    sigalrm_received = 0;
-    (void) alarm(1);
-    if (changed) {
-        return true;
+
+    // Note every changed file, not just the first (so as not to
+    // retrigger belatedly on another file, after reboot).
+    const char *changed = NULL;
+    for (WRec *rec = wlist; rec != NULL; rec = rec->next) {
+        if (rec->changed) changed = rec->path;
+    }
+    if (changed == NULL) return false;
+
+    if (cfg.watch_warm && can_reload()) {
+        WARN("Rewrite event for watched file \"%s\". Reloading...\n",
+             changed);
+        dlypc_warm_reload();
     } else {
-        return false;
+        WARN("Rewrite event for watched file \"%s\". Restarting...\n",
+             changed);
+        event_fire(EV_REBOOT);
+    }
+    for (WRec *rec = wlist; rec != NULL; rec = rec->next) {
+        rec->changed = false;
     }
+    return true;
 }
@@ -0,0 +1,104 @@
+#!/bin/sh
+
+# Runs bobbin's standard benchmark workloads under --bench, and prints
+# one line per workload:
+#
+#   NAME frames=... cycles=... instrs=... events=... secs=... mhz=... ...
+#
+# Usage: bench.sh BOBBIN TOP_SRCDIR [TESTS6502_BUILDDIR]
+#
+# Extra bobbin options (e.g. --block-cache) may be given in $BENCH_OPTS.
+
+BOBBIN=$1
+TOP=$2
+T6502=${3:-$TOP/test/tests6502}
+export BOBBIN_ROMDIR="$TOP/src/roms"
+
+# Upper limit on emulated frames, for workloads that end by themselves.
+MAXFRAMES=1000000
+
+status=0
+
+bench() {
+    name=$1; shift
+    out=$("$BOBBIN" "$@" $BENCH_OPTS 2>&1 >/dev/null)
+    line=$(printf '%s\n' "$out" | sed -n 's/^bench: //p' | tail -n 1)
+    if test -z "$line"; then
+        printf '%s FAILED\n' "$name"
+        printf '%s\n' "$out" | sed 's/^/    /' >&2
+        status=1
+    else
+        printf '%s %s\n' "$name" "$line"
+    fi
+}
+
+# CPU-bound: Klaus Dormann's functional test, until its success trap.
+# Needs ca65 to build, so may not be available.
+if test -e "$T6502/6502_functional_test.bin"; then
+    bench 6502_functional --iface simple -m plus --no-rom \
+        --load="$T6502/6502_functional_test.bin" \
+        --trap-failure 0x0001 --trap-success 0x0002 \
+        --bench $MAXFRAMES </dev/null
+fi
+if test -e "$T6502/65C02_extended_opcodes_test.bin"; then
+    bench 65C02_extended --iface simple -m enhanced --no-rom \
+        --load="$T6502/65C02_extended_opcodes_test.bin" \
+        --trap-failure 0x0001 --trap-success 0x0002 \
+        --bench $MAXFRAMES </dev/null
+fi
+
+# AppleSoft: generate a maze, until input runs out.
+bench amazing --simple --bench $MAXFRAMES < "$TOP/examples/amazing-run.bas"
+
+# Disk: boot ProDOS to the BASIC.SYSTEM prompt.
+bench prodos_boot --simple --disk "$TOP/disk/prodos242.dsk" \
+    --bench $MAXFRAMES </dev/null
+
+# Network: push 256KB over a loopback TCP connection between two
+# Uthernet II sockets (S0 LISTENs on port $6502; S1 CONNECTs to it by
+# way of the "gateway", which is the host), 1KB at a time. The
+# sockets are set up from the monitor; the program at $900 then waits
+# for both to be ESTABLISHED, and, 256 times over: fills S1's TX ring
+# through the data port, bumps Sn_TX_WR and SENDs; waits for S0's
+# Sn_RX_RSR to reach $400, drains it through the data port, bumps
+# Sn_RX_RD and RECVs. Then it jumps to the success trap.
+w5100() {
+    a=$1; shift
+    for v; do
+        printf 'C0B5:%02X\nC0B6:%02X\nC0B7:%s\n' $((a >> 8)) $((a & 255)) $v
+        a=$((a + 1))
+    done
+}
+uthernet_pump() {
+    echo 'CALL -151'
+    echo 'C0B4:01'
+    w5100 0x400 01                          # S0: TCP,
+    w5100 0x404 65 02                       #   port $6502,
+    w5100 0x401 01; w5100 0x401 02          #   OPEN, LISTEN
+    w5100 0x500 01                          # S1: TCP,
+    w5100 0x50C C0 A8 41 01 65 02           #   to 192.168.65.1:$6502,
+    w5100 0x501 01; w5100 0x501 04          #   OPEN, CONNECT
+    cat <<'EOF'
+0900: A9 03 8D B4 C0 A9 00 85 06 A2 04 8E B5 C0 A9 03
+0910: 8D B6 C0 AD B7 C0 C9 17 D0 F1 E8 E0 06 D0 EC A9
+0920: 05 8D B5 C0 A9 24 8D B6 C0 AD B7 C0 85 08 AD B7
+0930: C0 85 09 A5 08 29 07 09 48 8D B5 C0 A5 09 8D B6
+0940: C0 A2 04 A0 00 8C B7 C0 C8 D0 FA CA D0 F7 A9 05
+0950: 8D B5 C0 A9 24 8D B6 C0 A5 08 18 69 04 8D B7 C0
+0960: A5 09 8D B7 C0 A9 01 8D B6 C0 A9 20 8D B7 C0 A9
+0970: 04 8D B5 C0 A9 26 8D B6 C0 AD B7 C0 C9 04 90 EF
+0980: A9 28 8D B6 C0 AD B7 C0 85 08 AD B7 C0 85 09 A5
+0990: 08 29 07 09 60 8D B5 C0 A5 09 8D B6 C0 A2 04 A0
+09A0: 00 AD B7 C0 C8 D0 FA CA D0 F7 A9 04 8D B5 C0 A9
+09B0: 28 8D B6 C0 A5 08 18 69 04 8D B7 C0 A5 09 8D B7
+09C0: C0 A9 01 8D B6 C0 A9 40 8D B7 C0 C6 06 F0 03 4C
+09D0: 1F 09 4C 02 00
+900G
+EOF
+}
+uthernet_pump | bench uthernet_loopback --simple -m plus --uthernet2 \
+    --trap-success 0x0002 --bench $MAXFRAMES
+uthernet_pump | bench uthernet_loopback_thread --simple -m plus --uthernet2 \
+    --uthernet2-thread --trap-success 0x0002 --bench $MAXFRAMES
+
+exit $status
@@ -1,6 +1,11 @@
 #!/usr/bin/python
 
 from common import *
+import mmap
+import os
+import socket
+import struct
+import time
 
 @bobbin()
 def no_args(p):
@@ -12,6 +17,16 @@ def no_args(p):
     # Check that we get the Apple //e screen and prompt
     return "Apple //e" in p.before and "]" in p.before
 
+@bobbin()
+def tty_scroll_repaint(p):
+    # Text-page writes are repainted at frame boundaries; a screenful
+    # of scrolling should still leave the last line on display.
+    p.send('FOR I=1 TO 30:PRINT "LINE";I:NEXT:PRINT "XYZZY"\r')
+    got = p.expect([EOF, TIMEOUT])
+    if got != 1:
+        fail("got EOF")
+    return "XYZZY" in p.before
+
 @bobbin('-m plus --simple')
 def m_plus_simple(p):
     got = p.expect([EOF, TIMEOUT])
@@ -79,3 +94,81 @@ def m_plus_simple_v_v(p):
 \r
 \r
 ]""" % {"bobbin": BOBBIN}, before)
+
+@bobbin('-m plus --simple --screen-shm bobbin-test-screen')
+def screen_shm(p):
+    def latest():
+        time.sleep(0.5)  # a few frames
+        with open('/dev/shm/bobbin-test-screen', 'rb') as f:
+            m = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        magic, _, nslots, off, size, seq = struct.unpack_from('<8sIIIIQ', m)
+        slot = off + (seq % nslots) * size
+        sseq, frame, mode, flags, w, h = struct.unpack_from('<QQIIII', m, slot)
+        text = m[slot + 60:slot + 60 + 24 * 80]
+        return magic, sseq == seq, mode, flags, w, h, text
+
+    p.expect("\r\n]")
+    p.sendline('HOME:PRINT "SHM TEST"')
+    p.expect("\r\nSHM TEST\r\n")
+    magic, ok, mode, flags, w, h, text = latest()
+    if not (magic == b'BOBSCRN\0' and ok and mode == 0 and w == 0):
+        fail("bad text-mode frame: %r" % ((magic, ok, mode, w),))
+    if not text.startswith(b'SHM TEST'):
+        fail("text row 0 is %r" % text[:40])
+    p.sendline('HGR')
+    _, ok, mode, flags, w, h, _ = latest()
+    os.remove('/dev/shm/bobbin-test-screen')  # (bobbin will be killed)
+    # HGR, mixed with text, 280x192.
+    return want_got('4 1 280 192', '%d %d %d %d' % (mode, flags, w, h))
+
+@bobbin('-m plus --simple --control-socket /tmp/bobbin-test-control')
+def control_socket(p):
+    def req(id, op, payload=b''):
+        return struct.pack('<IHBB', len(payload), id, op, 0) + payload
+    def recv(n):
+        buf = b''
+        while len(buf) < n:
+            buf += s.recv(n - len(buf))
+        return buf
+    def resp():
+        n, id, op, status = struct.unpack('<IHBB', recv(8))
+        return id, op, status, recv(n)
+
+    p.expect("\r\n]")
+    s = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    s.settimeout(5)
+    s.connect('/tmp/bobbin-test-control')
+    # All in one go: PING, POKE $300, PEEK it back, GET_REGS, a bad op,
+    # and type a line.
+    s.sendall(req(1, 0, b'hi')
+              + req(2, 2, struct.pack('<H', 0x300) + b'\x12\x34')
+              + req(3, 1, struct.pack('<HH', 0x300, 2))
+              + req(4, 3)
+              + req(5, 99)
+              + req(6, 5, b'PRINT PEEK(769)\r'))
+    got = [resp() for _ in range(6)]
+    if got[0] != (1, 0, 0, b'hi') or got[1] != (2, 2, 0, b'') \
+            or got[2] != (3, 1, 0, b'\x12\x34') or got[5] != (6, 5, 0, b''):
+        fail("unexpected responses: %r" % got)
+    if got[3][2] != 0 or len(got[3][3]) != 8 or got[4][2] != 1:
+        fail("bad GET_REGS or bad-op response: %r" % got[3:5])
+    p.expect("\r\n52\r\n")
+
+    # Paused, the machine only moves when told to.
+    s.sendall(req(7, 7) + req(8, 6, struct.pack('<I', 1000))
+              + req(9, 6, struct.pack('<I', 1000)))
+    got = [resp() for _ in range(3)]
+    (c1,) = struct.unpack('<Q', got[1][3])
+    (c2,) = struct.unpack('<Q', got[2][3])
+    if not 1000 <= c2 - c1 < 1010:
+        fail("RUN 1000 ran %d cycles" % (c2 - c1))
+    s.sendall(req(10, 8) + req(11, 11, b'\x00'))
+    got = [resp() for _ in range(2)]
+    s.close()
+    mode, flags, w, h = struct.unpack_from('<IIII', got[1][3])
+    text = got[1][3][16:]
+    rows = [text[80*y:80*y+40].decode().rstrip() for y in range(24)]
+    if mode != 0 or '52' not in rows:
+        fail("bad screen: mode %d, rows %r" % (mode, rows))
+    return True
+
@@ -1,6 +1,10 @@
 #!/usr/bin/python
 
 from common import *
+import os
+import struct
+import tempfile
+import zlib
 
 @bobbin('-m plus --simple')
 def ctrl_c_in_dbg(p):
@@ -24,3 +28,155 @@ def ctrl_c_in_dbg(p):
     p.sendline("PRINT\"HELLO\"")
     p.expect("\r\nHELLO\r\n\r\n]")
     return True
+
+@bobbin('-m plus --simple --bp 300')
+def conditional_bp_and_wp(p):
+    p.expect("\r\n]")
+    p.sendline("CALL -151")
+    p.expect("\r\n\\*")
+    p.sendline("300: A2 00 E8 8E 10 03 E0 05 D0 F8 00")
+    p.expect("\r\n\\*")
+    p.sendline("300G")
+    p.expect("\r\nBreakpoint 1 at \\$0300\\.\r\n")
+    p.expect("\r\nBOBBIN> ")
+    p.sendline("b 306 if X==03")
+    p.expect("\r\nBOBBIN> ")
+    p.sendline("w 310 if X>=04 && [0310]!=00")
+    p.expect("\r\nBOBBIN> ")
+    p.sendline("c")
+    p.expect("\r\nBreakpoint 2 at \\$0306\\.\r\n")
+    p.expect("ACC: .. +X: 03 ")
+    p.expect("\r\nBOBBIN> ")
+    p.sendline("c")
+    # The watchpoint kept track of the value while breakpoint 2 fired.
+    p.expect("\r\nWatchpoint 3 fired:\r\n"
+             "Value changed at \\$0310 \\(\\$03 -> \\$04\\)\\.\r\n")
+    p.expect("\r\nBOBBIN> ")
+    return True
+
+@bobbin('-m plus --simple --bp 300')
+def until_conditions(p):
+    p.expect("\r\n]")
+    p.sendline("CALL -151")
+    p.expect("\r\n\\*")
+    p.sendline("300: A2 00 E8 8E 10 03 E0 05 D0 F8 00")
+    p.expect("\r\n\\*")
+    p.sendline("300G")
+    p.expect("\r\nBreakpoint 1 at \\$0300\\.\r\n")
+    p.expect("\r\nBOBBIN> ")
+    p.sendline("until [0310] == 04")
+    p.expect("\r\nUntil: \\$0310 is now \\$04 \\(after ")
+    p.expect("\r\nBOBBIN> ")
+    # The program BRKs into the monitor, which then waits for a key.
+    p.sendline("until input within 600")
+    p.expect("\r\nUntil: program is waiting for input \\(after ")
+    p.expect("\r\nBOBBIN> ")
+    return True
+
+@bobbin('-m plus --simple --bp 300')
+def save_png_matches_ppm(p):
+    p.expect("\r\n]")
+    p.sendline("CALL -151")
+    p.expect("\r\n\\*")
+    # A few GR blocks, on the first text row.
+    p.sendline("400: 01 F2 3C 00 DE")
+    p.expect("\r\n\\*")
+    p.sendline("300: 4C 00 03")
+    p.expect("\r\n\\*")
+    p.sendline("300G")
+    p.expect("\r\nBOBBIN> ")
+    d = tempfile.mkdtemp()
+    ppm, png = os.path.join(d, 'gr.ppm'), os.path.join(d, 'gr.png')
+    p.sendline("save-gr-ppm " + ppm)
+    p.expect("\r\nBOBBIN> ")
+    p.sendline("save-gr-png " + png)
+    p.expect("Saved GR1 to PNG file .* \\(280x192, 16 colors\\)\\.\r\n")
+    p.expect("\r\nBOBBIN> ")
+
+    want = open(ppm, 'rb').read().split(b'\n', 3)[3]
+    data = open(png, 'rb').read()
+    pos, idat = 8, b''
+    while pos < len(data):
+        n, = struct.unpack('>I', data[pos:pos+4])
+        if data[pos+4:pos+8] == b'IDAT':
+            idat += data[pos+8:pos+8+n]
+        pos += 12 + n
+    raw = zlib.decompress(idat)
+    stride = 280 * 3 + 1
+    got = b''.join(raw[y*stride+1:(y+1)*stride] for y in range(192))
+    for f in (ppm, png):
+        os.remove(f)
+    os.rmdir(d)
+    return data[:8] == b'\x89PNG\r\n\x1a\n' and got == want
+
+@bobbin('-m plus --simple --bp 300 --stats')
+def stats_counters(p):
+    p.expect("\r\n]")
+    p.sendline("CALL -151")
+    p.expect("\r\n\\*")
+    p.sendline("300: 4C 00 03")
+    p.expect("\r\n\\*")
+    p.sendline("300G")
+    p.expect("\r\nBOBBIN> ")
+    p.sendline("stats")
+    if p.expect(["\r\nStatistics not available; rebuild with ./configure"
+                 " --enable-stats\\.\r\n",
+                 "\r\n[0-9]+ instructions, [0-9]+ cycles this frame\r\n"]) == 0:
+        # Not a stats build; there's nothing more to see.
+        p.expect("\r\nBOBBIN> ")
+        return True
+    for field in ["events: +[0-9]+ dispatched",
+                  " +[0-9]+ PEEK +[0-9]+ POKE",
+                  "handlers: +[0-9]+ visited",
+                  "true-access: +[0-9]+ calls",
+                  "disk: +[0-9]+ nibbles read",
+                  "scheduler: +[0-9]+ callbacks",
+                  "sleep: +[0-9]+ frames slept, [0-9]+ frames late",
+                  " +[0-9]+ ns overslept, [0-9]+ ns underslept",
+                  "idle: +[0-9]+ frames waiting on the keyboard",
+                  "block cache: +[0-9]+ runs, [0-9]+ instructions,"
+                  " [0-9]+ decodes",
+                  "switch flips:"]:
+        p.expect(field + "\r\n")
+    p.expect("\r\nBOBBIN> ")
+    # Booting flipped some soft switches; after a reset, none have been.
+    p.sendline("stats reset")
+    p.expect("\r\nCounters reset\\.\r\n")
+    p.expect("\r\nBOBBIN> ")
+    p.sendline("stats")
+    p.expect("\r\nswitch flips:\r\nBreakpoint 1 at \\$0300\\.\r\n")
+    p.expect("\r\nBOBBIN> ")
+    # And --stats prints them all again at exit.
+    p.sendline("q")
+    p.expect("\r\n\\*\\*\\* bobbin performance counters \\*\\*\\*\r\n")
+    p.expect("\r\nswitch flips:\r\n")
+    p.expect(EOF)
+    return True
+
+@bobbin('-m plus --simple --bp 300 --block-cache')
+def until_pc_releases_block(p):
+    p.expect("\r\n]")
+    p.sendline("CALL -151")
+    p.expect("\r\n\\*")
+    # LDX #0; DEX; BNE *-1; JMP 300
+    p.sendline("300: A2 00 CA D0 FD 4C 00 03")
+    p.expect("\r\n\\*")
+    p.sendline("300G")
+    p.expect("\r\nBOBBIN> ")
+    # Splits the DEX; BNE block in two, until it's met.
+    p.sendline("until pc 303")
+    p.expect("\r\nUntil: PC reached \\$0303")
+    p.expect("\r\nBOBBIN> ")
+    # Each of these runs once around, back to the breakpoint.
+    p.sendline("stats reset")
+    p.expect("\r\nBreakpoint 1 at \\$0300\\.\r\n")
+    p.expect("\r\nBOBBIN> ")
+    p.sendline("stats")
+    if p.expect(["\r\nStatistics not available",
+                 "\r\nblock cache: +([0-9]+) runs, ([0-9]+) instructions"]) == 0:
+        p.expect("\r\nBOBBIN> ")
+        return True
+    runs, instrs = int(p.match.group(1)), int(p.match.group(2))
+    p.expect("\r\nBOBBIN> ")
+    # Whole again: the loop runs two instructions to a block.
+    return runs > 0 and instrs >= runs * 19 // 10
@@ -3,6 +3,7 @@ from basics import *
 from asoft import *
 from apple_iie import *
 from illegal_ops import *
+from uthernet import *
 import pexpect
 import os
 import re
@@ -0,0 +1,107 @@
+#!/usr/bin/python
+
+from common import *
+import socket
+import threading
+
+# Drives the W5100 by hand, from the monitor (one byte per address
+# setting, since the monitor's stores also read, and a read would
+# auto-increment the address).
+def w5100_write(addr, *vals):
+    cmds = []
+    for i, v in enumerate(vals):
+        a = addr + i
+        cmds += ['C0B5:%02X' % (a >> 8), 'C0B6:%02X' % (a & 0xFF),
+                 'C0B7:%02X' % v]
+    return cmds
+
+def w5100_read(addr, n=1):
+    cmds = []
+    for a in range(addr, addr + n):
+        cmds += ['C0B5:%02X' % (a >> 8), 'C0B6:%02X' % (a & 0xFF), 'C0B7']
+    return cmds
+
+def connect_send_recv(p):
+    srv = socket.socket()
+    srv.bind(('127.0.0.1', 0))
+    srv.listen(1)
+    port = srv.getsockname()[1]
+    got = []
+    def serve():
+        c, _ = srv.accept()
+        c.sendall(b'HELLO')
+        got.append(c.recv(100))
+        c.close()
+    t = threading.Thread(target=serve, daemon=True)
+    t.start()
+
+    cmds = ['CALL -151', 'C0B4:01']                 # indirect mode, no AI
+    cmds += w5100_write(0x400, 0x01, 0x01)          # S0: TCP, OPEN
+    # "Gateway" address, which is the host.
+    cmds += w5100_write(0x40C, 192, 168, 65, 1, port >> 8, port & 0xFF)
+    cmds += w5100_write(0x401, 0x04)                # CONNECT
+    cmds += w5100_read(0x403)                       # Sn_SR
+    cmds += w5100_write(0x4000, 0x48, 0x49, 0x21)   # "HI!" in the TX ring
+    cmds += w5100_write(0x424, 0x40, 0x03)          # Sn_TX_WR
+    cmds += w5100_write(0x401, 0x20)                # SEND
+    cmds += w5100_read(0x426, 2)                    # Sn_RX_RSR
+    cmds += w5100_read(0x6000, 5)                   # the RX ring
+    for c in cmds:
+        p.sendline(c)
+    reads = []
+    while len(reads) != 8:
+        p.expect('C0B7- ([0-9A-F]{2})')
+        reads.append(p.match.group(1))
+    t.join(1)
+    srv.close()
+    return want_got('17 00 05 48 45 4C 4C 4F', ' '.join(reads)) \
+        and want_got("[b'HI!']", str(got))
+
+@bobbin('-m plus --simple --uthernet2')
+def tcp_connect_send_recv(p):
+    return connect_send_recv(p)
+
+@bobbin('-m plus --simple --uthernet2 --uthernet2-thread')
+def tcp_net_thread(p):
+    return connect_send_recv(p)
+
+@bobbin('-m plus --simple --uthernet2')
+def tcp_ring_sizes(p):
+    # With 1KB apiece (TMSR = RMSR = 0), socket 1's rings start $400
+    # in: at $4400 and $6400.
+    srv = socket.socket()
+    srv.bind(('127.0.0.1', 0))
+    srv.listen(1)
+    port = srv.getsockname()[1]
+    got = []
+    def serve():
+        c, _ = srv.accept()
+        c.sendall(b'HELLO')
+        got.append(c.recv(100))
+        c.close()
+    t = threading.Thread(target=serve, daemon=True)
+    t.start()
+
+    cmds = ['CALL -151', 'C0B4:01']
+    cmds += w5100_write(0x1A, 0x00, 0x00)           # RMSR, TMSR
+    cmds += w5100_write(0x500, 0x01, 0x01)          # S1: TCP, OPEN
+    cmds += w5100_write(0x50C, 192, 168, 65, 1, port >> 8, port & 0xFF)
+    cmds += w5100_write(0x501, 0x04)                # CONNECT
+    cmds += w5100_read(0x503)                       # Sn_SR
+    cmds += w5100_read(0x520, 2)                    # Sn_TX_FSR
+    cmds += w5100_write(0x4400, 0x48, 0x49, 0x21)
+    cmds += w5100_write(0x524, 0x44, 0x03)          # Sn_TX_WR
+    cmds += w5100_write(0x501, 0x20)                # SEND
+    cmds += w5100_read(0x526, 2)                    # Sn_RX_RSR
+    cmds += w5100_read(0x528, 2)                    # Sn_RX_RD
+    cmds += w5100_read(0x6400, 5)
+    for c in cmds:
+        p.sendline(c)
+    reads = []
+    while len(reads) != 12:
+        p.expect('C0B7- ([0-9A-F]{2})')
+        reads.append(p.match.group(1))
+    t.join(1)
+    srv.close()
+    return want_got('17 04 00 00 05 64 00 48 45 4C 4C 4F', ' '.join(reads)) \
+        and want_got("[b'HI!']", str(got))